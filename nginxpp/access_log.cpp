@@ -0,0 +1,320 @@
+#include <nginxpp/access_log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gsl/gsl>
+
+#include <nginxpp/chrono_utils.hpp>
+#include <nginxpp/metrics.hpp>
+#include <nginxpp/spsc_ring.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::size_t RING_CAPACITY = 128;
+constexpr std::chrono::milliseconds DRAIN_INTERVAL {10};
+constexpr std::size_t MAX_BATCH_SIZE = 64 * 1024;
+
+using Ring = SpscRing<AccessLogEntry, RING_CAPACITY>;
+
+/// At namespace scope, so that signal handlers can set it
+std::atomic<bool> g_reopen_requested {false};
+
+[[nodiscard]] inline auto openLogFile(const std::string &path) noexcept {
+    if (path == ACCESS_LOG_STDOUT) {
+        return STDOUT_FILENO;
+    }
+    return open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+}
+
+inline void closeLogFile(const int fd) noexcept {
+    if (fd != -1 and fd != STDOUT_FILENO) {
+        close(fd);
+    }
+}
+
+inline void writeAll(const int fd, const std::string_view data) noexcept {
+    for (std::size_t written = 0; written < data.size();) {
+        const auto n = write(fd, data.data() + written, data.size() - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        written += n;
+    }
+}
+
+inline void appendEscaped(std::string &out, const std::string_view text) noexcept {
+    constexpr std::string_view HEX_DIGITS = "0123456789abcdef";
+
+    for (const auto c : text) {
+        const auto u = static_cast<unsigned char>(c);
+        if (c == '"' or c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20 or u >= 0x7f) {
+            out += "\\x";
+            out += HEX_DIGITS[u >> 4];
+            out += HEX_DIGITS[u & 0xf];
+        } else {
+            out += c;
+        }
+    }
+}
+
+
+class AccessLogger {
+public:
+    [[nodiscard]] bool Open(const std::string &path) noexcept {
+        std::call_once(m_thread_started, [this]() {
+            std::thread([this]() {
+                run();
+            }).detach();
+        });
+
+        auto fd = -1;
+        if (path != ACCESS_LOG_OFF) {
+            fd = openLogFile(path);
+            if (fd == -1) {
+                return false;
+            }
+        }
+
+        const std::lock_guard lock {m_mutex};
+        closeLogFile(std::exchange(m_fd, fd));
+        m_path = path;
+        m_enabled.store(fd != -1, std::memory_order_relaxed);
+        return true;
+    }
+
+    [[nodiscard]] bool Enabled() const noexcept {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void Flush() noexcept {
+        std::unique_lock lock {m_mutex};
+        if (m_path.empty()) {
+            return;
+        }
+        const auto target = ++m_flush_requested;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this, target]() {
+            return m_flush_done >= target;
+        });
+    }
+
+    void CountDropped() noexcept {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::uint64_t Dropped() const noexcept {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] gsl::not_null<Ring *> AcquireRing() noexcept {
+        const std::lock_guard lock {m_rings_mutex};
+        if (not m_free_rings.empty()) {
+            auto *const ring = m_free_rings.back();
+            m_free_rings.pop_back();
+            return ring;
+        }
+        return m_rings.emplace_back(std::make_unique<Ring>()).get();
+    }
+
+    void ReleaseRing(const gsl::not_null<Ring *> ring) noexcept {
+        const std::lock_guard lock {m_rings_mutex};
+        m_free_rings.push_back(ring);
+    }
+
+private:
+    [[noreturn]] void run() noexcept {
+        std::string batch;
+        batch.reserve(MAX_BATCH_SIZE + 1024);
+
+        for (;;) {
+            std::unique_lock lock {m_mutex};
+            m_cv.wait_for(lock, DRAIN_INTERVAL, [this]() {
+                return m_flush_requested > m_flush_done;
+            });
+            const auto flush_requested = m_flush_requested;
+
+            if (g_reopen_requested.exchange(false, std::memory_order_relaxed)) {
+                reopen();
+            }
+
+            drain(batch);
+            writeAll(m_fd, batch);
+            batch.clear();
+
+            m_flush_done = flush_requested;
+            m_cv.notify_all();
+        }
+    }
+
+    /// Keeps the current file if the new one cannot be opened, rather than stop logging.
+    void reopen() noexcept {
+        // Nothing to reopen while disabled, nor on stdout
+        if (m_fd == -1 or m_fd == STDOUT_FILENO) {
+            return;
+        }
+        const auto fd = openLogFile(m_path);
+        if (fd == -1) {
+            std::cerr << "Failed to reopen access log '" << m_path << "', keeping the current one: "
+                      << strerror(errno) << std::endl;
+            return;
+        }
+        closeLogFile(std::exchange(m_fd, fd));
+    }
+
+    void drain(std::string &batch) noexcept {
+        {
+            // Rings are never freed, so they can be consumed without blocking AcquireRing()
+            const std::lock_guard lock {m_rings_mutex};
+            m_drain_list.clear();
+            for (const auto &ring : m_rings) {
+                m_drain_list.push_back(ring.get());
+            }
+        }
+
+        for (auto *const ring : m_drain_list) {
+            ring->ConsumeAll([this, &batch](const AccessLogEntry &entry) {
+                AppendAccessLogLine(batch, entry);
+                if (batch.size() >= MAX_BATCH_SIZE) {
+                    writeAll(m_fd, batch);
+                    batch.clear();
+                }
+            });
+        }
+    }
+
+    std::once_flag m_thread_started;
+    std::atomic<bool> m_enabled {false};
+    std::atomic<std::uint64_t> m_dropped {0};
+
+    /// Guards the log file and the flush handshake
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::string m_path;
+    int m_fd = -1;
+    std::uint64_t m_flush_requested = 0;
+    std::uint64_t m_flush_done = 0;
+
+    std::mutex m_rings_mutex;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+    std::vector<Ring *> m_free_rings;
+    std::vector<Ring *> m_drain_list;
+};
+
+[[nodiscard]] auto &accessLogger() noexcept {
+    // Never destroyed, as detached threads may still log during exit
+    static auto *const LOGGER = new AccessLogger;
+    return *LOGGER;
+}
+
+/// Hands the ring back when its thread exits; entries still queued are drained later.
+class RingLease {
+public:
+    RingLease() noexcept : m_ring(accessLogger().AcquireRing()) {
+    }
+
+    ~RingLease() noexcept {
+        accessLogger().ReleaseRing(m_ring);
+    }
+
+    RingLease(const RingLease &) = delete;
+    RingLease &operator=(const RingLease &) = delete;
+
+    [[nodiscard]] Ring &Get() const noexcept {
+        return *m_ring;
+    }
+
+private:
+    gsl::not_null<Ring *> m_ring;
+};
+
+[[nodiscard]] inline auto &localRing() noexcept {
+    thread_local RingLease lease;
+    return lease.Get();
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+void AccessLogEntry::SetClient(const std::string_view address) noexcept {
+    client_size = address.copy(client.data(), client.size());
+}
+
+void AccessLogEntry::SetTarget(const std::string_view a_target) noexcept {
+    target_size = a_target.copy(target.data(), target.size());
+    target_truncated = a_target.size() > target.size();
+}
+
+void AppendAccessLogLine(std::string &out, const AccessLogEntry &entry) noexcept {
+    std::array<char, LISTING_TIME_SIZE> time_buffer;
+
+    out.append("time=\"").append(FormatListingTime(entry.time, time_buffer));
+    out.append("\" client=").append(entry.client.data(), entry.client_size);
+    // Peers over a Unix domain socket have none
+    if (entry.port) {
+        out.append(":").append(std::to_string(entry.port));
+    }
+    out.append(" method=").append(ToString(entry.method));
+    out.append(" target=\"/");
+    appendEscaped(out, {entry.target.data(), entry.target_size});
+    if (entry.target_truncated) {
+        out.append("...");
+    }
+    out.append("\" status=").append(std::to_string(entry.status));
+    out.append(" bytes=").append(std::to_string(entry.bytes_sent));
+    out.append(" duration_us=").append(std::to_string(entry.duration.count()));
+    out.append("\n");
+}
+
+bool OpenAccessLog(const std::string &path) noexcept {
+    return accessLogger().Open(path);
+}
+
+void LogAccess(const AccessLogEntry &entry) noexcept {
+    auto &logger = accessLogger();
+    if (not logger.Enabled()) {
+        return;
+    }
+
+    if (not localRing().TryPush(entry)) {
+        logger.CountDropped();
+    }
+}
+
+void ReopenAccessLog() noexcept {
+    g_reopen_requested.store(true, std::memory_order_relaxed);
+}
+
+void FlushAccessLog() noexcept {
+    accessLogger().Flush();
+}
+
+std::uint64_t AccessLogDropped() noexcept {
+    return accessLogger().Dropped();
+}
+
+} //namespace nginxpp
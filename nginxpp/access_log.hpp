@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <nginxpp/message.hpp>
+
+
+namespace nginxpp {
+
+constexpr auto ACCESS_LOG_STDOUT = "-";
+constexpr auto ACCESS_LOG_OFF = "off";
+
+/// One line of the access log. Fixed-size, so that it can be queued without allocating.
+struct AccessLogEntry {
+    static constexpr std::size_t MAX_CLIENT_SIZE = 46; // INET6_ADDRSTRLEN
+    static constexpr std::size_t MAX_TARGET_SIZE = 200;
+
+    std::chrono::system_clock::time_point time;
+    std::chrono::microseconds duration {};
+    std::size_t bytes_sent = 0;
+    int status = 0;
+    /// 0 for a peer over a Unix domain socket, whose client is "unix:"
+    int port = 0;
+    Method method {};
+    std::uint8_t client_size = 0;
+    std::uint8_t target_size = 0;
+    bool target_truncated = false;
+    std::array<char, MAX_CLIENT_SIZE> client;
+    std::array<char, MAX_TARGET_SIZE> target;
+
+    void SetClient(const std::string_view address) noexcept;
+
+    void SetTarget(const std::string_view a_target) noexcept;
+};
+
+/// Formats as a logfmt line, e.g.
+/// time="2022-08-10 12:34:56 GMT" client=127.0.0.1:5678 method=GET target="/" status=200 ...
+void AppendAccessLogLine(std::string &out, const AccessLogEntry &entry) noexcept;
+
+
+// Producers queue entries into rings owned by their threads, and a background thread drains
+// all rings into the log with batched writes.
+
+/// Starts logging to the given path, ACCESS_LOG_STDOUT or ACCESS_LOG_OFF.
+/// Returns false if the file cannot be opened.
+[[nodiscard]] bool OpenAccessLog(const std::string &path) noexcept;
+
+/// Never blocks: drops the entry instead if the ring of this thread is full.
+void LogAccess(const AccessLogEntry &entry) noexcept;
+
+/// Async-signal-safe: asks the background thread to reopen the file, e.g. after rotation.
+void ReopenAccessLog() noexcept;
+
+/// Waits until everything queued before this call has been written.
+void FlushAccessLog() noexcept;
+
+[[nodiscard]] std::uint64_t AccessLogDropped() noexcept;
+
+} //namespace nginxpp
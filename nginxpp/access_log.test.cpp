@@ -0,0 +1,161 @@
+#include <nginxpp/access_log.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] inline auto createEntry(const std::string_view target) {
+    AccessLogEntry entry;
+    entry.time = std::chrono::system_clock::time_point {std::chrono::seconds {784111777}};
+    entry.duration = std::chrono::microseconds {42};
+    entry.bytes_sent = 1024;
+    entry.status = 200;
+    entry.port = 5678;
+    entry.method = Method::GET;
+    entry.SetClient("127.0.0.1");
+    entry.SetTarget(target);
+    return entry;
+}
+
+[[nodiscard]] inline auto readLines(const std::filesystem::path &path) {
+    std::ifstream file {path};
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);) {
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+} // namespace
+
+
+TEST(AccessLogEntryTests, CanFormatAsLogfmt) {
+    std::string line;
+    AppendAccessLogLine(line, createEntry("index.html"));
+    EXPECT_EQ("time=\"1994-11-06 08:49:37 GMT\" client=127.0.0.1:5678 method=GET "
+              "target=\"/index.html\" status=200 bytes=1024 duration_us=42\n",
+              line);
+}
+
+TEST(AccessLogEntryTests, FormatsUnixPeersWithoutPort) {
+    auto entry = createEntry("index.html");
+    entry.SetClient("unix:");
+    entry.port = 0;
+    std::string line;
+    AppendAccessLogLine(line, entry);
+    EXPECT_NE(std::string::npos, line.find(" client=unix: method=GET "));
+}
+
+TEST(AccessLogEntryTests, EscapeTarget) {
+    std::string line;
+    AppendAccessLogLine(line, createEntry("a\"b\\c\nd"));
+    EXPECT_NE(std::string::npos, line.find(R"(target="/a\"b\\c\x0ad")"));
+}
+
+TEST(AccessLogEntryTests, TruncateLongTarget) {
+    const std::string target(AccessLogEntry::MAX_TARGET_SIZE * 2, 'a');
+    const auto entry = createEntry(target);
+    EXPECT_TRUE(entry.target_truncated);
+    EXPECT_EQ(AccessLogEntry::MAX_TARGET_SIZE, entry.target_size);
+
+    std::string line;
+    AppendAccessLogLine(line, entry);
+    EXPECT_NE(std::string::npos, line.find("a...\""));
+}
+
+
+TEST(AccessLogTests, FailIfPathNotExists) {
+    EXPECT_FALSE(OpenAccessLog("no_such_path/access.log"));
+}
+
+TEST(AccessLogTests, DrainAllThreads) {
+    const auto path = std::filesystem::temp_directory_path() / "nginxpp_access_log_test.log";
+    std::filesystem::remove(path);
+    ASSERT_TRUE(OpenAccessLog(path));
+
+    constexpr int THREAD_COUNT = 4;
+    constexpr int ENTRY_COUNT = 16;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        threads.emplace_back([]() {
+            for (int j = 0; j < ENTRY_COUNT; ++j) {
+                LogAccess(createEntry("index.html"));
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    FlushAccessLog();
+
+    const auto lines = readLines(path);
+    EXPECT_EQ(THREAD_COUNT * ENTRY_COUNT, lines.size() + AccessLogDropped());
+    for (const auto &line : lines) {
+        EXPECT_NE(std::string::npos, line.find("target=\"/index.html\""));
+    }
+
+    ASSERT_TRUE(OpenAccessLog(ACCESS_LOG_OFF));
+    LogAccess(createEntry("index.html"));
+    FlushAccessLog();
+    EXPECT_EQ(lines.size(), readLines(path).size());
+
+    std::filesystem::remove(path);
+}
+
+TEST(AccessLogTests, ReopenAfterRotation) {
+    const auto path = std::filesystem::temp_directory_path() / "nginxpp_access_log_rotate.log";
+    const auto rotated = std::filesystem::path {path} += ".1";
+    std::filesystem::remove(path);
+    ASSERT_TRUE(OpenAccessLog(path));
+
+    LogAccess(createEntry("before"));
+    FlushAccessLog();
+    std::filesystem::rename(path, rotated);
+
+    ReopenAccessLog();
+    LogAccess(createEntry("after"));
+    FlushAccessLog();
+
+    ASSERT_EQ(1, readLines(rotated).size());
+    const auto lines = readLines(path);
+    ASSERT_EQ(1, lines.size());
+    EXPECT_NE(std::string::npos, lines.front().find("target=\"/after\""));
+
+    ASSERT_TRUE(OpenAccessLog(ACCESS_LOG_OFF));
+    std::filesystem::remove(path);
+    std::filesystem::remove(rotated);
+}
+
+TEST(AccessLogTests, KeepsTheFileIfReopenFails) {
+    const auto path = std::filesystem::temp_directory_path() / "nginxpp_access_log_keep.log";
+    const auto rotated = std::filesystem::path {path} += ".1";
+    std::filesystem::remove(path);
+    ASSERT_TRUE(OpenAccessLog(path));
+
+    LogAccess(createEntry("before"));
+    FlushAccessLog();
+    std::filesystem::rename(path, rotated);
+    // Where the new file would go, which cannot be opened for writing
+    std::filesystem::create_directory(path);
+
+    ReopenAccessLog();
+    LogAccess(createEntry("after"));
+    FlushAccessLog();
+
+    const auto lines = readLines(rotated);
+    ASSERT_EQ(2, lines.size());
+    EXPECT_NE(std::string::npos, lines.back().find("target=\"/after\""));
+
+    ASSERT_TRUE(OpenAccessLog(ACCESS_LOG_OFF));
+    std::filesystem::remove(path);
+    std::filesystem::remove(rotated);
+}
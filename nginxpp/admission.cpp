@@ -0,0 +1,103 @@
+#include <nginxpp/admission.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+/// Descriptors kept for everything but connections: standard streams, logs, epoll instances
+constexpr std::size_t RESERVED_DESCRIPTORS = 64;
+
+/// Resumes accepting once a 1/RESUME_FRACTION of the limit is free again
+constexpr std::size_t RESUME_FRACTION = 16;
+
+[[nodiscard]] std::size_t limitFromDescriptors() noexcept {
+    rlimit limit {};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1 or limit.rlim_cur == RLIM_INFINITY) {
+        return SIZE_MAX;
+    }
+    const auto available =
+        limit.rlim_cur - std::min<rlim_t>(limit.rlim_cur, RESERVED_DESCRIPTORS);
+    return std::max<std::size_t>(1, available / 2);
+}
+
+[[nodiscard]] inline std::size_t resumeBelow(const std::size_t limit) noexcept {
+    return limit - limit / RESUME_FRACTION;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+ConnectionLimiter::ConnectionLimiter(const std::size_t limit) :
+    m_limit(limit ? limit : limitFromDescriptors()),
+    m_resume_below(resumeBelow(m_limit.load())),
+    m_resume_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (m_resume_fd == -1) {
+        throw ServerException {"Failed to create admission wake-up: "s + strerror(errno)};
+    }
+}
+
+ConnectionLimiter::~ConnectionLimiter() noexcept {
+    close(m_resume_fd);
+}
+
+bool ConnectionLimiter::TryAcquire() noexcept {
+    // Only the acceptor counts in, so the count cannot grow between the check and the increase
+    if (m_count.load() >= m_limit.load()) {
+        return false;
+    }
+    m_count.fetch_add(1);
+    return true;
+}
+
+void ConnectionLimiter::SetLimit(const std::size_t limit) noexcept {
+    // A paused acceptor woken by a connection closing in between, against the old threshold,
+    // only finds itself at the limit again and pauses anew
+    const auto effective = limit ? limit : limitFromDescriptors();
+    m_limit.store(effective);
+    m_resume_below.store(resumeBelow(effective));
+}
+
+void ConnectionLimiter::Release() noexcept {
+    // Sequentially consistent with Pause(): either this sees the acceptor paused, or the
+    // acceptor sees the lower count
+    const auto count = m_count.fetch_sub(1) - 1;
+    if (count < m_resume_below.load() and m_paused.load() and m_paused.exchange(false)) {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const auto written = write(m_resume_fd, &one, sizeof(one));
+    }
+}
+
+bool ConnectionLimiter::Pause() noexcept {
+    m_paused.store(true);
+    if (m_count.load() < m_resume_below.load()) {
+        m_paused.store(false);
+        return false;
+    }
+    return true;
+}
+
+void ConnectionLimiter::Resume() noexcept {
+    m_paused.store(false);
+    std::uint64_t count {};
+    [[maybe_unused]] const auto n = read(m_resume_fd, &count, sizeof(count));
+}
+
+} //namespace nginxpp
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+
+namespace nginxpp {
+
+/// Counts the open connections against a limit, so that the acceptor stops accepting at the
+/// limit, leaving new connections queued in the kernel, and resumes once enough have closed.
+/// Connections are only counted in by the acceptor, and counted out by any thread.
+class ConnectionLimiter {
+public:
+    /// 0 for as many connections as file descriptors allow, each connection needing up to two
+    /// of them: its socket and the file it sends; likewise for SetLimit().
+    explicit ConnectionLimiter(const std::size_t limit);
+
+    ~ConnectionLimiter() noexcept;
+
+    ConnectionLimiter(const ConnectionLimiter &) = delete;
+    ConnectionLimiter &operator=(const ConnectionLimiter &) = delete;
+
+    /// Counts a connection in, unless the limit is reached.
+    [[nodiscard]] bool TryAcquire() noexcept;
+
+    void Release() noexcept;
+
+    /// Called by the acceptor at the limit; false if connections closed in the meantime, so
+    /// that there is no need to wait.
+    [[nodiscard]] bool Pause() noexcept;
+
+    /// Readable once enough connections closed after a Pause(), to poll() instead of retrying.
+    [[nodiscard]] int ResumeDescriptor() const noexcept {
+        return m_resume_fd;
+    }
+
+    /// Consumes the wake-up, once the acceptor resumed.
+    void Resume() noexcept;
+
+    [[nodiscard]] std::size_t Count() const noexcept {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::size_t Limit() const noexcept {
+        return m_limit.load(std::memory_order_relaxed);
+    }
+
+    /// Called by the acceptor, e.g. on reload. Connections beyond a lowered limit stay open,
+    /// and no more are accepted until enough of them closed.
+    void SetLimit(const std::size_t limit) noexcept;
+
+private:
+    std::atomic<std::size_t> m_limit;
+    /// Below which a paused acceptor resumes; lower than the limit, so that it does not pause
+    /// again at the next connection
+    std::atomic<std::size_t> m_resume_below;
+    std::atomic<std::size_t> m_count {0};
+    std::atomic<bool> m_paused {false};
+    int m_resume_fd = -1;
+};
+
+} //namespace nginxpp
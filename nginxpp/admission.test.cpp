@@ -0,0 +1,96 @@
+#include <nginxpp/admission.hpp>
+
+#include <poll.h>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] bool isReadable(const int fd) {
+    pollfd pfd {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1;
+}
+
+} //namespace
+
+
+TEST(ConnectionLimiterTests, AcquiresUpToTheLimit) {
+    ConnectionLimiter limiter {2};
+    EXPECT_TRUE(limiter.TryAcquire());
+    EXPECT_TRUE(limiter.TryAcquire());
+    EXPECT_FALSE(limiter.TryAcquire());
+    EXPECT_EQ(2, limiter.Count());
+
+    limiter.Release();
+    EXPECT_TRUE(limiter.TryAcquire());
+}
+
+TEST(ConnectionLimiterTests, DerivesTheLimitFromDescriptors) {
+    const ConnectionLimiter limiter {0};
+    EXPECT_LT(0, limiter.Limit());
+}
+
+TEST(ConnectionLimiterTests, ReleaseWakesPausedAcceptor) {
+    ConnectionLimiter limiter {1};
+    ASSERT_TRUE(limiter.TryAcquire());
+    ASSERT_TRUE(limiter.Pause());
+    EXPECT_FALSE(isReadable(limiter.ResumeDescriptor()));
+
+    limiter.Release();
+    EXPECT_TRUE(isReadable(limiter.ResumeDescriptor()));
+
+    limiter.Resume();
+    EXPECT_FALSE(isReadable(limiter.ResumeDescriptor()));
+}
+
+TEST(ConnectionLimiterTests, ResumesOnlyOnceEnoughConnectionsClosed) {
+    ConnectionLimiter limiter {32};
+    while (limiter.TryAcquire()) {
+    }
+    ASSERT_TRUE(limiter.Pause());
+
+    limiter.Release();
+    EXPECT_FALSE(isReadable(limiter.ResumeDescriptor()));
+
+    limiter.Release();
+    limiter.Release();
+    EXPECT_TRUE(isReadable(limiter.ResumeDescriptor()));
+}
+
+TEST(ConnectionLimiterTests, ChangedLimitAppliesToTheNextAcquire) {
+    ConnectionLimiter limiter {2};
+    ASSERT_TRUE(limiter.TryAcquire());
+    ASSERT_TRUE(limiter.TryAcquire());
+
+    limiter.SetLimit(3);
+    EXPECT_EQ(3, limiter.Limit());
+    EXPECT_TRUE(limiter.TryAcquire());
+    EXPECT_FALSE(limiter.TryAcquire());
+
+    // Open connections beyond the lowered limit are kept
+    limiter.SetLimit(1);
+    EXPECT_EQ(3, limiter.Count());
+    limiter.Release();
+    EXPECT_FALSE(limiter.TryAcquire());
+    limiter.Release();
+    limiter.Release();
+    EXPECT_TRUE(limiter.TryAcquire());
+}
+
+TEST(ConnectionLimiterTests, NoPauseIfConnectionsClosedMeanwhile) {
+    ConnectionLimiter limiter {1};
+    ASSERT_TRUE(limiter.TryAcquire());
+    limiter.Release();
+    EXPECT_FALSE(limiter.Pause());
+}
+
+TEST(ConnectionLimiterTests, ReleaseWithoutPauseDoesNotWake) {
+    ConnectionLimiter limiter {1};
+    ASSERT_TRUE(limiter.TryAcquire());
+    limiter.Release();
+    EXPECT_FALSE(isReadable(limiter.ResumeDescriptor()));
+}
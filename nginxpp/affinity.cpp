@@ -0,0 +1,117 @@
+#include <nginxpp/affinity.hpp>
+
+#include <charconv>
+#include <climits>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef NGINXPP_HAVE_LIBNUMA
+#include <numa.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+thread_local unsigned t_node = 0;
+
+[[nodiscard]] unsigned nodeFromSysfs(const unsigned cpu) noexcept {
+    // The directory of each CPU links to its node as nodeN
+    constexpr std::string_view PREFIX = "node";
+    std::error_code error;
+    const std::filesystem::path dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    for (std::filesystem::directory_iterator it {dir, error}, end; not error and it != end;
+         it.increment(error)) {
+        const auto name = it->path().filename().string();
+        if (not name.starts_with(PREFIX)) {
+            continue;
+        }
+        unsigned node {};
+        const auto *const last = name.data() + name.size();
+        if (const auto [ptr, ec] = std::from_chars(name.data() + PREFIX.size(), last, node);
+            ec == std::errc {} and ptr == last) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+void preferNode(const unsigned node) noexcept {
+#ifdef NGINXPP_HAVE_LIBNUMA
+    if (numa_available() != -1) {
+        numa_set_preferred(static_cast<int>(node));
+    }
+#else
+    // As MPOL_PREFERRED from <numaif.h>, which only comes with libnuma
+    constexpr int PREFERRED = 1;
+    unsigned long mask = 0;
+    if (node >= sizeof(mask) * CHAR_BIT) {
+        return;
+    }
+    mask = 1UL << node;
+    // Fails without NUMA support in the kernel, where there is nothing to prefer anyway
+    (void)syscall(SYS_set_mempolicy, PREFERRED, &mask, sizeof(mask) * CHAR_BIT + 1);
+#endif
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::vector<unsigned> AllowedCpus() noexcept {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) != 0) {
+        return {};
+    }
+
+    std::vector<unsigned> cpus;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+unsigned NodeOfCpu(const unsigned cpu) noexcept {
+#ifdef NGINXPP_HAVE_LIBNUMA
+    if (numa_available() != -1) {
+        const auto node = numa_node_of_cpu(static_cast<int>(cpu));
+        return node < 0 ? 0 : static_cast<unsigned>(node);
+    }
+#endif
+    return nodeFromSysfs(cpu);
+}
+
+bool PinThreadToCpu(const unsigned cpu) noexcept {
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) != 0) {
+        return false;
+    }
+
+    t_node = NodeOfCpu(cpu);
+    preferNode(t_node);
+    return true;
+}
+
+unsigned CurrentNode() noexcept {
+    return t_node;
+}
+
+} //namespace nginxpp
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+
+namespace nginxpp {
+
+/// Nodes kept apart by per-node pools and caches; higher nodes share with lower ones.
+constexpr unsigned MAX_NUMA_NODES = 8;
+
+/// The CPUs the calling thread may run on, in ascending order; empty if unknown.
+[[nodiscard]] std::vector<unsigned> AllowedCpus() noexcept;
+
+/// The NUMA node of the CPU, from libnuma if available or else from sysfs; 0 if unknown, e.g.
+/// on a machine with a single node.
+[[nodiscard]] unsigned NodeOfCpu(const unsigned cpu) noexcept;
+
+/// Pins the calling thread to the CPU, and has it prefer the memory of the CPU's node for the
+/// pages it touches first, so that the buffers and caches it fills are local to it.
+/// False if the thread could not be pinned; the memory preference is best-effort.
+[[nodiscard]] bool PinThreadToCpu(const unsigned cpu) noexcept;
+
+/// The node of the CPU that the calling thread was pinned to, 0 if it was not.
+[[nodiscard]] unsigned CurrentNode() noexcept;
+
+} //namespace nginxpp
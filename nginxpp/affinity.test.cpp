@@ -0,0 +1,45 @@
+#include <nginxpp/affinity.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+TEST(AffinityTests, AllowedCpusAreSorted) {
+    const auto cpus = AllowedCpus();
+    ASSERT_FALSE(cpus.empty());
+    EXPECT_TRUE(std::is_sorted(cpus.begin(), cpus.end()));
+}
+
+TEST(AffinityTests, PinnedThreadOnlyRunsOnItsCpu) {
+    const auto cpu = AllowedCpus().back();
+    std::thread {[cpu]() {
+        ASSERT_TRUE(PinThreadToCpu(cpu));
+        EXPECT_EQ(std::vector {cpu}, AllowedCpus());
+        EXPECT_EQ(static_cast<int>(cpu), sched_getcpu());
+        EXPECT_EQ(NodeOfCpu(cpu), CurrentNode());
+    }}.join();
+
+    // Other threads are left alone
+    EXPECT_LE(1, AllowedCpus().size());
+}
+
+TEST(AffinityTests, UnpinnedThreadIsOnTheFirstNode) {
+    std::thread {[]() {
+        EXPECT_EQ(0, CurrentNode());
+    }}.join();
+}
+
+TEST(AffinityTests, PinningToAnUnknownCpuFails) {
+    std::thread {[]() {
+        EXPECT_FALSE(PinThreadToCpu(CPU_SETSIZE));
+        EXPECT_EQ(0, CurrentNode());
+    }}.join();
+}
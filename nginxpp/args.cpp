@@ -6,8 +6,8 @@
 
 namespace nginxpp {
 
-cxxopts::Options CreateBaseOptions() noexcept {
-    cxxopts::Options options("nginxpp", "Yet another web server in C++.");
+cxxopts::Options CreateBaseOptions(std::string program, std::string help_string) noexcept {
+    cxxopts::Options options(std::move(program), std::move(help_string));
 
     // clang-format off
     options.add_options()
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <string>
+
 #include <cxxopts.hpp>
 
 
 namespace nginxpp {
 
-[[nodiscard]] cxxopts::Options CreateBaseOptions() noexcept;
+[[nodiscard]] cxxopts::Options
+CreateBaseOptions(std::string program = "nginxpp",
+                  std::string help_string = "Yet another web server in C++.") noexcept;
 
 void HandleBaseOptions(const cxxopts::Options &options,
                        const cxxopts::ParseResult &parsed_options) noexcept;
@@ -0,0 +1,252 @@
+#include <nginxpp/async_socket.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <errno.h>
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <nginxpp/buffer_pool.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+template<typename Function, typename... Args>
+[[nodiscard]] inline constexpr auto handleEINTR(const Function func, Args &&...args) noexcept {
+    Expects(func);
+
+    int result {};
+    do {
+        result = func(std::forward<Args>(args)...);
+    } while (result < 0 and errno == EINTR);
+
+    return result;
+}
+
+[[nodiscard]] inline auto wouldBlock() noexcept {
+    return errno == EAGAIN or errno == EWOULDBLOCK;
+}
+
+/// The payload of a full TLS record; a head and a body that fit are sent in one
+constexpr std::size_t TLS_RECORD_SIZE = 16 * 1024;
+
+} //namespace
+
+
+namespace nginxpp {
+
+Task<bool> AsyncSocket::Handshake(const TlsContext &context,
+                                  const Clock::time_point deadline) noexcept {
+    m_tls.emplace(context, m_socket);
+    for (;;) {
+        if (m_tls->Handshake() == 1) {
+            co_return true;
+        }
+        if (not wouldBlock()) {
+            co_return false;
+        }
+        const bool ready = co_await waitTls(deadline);
+        if (not ready) {
+            co_return false;
+        }
+    }
+}
+
+Task<long> AsyncSocket::Read(const gsl::span<char> buffer,
+                             const Clock::time_point deadline) noexcept {
+    for (;;) {
+        const long n = m_tls ? m_tls->Read(buffer)
+                             : handleEINTR(recv, m_socket, buffer.data(), buffer.size(), 0);
+        if (n >= 0 or not wouldBlock()) {
+            co_return n;
+        }
+        if (m_tls and m_tls->WantsWrite()) {
+            const bool writable = co_await WaitWritable(deadline);
+            if (not writable) {
+                co_return -1;
+            }
+            continue;
+        }
+        if (not co_await m_io.Readable(deadline)) {
+            errno = ETIMEDOUT;
+            co_return -1;
+        }
+        m_ready_since = m_io.Loop().ReadySince();
+    }
+}
+
+long AsyncSocket::TryRead(const gsl::span<char> buffer) noexcept {
+    return m_tls ? m_tls->Read(buffer)
+                 : handleEINTR(recv, m_socket, buffer.data(), buffer.size(), 0);
+}
+
+Task<bool> AsyncSocket::WaitReadable(const Clock::time_point deadline) noexcept {
+    // Decrypted already, which the socket does not tell
+    if (m_tls and m_tls->HasPending()) {
+        co_return true;
+    }
+    for (;;) {
+        char c {};
+        const auto n = handleEINTR(recv, m_socket, &c, 1, MSG_PEEK);
+        if (n >= 0 or not wouldBlock()) {
+            co_return n != -1;
+        }
+        if (not co_await m_io.Idle(deadline)) {
+            co_return false;
+        }
+        m_ready_since = m_io.Loop().ReadySince();
+    }
+}
+
+Task<bool> AsyncSocket::WaitWritable(const Clock::time_point deadline) noexcept {
+    // Not awaited in the condition of an if ending in co_return, which GCC 12 compiles into a
+    // frame that is resumed at the wrong point, and corrupts the heap
+    const bool writable = co_await m_io.Writable(deadline);
+    if (not writable) {
+        errno = ETIMEDOUT;
+    }
+    co_return writable;
+}
+
+Task<bool> AsyncSocket::Write(const std::string_view head,
+                              const std::string_view body,
+                              const int flags) noexcept {
+    if (m_tls) {
+        if (head.empty() or body.empty() or head.size() + body.size() > TLS_RECORD_SIZE) {
+            const bool head_sent = co_await writeTls(head);
+            if (not head_sent) {
+                co_return false;
+            }
+            co_return co_await writeTls(body);
+        }
+        PooledBuffer record;
+        record.Lease(SizeFor(head.size() + body.size()));
+        std::memcpy(record.Data(), head.data(), head.size());
+        std::memcpy(record.Data() + head.size(), body.data(), body.size());
+        co_return co_await writeTls({record.Data(), head.size() + body.size()});
+    }
+
+    std::array<iovec, 2> vectors {iovec {const_cast<char *>(head.data()), head.size()},
+                                  iovec {const_cast<char *>(body.data()), body.size()}};
+    msghdr message {};
+    message.msg_iov = vectors.data();
+    message.msg_iovlen = vectors.size();
+
+    for (std::size_t left = head.size() + body.size(); left > 0;) {
+        const auto n = handleEINTR(sendmsg, m_socket, &message, flags | MSG_NOSIGNAL);
+        if (n == -1) {
+            if (not wouldBlock() or not co_await WaitWritable(DeadlineAfter(m_send_timeout))) {
+                co_return false;
+            }
+            continue;
+        }
+        left -= n;
+
+        for (std::size_t consumed = n; consumed > 0;) {
+            auto &front = *message.msg_iov;
+            const auto step = std::min(consumed, front.iov_len);
+            front.iov_base = static_cast<char *>(front.iov_base) + step;
+            front.iov_len -= step;
+            consumed -= step;
+            if (front.iov_len == 0) {
+                ++message.msg_iov;
+                --message.msg_iovlen;
+            }
+        }
+    }
+
+    co_return true;
+}
+
+Task<bool>
+AsyncSocket::WriteFile(const int fd, off_t offset, const std::size_t length) noexcept {
+    constexpr std::size_t MAX_CHUNK_SIZE = 1 << 30;
+
+    if (m_tls and not m_tls->KernelSend()) {
+        co_return co_await writeFileTls(fd, offset, length);
+    }
+    for (std::size_t total_sent = 0; total_sent < length;) {
+        const auto requested = std::min(MAX_CHUNK_SIZE, length - total_sent);
+        long n = 0;
+        if (m_tls) {
+            n = m_tls->SendFile(fd, offset, requested);
+            offset += std::max(n, 0L);
+        } else {
+            n = handleEINTR(sendfile, m_socket, fd, &offset, requested);
+        }
+        if (n == -1 and wouldBlock()) {
+            if (not co_await WaitWritable(DeadlineAfter(m_send_timeout))) {
+                co_return false;
+            }
+            continue;
+        }
+        if (n <= 0) {
+            co_return false;
+        }
+        total_sent += n;
+    }
+
+    co_return true;
+}
+
+Task<bool> AsyncSocket::waitTls(const Clock::time_point deadline) noexcept {
+    bool ready = false;
+    if (m_tls->WantsWrite()) {
+        ready = co_await m_io.Writable(deadline);
+    } else {
+        ready = co_await m_io.Readable(deadline);
+    }
+    if (not ready) {
+        errno = ETIMEDOUT;
+    }
+    co_return ready;
+}
+
+Task<bool> AsyncSocket::writeTls(std::string_view data) noexcept {
+    while (not data.empty()) {
+        const auto n = m_tls->Write(data);
+        if (n > 0) {
+            data.remove_prefix(n);
+            continue;
+        }
+        if (n == 0 or not wouldBlock()) {
+            co_return false;
+        }
+        const bool ready = co_await waitTls(DeadlineAfter(m_send_timeout));
+        if (not ready) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+Task<bool>
+AsyncSocket::writeFileTls(const int fd, off_t offset, const std::size_t length) noexcept {
+    // Read in a record at a time, for the TLS stream to encrypt
+    PooledBuffer chunk;
+    chunk.Lease(SizeFor(std::min(length, TLS_RECORD_SIZE)));
+    for (std::size_t total_sent = 0; total_sent < length;) {
+        const auto requested = std::min({chunk.Capacity(), TLS_RECORD_SIZE, length - total_sent});
+        const auto n = handleEINTR(pread, fd, chunk.Data(), requested, offset);
+        if (n <= 0) {
+            co_return false;
+        }
+        const bool sent = co_await writeTls({chunk.Data(), static_cast<std::size_t>(n)});
+        if (not sent) {
+            co_return false;
+        }
+        offset += n;
+        total_sent += n;
+    }
+    co_return true;
+}
+
+} //namespace nginxpp
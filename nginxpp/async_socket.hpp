@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+#include <gsl/gsl>
+
+#include <nginxpp/body.hpp>
+#include <nginxpp/event_loop.hpp>
+#include <nginxpp/server.hpp>
+#include <nginxpp/task.hpp>
+#include <nginxpp/tls.hpp>
+
+
+namespace nginxpp {
+
+[[nodiscard]] inline auto DeadlineAfter(const std::chrono::milliseconds timeout) noexcept {
+    return IoHandle::Clock::now() + timeout;
+}
+
+
+/// A non-blocking connection, whose operations suspend the calling coroutine until the event
+/// loop reports the socket ready, instead of blocking the thread. Once handshaken, it reads and
+/// writes over TLS instead.
+class AsyncSocket {
+public:
+    using Clock = IoHandle::Clock;
+
+    AsyncSocket(EventLoop &loop,
+                Socket sock,
+                const std::chrono::milliseconds send_timeout,
+                const Clock::time_point ready_since) noexcept :
+        m_socket(std::move(sock)),
+        m_io(loop, m_socket), m_send_timeout(send_timeout), m_ready_since(ready_since) {
+        Expects(m_socket != Socket::INVALID_SOCKET);
+    }
+
+    [[nodiscard]] const Socket &GetSocket() const noexcept {
+        return m_socket;
+    }
+
+    void SetSendTimeout(const std::chrono::milliseconds send_timeout) noexcept {
+        m_send_timeout = send_timeout;
+    }
+
+    /// Since when the input was last found ready without being waited for; when the
+    /// connection was accepted, or when the loop was woken up by the input.
+    [[nodiscard]] Clock::time_point ReadySince() const noexcept {
+        return m_ready_since;
+    }
+
+    /// Takes the server side of a TLS handshake, after which all else goes over TLS. Returns
+    /// false on failure, or if the deadline passed first.
+    [[nodiscard]] Task<bool> Handshake(const TlsContext &context,
+                                       const Clock::time_point deadline) noexcept;
+
+    /// nullptr if the connection is not over TLS.
+    [[nodiscard]] const TlsStream *Tls() const noexcept {
+        return m_tls ? &*m_tls : nullptr;
+    }
+
+    /// Returns the number of bytes read, 0 at the end of the stream, or -1 on failure, with
+    /// errno set to ETIMEDOUT if the deadline passed first.
+    [[nodiscard]] Task<long> Read(const gsl::span<char> buffer,
+                                  const Clock::time_point deadline) noexcept;
+
+    /// Reads what has arrived already, without waiting for more. Returns -1 with errno set to
+    /// EAGAIN if nothing has.
+    [[nodiscard]] long TryRead(const gsl::span<char> buffer) noexcept;
+
+    /// Waits idle until there is something to read, or the end of the stream, without reading
+    /// it. Returns false on timeout or failure, or once the loop drains.
+    [[nodiscard]] Task<bool> WaitReadable(const Clock::time_point deadline) noexcept;
+
+    /// Waits until the socket may be written to, e.g. for a connect() in progress to complete.
+    /// Returns false, with errno set to ETIMEDOUT, if the deadline passed first.
+    [[nodiscard]] Task<bool> WaitWritable(const Clock::time_point deadline) noexcept;
+
+    /// Sends the head and the body with as few system calls as possible.
+    [[nodiscard]] Task<bool>
+    Write(const std::string_view head, const std::string_view body, const int flags = 0) noexcept;
+
+    [[nodiscard]] Task<bool> WriteFile(const FileRange &range) noexcept {
+        return WriteFile(range.fd, range.offset, range.length);
+    }
+
+    /// Sends part of a file, e.g. the body of one frame of a response. Over TLS, the file is
+    /// read in and encrypted unless the kernel encrypts it.
+    [[nodiscard]] Task<bool>
+    WriteFile(const int fd, off_t offset, const std::size_t length) noexcept;
+
+private:
+    /// Waits for the socket to be ready for what the TLS stream last asked for. Returns false,
+    /// with errno set to ETIMEDOUT, if the deadline passed first.
+    [[nodiscard]] Task<bool> waitTls(const Clock::time_point deadline) noexcept;
+
+    [[nodiscard]] Task<bool> writeTls(std::string_view data) noexcept;
+
+    [[nodiscard]] Task<bool>
+    writeFileTls(const int fd, off_t offset, const std::size_t length) noexcept;
+
+    Socket m_socket;
+    /// Declared after the socket, to unregister before it is closed
+    IoHandle m_io;
+    /// Per wait for the socket to drain, i.e. for progress, not for the whole response
+    std::chrono::milliseconds m_send_timeout;
+    Clock::time_point m_ready_since;
+    /// Declared after the socket, to send close_notify before it is closed
+    std::optional<TlsStream> m_tls;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,42 @@
+#include <nginxpp/bench_utils.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+
+std::atomic<std::uint64_t> g_allocation_count {0};
+
+} //namespace
+
+
+// Replacing the global operator new counts the allocations of the nginxpp library too.
+void *operator new(std::size_t size) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (auto *const p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc {};
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+namespace nginxpp {
+
+std::uint64_t AllocationCount() noexcept {
+    return g_allocation_count.load(std::memory_order_relaxed);
+}
+
+} //namespace nginxpp
+
+
+BENCHMARK_MAIN();
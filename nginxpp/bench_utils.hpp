@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <streambuf>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+
+namespace nginxpp {
+
+/// Number of global operator new calls so far, in all threads.
+[[nodiscard]] std::uint64_t AllocationCount() noexcept;
+
+/// Reports the allocations per iteration made between its construction and destruction.
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State &state) noexcept :
+        m_state(state), m_start(AllocationCount()) {
+    }
+
+    ~AllocationCounter() noexcept {
+        m_state.counters["allocs/op"] = benchmark::Counter(
+            static_cast<double>(AllocationCount() - m_start), benchmark::Counter::kAvgIterations);
+    }
+
+    AllocationCounter(const AllocationCounter &) = delete;
+    AllocationCounter &operator=(const AllocationCounter &) = delete;
+
+private:
+    benchmark::State &m_state;
+    std::uint64_t m_start;
+};
+
+/// Reads from a string_view without copying it, unlike std::istringstream.
+class ViewBuf : public std::streambuf {
+public:
+    explicit ViewBuf(const std::string_view view) noexcept {
+        Reset(view);
+    }
+
+    void Reset(const std::string_view view) noexcept {
+        auto *const begin = const_cast<char *>(view.data());
+        setg(begin, begin, begin + view.size());
+    }
+};
+
+/// Discards everything written, but counts the bytes.
+class NullBuf : public std::streambuf {
+public:
+    [[nodiscard]] std::size_t Size() const noexcept {
+        return m_size;
+    }
+
+protected:
+    int_type overflow(const int_type c) override {
+        ++m_size;
+        return c;
+    }
+
+    std::streamsize xsputn(const char *, const std::streamsize n) override {
+        m_size += n;
+        return n;
+    }
+
+private:
+    std::size_t m_size = 0;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,98 @@
+#include <nginxpp/body.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nginxpp/variant_utils.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] inline auto openReadOnly(const std::filesystem::path &p) noexcept {
+    return FileDescriptor {open(p.c_str(), O_RDONLY | O_CLOEXEC)};
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+FileDescriptor::~FileDescriptor() noexcept {
+    if (m_fd != INVALID_FD) {
+        close(std::exchange(m_fd, INVALID_FD));
+    }
+}
+
+
+MappedRegion::~MappedRegion() noexcept {
+    if (m_address) {
+        munmap(std::exchange(m_address, nullptr), std::exchange(m_length, 0));
+    }
+}
+
+
+bool HasBody(const Body &body) noexcept {
+    return not std::holds_alternative<std::monostate>(body);
+}
+
+std::optional<std::size_t> GetBodySize(const Body &body) noexcept {
+    return std::visit(Overloaded {
+                          [](const std::monostate) -> std::optional<std::size_t> {
+                              return 0;
+                          },
+                          [](const std::string_view view) -> std::optional<std::size_t> {
+                              return view.size();
+                          },
+                          [](const std::string &buffer) -> std::optional<std::size_t> {
+                              return buffer.size();
+                          },
+                          [](const FileRange &range) -> std::optional<std::size_t> {
+                              return range.length;
+                          },
+                          [](const MappedRegion &region) -> std::optional<std::size_t> {
+                              return region.View().size();
+                          },
+                          [](const BodyGenerator &) -> std::optional<std::size_t> {
+                              return std::nullopt;
+                          },
+                      },
+                      body);
+}
+
+FileRange OpenFileRange(const std::filesystem::path &p) noexcept {
+    FileRange range;
+    auto fd = openReadOnly(p);
+    if (fd == FileDescriptor::INVALID_FD) {
+        return range;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 or not S_ISREG(st.st_mode)) {
+        return range;
+    }
+
+    range.fd = std::move(fd);
+    range.length = st.st_size;
+    return range;
+}
+
+MappedRegion MapFile(const std::filesystem::path &p) noexcept {
+    const auto range = OpenFileRange(p);
+    if (range.fd == FileDescriptor::INVALID_FD or range.length == 0) {
+        return {};
+    }
+
+    auto *const address = mmap(nullptr, range.length, PROT_READ, MAP_PRIVATE, range.fd, 0);
+    if (address == MAP_FAILED) {
+        return {};
+    }
+
+    return {address, range.length};
+}
+
+} //namespace nginxpp
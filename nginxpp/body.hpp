@@ -0,0 +1,113 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include <gsl/gsl>
+
+
+namespace nginxpp {
+
+class FileDescriptor {
+public:
+    static constexpr int INVALID_FD = -1;
+
+    FileDescriptor() noexcept = default;
+
+    explicit FileDescriptor(const int fd) noexcept : m_fd(fd) {
+    }
+
+    ~FileDescriptor() noexcept;
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    FileDescriptor(FileDescriptor &&other) noexcept :
+        FileDescriptor(std::exchange(other.m_fd, INVALID_FD)) {
+    }
+
+    FileDescriptor &operator=(FileDescriptor &&other) noexcept {
+        if (this != &other) {
+            std::swap(m_fd, other.m_fd);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] operator int() const noexcept {
+        return m_fd;
+    }
+
+private:
+    int m_fd = INVALID_FD;
+};
+
+
+/// A byte range of an open file, to be sent without copying it through user space.
+struct FileRange {
+    FileDescriptor fd;
+    off_t offset = 0;
+    std::size_t length = 0;
+};
+
+
+/// A read-only memory mapping, unmapped on destruction.
+class MappedRegion {
+public:
+    MappedRegion() noexcept = default;
+
+    MappedRegion(void *const address, const std::size_t length) noexcept :
+        m_address(address), m_length(length) {
+    }
+
+    ~MappedRegion() noexcept;
+    MappedRegion(const MappedRegion &) = delete;
+    MappedRegion &operator=(const MappedRegion &) = delete;
+
+    MappedRegion(MappedRegion &&other) noexcept :
+        MappedRegion(std::exchange(other.m_address, nullptr), std::exchange(other.m_length, 0)) {
+    }
+
+    MappedRegion &operator=(MappedRegion &&other) noexcept {
+        if (this != &other) {
+            std::swap(m_address, other.m_address);
+            std::swap(m_length, other.m_length);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] std::string_view View() const noexcept {
+        return {static_cast<const char *>(m_address), m_length};
+    }
+
+private:
+    void *m_address = nullptr;
+    std::size_t m_length = 0;
+};
+
+
+/// Fills the given buffer with the next chunk of the body, and returns its size.
+/// Returning 0 marks the end of the body.
+using BodyGenerator = std::function<std::size_t(gsl::span<char>)>;
+
+using Body = std::
+    variant<std::monostate, std::string_view, std::string, FileRange, MappedRegion, BodyGenerator>;
+
+[[nodiscard]] bool HasBody(const Body &body) noexcept;
+
+/// Returns std::nullopt if the size is not known in advance, i.e. for generators.
+[[nodiscard]] std::optional<std::size_t> GetBodySize(const Body &body) noexcept;
+
+/// Returns a FileRange with an invalid fd on failure.
+[[nodiscard]] FileRange OpenFileRange(const std::filesystem::path &p) noexcept;
+
+/// Returns an empty MappedRegion on failure, or if the file is empty.
+[[nodiscard]] MappedRegion MapFile(const std::filesystem::path &p) noexcept;
+
+} //namespace nginxpp
@@ -0,0 +1,78 @@
+#include <nginxpp/body.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/path_utils.hpp>
+
+
+using namespace nginxpp;
+
+
+TEST(FileDescriptorTests, InvalidByDefault) {
+    const FileDescriptor fd;
+    EXPECT_EQ(FileDescriptor::INVALID_FD, fd);
+}
+
+TEST(FileDescriptorTests, MoveLeavesSourceInvalid) {
+    auto range = OpenFileRange("Makefile");
+    ASSERT_NE(FileDescriptor::INVALID_FD, range.fd);
+
+    const auto fd = std::move(range.fd);
+    EXPECT_NE(FileDescriptor::INVALID_FD, fd);
+    EXPECT_EQ(FileDescriptor::INVALID_FD, range.fd);
+}
+
+
+TEST(OpenFileRangeTests, InvalidIfFileNotExist) {
+    const auto range = OpenFileRange("no_such_file.txt");
+    EXPECT_EQ(FileDescriptor::INVALID_FD, range.fd);
+}
+
+TEST(OpenFileRangeTests, InvalidIfDirectory) {
+    const auto range = OpenFileRange(".");
+    EXPECT_EQ(FileDescriptor::INVALID_FD, range.fd);
+}
+
+TEST(OpenFileRangeTests, CoversWholeFile) {
+    const auto range = OpenFileRange("Makefile");
+    ASSERT_NE(FileDescriptor::INVALID_FD, range.fd);
+    EXPECT_EQ(0, range.offset);
+    EXPECT_EQ(GetFileSize("Makefile"), range.length);
+}
+
+
+TEST(MapFileTests, EmptyIfFileNotExist) {
+    const auto region = MapFile("no_such_file.txt");
+    EXPECT_TRUE(region.View().empty());
+}
+
+TEST(MapFileTests, CanMapWholeFile) {
+    const auto region = MapFile("Makefile");
+    EXPECT_EQ(GetFileSize("Makefile"), region.View().size());
+}
+
+
+TEST(BodyTests, NoBodyByDefault) {
+    const Body body;
+    EXPECT_FALSE(HasBody(body));
+    EXPECT_EQ(0, GetBodySize(body));
+}
+
+TEST(BodyTests, SizeOfBuffers) {
+    EXPECT_EQ(5, GetBodySize(std::string_view {"Hello"}));
+    EXPECT_EQ(5, GetBodySize(std::string {"Hello"}));
+}
+
+TEST(BodyTests, SizeOfFileRange) {
+    const Body body = OpenFileRange("Makefile");
+    EXPECT_TRUE(HasBody(body));
+    EXPECT_EQ(GetFileSize("Makefile"), GetBodySize(body));
+}
+
+TEST(BodyTests, SizeOfGeneratorIsUnknown) {
+    const Body body = BodyGenerator {[](const gsl::span<char>) -> std::size_t {
+        return 0;
+    }};
+    EXPECT_TRUE(HasBody(body));
+    EXPECT_FALSE(GetBodySize(body));
+}
@@ -0,0 +1,152 @@
+#include <nginxpp/buffer_pool.hpp>
+
+#include <mutex>
+#include <vector>
+
+#include <nginxpp/affinity.hpp>
+#include <nginxpp/memory_utils.hpp>
+#include <nginxpp/metrics.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::size_t THREAD_CACHE_SIZE = 4;
+constexpr std::size_t GLOBAL_POOL_SIZE = 1024;
+
+[[nodiscard]] inline constexpr auto toIndex(const BufferSize size) noexcept {
+    return static_cast<std::size_t>(size);
+}
+
+/// Shared by the threads of a NUMA node, whose buffers stay on their node once first touched.
+class alignas(CACHE_LINE_SIZE) GlobalPool {
+public:
+    [[nodiscard]] char *Take(const BufferSize size) noexcept {
+        const std::lock_guard lock {m_mutex};
+        auto &buffers = m_buffers[toIndex(size)];
+        if (buffers.empty()) {
+            return nullptr;
+        }
+        auto *const buffer = buffers.back();
+        buffers.pop_back();
+        return buffer;
+    }
+
+    /// Frees the buffer instead if the pool is full.
+    void Give(const BufferSize size, char *const buffer) noexcept {
+        {
+            const std::lock_guard lock {m_mutex};
+            auto &buffers = m_buffers[toIndex(size)];
+            if (buffers.size() < GLOBAL_POOL_SIZE) {
+                buffers.push_back(buffer);
+                return;
+            }
+        }
+        delete[] buffer;
+    }
+
+    [[nodiscard]] auto Counts() const noexcept {
+        const std::lock_guard lock {m_mutex};
+        std::array<std::uint64_t, BUFFER_SIZE_COUNT> counts {};
+        for (std::size_t i = 0; i < BUFFER_SIZE_COUNT; ++i) {
+            counts[i] = m_buffers[i].size();
+        }
+        return counts;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::array<std::vector<char *>, BUFFER_SIZE_COUNT> m_buffers;
+};
+
+[[nodiscard]] auto &globalPools() noexcept {
+    // Never destroyed, as detached threads may still give back buffers during exit
+    static auto *const POOLS = new std::array<GlobalPool, MAX_NUMA_NODES>;
+    return *POOLS;
+}
+
+/// The pool of the node of the calling thread
+[[nodiscard]] auto &globalPool() noexcept {
+    return globalPools()[CurrentNode() % MAX_NUMA_NODES];
+}
+
+/// Saves the global lock for a connection that leases and releases on every request.
+class ThreadCache {
+public:
+    ThreadCache() noexcept = default;
+
+    ~ThreadCache() noexcept {
+        for (std::size_t i = 0; i < BUFFER_SIZE_COUNT; ++i) {
+            for (std::size_t j = 0; j < m_counts[i]; ++j) {
+                globalPool().Give(static_cast<BufferSize>(i), m_buffers[i][j]);
+            }
+        }
+    }
+
+    ThreadCache(const ThreadCache &) = delete;
+    ThreadCache &operator=(const ThreadCache &) = delete;
+
+    [[nodiscard]] char *Take(const BufferSize size) noexcept {
+        auto &count = m_counts[toIndex(size)];
+        if (count == 0) {
+            return globalPool().Take(size);
+        }
+        return m_buffers[toIndex(size)][--count];
+    }
+
+    void Give(const BufferSize size, char *const buffer) noexcept {
+        auto &count = m_counts[toIndex(size)];
+        if (count == THREAD_CACHE_SIZE) {
+            globalPool().Give(size, buffer);
+            return;
+        }
+        m_buffers[toIndex(size)][count++] = buffer;
+    }
+
+private:
+    std::array<std::array<char *, THREAD_CACHE_SIZE>, BUFFER_SIZE_COUNT> m_buffers {};
+    std::array<std::size_t, BUFFER_SIZE_COUNT> m_counts {};
+};
+
+[[nodiscard]] inline auto &threadCache() noexcept {
+    thread_local ThreadCache cache;
+    return cache;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+void PooledBuffer::Lease(const BufferSize size) noexcept {
+    Release();
+
+    m_data = threadCache().Take(size);
+    if (not m_data) {
+        m_data = new char[CapacityOf(size)];
+    }
+    m_size = size;
+    RecordConnectionMemory(CapacityOf(size));
+}
+
+void PooledBuffer::Release() noexcept {
+    if (m_data) {
+        threadCache().Give(m_size, std::exchange(m_data, nullptr));
+        RecordConnectionMemory(-static_cast<std::ptrdiff_t>(CapacityOf(m_size)));
+    }
+}
+
+std::array<std::uint64_t, BUFFER_SIZE_COUNT> CachedBufferCounts() noexcept {
+    std::array<std::uint64_t, BUFFER_SIZE_COUNT> counts {};
+    for (const auto &pool : globalPools()) {
+        const auto pool_counts = pool.Counts();
+        for (std::size_t i = 0; i < BUFFER_SIZE_COUNT; ++i) {
+            counts[i] += pool_counts[i];
+        }
+    }
+    return counts;
+}
+
+} //namespace nginxpp
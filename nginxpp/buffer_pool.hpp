@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <gsl/gsl>
+
+
+namespace nginxpp {
+
+/// Buffers come in a few size classes, so that they can be recycled between connections.
+enum class BufferSize { SMALL, MEDIUM, LARGE };
+constexpr std::size_t BUFFER_SIZE_COUNT = 3;
+constexpr std::array<std::size_t, BUFFER_SIZE_COUNT> BUFFER_CAPACITIES = {
+    4 * 1024, 16 * 1024, 64 * 1024};
+
+[[nodiscard]] static inline constexpr auto CapacityOf(const BufferSize size) noexcept {
+    return BUFFER_CAPACITIES[static_cast<std::size_t>(size)];
+}
+
+/// The smallest size class holding the given number of bytes, or LARGE.
+[[nodiscard]] static inline constexpr auto SizeFor(const std::size_t bytes) noexcept {
+    for (std::size_t i = 0; i + 1 < BUFFER_SIZE_COUNT; ++i) {
+        if (bytes <= BUFFER_CAPACITIES[i]) {
+            return static_cast<BufferSize>(i);
+        }
+    }
+    return BufferSize::LARGE;
+}
+
+
+/// A buffer leased from the pool, and given back on destruction. Empty by default.
+/// Leases are served from a small cache of the calling thread first, then from a pool shared
+/// by the threads of its NUMA node, and are counted as connection memory by the metrics.
+class PooledBuffer {
+public:
+    PooledBuffer() noexcept = default;
+
+    ~PooledBuffer() noexcept {
+        Release();
+    }
+
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    PooledBuffer(PooledBuffer &&other) noexcept :
+        m_data(std::exchange(other.m_data, nullptr)), m_size(other.m_size) {
+    }
+
+    PooledBuffer &operator=(PooledBuffer &&other) noexcept {
+        if (this != &other) {
+            Release();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = other.m_size;
+        }
+        return *this;
+    }
+
+    /// Leases a buffer of the given size class; the buffer from any previous lease is given
+    /// back first.
+    void Lease(const BufferSize size) noexcept;
+
+    void Release() noexcept;
+
+    [[nodiscard]] bool Empty() const noexcept {
+        return m_data == nullptr;
+    }
+
+    [[nodiscard]] char *Data() const noexcept {
+        return m_data;
+    }
+
+    [[nodiscard]] std::size_t Capacity() const noexcept {
+        return m_data ? CapacityOf(m_size) : 0;
+    }
+
+    [[nodiscard]] gsl::span<char> Span() const noexcept {
+        return {m_data, Capacity()};
+    }
+
+    [[nodiscard]] BufferSize Size() const noexcept {
+        return m_size;
+    }
+
+private:
+    char *m_data = nullptr;
+    BufferSize m_size = BufferSize::SMALL;
+};
+
+
+/// Buffers kept for reuse in the pools of all nodes, by size class. Thread caches are not counted.
+[[nodiscard]] std::array<std::uint64_t, BUFFER_SIZE_COUNT> CachedBufferCounts() noexcept;
+
+} //namespace nginxpp
@@ -0,0 +1,84 @@
+#include <nginxpp/buffer_pool.hpp>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/metrics.hpp>
+
+
+using namespace nginxpp;
+
+
+TEST(BufferPoolTests, SizeForPicksTheSmallestFit) {
+    EXPECT_EQ(BufferSize::SMALL, SizeFor(0));
+    EXPECT_EQ(BufferSize::SMALL, SizeFor(CapacityOf(BufferSize::SMALL)));
+    EXPECT_EQ(BufferSize::MEDIUM, SizeFor(CapacityOf(BufferSize::SMALL) + 1));
+    EXPECT_EQ(BufferSize::LARGE, SizeFor(CapacityOf(BufferSize::MEDIUM) + 1));
+    EXPECT_EQ(BufferSize::LARGE, SizeFor(CapacityOf(BufferSize::LARGE) * 2));
+}
+
+TEST(BufferPoolTests, EmptyByDefault) {
+    const PooledBuffer buffer;
+    EXPECT_TRUE(buffer.Empty());
+    EXPECT_EQ(0, buffer.Capacity());
+    EXPECT_TRUE(buffer.Span().empty());
+}
+
+TEST(BufferPoolTests, LeaseHasTheCapacityOfItsSize) {
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::MEDIUM);
+    ASSERT_FALSE(buffer.Empty());
+    EXPECT_EQ(BufferSize::MEDIUM, buffer.Size());
+    EXPECT_EQ(CapacityOf(BufferSize::MEDIUM), buffer.Span().size());
+
+    buffer.Release();
+    EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(BufferPoolTests, ReleasedBuffersAreReused) {
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::SMALL);
+    const auto *const data = buffer.Data();
+    buffer.Release();
+
+    buffer.Lease(BufferSize::SMALL);
+    EXPECT_EQ(data, buffer.Data());
+}
+
+TEST(BufferPoolTests, MoveTransfersTheLease) {
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::SMALL);
+    const auto *const data = buffer.Data();
+
+    PooledBuffer other {std::move(buffer)};
+    EXPECT_TRUE(buffer.Empty());
+    EXPECT_EQ(data, other.Data());
+
+    buffer = std::move(other);
+    EXPECT_TRUE(other.Empty());
+    EXPECT_EQ(data, buffer.Data());
+}
+
+TEST(BufferPoolTests, ThreadCachesGoBackToTheGlobalPool) {
+    const auto before = CachedBufferCounts()[static_cast<std::size_t>(BufferSize::LARGE)];
+
+    std::thread([]() {
+        PooledBuffer buffer;
+        buffer.Lease(BufferSize::LARGE);
+    }).join();
+
+    EXPECT_LE(before, CachedBufferCounts()[static_cast<std::size_t>(BufferSize::LARGE)]);
+    EXPECT_LT(0, CachedBufferCounts()[static_cast<std::size_t>(BufferSize::LARGE)]);
+}
+
+TEST(BufferPoolTests, LeasesAreCountedAsConnectionMemory) {
+    const auto before = ScrapeMetrics().ConnectionMemory();
+
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::LARGE);
+    EXPECT_EQ(before + CapacityOf(BufferSize::LARGE), ScrapeMetrics().ConnectionMemory());
+
+    buffer.Release();
+    EXPECT_EQ(before, ScrapeMetrics().ConnectionMemory());
+}
@@ -0,0 +1,444 @@
+#include <nginxpp/cache.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gsl/gsl>
+
+#include <nginxpp/exception.hpp>
+#include <nginxpp/response_headers.hpp>
+#include <nginxpp/string_utils.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] bool isCacheableByDefault(const int status) noexcept {
+    constexpr std::array<int, 11> CACHEABLE = {
+        200, 203, 204, 300, 301, 308, 404, 405, 410, 414, 501};
+    return std::find(CACHEABLE.begin(), CACHEABLE.end(), status) != CACHEABLE.end();
+}
+
+[[nodiscard]] std::string_view trim(std::string_view str) noexcept {
+    str.remove_prefix(std::min(str.find_first_not_of(" \t"), str.size()));
+    return str.substr(0, str.find_last_not_of(" \t") + 1);
+}
+
+/// Calls the visitor with each field of the head after its status line, its name lowered.
+template<typename Visitor>
+void forEachField(std::string_view head, Visitor &&visit) noexcept {
+    for (bool first = true; not head.empty(); first = false) {
+        const auto end = head.find('\n');
+        auto line = head.substr(0, end);
+        head.remove_prefix(end == head.npos ? head.size() : end + 1);
+        if (not line.empty() and line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        const auto colon = line.find(':');
+        if (first or colon == line.npos) {
+            continue;
+        }
+        visit(ToLower(std::string {line.substr(0, colon)}), trim(line.substr(colon + 1)), line);
+    }
+}
+
+/// Calls the visitor with each comma-separated element of a list, trimmed.
+template<typename Visitor>
+void forEachElement(std::string_view list, Visitor &&visit) noexcept {
+    while (not list.empty()) {
+        const auto comma = list.find(',');
+        if (const auto element = trim(list.substr(0, comma)); not element.empty()) {
+            visit(element);
+        }
+        list.remove_prefix(comma == list.npos ? list.size() : comma + 1);
+    }
+}
+
+/// The IMF-fixdate of RFC 9110, section 5.6.7, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+[[nodiscard]] std::optional<std::time_t> parseHttpDate(const std::string_view value) noexcept {
+    const std::string date {value};
+    std::tm tm {};
+    const auto *const end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (not end or *end != '\0') {
+        return std::nullopt;
+    }
+    return timegm(&tm);
+}
+
+[[nodiscard]] std::optional<std::chrono::seconds>
+parseSeconds(const std::string_view value) noexcept {
+    const auto seconds = ParseNumber<long>(value);
+    return seconds ? std::optional {std::chrono::seconds {*seconds}} : std::nullopt;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::string_view ToString(const CacheStatus status) noexcept {
+    switch (status) {
+    case CacheStatus::BYPASS:
+        return "BYPASS";
+    case CacheStatus::MISS:
+        return "MISS";
+    case CacheStatus::EXPIRED:
+        return "EXPIRED";
+    case CacheStatus::STALE:
+        return "STALE";
+    case CacheStatus::UPDATING:
+        return "UPDATING";
+    case CacheStatus::HIT:
+        return "HIT";
+    }
+    return "UNKNOWN";
+}
+
+std::optional<CachePolicy>
+ParseCachePolicy(const int status,
+                 const std::string_view head,
+                 const std::vector<std::string> &vary,
+                 const std::chrono::milliseconds default_fresh,
+                 const std::chrono::milliseconds default_stale) noexcept {
+    if (not isCacheableByDefault(status)) {
+        return std::nullopt;
+    }
+
+    CachePolicy policy;
+    bool storable = true;
+    std::optional<std::chrono::seconds> max_age;
+    std::optional<std::chrono::seconds> shared_max_age;
+    std::optional<std::chrono::seconds> stale;
+    std::optional<std::time_t> expires;
+    std::optional<std::time_t> date;
+    forEachField(head, [&](const std::string &name, const std::string_view value, auto) {
+        if (name == "cache-control") {
+            forEachElement(value, [&](const std::string_view element) {
+                const auto equals = element.find('=');
+                const auto directive = ToLower(std::string {trim(element.substr(0, equals))});
+                auto argument = equals == element.npos ? std::string_view {}
+                                                       : trim(element.substr(equals + 1));
+                if (argument.size() >= 2 and argument.front() == '"' and argument.back() == '"') {
+                    argument = argument.substr(1, argument.size() - 2);
+                }
+                if (directive == "no-store" or directive == "no-cache" or directive == "private") {
+                    storable = false;
+                } else if (directive == "s-maxage") {
+                    shared_max_age = parseSeconds(argument);
+                } else if (directive == "max-age") {
+                    max_age = parseSeconds(argument);
+                } else if (directive == "stale-while-revalidate") {
+                    stale = parseSeconds(argument);
+                }
+            });
+        } else if (name == "expires") {
+            // Invalid dates, such as "0", mean already expired
+            expires = parseHttpDate(value).value_or(0);
+        } else if (name == "date") {
+            date = parseHttpDate(value);
+        } else if (name == "vary") {
+            forEachElement(value, [&](const std::string_view element) {
+                const auto header = ToLower(std::string {element});
+                storable = storable and std::find(vary.begin(), vary.end(), header) != vary.end();
+            });
+        } else if (name == "set-cookie") {
+            storable = false;
+        } else if (name == "etag") {
+            policy.etag = value;
+        } else if (name == "last-modified") {
+            policy.last_modified = value;
+        }
+    });
+    if (not storable) {
+        return std::nullopt;
+    }
+
+    if (shared_max_age or max_age) {
+        policy.fresh = shared_max_age.value_or(max_age.value_or(std::chrono::seconds {}));
+    } else if (expires) {
+        policy.fresh = std::chrono::seconds {*expires - date.value_or(std::time(nullptr))};
+    } else {
+        policy.fresh = default_fresh;
+    }
+    if (policy.fresh.count() <= 0) {
+        return std::nullopt;
+    }
+    policy.stale = stale ? std::chrono::milliseconds {*stale} : default_stale;
+    return policy;
+}
+
+
+CacheBody::~CacheBody() noexcept {
+    if (not path.empty()) {
+        unlink(path.c_str());
+    }
+}
+
+
+ContentCache::ContentCache(const std::filesystem::path &dir,
+                           const std::size_t max_size,
+                           std::vector<std::string> vary,
+                           const std::chrono::milliseconds default_fresh,
+                           const std::chrono::milliseconds default_stale) :
+    m_dir(dir / ("nginxpp-" + std::to_string(getpid()))),
+    m_max_size(max_size), m_vary(std::move(vary)), m_default_fresh(default_fresh),
+    m_default_stale(default_stale) {
+    // Left over by a process that had the same pid and did not exit cleanly
+    std::error_code error;
+    std::filesystem::remove_all(m_dir, error);
+    if (not std::filesystem::create_directories(m_dir, error)) {
+        throw ServerException {"Failed to create cache directory '" + m_dir.string() +
+                               "': " + error.message()};
+    }
+}
+
+ContentCache::~ContentCache() noexcept {
+    {
+        const std::lock_guard lock {m_mutex};
+        m_index.clear();
+        m_lru.clear();
+    }
+    std::error_code error;
+    std::filesystem::remove_all(m_dir, error);
+}
+
+std::string ContentCache::Key(const Request &a_request) const noexcept {
+    const auto &headers = a_request.headers;
+    if ((a_request.method != Method::GET and a_request.method != Method::HEAD) or
+        headers.contains("authorization") or headers.contains("range") or
+        headers.contains("transfer-encoding")) {
+        return {};
+    }
+    if (const auto iter = headers.find("content-length");
+        iter != headers.end() and iter->second != "0") {
+        return {};
+    }
+
+    std::string key = "GET ";
+    if (const auto host = headers.find("host"); host != headers.end()) {
+        key.append(ToLower(host->second));
+    }
+    key.append(" /").append(a_request.target);
+    for (const auto &name : m_vary) {
+        key.append("\n").append(name).append(":");
+        if (const auto iter = headers.find(name); iter != headers.end()) {
+            key.append(iter->second);
+        }
+    }
+    return key;
+}
+
+ContentCache::Lookup ContentCache::Find(const std::string &key,
+                                        const Clock::time_point now) {
+    const std::lock_guard lock {m_mutex};
+    EntryPtr entry;
+    if (const auto iter = m_index.find(key); iter != m_index.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, iter->second);
+        entry = iter->second->second;
+        if (now < entry->fresh_until) {
+            return {CacheStatus::HIT, std::move(entry), nullptr};
+        }
+    }
+
+    const auto locked = m_locked.contains(key);
+    if (entry and now < entry->stale_until) {
+        if (locked) {
+            return {CacheStatus::UPDATING, std::move(entry), nullptr};
+        }
+        m_locked.insert(key);
+        auto fill = std::make_unique<CacheFill>(*this, key, CacheStatus::STALE, entry);
+        return {CacheStatus::STALE, std::move(entry), std::move(fill)};
+    }
+
+    const auto status = entry ? CacheStatus::EXPIRED : CacheStatus::MISS;
+    if (locked) {
+        return {status, nullptr, nullptr};
+    }
+    m_locked.insert(key);
+    return {status, nullptr, std::make_unique<CacheFill>(*this, key, status, nullptr)};
+}
+
+std::size_t ContentCache::Size() const noexcept {
+    const std::lock_guard lock {m_mutex};
+    return m_size;
+}
+
+std::size_t ContentCache::EntryCount() const noexcept {
+    const std::lock_guard lock {m_mutex};
+    return m_index.size();
+}
+
+std::filesystem::path ContentCache::nextPath() noexcept {
+    const std::lock_guard lock {m_mutex};
+    return m_dir / std::to_string(m_next_file++);
+}
+
+void ContentCache::store(const std::string &key, EntryPtr entry) noexcept {
+    // Evicted entries are freed out of the lock, which may remove their files
+    std::vector<EntryPtr> evicted;
+    const std::lock_guard lock {m_mutex};
+    if (const auto iter = m_index.find(key); iter != m_index.end()) {
+        m_size -= iter->second->second->body->size;
+        evicted.push_back(std::move(iter->second->second));
+        m_lru.erase(iter->second);
+        m_index.erase(iter);
+    }
+
+    m_size += entry->body->size;
+    m_lru.emplace_front(key, std::move(entry));
+    m_index.emplace(key, m_lru.begin());
+    while (m_size > m_max_size and m_lru.size() > 1) {
+        auto &[lru_key, lru_entry] = m_lru.back();
+        m_size -= lru_entry->body->size;
+        evicted.push_back(std::move(lru_entry));
+        m_index.erase(lru_key);
+        m_lru.pop_back();
+    }
+}
+
+void ContentCache::unlock(const std::string &key) noexcept {
+    const std::lock_guard lock {m_mutex};
+    m_locked.erase(key);
+}
+
+
+CacheFill::CacheFill(ContentCache &cache,
+                     std::string key,
+                     const CacheStatus status,
+                     ContentCache::EntryPtr stale) noexcept :
+    m_cache(cache),
+    m_key(std::move(key)), m_status(status), m_stale(std::move(stale)) {
+}
+
+CacheFill::~CacheFill() noexcept {
+    abandon();
+    m_cache.unlock(m_key);
+}
+
+bool CacheFill::Begin(const int status, const std::string_view head) noexcept {
+    // Fresh again, as far as the backend can tell
+    m_renewal = m_stale and status == 304;
+    const auto policy_status = m_renewal ? m_stale->status : status;
+    m_policy = ParseCachePolicy(
+        policy_status, head, m_cache.m_vary, m_cache.m_default_fresh, m_cache.m_default_stale);
+    if (not m_policy or m_renewal) {
+        return m_policy.has_value();
+    }
+    m_response_status = status;
+
+    auto fields = std::make_shared<std::string>();
+    forEachField(head, [&fields](const std::string &name, auto, const std::string_view line) {
+        if (name != "content-length" and name != "date" and name != "server" and name != "age") {
+            fields->append(line).append(CRLF);
+        }
+    });
+    m_fields = std::move(fields);
+
+    m_path = m_cache.nextPath();
+    m_file = FileDescriptor {open(m_path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600)};
+    if (m_file == FileDescriptor::INVALID_FD) {
+        m_path.clear();
+        abandon();
+        return false;
+    }
+    return true;
+}
+
+void CacheFill::Append(std::string_view data) noexcept {
+    if (m_file == FileDescriptor::INVALID_FD) {
+        return;
+    }
+    if (m_size + data.size() > m_cache.m_max_size) {
+        abandon();
+        return;
+    }
+    m_size += data.size();
+    while (not data.empty()) {
+        const auto n = write(m_file, data.data(), data.size());
+        if (n == -1 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            abandon();
+            return;
+        }
+        data.remove_prefix(n);
+    }
+}
+
+void CacheFill::Commit() noexcept {
+    if (not m_policy) {
+        return;
+    }
+
+    auto entry = std::make_shared<CacheEntry>();
+    if (m_renewal) {
+        *entry = *m_stale;
+        if (not m_policy->etag.empty()) {
+            entry->etag = m_policy->etag;
+        }
+        if (not m_policy->last_modified.empty()) {
+            entry->last_modified = m_policy->last_modified;
+        }
+    } else if (m_file != FileDescriptor::INVALID_FD) {
+        entry->status = m_response_status;
+        entry->fields = std::move(m_fields);
+        entry->body = std::make_shared<const CacheBody>(
+            std::move(m_file), std::exchange(m_path, {}), m_size);
+        entry->etag = std::move(m_policy->etag);
+        entry->last_modified = std::move(m_policy->last_modified);
+    } else {
+        return;
+    }
+    entry->stored_at = ContentCache::Clock::now();
+    entry->fresh_until = entry->stored_at + m_policy->fresh;
+    entry->stale_until = entry->fresh_until + m_policy->stale;
+    m_policy.reset();
+
+    m_cache.store(m_key, std::move(entry));
+}
+
+void CacheFill::abandon() noexcept {
+    m_policy.reset();
+    m_file = FileDescriptor {};
+    if (not m_path.empty()) {
+        unlink(m_path.c_str());
+        m_path.clear();
+    }
+}
+
+
+Response ServeEntry(const CacheEntry &entry,
+                    const Method method,
+                    const CacheStatus status,
+                    const CacheEntry::Clock::time_point now) noexcept {
+    Response a_response;
+    FileDescriptor fd {dup(entry.body->fd)};
+    if (fd == FileDescriptor::INVALID_FD) {
+        a_response.status = 500;
+        a_response.error_str = "Failed to open cached body: "s + strerror(errno);
+        return a_response;
+    }
+
+    a_response.status = entry.status;
+    a_response.fixed_headers = entry.fields;
+    a_response.headers["Content-Length"] = std::to_string(entry.body->size);
+    a_response.headers["Age"] = std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(now - entry.stored_at).count());
+    a_response.headers["X-Cache-Status"] = ToString(status);
+    if (method != Method::HEAD and entry.body->size) {
+        a_response.body = FileRange {std::move(fd), 0, entry.body->size};
+    }
+    return a_response;
+}
+
+} //namespace nginxpp
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <nginxpp/body.hpp>
+#include <nginxpp/message.hpp>
+
+
+namespace nginxpp {
+
+/// How a proxied request fared with the cache, as told by nginx's $upstream_cache_status:
+/// EXPIRED was fetched again as too stale to serve, STALE was served while this request
+/// refreshes it in the background, UPDATING while another one does.
+enum class CacheStatus { BYPASS, MISS, EXPIRED, STALE, UPDATING, HIT };
+constexpr std::size_t CACHE_STATUS_COUNT = 6;
+
+[[nodiscard]] std::string_view ToString(const CacheStatus status) noexcept;
+
+
+/// How long a response may be served from the cache, as its head tells.
+struct CachePolicy {
+    std::chrono::milliseconds fresh {};
+    /// Past freshness, during which it is served while being refreshed
+    std::chrono::milliseconds stale {};
+    /// Validators, to refresh it with a conditional request
+    std::string etag;
+    std::string last_modified;
+};
+
+/// Returns std::nullopt if the response must not be stored: for a status not cacheable by
+/// default (RFC 9111, section 4.2.2), Cache-Control no-store, no-cache or private, Set-Cookie,
+/// a Vary naming other request headers than those the cache keys on, or no freshness at all.
+/// Freshness comes from s-maxage or max-age, else from Expires past Date, else from the default;
+/// staleness from stale-while-revalidate, else from the default.
+/// The head starts with the status line, and its field names may be in any case.
+[[nodiscard]] std::optional<CachePolicy>
+ParseCachePolicy(const int status,
+                 const std::string_view head,
+                 const std::vector<std::string> &vary,
+                 const std::chrono::milliseconds default_fresh,
+                 const std::chrono::milliseconds default_stale) noexcept;
+
+
+/// The body file of a cached response, removed once no entry refers to it any more. Responses
+/// being sent from it hold descriptors of their own, which keep it readable until they are done.
+struct CacheBody {
+    FileDescriptor fd;
+    std::filesystem::path path;
+    std::size_t size = 0;
+
+    CacheBody(FileDescriptor file,
+              std::filesystem::path file_path,
+              const std::size_t length) noexcept :
+        fd(std::move(file)),
+        path(std::move(file_path)), size(length) {
+    }
+
+    ~CacheBody() noexcept;
+    CacheBody(const CacheBody &) = delete;
+    CacheBody &operator=(const CacheBody &) = delete;
+};
+
+struct CacheEntry {
+    using Clock = std::chrono::steady_clock;
+
+    int status = 200;
+    /// Serialized end-to-end fields, but for Date, Server, Age and Content-Length, which the
+    /// cache sets on its own
+    std::shared_ptr<const std::string> fields;
+    std::shared_ptr<const CacheBody> body;
+    Clock::time_point stored_at {};
+    Clock::time_point fresh_until {};
+    Clock::time_point stale_until {};
+    std::string etag;
+    std::string last_modified;
+};
+
+/// The cached response, with its Age and its cache status in X-Cache-Status, and without its
+/// body for HEAD. Sends the body from a descriptor of its own, which outlives eviction.
+[[nodiscard]] Response ServeEntry(const CacheEntry &entry,
+                                  const Method method,
+                                  const CacheStatus status,
+                                  const CacheEntry::Clock::time_point now) noexcept;
+
+
+class CacheFill;
+
+/// Proxied responses, indexed in memory and stored in files, evicted least recently used first
+/// once their bodies exceed the maximum size. Shared by all loops, each lookup taking a lock.
+/// Keyed by method, host and target, HEAD sharing the entries of GET, and by the values of the
+/// request headers that the cache is configured to vary on.
+/// The index does not outlive the process, whose files go to a directory of its own, removed
+/// when the cache is destroyed; worker processes thus do not share entries, and none survive
+/// a restart.
+class ContentCache {
+public:
+    using Clock = CacheEntry::Clock;
+    using EntryPtr = std::shared_ptr<const CacheEntry>;
+
+    /// Vary names request headers, in lower case.
+    /// Throws ServerException if the directory of the process cannot be created.
+    ContentCache(const std::filesystem::path &dir,
+                 const std::size_t max_size,
+                 std::vector<std::string> vary,
+                 const std::chrono::milliseconds default_fresh,
+                 const std::chrono::milliseconds default_stale);
+
+    ~ContentCache() noexcept;
+    ContentCache(const ContentCache &) = delete;
+    ContentCache &operator=(const ContentCache &) = delete;
+
+    /// Empty if the request bypasses the cache: a method other than GET and HEAD, a body, a
+    /// range, which is served whole from the backend, or credentials, which a shared cache may
+    /// not answer for.
+    [[nodiscard]] std::string Key(const Request &a_request) const noexcept;
+
+    struct Lookup {
+        CacheStatus status = CacheStatus::MISS;
+        /// To be served; nullptr for MISS and EXPIRED
+        EntryPtr entry;
+        /// Set for the one request that is to store or refresh the entry, which holds its key
+        /// until done; nullptr if another one holds it, for this one to wait and look again
+        std::unique_ptr<CacheFill> fill;
+    };
+
+    [[nodiscard]] Lookup Find(const std::string &key, const Clock::time_point now);
+
+    [[nodiscard]] std::size_t Size() const noexcept;
+
+    [[nodiscard]] std::size_t EntryCount() const noexcept;
+
+    [[nodiscard]] const std::filesystem::path &Directory() const noexcept {
+        return m_dir;
+    }
+
+private:
+    friend class CacheFill;
+
+    /// Unique within the process, so that a refresh never writes over a body being sent
+    [[nodiscard]] std::filesystem::path nextPath() noexcept;
+
+    void store(const std::string &key, EntryPtr entry) noexcept;
+
+    void unlock(const std::string &key) noexcept;
+
+    std::filesystem::path m_dir;
+    std::size_t m_max_size = 0;
+    std::vector<std::string> m_vary;
+    std::chrono::milliseconds m_default_fresh {};
+    std::chrono::milliseconds m_default_stale {};
+
+    mutable std::mutex m_mutex;
+    /// Most recently used first
+    std::list<std::pair<std::string, EntryPtr>> m_lru;
+    std::unordered_map<std::string, decltype(m_lru)::iterator> m_index;
+    /// Keys being stored or refreshed
+    std::unordered_set<std::string> m_locked;
+    std::size_t m_size = 0;
+    std::size_t m_next_file = 0;
+};
+
+
+/// Writes a response to a file as it is relayed, and stores it once whole. Holds the key of
+/// the entry for as long as it lives, so that concurrent misses wait for it rather than fetch
+/// the same response.
+class CacheFill {
+public:
+    CacheFill(ContentCache &cache,
+              std::string key,
+              const CacheStatus status,
+              ContentCache::EntryPtr stale) noexcept;
+
+    ~CacheFill() noexcept;
+    CacheFill(const CacheFill &) = delete;
+    CacheFill &operator=(const CacheFill &) = delete;
+
+    /// MISS, EXPIRED, or STALE for a refresh in the background.
+    [[nodiscard]] CacheStatus Status() const noexcept {
+        return m_status;
+    }
+
+    /// The entry being refreshed, whose validators make the request conditional; nullptr if
+    /// none.
+    [[nodiscard]] const ContentCache::EntryPtr &Stale() const noexcept {
+        return m_stale;
+    }
+
+    /// Returns false if the response is not to be stored, which makes the rest no-ops.
+    /// A 304 to a refresh renews the stale entry, with its body.
+    bool Begin(const int status, const std::string_view head) noexcept;
+
+    /// Gives up on storing the response if the body cannot be written, or outgrows the cache.
+    void Append(const std::string_view data) noexcept;
+
+    /// Stores the response, once its body is whole.
+    void Commit() noexcept;
+
+private:
+    void abandon() noexcept;
+
+    ContentCache &m_cache;
+    std::string m_key;
+    CacheStatus m_status;
+    ContentCache::EntryPtr m_stale;
+    std::optional<CachePolicy> m_policy;
+    int m_response_status = 0;
+    std::shared_ptr<const std::string> m_fields;
+    FileDescriptor m_file;
+    std::filesystem::path m_path;
+    std::size_t m_size = 0;
+    bool m_renewal = false;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,272 @@
+#include <nginxpp/cache.hpp>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+constexpr std::string_view CACHEABLE_HEAD = "HTTP/1.1 200 OK\r\n"
+                                            "Content-Type: text/plain\r\n"
+                                            "Content-Length: 5\r\n"
+                                            "Cache-Control: max-age=60\r\n"
+                                            "ETag: \"v1\"\r\n";
+
+[[nodiscard]] std::optional<CachePolicy> parse(const std::string_view fields,
+                                               const int status = 200,
+                                               const std::vector<std::string> &vary = {}) {
+    const auto head = "HTTP/1.1 " + std::to_string(status) + " X\r\n" + std::string {fields};
+    return ParseCachePolicy(status, head, vary, 0ms, 10s);
+}
+
+[[nodiscard]] Request createRequest(const Method method, const std::string &target) {
+    Request a_request;
+    a_request.method = method;
+    a_request.target = target;
+    a_request.version = "HTTP/1.1";
+    a_request.headers["host"] = "example.com";
+    return a_request;
+}
+
+[[nodiscard]] std::string readBody(const CacheEntry &entry) {
+    std::string body(entry.body->size, '\0');
+    EXPECT_EQ(ssize_t(body.size()), pread(entry.body->fd, body.data(), body.size(), 0));
+    return body;
+}
+
+class ContentCacheTests : public ::testing::Test {
+protected:
+    ContentCacheTests() : m_cache(std::filesystem::temp_directory_path(), 16, {}, 0ms, 10s) {
+    }
+
+    /// Stores the response under the key, as a request missing it would.
+    void fill(const std::string &key,
+              const std::string_view body,
+              const std::string_view head = CACHEABLE_HEAD) {
+        auto lookup = m_cache.Find(key, ContentCache::Clock::now());
+        ASSERT_TRUE(lookup.fill);
+        ASSERT_TRUE(lookup.fill->Begin(200, head));
+        lookup.fill->Append(body);
+        lookup.fill->Commit();
+    }
+
+    ContentCache m_cache;
+};
+
+} //namespace
+
+
+TEST(ParseCachePolicyTests, FreshnessFromCacheControl) {
+    EXPECT_EQ(60s, parse("Cache-Control: public, max-age=60\r\n")->fresh);
+    EXPECT_EQ(30s, parse("cache-control: max-age=60, s-maxage=30\r\n")->fresh);
+    EXPECT_EQ(5s, parse("Cache-Control: max-age=60, stale-while-revalidate=5\r\n")->stale);
+    EXPECT_EQ(10s, parse("Cache-Control: max-age=60\r\n")->stale);
+}
+
+TEST(ParseCachePolicyTests, FreshnessFromExpires) {
+    EXPECT_EQ(60s,
+              parse("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                    "Expires: Sun, 06 Nov 1994 08:50:37 GMT\r\n")
+                  ->fresh);
+    EXPECT_FALSE(parse("Expires: 0\r\n"));
+}
+
+TEST(ParseCachePolicyTests, FreshnessFromDefault) {
+    const auto head = "HTTP/1.1 200 OK\r\n";
+    EXPECT_FALSE(ParseCachePolicy(200, head, {}, 0ms, 0ms));
+    EXPECT_EQ(5s, ParseCachePolicy(200, head, {}, 5s, 0ms)->fresh);
+}
+
+TEST(ParseCachePolicyTests, KeepsValidators) {
+    const auto policy =
+        parse("ETag: \"abc\"\r\nLast-Modified: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+              "Cache-Control: max-age=1\r\n");
+    ASSERT_TRUE(policy);
+    EXPECT_EQ("\"abc\"", policy->etag);
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", policy->last_modified);
+}
+
+TEST(ParseCachePolicyTests, RefusesWhatMustNotBeStored) {
+    EXPECT_FALSE(parse("Cache-Control: no-store, max-age=60\r\n"));
+    EXPECT_FALSE(parse("Cache-Control: private, max-age=60\r\n"));
+    EXPECT_FALSE(parse("Cache-Control: max-age=60\r\nSet-Cookie: id=1\r\n"));
+    EXPECT_FALSE(parse("Cache-Control: max-age=60\r\n", 500));
+    EXPECT_FALSE(parse("Cache-Control: max-age=60\r\n", 206));
+    EXPECT_FALSE(parse("Cache-Control: max-age=0\r\n"));
+}
+
+TEST(ParseCachePolicyTests, VaryOnlyOnKeyedHeaders) {
+    const auto fields = "Cache-Control: max-age=60\r\nVary: Accept-Encoding\r\n";
+    EXPECT_FALSE(parse(fields));
+    EXPECT_TRUE(parse(fields, 200, {"accept-encoding"}));
+}
+
+
+TEST_F(ContentCacheTests, KeysOnHostAndTarget) {
+    const auto get = m_cache.Key(createRequest(Method::GET, "a?b=1"));
+    EXPECT_FALSE(get.empty());
+    EXPECT_EQ(get, m_cache.Key(createRequest(Method::HEAD, "a?b=1")));
+    EXPECT_NE(get, m_cache.Key(createRequest(Method::GET, "a?b=2")));
+
+    auto other_host = createRequest(Method::GET, "a?b=1");
+    other_host.headers["host"] = "example.org";
+    EXPECT_NE(get, m_cache.Key(other_host));
+}
+
+TEST_F(ContentCacheTests, BypassesUnsafeRequests) {
+    EXPECT_TRUE(m_cache.Key(createRequest(Method::POST, "a")).empty());
+
+    auto with_credentials = createRequest(Method::GET, "a");
+    with_credentials.headers["authorization"] = "Basic Zm9vOmJhcg==";
+    EXPECT_TRUE(m_cache.Key(with_credentials).empty());
+
+    auto with_range = createRequest(Method::GET, "a");
+    with_range.headers["range"] = "bytes=0-1";
+    EXPECT_TRUE(m_cache.Key(with_range).empty());
+
+    auto with_body = createRequest(Method::GET, "a");
+    with_body.headers["content-length"] = "3";
+    EXPECT_TRUE(m_cache.Key(with_body).empty());
+}
+
+TEST(ContentCacheVaryTests, KeysOnVaryHeaders) {
+    ContentCache cache {std::filesystem::temp_directory_path(), 16, {"accept-encoding"}, 0ms, 0ms};
+    auto gzip = createRequest(Method::GET, "a");
+    gzip.headers["accept-encoding"] = "gzip";
+    EXPECT_NE(cache.Key(gzip), cache.Key(createRequest(Method::GET, "a")));
+}
+
+TEST_F(ContentCacheTests, MissLocksKeyUntilFilled) {
+    const auto now = ContentCache::Clock::now();
+    auto miss = m_cache.Find("a", now);
+    EXPECT_EQ(CacheStatus::MISS, miss.status);
+    EXPECT_FALSE(miss.entry);
+    ASSERT_TRUE(miss.fill);
+
+    // Another miss waits rather than fetch it too
+    const auto waiting = m_cache.Find("a", now);
+    EXPECT_FALSE(waiting.entry);
+    EXPECT_FALSE(waiting.fill);
+
+    ASSERT_TRUE(miss.fill->Begin(200, CACHEABLE_HEAD));
+    miss.fill->Append("hel");
+    miss.fill->Append("lo");
+    miss.fill->Commit();
+    miss.fill.reset();
+
+    const auto hit = m_cache.Find("a", ContentCache::Clock::now());
+    EXPECT_EQ(CacheStatus::HIT, hit.status);
+    ASSERT_TRUE(hit.entry);
+    EXPECT_FALSE(hit.fill);
+    EXPECT_EQ("hello", readBody(*hit.entry));
+    EXPECT_EQ("\"v1\"", hit.entry->etag);
+    EXPECT_EQ(std::string::npos, hit.entry->fields->find("Content-Length"));
+    EXPECT_NE(std::string::npos, hit.entry->fields->find("Content-Type: text/plain\r\n"));
+    EXPECT_EQ(5, m_cache.Size());
+}
+
+TEST_F(ContentCacheTests, AbandonedFillUnlocksKey) {
+    auto miss = m_cache.Find("a", ContentCache::Clock::now());
+    ASSERT_TRUE(miss.fill);
+    EXPECT_FALSE(miss.fill->Begin(200, "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\n"));
+    miss.fill->Commit();
+    miss.fill.reset();
+
+    const auto again = m_cache.Find("a", ContentCache::Clock::now());
+    EXPECT_EQ(CacheStatus::MISS, again.status);
+    EXPECT_TRUE(again.fill);
+    EXPECT_EQ(0, m_cache.EntryCount());
+}
+
+TEST_F(ContentCacheTests, ServesStaleWhileOneRequestRefreshes) {
+    fill("a", "hello");
+    const auto stale_at = ContentCache::Clock::now() + 61s;
+
+    auto stale = m_cache.Find("a", stale_at);
+    EXPECT_EQ(CacheStatus::STALE, stale.status);
+    ASSERT_TRUE(stale.entry);
+    ASSERT_TRUE(stale.fill);
+    EXPECT_EQ(stale.entry, stale.fill->Stale());
+
+    const auto updating = m_cache.Find("a", stale_at);
+    EXPECT_EQ(CacheStatus::UPDATING, updating.status);
+    EXPECT_TRUE(updating.entry);
+    EXPECT_FALSE(updating.fill);
+
+    const auto expired = m_cache.Find("a", stale_at + 10s);
+    EXPECT_EQ(CacheStatus::EXPIRED, expired.status);
+    EXPECT_FALSE(expired.entry);
+}
+
+TEST_F(ContentCacheTests, RenewsStaleEntryOnNotModified) {
+    fill("a", "hello");
+    auto stale = m_cache.Find("a", ContentCache::Clock::now() + 61s);
+    ASSERT_TRUE(stale.fill);
+    ASSERT_TRUE(
+        stale.fill->Begin(304, "HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=120\r\n"));
+    stale.fill->Commit();
+    stale.fill.reset();
+
+    const auto hit = m_cache.Find("a", ContentCache::Clock::now() + 61s);
+    EXPECT_EQ(CacheStatus::HIT, hit.status);
+    ASSERT_TRUE(hit.entry);
+    EXPECT_EQ(200, hit.entry->status);
+    EXPECT_EQ("hello", readBody(*hit.entry));
+}
+
+TEST_F(ContentCacheTests, EvictsLeastRecentlyUsedBySize) {
+    fill("a", "123456");
+    fill("b", "123456");
+    // Used last, so "b" goes first
+    (void)m_cache.Find("a", ContentCache::Clock::now());
+    fill("c", "123456");
+
+    EXPECT_EQ(2, m_cache.EntryCount());
+    EXPECT_EQ(12, m_cache.Size());
+    EXPECT_EQ(CacheStatus::HIT, m_cache.Find("a", ContentCache::Clock::now()).status);
+    EXPECT_EQ(CacheStatus::MISS, m_cache.Find("b", ContentCache::Clock::now()).status);
+}
+
+TEST_F(ContentCacheTests, SkipsBodiesLargerThanCache) {
+    auto miss = m_cache.Find("a", ContentCache::Clock::now());
+    ASSERT_TRUE(miss.fill);
+    ASSERT_TRUE(miss.fill->Begin(200, CACHEABLE_HEAD));
+    miss.fill->Append(std::string(17, 'x'));
+    miss.fill->Commit();
+
+    EXPECT_EQ(0, m_cache.EntryCount());
+}
+
+TEST_F(ContentCacheTests, ServesEntryWithAgeAndStatus) {
+    fill("a", "hello");
+    const auto hit = m_cache.Find("a", ContentCache::Clock::now());
+    ASSERT_TRUE(hit.entry);
+
+    const auto a_response =
+        ServeEntry(*hit.entry, Method::GET, CacheStatus::HIT, hit.entry->stored_at + 3s);
+    EXPECT_EQ(200, a_response.status);
+    EXPECT_EQ("5", a_response.headers.at("Content-Length"));
+    EXPECT_EQ("3", a_response.headers.at("Age"));
+    EXPECT_EQ("HIT", a_response.headers.at("X-Cache-Status"));
+    EXPECT_TRUE(std::holds_alternative<FileRange>(a_response.body));
+
+    const auto head =
+        ServeEntry(*hit.entry, Method::HEAD, CacheStatus::HIT, hit.entry->stored_at);
+    EXPECT_EQ("5", head.headers.at("Content-Length"));
+    EXPECT_FALSE(std::holds_alternative<FileRange>(head.body));
+}
+
+TEST(ContentCacheLifetimeTests, RemovesItsDirectory) {
+    std::filesystem::path dir;
+    {
+        ContentCache cache {std::filesystem::temp_directory_path(), 16, {}, 0ms, 0ms};
+        dir = cache.Directory();
+        EXPECT_TRUE(std::filesystem::is_directory(dir));
+    }
+    EXPECT_FALSE(std::filesystem::exists(dir));
+}
@@ -1,28 +1,163 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include <gsl/gsl>
 
 
 namespace nginxpp {
 
 template<typename DestinationTimePoint, typename SourceTimePoint>
-static inline constexpr DestinationTimePoint ClockCast(const SourceTimePoint &tp) {
-    const auto source_now = SourceTimePoint::clock::now();
-    const auto destination_now = DestinationTimePoint::clock::now();
-    return destination_now + (tp - source_now);
+[[nodiscard]] static inline constexpr DestinationTimePoint
+ClockCast(const SourceTimePoint &tp) {
+    using DestinationClock = typename DestinationTimePoint::clock;
+    using DestinationDuration = typename DestinationTimePoint::duration;
+    using SourceClock = typename SourceTimePoint::clock;
+
+#if __cpp_lib_chrono >= 201907L
+    return std::chrono::time_point_cast<DestinationDuration>(
+        std::chrono::clock_cast<DestinationClock>(tp));
+#else
+    if constexpr (std::is_same_v<SourceClock, DestinationClock>) {
+        return std::chrono::time_point_cast<DestinationDuration>(tp);
+    } else if constexpr (std::is_same_v<DestinationClock, std::chrono::system_clock> and
+                         requires { SourceClock::to_sys(tp); }) {
+        return std::chrono::time_point_cast<DestinationDuration>(SourceClock::to_sys(tp));
+    } else {
+        const auto source_now = SourceClock::now();
+        const auto destination_now = DestinationClock::now();
+        return std::chrono::time_point_cast<DestinationDuration>(destination_now +
+                                                                 (tp - source_now));
+    }
+#endif
 }
 
-static inline auto &operator<<(std::ostream &out,
-                               const std::chrono::system_clock::time_point &tp) noexcept {
-    constexpr auto *format = "%F %T %Z";
+/// e.g. "1994-11-06 08:49:37 GMT"
+constexpr std::size_t LISTING_TIME_SIZE = 23;
+/// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+constexpr std::size_t HTTP_DATE_SIZE = 29;
 
-    const auto tt = std::chrono::system_clock::to_time_t(tp);
-    const auto *tm = std::gmtime(&tt); //not thread-safe
-    if (tm) {
-        out << std::put_time(tm, format);
+
+namespace internal {
+
+static inline constexpr void writeDigits(char *const out, unsigned value, const int width) {
+    for (auto i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
     }
+}
+
+/// The date part of both formats, which is all that calendar arithmetic is needed for.
+struct DatePrefix {
+    static constexpr std::size_t LISTING_SIZE = 11; // "1994-11-06 "
+    static constexpr std::size_t HTTP_SIZE = 17;    // "Sun, 06 Nov 1994 "
 
-    return out;
+    std::chrono::sys_days day = std::chrono::sys_days::min();
+    std::array<char, LISTING_SIZE> listing {};
+    std::array<char, HTTP_SIZE> http {};
+};
+
+static inline constexpr void fillDatePrefix(DatePrefix &prefix,
+                                            const std::chrono::sys_days day) noexcept {
+    constexpr std::string_view WEEKDAYS = "SunMonTueWedThuFriSat";
+    constexpr std::string_view MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    const std::chrono::year_month_day ymd {day};
+    const auto year = static_cast<unsigned>(std::clamp(static_cast<int>(ymd.year()), 0, 9999));
+    const auto month = static_cast<unsigned>(ymd.month());
+    const auto day_of_month = static_cast<unsigned>(ymd.day());
+    const auto weekday = std::chrono::weekday {day}.c_encoding();
+
+    prefix.day = day;
+
+    auto *out = prefix.listing.data();
+    writeDigits(out, year, 4);
+    out[4] = '-';
+    writeDigits(out + 5, month, 2);
+    out[7] = '-';
+    writeDigits(out + 8, day_of_month, 2);
+    out[10] = ' ';
+
+    out = prefix.http.data();
+    WEEKDAYS.copy(out, 3, weekday * 3);
+    out[3] = ',';
+    out[4] = ' ';
+    writeDigits(out + 5, day_of_month, 2);
+    out[7] = ' ';
+    MONTHS.copy(out + 8, 3, (month - 1) * 3);
+    out[11] = ' ';
+    writeDigits(out + 12, year, 4);
+    out[16] = ' ';
+}
+
+/// Listings are sorted-ish and headers repeat the current day, so the last prefix is cached
+/// per thread, which also keeps formatting reentrant.
+[[nodiscard]] static inline const DatePrefix &
+getDatePrefix(const std::chrono::sys_days day) noexcept {
+    thread_local DatePrefix cached;
+    if (cached.day != day) {
+        fillDatePrefix(cached, day);
+    }
+    return cached;
+}
+
+/// Writes "HH:MM:SS GMT"
+static inline constexpr void writeTimeOfDay(char *const out,
+                                            const std::chrono::seconds since_midnight) noexcept {
+    const std::chrono::hh_mm_ss hms {since_midnight};
+    writeDigits(out, hms.hours().count(), 2);
+    out[2] = ':';
+    writeDigits(out + 3, hms.minutes().count(), 2);
+    out[5] = ':';
+    writeDigits(out + 6, hms.seconds().count(), 2);
+    std::string_view {" GMT"}.copy(out + 8, 4);
+}
+
+} //namespace internal
+
+
+[[nodiscard]] static inline std::string_view
+FormatListingTime(const std::chrono::system_clock::time_point &tp,
+                  const gsl::span<char, LISTING_TIME_SIZE> buffer) noexcept {
+    const auto seconds = std::chrono::floor<std::chrono::seconds>(tp);
+    const auto day = std::chrono::floor<std::chrono::days>(seconds);
+    const auto &prefix = internal::getDatePrefix(day);
+
+    std::copy(prefix.listing.cbegin(), prefix.listing.cend(), buffer.begin());
+    internal::writeTimeOfDay(buffer.data() + prefix.listing.size(), seconds - day);
+
+    return {buffer.data(), buffer.size()};
+}
+
+[[nodiscard]] static inline std::string_view
+FormatHttpDate(const std::chrono::system_clock::time_point &tp,
+               const gsl::span<char, HTTP_DATE_SIZE> buffer) noexcept {
+    const auto seconds = std::chrono::floor<std::chrono::seconds>(tp);
+    const auto day = std::chrono::floor<std::chrono::days>(seconds);
+    const auto &prefix = internal::getDatePrefix(day);
+
+    std::copy(prefix.http.cbegin(), prefix.http.cend(), buffer.begin());
+    internal::writeTimeOfDay(buffer.data() + prefix.http.size(), seconds - day);
+
+    return {buffer.data(), buffer.size()};
+}
+
+[[nodiscard]] static inline auto
+ToHttpDate(const std::chrono::system_clock::time_point &tp) noexcept {
+    std::array<char, HTTP_DATE_SIZE> buffer;
+    return std::string {FormatHttpDate(tp, buffer)};
+}
+
+static inline auto &operator<<(std::ostream &out,
+                               const std::chrono::system_clock::time_point &tp) noexcept {
+    std::array<char, LISTING_TIME_SIZE> buffer;
+    return out << FormatListingTime(tp, buffer);
 }
 
 static inline auto &operator<<(std::ostream &out,
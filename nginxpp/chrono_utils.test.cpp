@@ -0,0 +1,91 @@
+#include <nginxpp/chrono_utils.hpp>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+// Sun, 06 Nov 1994 08:49:37 GMT
+const std::chrono::system_clock::time_point SAMPLE_TIME {std::chrono::seconds {784111777}};
+
+} // namespace
+
+
+TEST(FormatHttpDateTests, InIMFFixdateFormat) {
+    std::array<char, HTTP_DATE_SIZE> buffer;
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", FormatHttpDate(SAMPLE_TIME, buffer));
+}
+
+TEST(FormatHttpDateTests, IgnoreSubseconds) {
+    std::array<char, HTTP_DATE_SIZE> buffer;
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT",
+              FormatHttpDate(SAMPLE_TIME + std::chrono::milliseconds {999}, buffer));
+}
+
+TEST(FormatHttpDateTests, CanFormatEpoch) {
+    std::array<char, HTTP_DATE_SIZE> buffer;
+    EXPECT_EQ("Thu, 01 Jan 1970 00:00:00 GMT",
+              FormatHttpDate(std::chrono::system_clock::time_point {}, buffer));
+}
+
+TEST(FormatHttpDateTests, SameAsHttpDate) {
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", ToHttpDate(SAMPLE_TIME));
+}
+
+
+TEST(FormatListingTimeTests, InExpectedFormat) {
+    std::array<char, LISTING_TIME_SIZE> buffer;
+    EXPECT_EQ("1994-11-06 08:49:37 GMT", FormatListingTime(SAMPLE_TIME, buffer));
+}
+
+TEST(FormatListingTimeTests, CachedPrefixFollowsDayChange) {
+    std::array<char, LISTING_TIME_SIZE> buffer;
+    EXPECT_EQ("1994-11-06 23:59:59 GMT",
+              FormatListingTime(SAMPLE_TIME + std::chrono::seconds {54622}, buffer));
+    EXPECT_EQ("1994-11-07 00:00:00 GMT",
+              FormatListingTime(SAMPLE_TIME + std::chrono::seconds {54623}, buffer));
+}
+
+TEST(FormatListingTimeTests, SameAsOutputOperator) {
+    std::ostringstream oss;
+    oss << SAMPLE_TIME;
+    EXPECT_EQ("1994-11-06 08:49:37 GMT", oss.str());
+}
+
+TEST(FormatListingTimeTests, ReentrantAcrossThreads) {
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches {0};
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([i, &mismatches]() {
+            const auto tp = SAMPLE_TIME + std::chrono::days {i};
+            const std::string expected = "1994-11-0" + std::to_string(6 + i) + " 08:49:37 GMT";
+            std::array<char, LISTING_TIME_SIZE> buffer;
+            for (int j = 0; j < 1000; ++j) {
+                if (FormatListingTime(tp, buffer) != expected) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(0, mismatches);
+}
+
+
+TEST(ClockCastTests, RoundTripsFileTime) {
+    const auto now = std::chrono::system_clock::now();
+    const auto file_time = std::filesystem::file_time_type::clock::now();
+    const auto converted = ClockCast<std::chrono::system_clock::time_point>(file_time);
+
+    EXPECT_LT(std::chrono::abs(converted - now), std::chrono::seconds {1});
+}
@@ -0,0 +1,90 @@
+#include <nginxpp/config.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include <errno.h>
+#include <string.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::string_view WHITESPACE = " \t\r";
+
+[[nodiscard]] std::string_view trim(std::string_view str) noexcept {
+    const auto begin = str.find_first_not_of(WHITESPACE);
+    if (begin == str.npos) {
+        return {};
+    }
+    str.remove_prefix(begin);
+    return str.substr(0, str.find_last_not_of(WHITESPACE) + 1);
+}
+
+/// As long options are named, which keeps a line from passing for a short option or a value
+[[nodiscard]] bool isOptionName(const std::string_view name) noexcept {
+    return not name.empty() and name.front() != '-' and
+           std::all_of(name.begin(), name.end(), [](const char c) {
+               return (c >= 'a' and c <= 'z') or (c >= '0' and c <= '9') or c == '-';
+           });
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::vector<std::string> ParseConfig(const std::string_view text) {
+    std::vector<std::string> arguments;
+    std::size_t number = 0;
+    for (std::size_t begin = 0; begin < text.size();) {
+        const auto end = std::min(text.find('\n', begin), text.size());
+        const auto line = trim(text.substr(begin, end - begin));
+        begin = end + 1;
+        ++number;
+        if (line.empty() or line.front() == '#') {
+            continue;
+        }
+
+        const auto equals = line.find('=');
+        const auto name = trim(line.substr(0, equals));
+        if (not isOptionName(name)) {
+            throw ConfigException {"line " + std::to_string(number) + ": invalid option name '" +
+                                   std::string {name} + '\''};
+        }
+        if (equals == line.npos) {
+            arguments.push_back("--" + std::string {name});
+            continue;
+        }
+
+        const auto value = trim(line.substr(equals + 1));
+        if (value.empty()) {
+            throw ConfigException {"line " + std::to_string(number) + ": missing value of '" +
+                                   std::string {name} + '\''};
+        }
+        arguments.push_back("--" + std::string {name} + '=' + std::string {value});
+    }
+    return arguments;
+}
+
+std::vector<std::string> ReadConfigFile(const std::filesystem::path &path) {
+    std::ifstream file {path};
+    const std::string text {std::istreambuf_iterator<char> {file}, {}};
+    if (not file.is_open() or file.bad()) {
+        throw ConfigException {"Failed to read config file '" + path.string() +
+                               "': " + strerror(errno)};
+    }
+
+    try {
+        return ParseConfig(text);
+    } catch (const ConfigException &e) {
+        throw ConfigException {"Invalid config file '" + path.string() + "': " + e.what()};
+    }
+}
+
+} //namespace nginxpp
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace nginxpp {
+
+/// Turns a config file into the command line arguments it stands for, so that it takes the
+/// same options as the command line, by the same names. Each line holds `name = value` for an
+/// option taking a value, or a bare `name` for a flag; blank lines and lines starting with `#`
+/// are skipped. Throws ConfigException naming the line of the first malformed one.
+[[nodiscard]] std::vector<std::string> ParseConfig(const std::string_view text);
+
+/// As ParseConfig(), with the path in the message of the ConfigException if the file cannot be
+/// read or is malformed.
+[[nodiscard]] std::vector<std::string> ReadConfigFile(const std::filesystem::path &path);
+
+} //namespace nginxpp
@@ -0,0 +1,61 @@
+#include <nginxpp/config.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+TEST(ParseConfigTests, TurnsLinesIntoArguments) {
+    const auto arguments = ParseConfig("mount = /var/www\n"
+                                       "\tkeep-alive-timeout=0  \r\n"
+                                       "status\n");
+    EXPECT_EQ((std::vector<std::string> {"--mount=/var/www", "--keep-alive-timeout=0", "--status"}),
+              arguments);
+}
+
+TEST(ParseConfigTests, SkipsBlankLinesAndComments) {
+    const auto arguments = ParseConfig("# Served files\n"
+                                       "\n"
+                                       "   # indented\n"
+                                       "mount = /srv/my files # not a comment");
+    EXPECT_EQ((std::vector<std::string> {"--mount=/srv/my files # not a comment"}), arguments);
+}
+
+TEST(ParseConfigTests, EmptyConfigHasNoArguments) {
+    EXPECT_TRUE(ParseConfig("").empty());
+    EXPECT_TRUE(ParseConfig("\n\n# nothing\n").empty());
+}
+
+TEST(ParseConfigTests, ThrowIfGivenMalformedLine) {
+    EXPECT_THROW((void)ParseConfig("--port = 80"), ConfigException);
+    EXPECT_THROW((void)ParseConfig("= 80"), ConfigException);
+    EXPECT_THROW((void)ParseConfig("Port = 80"), ConfigException);
+    EXPECT_THROW((void)ParseConfig("port ="), ConfigException);
+
+    try {
+        (void)ParseConfig("port = 80\n\nmount:/var/www\n");
+        FAIL();
+    } catch (const ConfigException &e) {
+        EXPECT_EQ("line 3: invalid option name 'mount:/var/www'", std::string {e.what()});
+    }
+}
+
+TEST(ReadConfigFileTests, ReadsTheFile) {
+    const auto path = std::filesystem::temp_directory_path() / "nginxpp_config_test.conf";
+    std::ofstream {path} << "port = 8080\n";
+    EXPECT_EQ(std::vector<std::string> {"--port=8080"}, ReadConfigFile(path));
+
+    std::ofstream {path} << "port 8080\n";
+    EXPECT_THROW((void)ReadConfigFile(path), ConfigException);
+    std::filesystem::remove(path);
+}
+
+TEST(ReadConfigFileTests, ThrowIfGivenPathNotExists) {
+    EXPECT_THROW((void)ReadConfigFile("no_such_path/nginxpp.conf"), ConfigException);
+}
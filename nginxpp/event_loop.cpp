@@ -0,0 +1,266 @@
+#include <nginxpp/event_loop.hpp>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <gsl/gsl>
+
+#include <nginxpp/exception.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+
+/// Bounds the wait when there is no timer, so that Stop is noticed even if a wake-up is lost
+constexpr std::chrono::milliseconds MAX_WAIT {1000};
+
+constexpr std::uint32_t READ_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+constexpr std::uint32_t WRITE_EVENTS = EPOLLOUT | EPOLLHUP | EPOLLERR;
+
+using Events = std::array<epoll_event, MAX_EVENTS>;
+
+[[nodiscard]] int waitForEvents(const int epoll_fd, Events &events, const int timeout) noexcept {
+    int n {};
+    do {
+        n = epoll_wait(epoll_fd, events.data(), events.size(), timeout);
+    } while (n < 0 and errno == EINTR);
+    return n;
+}
+
+void notify(const int fd) noexcept {
+    const std::uint64_t one = 1;
+    // Only fails if the counter would overflow, in which case the loop is woken already
+    [[maybe_unused]] const auto written = write(fd, &one, sizeof(one));
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+bool IoHandle::Awaiter::await_ready() const noexcept {
+    if (m_idle and m_io.m_loop.m_draining) {
+        m_waiter.timed_out = true;
+        return true;
+    }
+    return not m_io.m_registered;
+}
+
+void IoHandle::Awaiter::await_suspend(const std::coroutine_handle<> handle) const noexcept {
+    m_io.m_loop.suspend(m_waiter, handle, m_deadline, m_idle);
+}
+
+IoHandle::IoHandle(EventLoop &loop, const int fd) noexcept : m_loop(loop), m_fd(fd) {
+    epoll_event event {};
+    event.events = READ_EVENTS | WRITE_EVENTS | EPOLLET;
+    event.data.ptr = this;
+    m_registered = epoll_ctl(m_loop.m_epoll_fd, EPOLL_CTL_ADD, m_fd, &event) == 0;
+}
+
+IoHandle::~IoHandle() noexcept {
+    m_loop.cancel(m_reader);
+    m_loop.cancel(m_writer);
+    if (m_registered) {
+        (void)epoll_ctl(m_loop.m_epoll_fd, EPOLL_CTL_DEL, m_fd, nullptr);
+    }
+}
+
+
+EventLoop::EventLoop() :
+    m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)), m_wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (m_epoll_fd == -1 or m_wake_fd == -1) {
+        const auto error = errno;
+        closeDescriptors();
+        throw ServerException {"Failed to create event loop: "s + strerror(error)};
+    }
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event) == -1) {
+        const auto error = errno;
+        closeDescriptors();
+        throw ServerException {"Failed to register event loop wake-up: "s + strerror(error)};
+    }
+}
+
+EventLoop::~EventLoop() noexcept {
+    closeDescriptors();
+}
+
+void EventLoop::Run() noexcept {
+    Events events;
+
+    while (not m_stopped.load(std::memory_order_acquire)) {
+        // Polls first, to tell events that queued up while the loop was busy from those that
+        // woke it up; only an idle loop pays for the second call
+        auto n = waitForEvents(m_epoll_fd, events, 0);
+        const auto pending = n > 0;
+        if (not pending) {
+            n = waitForEvents(m_epoll_fd, events, nextTimeout());
+        }
+        const auto now = Clock::now();
+        m_ready_since = pending ? m_woken_at : now;
+        m_woken_at = now;
+
+        // Handles are collected first and resumed after, as a resumed session may close its
+        // descriptor and free the handle that a later event points to. Posted tasks run once
+        // the batch is dispatched, for the same reason.
+        bool woken = false;
+        for (int i = 0; i < n; ++i) {
+            auto *const io = static_cast<IoHandle *>(events[i].data.ptr);
+            if (not io) {
+                woken = true;
+                continue;
+            }
+            if (events[i].events & READ_EVENTS) {
+                wake(io->m_reader, m_ready);
+            }
+            if (events[i].events & WRITE_EVENTS) {
+                wake(io->m_writer, m_ready);
+            }
+        }
+        if (woken) {
+            runPosted();
+        }
+        expireTimers(m_ready);
+
+        for (const auto handle : m_ready) {
+            handle.resume();
+        }
+        m_ready.clear();
+    }
+}
+
+void EventLoop::Stop() noexcept {
+    m_stopped.store(true, std::memory_order_release);
+    notify(m_wake_fd);
+}
+
+void EventLoop::Drain() noexcept {
+    Post([this]() {
+        drainIdle();
+    });
+}
+
+void EventLoop::Post(std::function<void()> task) noexcept {
+    {
+        const std::lock_guard lock {m_posted_mutex};
+        m_posted.push_back(std::move(task));
+    }
+    notify(m_wake_fd);
+}
+
+void EventLoop::suspend(internal::Waiter &waiter,
+                        const std::coroutine_handle<> handle,
+                        const Clock::time_point deadline,
+                        const bool idle) noexcept {
+    Expects(not waiter.handle);
+
+    waiter.handle = handle;
+    waiter.timed_out = false;
+    m_timers.Schedule(waiter, deadline);
+    if (idle) {
+        waiter.idle_index = m_idle.size();
+        m_idle.push_back(&waiter);
+    }
+}
+
+void EventLoop::cancel(internal::Waiter &waiter) noexcept {
+    if (waiter.handle) {
+        m_timers.Cancel(waiter);
+        forgetIdle(waiter);
+        waiter.handle = nullptr;
+    }
+}
+
+void EventLoop::wake(internal::Waiter &waiter, Ready &ready) noexcept {
+    if (waiter.handle) {
+        m_timers.Cancel(waiter);
+        forgetIdle(waiter);
+        ready.push_back(std::exchange(waiter.handle, nullptr));
+    }
+}
+
+void EventLoop::expireTimers(Ready &ready) noexcept {
+    m_timers.Advance(m_woken_at, m_expired);
+    for (auto *const timer : m_expired) {
+        auto &waiter = static_cast<internal::Waiter &>(*timer);
+        forgetIdle(waiter);
+        waiter.timed_out = true;
+        ready.push_back(std::exchange(waiter.handle, nullptr));
+    }
+    m_expired.clear();
+}
+
+void EventLoop::forgetIdle(internal::Waiter &waiter) noexcept {
+    const auto index = std::exchange(waiter.idle_index, internal::Waiter::NOT_IDLE);
+    if (index == internal::Waiter::NOT_IDLE) {
+        return;
+    }
+    // Swapped with the last, so that leaving costs the same however many are idle
+    auto *const last = m_idle.back();
+    m_idle.pop_back();
+    if (last != &waiter) {
+        m_idle[index] = last;
+        last->idle_index = index;
+    }
+}
+
+void EventLoop::drainIdle() noexcept {
+    m_draining = true;
+
+    // Resumed along with the rest of the batch, rather than from within the posted task
+    for (auto *const waiter : std::exchange(m_idle, {})) {
+        m_timers.Cancel(*waiter);
+        waiter->idle_index = internal::Waiter::NOT_IDLE;
+        waiter->timed_out = true;
+        m_ready.push_back(std::exchange(waiter->handle, nullptr));
+    }
+}
+
+int EventLoop::nextTimeout() const noexcept {
+    return std::chrono::ceil<std::chrono::milliseconds>(
+               m_timers.NextTimeout(Clock::now(), MAX_WAIT))
+        .count();
+}
+
+void EventLoop::closeDescriptors() noexcept {
+    if (m_wake_fd != -1) {
+        close(std::exchange(m_wake_fd, -1));
+    }
+    if (m_epoll_fd != -1) {
+        close(std::exchange(m_epoll_fd, -1));
+    }
+}
+
+void EventLoop::runPosted() noexcept {
+    std::uint64_t count {};
+    // Resets the counter; the loop was woken up, no matter how many times
+    [[maybe_unused]] const auto n = read(m_wake_fd, &count, sizeof(count));
+
+    std::vector<std::function<void()>> posted;
+    {
+        const std::lock_guard lock {m_posted_mutex};
+        posted.swap(m_posted);
+    }
+    for (const auto &task : posted) {
+        task();
+    }
+}
+
+} //namespace nginxpp
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <nginxpp/timer_wheel.hpp>
+
+
+namespace nginxpp {
+
+class EventLoop;
+
+namespace internal {
+
+/// A coroutine suspended until its descriptor is ready, or until its deadline.
+struct Waiter : public TimerWheel::Timer {
+    static constexpr std::size_t NOT_IDLE = SIZE_MAX;
+
+    std::coroutine_handle<> handle;
+    bool timed_out = false;
+    /// Among the idle waiters of the loop, if waiting idle
+    std::size_t idle_index = NOT_IDLE;
+};
+
+} //namespace internal
+
+
+/// Readiness notifications of one descriptor, registered with its loop for as long as this
+/// lives. Edge-triggered, so wait only after the descriptor has reported EAGAIN.
+/// At most one coroutine may wait for each direction at a time.
+class IoHandle {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Returned by Readable and Writable, resumes with false if the deadline passed first.
+    class [[nodiscard]] Awaiter {
+    public:
+        Awaiter(IoHandle &io,
+                internal::Waiter &waiter,
+                const Clock::time_point deadline,
+                const bool idle = false) noexcept :
+            m_io(io), m_waiter(waiter), m_deadline(deadline), m_idle(idle) {
+        }
+
+        /// Fails right away if the descriptor could not be registered, or if waiting idle on a
+        /// draining loop
+        [[nodiscard]] bool await_ready() const noexcept;
+
+        void await_suspend(const std::coroutine_handle<> handle) const noexcept;
+
+        [[nodiscard]] bool await_resume() const noexcept {
+            return m_io.m_registered and not m_waiter.timed_out;
+        }
+
+    private:
+        IoHandle &m_io;
+        internal::Waiter &m_waiter;
+        Clock::time_point m_deadline;
+        bool m_idle = false;
+    };
+
+    IoHandle(EventLoop &loop, const int fd) noexcept;
+
+    ~IoHandle() noexcept;
+
+    IoHandle(const IoHandle &) = delete;
+    IoHandle &operator=(const IoHandle &) = delete;
+
+    [[nodiscard]] Awaiter Readable(const Clock::time_point deadline) noexcept {
+        return {*this, m_reader, deadline};
+    }
+
+    /// Readable, for a connection idle between requests, which a draining loop gives up on as
+    /// if the deadline passed.
+    [[nodiscard]] Awaiter Idle(const Clock::time_point deadline) noexcept {
+        return {*this, m_reader, deadline, true};
+    }
+
+    [[nodiscard]] Awaiter Writable(const Clock::time_point deadline) noexcept {
+        return {*this, m_writer, deadline};
+    }
+
+    [[nodiscard]] EventLoop &Loop() const noexcept {
+        return m_loop;
+    }
+
+private:
+    friend class EventLoop;
+
+    EventLoop &m_loop;
+    int m_fd;
+    bool m_registered = false;
+    internal::Waiter m_reader;
+    internal::Waiter m_writer;
+};
+
+
+/// One epoll instance, and the coroutines waiting on it, run by a single thread.
+/// Only Post and Stop may be called from other threads.
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Returned by Sleep, resumes once the deadline passed.
+    class [[nodiscard]] SleepAwaiter {
+    public:
+        SleepAwaiter(EventLoop &loop, const Clock::time_point deadline) noexcept :
+            m_loop(loop), m_deadline(deadline) {
+        }
+
+        ~SleepAwaiter() noexcept {
+            m_loop.cancel(m_waiter);
+        }
+
+        SleepAwaiter(const SleepAwaiter &) = delete;
+        SleepAwaiter &operator=(const SleepAwaiter &) = delete;
+
+        [[nodiscard]] bool await_ready() const noexcept {
+            return Clock::now() >= m_deadline;
+        }
+
+        void await_suspend(const std::coroutine_handle<> handle) noexcept {
+            m_loop.suspend(m_waiter, handle, m_deadline, false);
+        }
+
+        void await_resume() const noexcept {
+        }
+
+    private:
+        EventLoop &m_loop;
+        internal::Waiter m_waiter;
+        Clock::time_point m_deadline;
+    };
+
+    /// Throws ServerException if epoll or the wake-up eventfd cannot be created.
+    EventLoop();
+
+    ~EventLoop() noexcept;
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /// Runs until stopped. Coroutines still suspended then are abandoned, not destroyed.
+    void Run() noexcept;
+
+    void Stop() noexcept;
+
+    /// Resumes the coroutines waiting idle as if they timed out, and fails later idle waits
+    /// right away, so that connections are closed once done with their current request.
+    void Drain() noexcept;
+
+    /// Runs the task on the loop thread, e.g. to start a session there.
+    void Post(std::function<void()> task) noexcept;
+
+    /// Suspends the coroutine on the loop thread until the deadline, e.g. to retry later.
+    [[nodiscard]] SleepAwaiter Sleep(const Clock::time_point deadline) noexcept {
+        return {*this, deadline};
+    }
+
+    /// The earliest the events being handled may have arrived: when the previous batch was
+    /// returned by epoll if they were pending already, or else when they woke the loop up.
+    /// Whatever they resumed has been waiting on the loop since about then.
+    [[nodiscard]] Clock::time_point ReadySince() const noexcept {
+        return m_ready_since;
+    }
+
+private:
+    friend class IoHandle;
+
+    using Ready = std::vector<std::coroutine_handle<>>;
+
+    void suspend(internal::Waiter &waiter,
+                 const std::coroutine_handle<> handle,
+                 const Clock::time_point deadline,
+                 const bool idle) noexcept;
+
+    void cancel(internal::Waiter &waiter) noexcept;
+
+    void wake(internal::Waiter &waiter, Ready &ready) noexcept;
+
+    void expireTimers(Ready &ready) noexcept;
+
+    void forgetIdle(internal::Waiter &waiter) noexcept;
+
+    void drainIdle() noexcept;
+
+    [[nodiscard]] int nextTimeout() const noexcept;
+
+    void closeDescriptors() noexcept;
+
+    void runPosted() noexcept;
+
+    int m_epoll_fd = -1;
+    int m_wake_fd = -1;
+    std::atomic<bool> m_stopped {false};
+    Clock::time_point m_woken_at {};
+    Clock::time_point m_ready_since {};
+    TimerWheel m_timers;
+    std::vector<TimerWheel::Timer *> m_expired;
+    /// Only touched by the loop thread
+    Ready m_ready;
+    std::vector<internal::Waiter *> m_idle;
+    bool m_draining = false;
+
+    std::mutex m_posted_mutex;
+    std::vector<std::function<void()>> m_posted;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,244 @@
+#include <nginxpp/event_loop.hpp>
+
+#include <array>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/task.hpp>
+
+
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+class EventLoopTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_fds.data()));
+        m_thread = std::thread([this]() {
+            m_loop.Run();
+        });
+    }
+
+    void TearDown() override {
+        m_loop.Stop();
+        m_thread.join();
+        close(m_fds[0]);
+        close(m_fds[1]);
+    }
+
+    EventLoop m_loop;
+    std::array<int, 2> m_fds {};
+    std::thread m_thread;
+};
+
+DetachedTask waitReadable(EventLoop &loop,
+                          const int fd,
+                          const std::chrono::milliseconds timeout,
+                          std::promise<bool> &ready) {
+    IoHandle io {loop, fd};
+    ready.set_value(co_await io.Readable(EventLoop::Clock::now() + timeout));
+}
+
+DetachedTask waitIdle(EventLoop &loop, const int fd, std::promise<bool> &ready) {
+    IoHandle io {loop, fd};
+    ready.set_value(co_await io.Idle(EventLoop::Clock::now() + 10s));
+}
+
+/// As waitIdle, with the handle on the heap rather than in the recycled frame, so that a
+/// sanitizer notices the handle used once freed
+DetachedTask waitIdleOnHeap(EventLoop &loop, const int fd, std::promise<bool> &ready) {
+    const auto io = std::make_unique<IoHandle>(loop, fd);
+    ready.set_value(co_await io->Idle(EventLoop::Clock::now() + 10s));
+}
+
+DetachedTask recordReadySince(EventLoop &loop,
+                              const int fd,
+                              std::promise<EventLoop::Clock::time_point> &ready_since) {
+    IoHandle io {loop, fd};
+    (void)co_await io.Readable(EventLoop::Clock::now() + 10s);
+    ready_since.set_value(loop.ReadySince());
+}
+
+DetachedTask sleepUntil(EventLoop &loop,
+                        const EventLoop::Clock::time_point deadline,
+                        std::promise<EventLoop::Clock::time_point> &woken) {
+    co_await loop.Sleep(deadline);
+    woken.set_value(EventLoop::Clock::now());
+}
+
+} //namespace
+
+
+TEST_F(EventLoopTests, PostedTasksRunOnTheLoopThread) {
+    std::promise<std::thread::id> ran_on;
+    m_loop.Post([&ran_on]() {
+        ran_on.set_value(std::this_thread::get_id());
+    });
+    EXPECT_EQ(m_thread.get_id(), ran_on.get_future().get());
+}
+
+TEST_F(EventLoopTests, ResumesWhenReadable) {
+    std::promise<bool> ready;
+    m_loop.Post([this, &ready]() {
+        waitReadable(m_loop, m_fds[0], 10s, ready);
+    });
+
+    ASSERT_EQ(1, write(m_fds[1], "x", 1));
+    EXPECT_TRUE(ready.get_future().get());
+}
+
+TEST_F(EventLoopTests, ResumesWithFalseOnTimeout) {
+    std::promise<bool> ready;
+    const auto start = EventLoop::Clock::now();
+    m_loop.Post([this, &ready]() {
+        waitReadable(m_loop, m_fds[0], 50ms, ready);
+    });
+
+    EXPECT_FALSE(ready.get_future().get());
+    EXPECT_LE(50ms, EventLoop::Clock::now() - start);
+}
+
+TEST_F(EventLoopTests, ResumesWhenPeerCloses) {
+    std::promise<bool> ready;
+    m_loop.Post([this, &ready]() {
+        waitReadable(m_loop, m_fds[0], 10s, ready);
+    });
+
+    ASSERT_EQ(0, shutdown(m_fds[1], SHUT_WR));
+    EXPECT_TRUE(ready.get_future().get());
+}
+
+TEST_F(EventLoopTests, IdleLoopIsReadySinceWokenUp) {
+    std::this_thread::sleep_for(50ms);
+    const auto posted = EventLoop::Clock::now();
+    std::promise<EventLoop::Clock::time_point> ready_since;
+    m_loop.Post([this, &ready_since]() {
+        ready_since.set_value(m_loop.ReadySince());
+    });
+    EXPECT_LE(posted, ready_since.get_future().get());
+}
+
+TEST_F(EventLoopTests, EventsQueuedWhileBusyAreReadySinceTheBusyBatch) {
+    std::promise<EventLoop::Clock::time_point> ready_since;
+    std::promise<EventLoop::Clock::time_point> busy_since;
+    std::promise<void> busy;
+    m_loop.Post([this, &ready_since, &busy_since, &busy]() {
+        busy_since.set_value(EventLoop::Clock::now());
+        recordReadySince(m_loop, m_fds[0], ready_since);
+        busy.set_value();
+        // Keeps the loop busy while the event arrives
+        std::this_thread::sleep_for(50ms);
+    });
+    busy.get_future().get();
+    ASSERT_EQ(1, write(m_fds[1], "x", 1));
+
+    EXPECT_GE(busy_since.get_future().get(), ready_since.get_future().get());
+}
+
+TEST(EventLoopStopTests, StopEndsRun) {
+    EventLoop loop;
+    std::thread thread([&loop]() {
+        loop.Run();
+    });
+    loop.Stop();
+    thread.join();
+}
+
+TEST_F(EventLoopTests, DrainResumesIdleWaitersAsTimedOut) {
+    std::promise<bool> ready;
+    std::promise<void> waiting;
+    m_loop.Post([this, &ready, &waiting]() {
+        waitIdle(m_loop, m_fds[0], ready);
+        waiting.set_value();
+    });
+    waiting.get_future().wait();
+
+    const auto start = EventLoop::Clock::now();
+    m_loop.Drain();
+    EXPECT_FALSE(ready.get_future().get());
+    EXPECT_GT(1s, EventLoop::Clock::now() - start);
+}
+
+TEST_F(EventLoopTests, IdleWaitsFailRightAwayOnceDrained) {
+    m_loop.Drain();
+    std::promise<bool> ready;
+    m_loop.Post([this, &ready]() {
+        waitIdle(m_loop, m_fds[0], ready);
+    });
+    EXPECT_FALSE(ready.get_future().get());
+}
+
+TEST_F(EventLoopTests, DrainLeavesOtherWaitersAlone) {
+    std::promise<bool> ready;
+    m_loop.Post([this, &ready]() {
+        waitReadable(m_loop, m_fds[0], 10s, ready);
+    });
+    m_loop.Drain();
+
+    auto resumed = ready.get_future();
+    EXPECT_EQ(std::future_status::timeout, resumed.wait_for(50ms));
+    ASSERT_EQ(1, write(m_fds[1], "x", 1));
+    EXPECT_TRUE(resumed.get());
+}
+
+TEST_F(EventLoopTests, DrainsWhileTheBatchHoldsEventsForTheIdle) {
+    constexpr std::size_t IDLE = 32;
+    std::array<std::array<int, 2>, IDLE> fds {};
+    std::array<std::promise<bool>, IDLE> ready;
+    for (auto &pair : fds) {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data()));
+    }
+    std::promise<void> waiting;
+    m_loop.Post([this, &fds, &ready, &waiting]() {
+        for (std::size_t i = 0; i < IDLE; ++i) {
+            waitIdleOnHeap(m_loop, fds[i][0], ready[i]);
+        }
+        waiting.set_value();
+    });
+    waiting.get_future().wait();
+
+    // Keeps the loop busy, so that the drain and the events for the idle sockets arrive in the
+    // same batch, the drain first
+    std::promise<void> busy;
+    m_loop.Post([&busy]() {
+        busy.set_value();
+        std::this_thread::sleep_for(50ms);
+    });
+    busy.get_future().wait();
+    m_loop.Drain();
+    for (const auto &pair : fds) {
+        ASSERT_EQ(1, write(pair[1], "x", 1));
+    }
+
+    // Each resumed once, whether by its event or by the drain
+    for (auto &resumed : ready) {
+        EXPECT_EQ(std::future_status::ready, resumed.get_future().wait_for(1s));
+    }
+    std::promise<bool> still_running;
+    m_loop.Post([&still_running]() {
+        still_running.set_value(true);
+    });
+    EXPECT_TRUE(still_running.get_future().get());
+    for (const auto &pair : fds) {
+        close(pair[0]);
+        close(pair[1]);
+    }
+}
+
+TEST_F(EventLoopTests, SleepResumesAfterDeadline) {
+    std::promise<EventLoop::Clock::time_point> woken;
+    const auto deadline = EventLoop::Clock::now() + 50ms;
+    m_loop.Post([this, deadline, &woken]() {
+        sleepUntil(m_loop, deadline, woken);
+    });
+    EXPECT_LE(deadline, woken.get_future().get());
+}
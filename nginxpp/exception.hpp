@@ -38,5 +38,9 @@ class HttpVersionException : public ServerException {
     using ServerException::ServerException;
 };
 
+class ConfigException : public Exception {
+    using Exception::Exception;
+};
+
 
 } //namespace nginxpp
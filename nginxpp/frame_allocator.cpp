@@ -0,0 +1,101 @@
+#include <nginxpp/frame_allocator.hpp>
+
+#include <array>
+#include <new>
+#include <utility>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::size_t MIN_FRAME_SIZE = 64;
+/// From 64 bytes to 16 KiB
+constexpr std::size_t FRAME_CLASS_COUNT = 9;
+constexpr std::size_t MAX_CACHED_FRAMES = 1024;
+
+[[nodiscard]] inline constexpr std::size_t capacityOf(const std::size_t frame_class) noexcept {
+    return MIN_FRAME_SIZE << frame_class;
+}
+
+/// FRAME_CLASS_COUNT if the frame is too large for any class.
+[[nodiscard]] inline constexpr std::size_t classOf(const std::size_t size) noexcept {
+    std::size_t frame_class = 0;
+    while (frame_class < FRAME_CLASS_COUNT and capacityOf(frame_class) < size) {
+        ++frame_class;
+    }
+    return frame_class;
+}
+
+/// Threaded through the free frames themselves.
+struct FreeFrame {
+    FreeFrame *next;
+};
+
+class FrameCache {
+public:
+    FrameCache() noexcept = default;
+
+    ~FrameCache() noexcept {
+        for (auto *head : m_heads) {
+            while (head) {
+                ::operator delete(std::exchange(head, head->next));
+            }
+        }
+    }
+
+    FrameCache(const FrameCache &) = delete;
+    FrameCache &operator=(const FrameCache &) = delete;
+
+    [[nodiscard]] void *Take(const std::size_t frame_class) {
+        auto &head = m_heads[frame_class];
+        if (not head) {
+            return ::operator new(capacityOf(frame_class));
+        }
+        --m_counts[frame_class];
+        return std::exchange(head, head->next);
+    }
+
+    void Give(const std::size_t frame_class, void *const frame) noexcept {
+        if (m_counts[frame_class] == MAX_CACHED_FRAMES) {
+            ::operator delete(frame);
+            return;
+        }
+        ++m_counts[frame_class];
+        m_heads[frame_class] = new (frame) FreeFrame {m_heads[frame_class]};
+    }
+
+private:
+    std::array<FreeFrame *, FRAME_CLASS_COUNT> m_heads {};
+    std::array<std::size_t, FRAME_CLASS_COUNT> m_counts {};
+};
+
+[[nodiscard]] inline auto &frameCache() noexcept {
+    thread_local FrameCache cache;
+    return cache;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+void *AllocateFrame(const std::size_t size) {
+    const auto frame_class = classOf(size);
+    if (frame_class == FRAME_CLASS_COUNT) {
+        return ::operator new(size);
+    }
+    return frameCache().Take(frame_class);
+}
+
+void DeallocateFrame(void *const frame, const std::size_t size) noexcept {
+    const auto frame_class = classOf(size);
+    if (frame_class == FRAME_CLASS_COUNT) {
+        ::operator delete(frame);
+        return;
+    }
+    frameCache().Give(frame_class, frame);
+}
+
+} //namespace nginxpp
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace nginxpp {
+
+/// Coroutine frames are recycled through free lists of the calling thread, by power-of-two size
+/// class. A session runs on a single event loop thread, so its frames are allocated and freed
+/// on the same core without any locking. Frames larger than the largest class go to the heap.
+[[nodiscard]] void *AllocateFrame(const std::size_t size);
+
+/// Takes the size given to AllocateFrame.
+void DeallocateFrame(void *const frame, const std::size_t size) noexcept;
+
+
+/// Base of promise types, to have their coroutine frames from AllocateFrame.
+struct FrameAllocated {
+    [[nodiscard]] static void *operator new(const std::size_t size) {
+        return AllocateFrame(size);
+    }
+
+    static void operator delete(void *const frame, const std::size_t size) noexcept {
+        DeallocateFrame(frame, size);
+    }
+};
+
+} //namespace nginxpp
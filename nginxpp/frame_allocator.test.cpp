@@ -0,0 +1,42 @@
+#include <nginxpp/frame_allocator.hpp>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+TEST(FrameAllocatorTests, FreedFramesAreReused) {
+    auto *const frame = AllocateFrame(200);
+    DeallocateFrame(frame, 200);
+
+    // Same size class
+    auto *const again = AllocateFrame(250);
+    EXPECT_EQ(frame, again);
+    DeallocateFrame(again, 250);
+}
+
+TEST(FrameAllocatorTests, SizeClassesAreSeparate) {
+    auto *const small = AllocateFrame(64);
+    DeallocateFrame(small, 64);
+
+    auto *const large = AllocateFrame(1000);
+    EXPECT_NE(small, large);
+    DeallocateFrame(large, 1000);
+}
+
+TEST(FrameAllocatorTests, HugeFramesGoToTheHeap) {
+    constexpr std::size_t HUGE_SIZE = 1 << 20;
+    auto *const frame = static_cast<char *>(AllocateFrame(HUGE_SIZE));
+    frame[HUGE_SIZE - 1] = 'x';
+    DeallocateFrame(frame, HUGE_SIZE);
+}
+
+TEST(FrameAllocatorTests, FramesMayBeFreedOnAnotherThread) {
+    auto *const frame = AllocateFrame(128);
+    std::thread([frame]() {
+        DeallocateFrame(frame, 128);
+    }).join();
+}
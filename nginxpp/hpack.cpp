@@ -0,0 +1,508 @@
+#include <nginxpp/hpack.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+const std::array<HeaderField, HpackTable::STATIC_COUNT> STATIC_TABLE = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+struct HuffmanCode {
+    std::uint32_t code;
+    std::uint8_t length;
+};
+
+constexpr std::uint16_t HUFFMAN_EOS = 256;
+constexpr std::uint8_t HUFFMAN_MAX_LENGTH = 30;
+
+/// By symbol, EOS last (RFC 7541, appendix B)
+constexpr std::array<HuffmanCode, 257> HUFFMAN_CODES = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28},
+    {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24},
+    {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28},
+    {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28}, {0xffffff4, 28},
+    {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8},
+    {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7},
+    {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7},
+    {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7},
+    {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15},
+    {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5},
+    {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20},
+    {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22},
+    {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22},
+    {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23},
+    {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22},
+    {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23},
+    {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20},
+    {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26},
+    {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26},
+    {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20},
+    {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+    {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26},
+    {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+}};
+
+/// The code is canonical: the codes of a length are consecutive, in the order of their symbols,
+/// and follow the last code of the length before. A symbol is then found by comparing the next
+/// bits to the first code of each length, shortest first.
+struct HuffmanDecodeTable {
+    std::array<std::uint32_t, HUFFMAN_MAX_LENGTH + 1> first {};
+    std::array<std::uint16_t, HUFFMAN_MAX_LENGTH + 1> count {};
+    /// Of the first symbol of each length in the symbols
+    std::array<std::uint16_t, HUFFMAN_MAX_LENGTH + 1> offset {};
+    /// By length, then by symbol
+    std::array<std::uint16_t, HUFFMAN_CODES.size()> symbols {};
+};
+
+[[nodiscard]] constexpr HuffmanDecodeTable buildHuffmanDecodeTable() noexcept {
+    HuffmanDecodeTable table;
+    std::uint16_t next = 0;
+    for (std::uint8_t length = 1; length <= HUFFMAN_MAX_LENGTH; ++length) {
+        table.offset[length] = next;
+        for (std::uint16_t symbol = 0; symbol < HUFFMAN_CODES.size(); ++symbol) {
+            if (HUFFMAN_CODES[symbol].length != length) {
+                continue;
+            }
+            if (table.count[length] == 0) {
+                table.first[length] = HUFFMAN_CODES[symbol].code;
+            }
+            ++table.count[length];
+            table.symbols[next++] = symbol;
+        }
+    }
+    return table;
+}
+
+constexpr HuffmanDecodeTable HUFFMAN_DECODE_TABLE = buildHuffmanDecodeTable();
+
+/// The symbol that the most significant of the bits start with, and its length; a length of 0
+/// if the bits are not enough to tell.
+[[nodiscard]] std::pair<std::uint16_t, std::uint8_t> decodeSymbol(const std::uint64_t bits,
+                                                                  const int bit_count) noexcept {
+    const auto &table = HUFFMAN_DECODE_TABLE;
+    const auto max_length = std::min<int>(bit_count, HUFFMAN_MAX_LENGTH);
+    for (int length = 1; length <= max_length; ++length) {
+        const auto code = static_cast<std::uint32_t>(bits >> (bit_count - length)) &
+                          ((std::uint32_t {1} << length) - 1);
+        if (code >= table.first[length] and code - table.first[length] < table.count[length]) {
+            return {table.symbols[table.offset[length] + code - table.first[length]],
+                    static_cast<std::uint8_t>(length)};
+        }
+    }
+    return {0, 0};
+}
+
+
+/// The representations of a field, by the bits their first byte starts with (RFC 7541,
+/// section 6), and the size of the prefix of the integer that follows. Literals never to be
+/// indexed start with 0001, and are otherwise decoded as those not indexed, with 0000.
+constexpr std::uint8_t INDEXED = 0x80;
+constexpr int INDEXED_PREFIX = 7;
+constexpr std::uint8_t LITERAL_INDEXED = 0x40;
+constexpr int LITERAL_INDEXED_PREFIX = 6;
+constexpr std::uint8_t SIZE_UPDATE = 0x20;
+constexpr int SIZE_UPDATE_PREFIX = 5;
+constexpr int LITERAL_PREFIX = 4;
+constexpr std::uint8_t HUFFMAN_FLAG = 0x80;
+constexpr int STRING_PREFIX = 7;
+
+/// Far beyond any index or length that a block may hold
+constexpr std::uint64_t MAX_INTEGER = std::uint64_t {1} << 32;
+/// Past which another 7 bits no longer fit, whatever the value so far
+constexpr int MAX_INTEGER_SHIFT = 56;
+
+void appendInteger(std::string &out,
+                   const std::uint8_t flags,
+                   const int prefix,
+                   std::uint64_t value) noexcept {
+    const std::uint64_t max_prefix = (1U << prefix) - 1;
+    if (value < max_prefix) {
+        out += static_cast<char>(flags | value);
+        return;
+    }
+    out += static_cast<char>(flags | max_prefix);
+    for (value -= max_prefix; value >= 0x80; value >>= 7) {
+        out += static_cast<char>(0x80 | (value & 0x7f));
+    }
+    out += static_cast<char>(value);
+}
+
+/// Returns false if the integer is cut short or too large.
+[[nodiscard]] bool decodeInteger(const std::string_view block,
+                                 std::size_t &pos,
+                                 const int prefix,
+                                 std::uint64_t &value) noexcept {
+    Expects(pos < block.size());
+
+    const std::uint64_t max_prefix = (1U << prefix) - 1;
+    value = static_cast<std::uint8_t>(block[pos++]) & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (int shift = 0; pos < block.size(); shift += 7) {
+        // Zero continuation bytes leave the value alone, but not the shift
+        if (shift > MAX_INTEGER_SHIFT) {
+            return false;
+        }
+        const auto byte = static_cast<std::uint8_t>(block[pos++]);
+        value += std::uint64_t {byte & 0x7fU} << shift;
+        if (value > MAX_INTEGER) {
+            return false;
+        }
+        if (not(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void appendString(std::string &out, const std::string_view str) noexcept {
+    if (const auto huffman_size = HuffmanEncodedSize(str); huffman_size < str.size()) {
+        appendInteger(out, HUFFMAN_FLAG, STRING_PREFIX, huffman_size);
+        AppendHuffman(out, str);
+    } else {
+        appendInteger(out, 0, STRING_PREFIX, str.size());
+        out += str;
+    }
+}
+
+[[nodiscard]] bool
+decodeString(const std::string_view block, std::size_t &pos, std::string &str) noexcept {
+    if (pos == block.size()) {
+        return false;
+    }
+    const bool huffman = static_cast<std::uint8_t>(block[pos]) & HUFFMAN_FLAG;
+    std::uint64_t length = 0;
+    if (not decodeInteger(block, pos, STRING_PREFIX, length) or length > block.size() - pos) {
+        return false;
+    }
+    const auto code = block.substr(pos, length);
+    pos += length;
+    if (huffman) {
+        return DecodeHuffman(str, code);
+    }
+    str = code;
+    return true;
+}
+
+/// Values that hardly ever repeat would only evict those that do
+[[nodiscard]] bool isWorthIndexing(const std::string_view name) noexcept {
+    return name != "content-length" and name != "content-range" and name != "age" and
+           name != "etag" and name != "last-modified";
+}
+
+} //namespace
+
+
+const HeaderField *HpackTable::Get(const std::size_t index) const noexcept {
+    if (index == 0) {
+        return nullptr;
+    }
+    if (index <= STATIC_COUNT) {
+        return &STATIC_TABLE[index - 1];
+    }
+    const auto dynamic_index = index - STATIC_COUNT - 1;
+    return dynamic_index < m_fields.size() ? &m_fields[dynamic_index] : nullptr;
+}
+
+std::pair<std::size_t, bool> HpackTable::Find(const std::string_view name,
+                                              const std::string_view value) const noexcept {
+    std::size_t name_index = 0;
+    for (std::size_t i = 0; i < STATIC_COUNT; ++i) {
+        if (STATIC_TABLE[i].name != name) {
+            continue;
+        }
+        if (STATIC_TABLE[i].value == value) {
+            return {i + 1, true};
+        }
+        if (name_index == 0) {
+            name_index = i + 1;
+        }
+    }
+    for (std::size_t i = 0; i < m_fields.size(); ++i) {
+        if (m_fields[i].name != name) {
+            continue;
+        }
+        if (m_fields[i].value == value) {
+            return {STATIC_COUNT + i + 1, true};
+        }
+        if (name_index == 0) {
+            name_index = STATIC_COUNT + i + 1;
+        }
+    }
+    return {name_index, false};
+}
+
+void HpackTable::Add(HeaderField field) noexcept {
+    const auto size = field.Size();
+    if (size > m_max_size) {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    m_size += size;
+    m_fields.push_front(std::move(field));
+}
+
+void HpackTable::SetMaxSize(const std::size_t max_size) noexcept {
+    m_max_size = max_size;
+    evict(max_size);
+}
+
+void HpackTable::evict(const std::size_t max_size) noexcept {
+    while (m_size > max_size) {
+        m_size -= m_fields.back().Size();
+        m_fields.pop_back();
+    }
+}
+
+
+HpackResult HpackDecoder::Decode(const std::string_view block, HeaderList &fields) noexcept {
+    std::size_t list_size = 0;
+    bool too_large = false;
+    // Size updates may only come first
+    bool field_seen = false;
+    for (std::size_t pos = 0; pos < block.size();) {
+        const auto first = static_cast<std::uint8_t>(block[pos]);
+        std::uint64_t index = 0;
+        HeaderField field;
+        bool indexing = false;
+        if (first & INDEXED) {
+            if (not decodeInteger(block, pos, INDEXED_PREFIX, index)) {
+                return HpackResult::INVALID;
+            }
+            const auto *const indexed = m_table.Get(index);
+            if (not indexed) {
+                return HpackResult::INVALID;
+            }
+            field = *indexed;
+        } else if ((first & SIZE_UPDATE) and not(first & LITERAL_INDEXED)) {
+            std::uint64_t max_size = 0;
+            if (field_seen or not decodeInteger(block, pos, SIZE_UPDATE_PREFIX, max_size) or
+                max_size > m_max_table_size) {
+                return HpackResult::INVALID;
+            }
+            m_table.SetMaxSize(max_size);
+            continue;
+        } else {
+            indexing = first & LITERAL_INDEXED;
+            if (not decodeInteger(
+                    block, pos, indexing ? LITERAL_INDEXED_PREFIX : LITERAL_PREFIX, index)) {
+                return HpackResult::INVALID;
+            }
+            if (index) {
+                const auto *const indexed = m_table.Get(index);
+                if (not indexed) {
+                    return HpackResult::INVALID;
+                }
+                field.name = indexed->name;
+            } else if (not decodeString(block, pos, field.name)) {
+                return HpackResult::INVALID;
+            }
+            if (not decodeString(block, pos, field.value)) {
+                return HpackResult::INVALID;
+            }
+        }
+        field_seen = true;
+
+        list_size += field.Size();
+        too_large = too_large or list_size > m_max_list_size;
+        if (indexing) {
+            m_table.Add(field);
+        }
+        if (not too_large) {
+            fields.push_back(std::move(field));
+        }
+    }
+    return too_large ? HpackResult::TOO_LARGE : HpackResult::OK;
+}
+
+
+void HpackEncoder::Encode(std::string &block,
+                          const std::string_view name,
+                          const std::string_view value) noexcept {
+    if (m_size_changed) {
+        appendInteger(block, SIZE_UPDATE, SIZE_UPDATE_PREFIX, m_table.MaxSize());
+        m_size_changed = false;
+    }
+
+    const auto [index, full_match] = m_table.Find(name, value);
+    if (full_match) {
+        appendInteger(block, INDEXED, INDEXED_PREFIX, index);
+        return;
+    }
+
+    // A field larger than the table would only empty it
+    const auto size = HeaderField {}.Size() + name.size() + value.size();
+    const bool indexing = isWorthIndexing(name) and size <= m_table.MaxSize();
+    if (indexing) {
+        appendInteger(block, LITERAL_INDEXED, LITERAL_INDEXED_PREFIX, index);
+    } else {
+        appendInteger(block, 0, LITERAL_PREFIX, index);
+    }
+    if (index == 0) {
+        appendString(block, name);
+    }
+    appendString(block, value);
+    if (indexing) {
+        m_table.Add({std::string {name}, std::string {value}});
+    }
+}
+
+void HpackEncoder::SetMaxTableSize(const std::size_t max_size) noexcept {
+    const auto size = std::min(max_size, HPACK_DEFAULT_TABLE_SIZE);
+    if (size != m_table.MaxSize()) {
+        m_table.SetMaxSize(size);
+        m_size_changed = true;
+    }
+}
+
+
+namespace nginxpp {
+
+std::size_t HuffmanEncodedSize(const std::string_view str) noexcept {
+    std::size_t bits = 0;
+    for (const auto c : str) {
+        bits += HUFFMAN_CODES[static_cast<std::uint8_t>(c)].length;
+    }
+    return (bits + 7) / 8;
+}
+
+void AppendHuffman(std::string &out, const std::string_view str) noexcept {
+    std::uint64_t bits = 0;
+    int bit_count = 0;
+    for (const auto c : str) {
+        const auto &code = HUFFMAN_CODES[static_cast<std::uint8_t>(c)];
+        bits = (bits << code.length) | code.code;
+        for (bit_count += code.length; bit_count >= 8; bit_count -= 8) {
+            out += static_cast<char>(bits >> (bit_count - 8));
+        }
+    }
+    if (bit_count) {
+        // Padded with the most significant bits of EOS, all ones
+        out += static_cast<char>((bits << (8 - bit_count)) | (0xff >> bit_count));
+    }
+}
+
+bool DecodeHuffman(std::string &out, const std::string_view code) noexcept {
+    out.clear();
+    std::uint64_t bits = 0;
+    int bit_count = 0;
+    const auto decodeNext = [&]() {
+        const auto [symbol, length] = decodeSymbol(bits, bit_count);
+        if (length == 0 or symbol == HUFFMAN_EOS) {
+            return false;
+        }
+        out += static_cast<char>(symbol);
+        bit_count -= length;
+        bits &= (std::uint64_t {1} << bit_count) - 1;
+        return true;
+    };
+
+    for (const auto c : code) {
+        bits = (bits << 8) | static_cast<std::uint8_t>(c);
+        bit_count += 8;
+        // Every run of as many bits as the longest code starts with a symbol
+        while (bit_count >= HUFFMAN_MAX_LENGTH) {
+            if (not decodeNext()) {
+                return false;
+            }
+        }
+    }
+    while (bit_count > 0 and decodeSymbol(bits, bit_count).second) {
+        if (not decodeNext()) {
+            return false;
+        }
+    }
+    return bit_count < 8 and bits == (std::uint64_t {1} << bit_count) - 1;
+}
+
+} //namespace nginxpp
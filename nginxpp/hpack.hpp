@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace nginxpp {
+
+/// The dynamic table size both ends of a connection start with (RFC 7541, section 4.2)
+constexpr std::size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+
+struct HeaderField {
+    std::string name;
+    std::string value;
+
+    /// As counted against table and list sizes: 32 bytes on top of the name and the value
+    [[nodiscard]] std::size_t Size() const noexcept {
+        return name.size() + value.size() + 32;
+    }
+};
+
+using HeaderList = std::vector<HeaderField>;
+
+
+/// The static table, followed by the fields that one end of a connection has indexed, newest
+/// first, evicted oldest first once their size exceeds the maximum (RFC 7541, section 2.3).
+class HpackTable {
+public:
+    static constexpr std::size_t STATIC_COUNT = 61;
+
+    explicit HpackTable(const std::size_t max_size = HPACK_DEFAULT_TABLE_SIZE) noexcept :
+        m_max_size(max_size) {
+    }
+
+    /// By its index, 1 and on; nullptr past the last field.
+    [[nodiscard]] const HeaderField *Get(const std::size_t index) const noexcept;
+
+    /// The index of the field, else of a field of that name, which is then not a full match;
+    /// 0 if none. Prefers the static table.
+    [[nodiscard]] std::pair<std::size_t, bool> Find(const std::string_view name,
+                                                    const std::string_view value) const noexcept;
+
+    /// A field larger than the maximum size empties the table, and is not added.
+    void Add(HeaderField field) noexcept;
+
+    void SetMaxSize(const std::size_t max_size) noexcept;
+
+    [[nodiscard]] std::size_t MaxSize() const noexcept {
+        return m_max_size;
+    }
+
+    [[nodiscard]] std::size_t Size() const noexcept {
+        return m_size;
+    }
+
+    /// Of the dynamic table
+    [[nodiscard]] std::size_t Count() const noexcept {
+        return m_fields.size();
+    }
+
+private:
+    void evict(const std::size_t max_size) noexcept;
+
+    std::deque<HeaderField> m_fields;
+    std::size_t m_size = 0;
+    std::size_t m_max_size;
+};
+
+
+enum class HpackResult { OK, TOO_LARGE, INVALID };
+
+/// Decodes the header blocks of one direction of a connection, in the order they were sent.
+class HpackDecoder {
+public:
+    /// The maximum table size is the one advertised to the encoder, which it may lower;
+    /// the maximum list size bounds what a block may decode to, however small it is.
+    HpackDecoder(const std::size_t max_table_size, const std::size_t max_list_size) noexcept :
+        m_table(max_table_size), m_max_table_size(max_table_size), m_max_list_size(max_list_size) {
+    }
+
+    /// Appends the fields of a whole block. TOO_LARGE if they exceed the maximum list size, in
+    /// which case the rest are decoded into the table but dropped. INVALID on a compression
+    /// error, which leaves the table out of step with the encoder, and so the connection
+    /// unusable.
+    [[nodiscard]] HpackResult Decode(const std::string_view block, HeaderList &fields) noexcept;
+
+    [[nodiscard]] const HpackTable &Table() const noexcept {
+        return m_table;
+    }
+
+private:
+    HpackTable m_table;
+    std::size_t m_max_table_size;
+    std::size_t m_max_list_size;
+};
+
+
+/// Encodes the header blocks of one direction of a connection, to be sent in the order they
+/// were encoded. Indexes fields for later blocks to refer to, but for those whose values
+/// hardly ever repeat, and Huffman-codes strings whenever that makes them shorter.
+class HpackEncoder {
+public:
+    /// Appends a field to the block. Names are in lower case.
+    void Encode(std::string &block,
+                const std::string_view name,
+                const std::string_view value) noexcept;
+
+    /// As the decoder allows, but no larger than the default, so that a connection holds no
+    /// more; a change is signalled at the start of the next block.
+    void SetMaxTableSize(const std::size_t max_size) noexcept;
+
+    [[nodiscard]] const HpackTable &Table() const noexcept {
+        return m_table;
+    }
+
+private:
+    HpackTable m_table;
+    bool m_size_changed = false;
+};
+
+
+/// The length of the string once Huffman-coded (RFC 7541, section 5.2).
+[[nodiscard]] std::size_t HuffmanEncodedSize(const std::string_view str) noexcept;
+
+void AppendHuffman(std::string &out, const std::string_view str) noexcept;
+
+/// Replaces the output with the decoded string. Returns false if the code is invalid: EOS
+/// coded, or padding longer than 7 bits or other than the most significant bits of EOS.
+[[nodiscard]] bool DecodeHuffman(std::string &out, const std::string_view code) noexcept;
+
+} //namespace nginxpp
@@ -0,0 +1,232 @@
+#include <nginxpp/hpack.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+#include <gtest/gtest.h>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] std::string fromHex(const std::string_view hex) {
+    std::string digits;
+    std::copy_if(hex.begin(), hex.end(), std::back_inserter(digits), [](const char c) {
+        return c != ' ';
+    });
+    std::string bytes;
+    for (std::size_t i = 0; i + 1 < digits.size(); i += 2) {
+        bytes += static_cast<char>(std::stoi(digits.substr(i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+[[nodiscard]] HeaderList decode(HpackDecoder &decoder, const std::string_view hex) {
+    HeaderList fields;
+    EXPECT_EQ(HpackResult::OK, decoder.Decode(fromHex(hex), fields));
+    return fields;
+}
+
+void expectFields(const HeaderList &expected, const HeaderList &actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].name, actual[i].name);
+        EXPECT_EQ(expected[i].value, actual[i].value);
+    }
+}
+
+} //namespace
+
+
+TEST(HuffmanTests, RoundTrips) {
+    const auto str = "custom-value, \x01\xff and every byte in between"s;
+    std::string code;
+    AppendHuffman(code, str);
+    EXPECT_EQ(HuffmanEncodedSize(str), code.size());
+
+    std::string decoded;
+    ASSERT_TRUE(DecodeHuffman(decoded, code));
+    EXPECT_EQ(str, decoded);
+}
+
+TEST(HuffmanTests, EncodeAsSpecified) {
+    // RFC 7541, appendix C.4.1
+    std::string code;
+    AppendHuffman(code, "www.example.com");
+    EXPECT_EQ(fromHex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"), code);
+}
+
+TEST(HuffmanTests, RejectInvalidPadding) {
+    std::string decoded;
+    // 'a' is 00011, padded with zeros instead of ones
+    EXPECT_FALSE(DecodeHuffman(decoded, "\x18"));
+    // A whole byte of padding
+    EXPECT_FALSE(DecodeHuffman(decoded, "\x1f\xff"));
+    // EOS
+    EXPECT_FALSE(DecodeHuffman(decoded, "\xff\xff\xff\xff"));
+    EXPECT_TRUE(DecodeHuffman(decoded, "\x1f"));
+    EXPECT_EQ("a", decoded);
+}
+
+
+TEST(HpackTableTests, EvictOldestFirst) {
+    HpackTable table {100};
+    table.Add({"a", "1"});
+    table.Add({"b", "2"});
+    EXPECT_EQ(2, table.Count());
+    EXPECT_EQ(68, table.Size());
+
+    table.Add({"c", "3"});
+    EXPECT_EQ(2, table.Count());
+    EXPECT_EQ("c", table.Get(HpackTable::STATIC_COUNT + 1)->name);
+    EXPECT_EQ("b", table.Get(HpackTable::STATIC_COUNT + 2)->name);
+    EXPECT_EQ(nullptr, table.Get(HpackTable::STATIC_COUNT + 3));
+
+    table.Add({"large", std::string(100, 'x')});
+    EXPECT_EQ(0, table.Count());
+    EXPECT_EQ(0, table.Size());
+}
+
+TEST(HpackTableTests, FindFullMatchFirst) {
+    HpackTable table;
+    EXPECT_EQ(std::make_pair(std::size_t {2}, true), table.Find(":method", "GET"));
+    EXPECT_EQ(std::make_pair(std::size_t {8}, false), table.Find(":status", "201"));
+    EXPECT_EQ(std::make_pair(std::size_t {0}, false), table.Find("x-custom", "1"));
+
+    table.Add({":status", "201"});
+    EXPECT_EQ(std::make_pair(HpackTable::STATIC_COUNT + 1, true), table.Find(":status", "201"));
+}
+
+
+TEST(HpackDecoderTests, DecodeRequestsWithoutHuffman) {
+    // RFC 7541, appendix C.3
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    expectFields({{":method", "GET"},
+                  {":scheme", "http"},
+                  {":path", "/"},
+                  {":authority", "www.example.com"}},
+                 decode(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"));
+    EXPECT_EQ(57, decoder.Table().Size());
+
+    expectFields({{":method", "GET"},
+                  {":scheme", "http"},
+                  {":path", "/"},
+                  {":authority", "www.example.com"},
+                  {"cache-control", "no-cache"}},
+                 decode(decoder, "8286 84be 5808 6e6f 2d63 6163 6865"));
+    EXPECT_EQ(110, decoder.Table().Size());
+}
+
+TEST(HpackDecoderTests, DecodeRequestsWithHuffman) {
+    // RFC 7541, appendix C.4
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    (void)decode(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff");
+    (void)decode(decoder, "8286 84be 5886 a8eb 1064 9cbf");
+    expectFields({{":method", "GET"},
+                  {":scheme", "https"},
+                  {":path", "/index.html"},
+                  {":authority", "www.example.com"},
+                  {"custom-key", "custom-value"}},
+                 decode(decoder,
+                        "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"));
+    EXPECT_EQ(3, decoder.Table().Count());
+    EXPECT_EQ(164, decoder.Table().Size());
+}
+
+TEST(HpackDecoderTests, DecodeLiteralsNotIndexed) {
+    // RFC 7541, appendices C.2.2 and C.2.3
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    expectFields({{":path", "/sample/path"}},
+                 decode(decoder, "040c 2f73 616d 706c 652f 7061 7468"));
+    expectFields({{"password", "secret"}},
+                 decode(decoder, "1008 7061 7373 776f 7264 0673 6563 7265 74"));
+    EXPECT_EQ(0, decoder.Table().Count());
+}
+
+TEST(HpackDecoderTests, ApplySizeUpdatesAtTheStartOnly) {
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    (void)decode(decoder, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572");
+    EXPECT_EQ(1, decoder.Table().Count());
+
+    // Down to 0, which empties the table, then back up
+    expectFields({{":method", "GET"}}, decode(decoder, "20 3f e1 1f 82"));
+    EXPECT_EQ(0, decoder.Table().Count());
+    EXPECT_EQ(HPACK_DEFAULT_TABLE_SIZE, decoder.Table().MaxSize());
+
+    HeaderList fields;
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("82 20"), fields));
+}
+
+TEST(HpackDecoderTests, RejectInvalidBlocks) {
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    HeaderList fields;
+    // Index 0, then past the end of the table
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("80"), fields));
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("be"), fields));
+    // A size update beyond the maximum advertised
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("3fe2 1f"), fields));
+    // Strings cut short
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("400a 6375"), fields));
+    EXPECT_EQ(HpackResult::INVALID, decoder.Decode(fromHex("ff"), fields));
+    // An index padded with continuation bytes that add nothing, past what 64 bits hold
+    EXPECT_EQ(HpackResult::INVALID,
+              decoder.Decode(fromHex("ff 80 80 80 80 80 80 80 80 80 80 80 01"), fields));
+}
+
+TEST(HpackDecoderTests, DropFieldsPastTheMaximumListSize) {
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 100};
+    HeaderList fields;
+    EXPECT_EQ(HpackResult::TOO_LARGE,
+              decoder.Decode(fromHex("82 86 84 400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d "
+                                     "6865 6164 6572"),
+                             fields));
+    EXPECT_EQ(2, fields.size());
+    // Still indexed, to keep in step with the encoder
+    EXPECT_EQ(1, decoder.Table().Count());
+}
+
+
+TEST(HpackEncoderTests, RoundTrips) {
+    HpackEncoder encoder;
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    const HeaderList response = {{":status", "200"},
+                                 {"server", "nginxpp"},
+                                 {"content-type", "text/html"},
+                                 {"content-length", "1234"}};
+
+    for (int i = 0; i < 2; ++i) {
+        std::string block;
+        for (const auto &field : response) {
+            encoder.Encode(block, field.name, field.value);
+        }
+        HeaderList fields;
+        ASSERT_EQ(HpackResult::OK, decoder.Decode(block, fields));
+        expectFields(response, fields);
+        if (i == 1) {
+            // Indexed but for the length, which takes a name index and a Huffman-coded value
+            EXPECT_EQ(3 + 2 + 4, block.size());
+        }
+    }
+    EXPECT_EQ(2, encoder.Table().Count());
+    EXPECT_EQ(encoder.Table().Size(), decoder.Table().Size());
+}
+
+TEST(HpackEncoderTests, SignalSizeChanges) {
+    HpackEncoder encoder;
+    HpackDecoder decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    encoder.SetMaxTableSize(0);
+
+    std::string block;
+    encoder.Encode(block, "server", "nginxpp");
+    EXPECT_EQ('\x20', block.front());
+    HeaderList fields;
+    ASSERT_EQ(HpackResult::OK, decoder.Decode(block, fields));
+    EXPECT_EQ(0, decoder.Table().MaxSize());
+    EXPECT_EQ(0, encoder.Table().Count());
+
+    encoder.SetMaxTableSize(1 << 20);
+    EXPECT_EQ(HPACK_DEFAULT_TABLE_SIZE, encoder.Table().MaxSize());
+}
@@ -0,0 +1,914 @@
+#include <nginxpp/http2.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <variant>
+
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <nginxpp/response_headers.hpp>
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/variant_utils.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+/// Far more than any client sends for a request, so that no block grows without end
+constexpr std::size_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+
+/// Of DATA frames sent before looking at the input again, for new requests and window updates
+constexpr std::size_t MAX_SEND_BATCH = 256 * 1024;
+
+/// DATA frames this small are copied in with the frames around them, to go out with them in
+/// one system call, rather than sent on their own without a copy
+constexpr std::size_t MAX_COPIED_DATA = 4096;
+
+constexpr std::size_t SETTING_SIZE = 6;
+constexpr std::size_t PRIORITY_SIZE = 5;
+constexpr std::uint32_t MAX_FRAME_SIZE_LIMIT = (1U << 24) - 1;
+constexpr std::uint32_t STREAM_ID_MASK = 0x7fffffff;
+
+[[nodiscard]] inline std::uint32_t readUint32(const std::string_view bytes) noexcept {
+    Expects(bytes.size() >= 4);
+
+    return static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[0])) << 24 |
+           static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[1])) << 16 |
+           static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[2])) << 8 |
+           static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[3]));
+}
+
+inline void appendUint32(std::string &out, const std::uint32_t value) noexcept {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+inline void appendSetting(std::string &out, const SettingId id, const std::uint32_t value) {
+    out += static_cast<char>(static_cast<std::uint16_t>(id) >> 8);
+    out += static_cast<char>(static_cast<std::uint16_t>(id));
+    appendUint32(out, value);
+}
+
+/// Of HTTP/1.1, meaningless over HTTP/2 (RFC 9113, section 8.2.2)
+[[nodiscard]] bool isConnectionSpecific(const std::string_view name) noexcept {
+    return name == "connection" or name == "keep-alive" or name == "proxy-connection" or
+           name == "transfer-encoding" or name == "upgrade";
+}
+
+/// Splits "Name: value\r\n" lines into their names and values
+template<typename Function>
+void forEachField(const std::string_view lines, const Function &function) {
+    for (std::size_t begin = 0; begin < lines.size();) {
+        auto end = lines.find(CRLF, begin);
+        if (end == lines.npos) {
+            end = lines.size();
+        }
+        const auto line = lines.substr(begin, end - begin);
+        if (const auto colon = line.find(':'); colon != line.npos) {
+            auto value = line.substr(colon + 1);
+            value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+            function(line.substr(0, colon), value);
+        }
+        begin = end + std::string_view {CRLF}.size();
+    }
+}
+
+[[nodiscard]] inline bool hasUpperCase(const std::string_view name) noexcept {
+    return std::any_of(name.begin(), name.end(), [](const char c) {
+        return c >= 'A' and c <= 'Z';
+    });
+}
+
+/// Returns false if the request is malformed (RFC 9113, section 8.1.1): pseudo-headers
+/// unknown, repeated, missing or after the other fields, names in upper case, or fields of
+/// HTTP/1.1 connections.
+[[nodiscard]] bool buildRequest(HeaderList &fields, Request &a_request) noexcept {
+    a_request.version = "HTTP/2";
+
+    bool method = false;
+    bool scheme = false;
+    bool path = false;
+    bool authority = false;
+    bool regular_seen = false;
+    for (auto &field : fields) {
+        if (field.name.starts_with(':')) {
+            if (regular_seen) {
+                return false;
+            }
+            if (field.name == ":method" and not method) {
+                method = true;
+                a_request.method = ToMethod(field.value);
+            } else if (field.name == ":scheme" and not scheme) {
+                scheme = true;
+            } else if (field.name == ":path" and not path) {
+                path = true;
+                if (not field.value.starts_with('/') and field.value != "*") {
+                    return false;
+                }
+                a_request.target = std::move(field.value);
+                if (a_request.target.starts_with('/')) {
+                    a_request.target.erase(a_request.target.cbegin());
+                }
+            } else if (field.name == ":authority" and not authority) {
+                authority = true;
+                a_request.headers["host"] = std::move(field.value);
+            } else {
+                return false;
+            }
+            continue;
+        }
+
+        regular_seen = true;
+        if (field.name.empty() or hasUpperCase(field.name) or
+            isConnectionSpecific(field.name) or (field.name == "te" and field.value != "trailers")) {
+            return false;
+        }
+        // The authority stands for the host
+        if (field.name == "host" and authority) {
+            continue;
+        }
+        const auto [iter, inserted] =
+            a_request.headers.try_emplace(std::move(field.name), std::move(field.value));
+        if (not inserted) {
+            // Cookies may be split into crumbs, which are joined back as in HTTP/1.1
+            iter->second += iter->first == "cookie" ? "; " : ", ";
+            iter->second += field.value;
+        }
+    }
+
+    if (not method or (a_request.method != Method::CONNECT and (not scheme or not path))) {
+        return false;
+    }
+
+    if (a_request.target.size() > MAX_LINE_LENGTH) {
+        a_request.status = 414;
+        a_request.error_str = "Target URI length " + std::to_string(a_request.target.size()) +
+                              " exceeds maximum " + std::to_string(MAX_LINE_LENGTH);
+    } else if (a_request.method == Method::UNKNOWN) {
+        a_request.status = 501;
+        a_request.error_str = "Unknown HTTP method";
+    }
+    return true;
+}
+
+/// The body held in memory, if it is
+[[nodiscard]] std::string_view bodyView(const Body &body) noexcept {
+    if (const auto *const view = std::get_if<std::string_view>(&body)) {
+        return *view;
+    }
+    if (const auto *const buffer = std::get_if<std::string>(&body)) {
+        return *buffer;
+    }
+    if (const auto *const region = std::get_if<MappedRegion>(&body)) {
+        return region->View();
+    }
+    return {};
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+FrameHeader ParseFrameHeader(const std::string_view bytes) noexcept {
+    Expects(bytes.size() >= FRAME_HEADER_SIZE);
+
+    FrameHeader header;
+    header.length = readUint32(bytes) >> 8;
+    header.type = static_cast<FrameType>(bytes[3]);
+    header.flags = static_cast<std::uint8_t>(bytes[4]);
+    header.stream_id = readUint32(bytes.substr(5)) & STREAM_ID_MASK;
+    return header;
+}
+
+void AppendFrameHeader(std::string &out, const FrameHeader &header) noexcept {
+    Expects(header.length <= MAX_FRAME_SIZE_LIMIT);
+
+    out += static_cast<char>(header.length >> 16);
+    out += static_cast<char>(header.length >> 8);
+    out += static_cast<char>(header.length);
+    out += static_cast<char>(header.type);
+    out += static_cast<char>(header.flags);
+    appendUint32(out, header.stream_id & STREAM_ID_MASK);
+}
+
+StreamPriority ParsePriority(const std::string_view value) noexcept {
+    StreamPriority priority;
+    for (std::size_t begin = 0; begin < value.size();) {
+        auto end = value.find(',', begin);
+        if (end == value.npos) {
+            end = value.size();
+        }
+        auto member = value.substr(begin, end - begin);
+        begin = end + 1;
+
+        member = member.substr(0, member.find(';'));
+        member.remove_prefix(std::min(member.find_first_not_of(' '), member.size()));
+        member = member.substr(0, member.find_last_not_of(' ') + 1);
+        if (member.starts_with("u=")) {
+            const auto urgency = ParseNumber<unsigned>(member.substr(2));
+            if (urgency and *urgency <= StreamPriority::MAX_URGENCY) {
+                priority.urgency = static_cast<std::uint8_t>(*urgency);
+            }
+        } else if (member == "i" or member == "i=?1") {
+            priority.incremental = true;
+        } else if (member == "i=?0") {
+            priority.incremental = false;
+        }
+    }
+    return priority;
+}
+
+
+Http2Connection::Http2Connection(AsyncSocket &socket,
+                                 const Http2Options &options,
+                                 Http2Callbacks callbacks) noexcept :
+    m_socket(socket),
+    m_options(options), m_callbacks(std::move(callbacks)),
+    m_decoder(HPACK_DEFAULT_TABLE_SIZE, MAX_HEADER_LIST_SIZE) {
+}
+
+Http2Connection::~Http2Connection() noexcept {
+    // Given up on, as the connection ended before they were sent
+    while (not m_streams.empty()) {
+        closeStream(m_streams.begin());
+    }
+}
+
+Task<bool> Http2Connection::Serve(const std::string_view pending) noexcept {
+    m_input.Lease(BufferSize::LARGE);
+    Expects(pending.size() <= m_input.Capacity());
+    std::memcpy(m_input.Data(), pending.data(), pending.size());
+    m_input_end = pending.size();
+
+    const auto preface_deadline = DeadlineAfter(m_options.read_timeout);
+    while (m_input_end < HTTP2_PREFACE_REST.size()) {
+        const auto n = co_await readInput(preface_deadline);
+        if (n <= 0) {
+            co_return false;
+        }
+    }
+    if (not input().starts_with(HTTP2_PREFACE_REST)) {
+        co_return false;
+    }
+    m_input_begin += HTTP2_PREFACE_REST.size();
+
+    std::string settings;
+    appendSetting(settings, SettingId::MAX_CONCURRENT_STREAMS, m_options.max_concurrent_streams);
+    appendSetting(settings, SettingId::ENABLE_PUSH, 0);
+    appendSetting(settings, SettingId::MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST_SIZE);
+    queueFrame({static_cast<std::uint32_t>(settings.size()), FrameType::SETTINGS, 0, 0},
+               settings);
+
+    for (;;) {
+        if (not processInput()) {
+            (void)co_await flush();
+            co_return false;
+        }
+        if (not m_going_away and m_callbacks.stopping and m_callbacks.stopping()) {
+            queueGoAway(Http2Error::NO_ERROR);
+        }
+        if ((m_going_away or m_peer_going_away) and m_streams.empty()) {
+            co_return co_await flush();
+        }
+
+        std::uint32_t id = 0;
+        if (not m_output.empty() or nextToSend(id)) {
+            const auto sent = co_await send();
+            if (not sent) {
+                co_return false;
+            }
+            // What arrived meanwhile, without waiting for it
+            const auto n = tryReadInput();
+            if (n == 0 or (n == -1 and errno != EAGAIN and errno != EWOULDBLOCK)) {
+                co_return n == 0;
+            }
+            continue;
+        }
+
+        // Waits idle between requests, for the client to send the next one or to close
+        const bool idle = m_streams.empty() and input().empty();
+        if (idle) {
+            const auto readable =
+                co_await m_socket.WaitReadable(DeadlineAfter(m_options.idle_timeout));
+            if (not readable) {
+                queueGoAway(Http2Error::NO_ERROR);
+                co_return co_await flush();
+            }
+        }
+        const auto n = co_await readInput(DeadlineAfter(m_options.read_timeout));
+        if (n <= 0) {
+            co_return n == 0;
+        }
+    }
+}
+
+bool Http2Connection::processInput() noexcept {
+    while (input().size() >= FRAME_HEADER_SIZE) {
+        const auto header = ParseFrameHeader(input());
+        if (header.length > HTTP2_DEFAULT_FRAME_SIZE) {
+            return connectionError(Http2Error::FRAME_SIZE_ERROR);
+        }
+        if (input().size() < FRAME_HEADER_SIZE + header.length) {
+            break;
+        }
+
+        const auto handled =
+            handleFrame(header, input().substr(FRAME_HEADER_SIZE, header.length));
+        m_input_begin += FRAME_HEADER_SIZE + header.length;
+        if (not handled) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::handleFrame(const FrameHeader &header,
+                                  const std::string_view payload) noexcept {
+    if (not m_settings_received and header.type != FrameType::SETTINGS) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    if (m_header_stream and header.type != FrameType::CONTINUATION) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+
+    switch (header.type) {
+    case FrameType::DATA:
+        return onData(header, payload);
+    case FrameType::HEADERS:
+        return onHeaders(header, payload);
+    case FrameType::PRIORITY:
+        // Deprecated by RFC 9113, in favour of the priority field and PRIORITY_UPDATE
+        if (header.stream_id == 0) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        if (payload.size() != PRIORITY_SIZE) {
+            resetStream(header.stream_id, Http2Error::FRAME_SIZE_ERROR);
+        }
+        return true;
+    case FrameType::RST_STREAM:
+        if (header.stream_id == 0 or header.stream_id > m_last_stream_id) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        if (payload.size() != 4) {
+            return connectionError(Http2Error::FRAME_SIZE_ERROR);
+        }
+        if (const auto iter = m_streams.find(header.stream_id); iter != m_streams.end()) {
+            closeStream(iter);
+        }
+        return true;
+    case FrameType::SETTINGS:
+        return onSettings(header, payload);
+    case FrameType::PUSH_PROMISE:
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    case FrameType::PING:
+        if (header.stream_id != 0) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        if (payload.size() != 8) {
+            return connectionError(Http2Error::FRAME_SIZE_ERROR);
+        }
+        if (not(header.flags & FLAG_ACK)) {
+            queueFrame({8, FrameType::PING, FLAG_ACK, 0}, payload);
+        }
+        return true;
+    case FrameType::GOAWAY:
+        if (header.stream_id != 0) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        // The client opens no more streams, those open are still answered
+        m_peer_going_away = true;
+        return true;
+    case FrameType::WINDOW_UPDATE:
+        return onWindowUpdate(header, payload);
+    case FrameType::CONTINUATION:
+        return onContinuation(header, payload);
+    case FrameType::PRIORITY_UPDATE:
+        if (header.stream_id != 0) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        return onPriorityUpdate(payload);
+    }
+    // Extensions unknown are ignored
+    return true;
+}
+
+bool Http2Connection::onData(const FrameHeader &header, std::string_view payload) noexcept {
+    if (header.stream_id == 0 or header.stream_id > m_last_stream_id) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    if (header.flags & FLAG_PADDED) {
+        if (payload.empty() or static_cast<std::uint8_t>(payload[0]) >= payload.size()) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+    }
+
+    // Padding included; the window is opened again at once, as the body is not kept
+    m_receive_window -= header.length;
+    if (m_receive_window < 0) {
+        return connectionError(Http2Error::FLOW_CONTROL_ERROR);
+    }
+    if (header.length) {
+        queueWindowUpdate(0, header.length);
+        m_receive_window += header.length;
+    }
+
+    const auto iter = m_streams.find(header.stream_id);
+    if (iter == m_streams.end() or iter->second.dispatched) {
+        resetStream(header.stream_id, Http2Error::STREAM_CLOSED);
+        return true;
+    }
+    auto &stream = iter->second;
+    stream.receive_window -= header.length;
+    if (stream.receive_window < 0) {
+        resetStream(header.stream_id, Http2Error::FLOW_CONTROL_ERROR);
+        return true;
+    }
+
+    if (header.flags & FLAG_END_STREAM) {
+        dispatch(iter);
+    } else if (header.length) {
+        queueWindowUpdate(header.stream_id, header.length);
+        stream.receive_window += header.length;
+    }
+    return true;
+}
+
+bool Http2Connection::onHeaders(const FrameHeader &header, std::string_view payload) noexcept {
+    const auto id = header.stream_id;
+    if (id == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+
+    std::size_t padding = 0;
+    if (header.flags & FLAG_PADDED) {
+        if (payload.empty()) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        padding = static_cast<std::uint8_t>(payload[0]);
+        payload.remove_prefix(1);
+    }
+    if (header.flags & FLAG_PRIORITY) {
+        if (payload.size() < PRIORITY_SIZE) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        payload.remove_prefix(PRIORITY_SIZE);
+    }
+    if (padding > payload.size()) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    payload.remove_suffix(padding);
+
+    if (const auto iter = m_streams.find(id); iter != m_streams.end()) {
+        // Trailers, which end the request
+        if (iter->second.dispatched or not(header.flags & FLAG_END_STREAM)) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+    } else if (id <= m_last_stream_id) {
+        return connectionError(Http2Error::STREAM_CLOSED);
+    } else if (id % 2 == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    } else {
+        m_last_stream_id = id;
+    }
+
+    m_header_block.assign(payload);
+    m_header_stream = id;
+    m_header_end_stream = header.flags & FLAG_END_STREAM;
+    return header.flags & FLAG_END_HEADERS ? onHeaderBlock() : true;
+}
+
+bool Http2Connection::onContinuation(const FrameHeader &header,
+                                     const std::string_view payload) noexcept {
+    if (header.stream_id == 0 or header.stream_id != m_header_stream) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    // However small the fields, a block is never decoded but whole
+    if (m_header_block.size() + payload.size() > MAX_HEADER_LIST_SIZE) {
+        return connectionError(Http2Error::ENHANCE_YOUR_CALM);
+    }
+
+    m_header_block += payload;
+    return header.flags & FLAG_END_HEADERS ? onHeaderBlock() : true;
+}
+
+bool Http2Connection::onHeaderBlock() noexcept {
+    const auto id = std::exchange(m_header_stream, 0);
+    HeaderList fields;
+    const auto result = m_decoder.Decode(m_header_block, fields);
+    m_header_block.clear();
+    if (result == HpackResult::INVALID) {
+        return connectionError(Http2Error::COMPRESSION_ERROR);
+    }
+
+    if (const auto iter = m_streams.find(id); iter != m_streams.end()) {
+        // The fields of trailers are of no use to answer from the mount directory
+        dispatch(iter);
+        return true;
+    }
+
+    // Opened after the last stream told of in GOAWAY, which the client retries elsewhere
+    if (m_going_away) {
+        return true;
+    }
+    if (m_streams.size() >= m_options.max_concurrent_streams) {
+        resetStream(id, Http2Error::REFUSED_STREAM);
+        return true;
+    }
+
+    Stream stream;
+    if (result == HpackResult::TOO_LARGE) {
+        stream.request.version = "HTTP/2";
+        stream.request.status = 431;
+        stream.request.error_str =
+            "Request header list exceeds maximum size of " + std::to_string(MAX_HEADER_LIST_SIZE);
+    } else if (not buildRequest(fields, stream.request)) {
+        resetStream(id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    stream.started = Clock::now();
+    stream.send_window = m_initial_window;
+
+    const auto iter = m_streams.emplace(id, std::move(stream)).first;
+    if (m_header_end_stream) {
+        dispatch(iter);
+    }
+    return true;
+}
+
+bool Http2Connection::onSettings(const FrameHeader &header,
+                                 const std::string_view payload) noexcept {
+    if (header.stream_id != 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    if (header.flags & FLAG_ACK) {
+        return payload.empty() ? true : connectionError(Http2Error::FRAME_SIZE_ERROR);
+    }
+    if (payload.size() % SETTING_SIZE) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR);
+    }
+
+    for (std::size_t i = 0; i < payload.size(); i += SETTING_SIZE) {
+        const auto id = static_cast<SettingId>(static_cast<std::uint8_t>(payload[i]) << 8 |
+                                               static_cast<std::uint8_t>(payload[i + 1]));
+        const auto value = readUint32(payload.substr(i + 2));
+        switch (id) {
+        case SettingId::HEADER_TABLE_SIZE:
+            m_encoder.SetMaxTableSize(value);
+            break;
+        case SettingId::ENABLE_PUSH:
+            if (value > 1) {
+                return connectionError(Http2Error::PROTOCOL_ERROR);
+            }
+            break;
+        case SettingId::INITIAL_WINDOW_SIZE: {
+            if (value > HTTP2_MAX_WINDOW) {
+                return connectionError(Http2Error::FLOW_CONTROL_ERROR);
+            }
+            // Applies to the streams open, whose windows may turn negative
+            const auto delta = static_cast<std::int64_t>(value) - m_initial_window;
+            for (auto &[stream_id, stream] : m_streams) {
+                stream.send_window += delta;
+                if (stream.send_window > HTTP2_MAX_WINDOW) {
+                    return connectionError(Http2Error::FLOW_CONTROL_ERROR);
+                }
+            }
+            m_initial_window = value;
+            break;
+        }
+        case SettingId::MAX_FRAME_SIZE:
+            if (value < HTTP2_DEFAULT_FRAME_SIZE or value > MAX_FRAME_SIZE_LIMIT) {
+                return connectionError(Http2Error::PROTOCOL_ERROR);
+            }
+            m_max_frame_size = value;
+            break;
+        case SettingId::MAX_CONCURRENT_STREAMS:
+        case SettingId::MAX_HEADER_LIST_SIZE:
+            break;
+        }
+    }
+
+    m_settings_received = true;
+    queueFrame({0, FrameType::SETTINGS, FLAG_ACK, 0}, {});
+    return true;
+}
+
+bool Http2Connection::onWindowUpdate(const FrameHeader &header,
+                                     const std::string_view payload) noexcept {
+    if (payload.size() != 4) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR);
+    }
+    const auto increment = readUint32(payload) & STREAM_ID_MASK;
+
+    if (header.stream_id == 0) {
+        if (increment == 0) {
+            return connectionError(Http2Error::PROTOCOL_ERROR);
+        }
+        m_send_window += increment;
+        return m_send_window > HTTP2_MAX_WINDOW
+            ? connectionError(Http2Error::FLOW_CONTROL_ERROR)
+            : true;
+    }
+
+    if (header.stream_id > m_last_stream_id) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    const auto iter = m_streams.find(header.stream_id);
+    if (iter == m_streams.end()) {
+        // Sent before the client learnt that the stream was closed
+        return true;
+    }
+    if (increment == 0) {
+        resetStream(header.stream_id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    iter->second.send_window += increment;
+    if (iter->second.send_window > HTTP2_MAX_WINDOW) {
+        resetStream(header.stream_id, Http2Error::FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+bool Http2Connection::onPriorityUpdate(const std::string_view payload) noexcept {
+    if (payload.size() < 4) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR);
+    }
+    const auto id = readUint32(payload) & STREAM_ID_MASK;
+    if (id == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR);
+    }
+    // Streams not open yet take their priority from their own field instead
+    if (const auto iter = m_streams.find(id); iter != m_streams.end()) {
+        iter->second.priority = ParsePriority(payload.substr(4));
+    }
+    return true;
+}
+
+void Http2Connection::dispatch(const Streams::iterator iter) noexcept {
+    const auto id = iter->first;
+    auto &stream = iter->second;
+    stream.dispatched = true;
+    if (const auto priority = stream.request.headers.find("priority");
+        priority != stream.request.headers.cend()) {
+        stream.priority = ParsePriority(priority->second);
+    }
+
+    stream.response = m_callbacks.handle(stream.request);
+    const auto &a_response = stream.response;
+    const auto size = GetBodySize(a_response.body);
+    stream.body_left = size.value_or(0);
+    stream.sending_body =
+        a_response and stream.request.method != Method::HEAD and size.value_or(1) > 0;
+
+    std::string block;
+    m_encoder.Encode(block, ":status", std::to_string(a_response.status));
+    const auto encodeLine = [&](const std::string_view line) {
+        forEachField(line, [&](const std::string_view name, const std::string_view value) {
+            m_encoder.Encode(block, ToLower(std::string {name}), value);
+        });
+    };
+    encodeLine(GetDateHeader());
+    encodeLine(GetServerHeader());
+    for (const auto &[name, value] : a_response.headers) {
+        if (auto lower = ToLower(name); not isConnectionSpecific(lower)) {
+            m_encoder.Encode(block, lower, value);
+        }
+    }
+    if (a_response.fixed_headers) {
+        encodeLine(*a_response.fixed_headers);
+    }
+
+    // Frames of a block follow one another, with nothing in between
+    std::string_view rest = block;
+    auto type = FrameType::HEADERS;
+    do {
+        const auto fragment = rest.substr(0, m_max_frame_size);
+        rest.remove_prefix(fragment.size());
+        std::uint8_t flags = rest.empty() ? FLAG_END_HEADERS : 0;
+        if (type == FrameType::HEADERS and not stream.sending_body) {
+            flags |= FLAG_END_STREAM;
+        }
+        queueFrame({static_cast<std::uint32_t>(fragment.size()), type, flags, id}, fragment);
+        stream.bytes_sent += FRAME_HEADER_SIZE + fragment.size();
+        type = FrameType::CONTINUATION;
+    } while (not rest.empty());
+
+    if (not stream.sending_body) {
+        closeStream(iter);
+    }
+}
+
+void Http2Connection::closeStream(const Streams::iterator iter) noexcept {
+    const auto &stream = iter->second;
+    if (stream.dispatched and m_callbacks.done) {
+        m_callbacks.done(
+            stream.request, stream.response, stream.bytes_sent, Clock::now() - stream.started);
+    }
+    m_streams.erase(iter);
+}
+
+void Http2Connection::resetStream(const std::uint32_t id, const Http2Error error) noexcept {
+    std::string payload;
+    appendUint32(payload, static_cast<std::uint32_t>(error));
+    queueFrame({4, FrameType::RST_STREAM, 0, id}, payload);
+
+    if (const auto iter = m_streams.find(id); iter != m_streams.end()) {
+        closeStream(iter);
+    }
+}
+
+bool Http2Connection::connectionError(const Http2Error error) noexcept {
+    queueGoAway(error);
+    return false;
+}
+
+void Http2Connection::queueFrame(const FrameHeader &header,
+                                 const std::string_view payload) noexcept {
+    AppendFrameHeader(m_output, header);
+    m_output += payload;
+}
+
+void Http2Connection::queueWindowUpdate(const std::uint32_t id,
+                                        const std::uint32_t increment) noexcept {
+    std::string payload;
+    appendUint32(payload, increment);
+    queueFrame({4, FrameType::WINDOW_UPDATE, 0, id}, payload);
+}
+
+void Http2Connection::queueGoAway(const Http2Error error) noexcept {
+    m_going_away = true;
+    std::string payload;
+    appendUint32(payload, m_last_stream_id);
+    appendUint32(payload, static_cast<std::uint32_t>(error));
+    queueFrame({8, FrameType::GOAWAY, 0, 0}, payload);
+}
+
+Http2Connection::Stream *Http2Connection::nextToSend(std::uint32_t &id) noexcept {
+    if (m_send_window <= 0) {
+        return nullptr;
+    }
+    const auto canSend = [](const Stream &stream) {
+        return stream.sending_body and stream.send_window > 0;
+    };
+
+    auto urgency = StreamPriority::MAX_URGENCY + 1;
+    for (const auto &[stream_id, stream] : m_streams) {
+        if (canSend(stream) and stream.priority.urgency < urgency) {
+            urgency = stream.priority.urgency;
+        }
+    }
+
+    // In the order they were opened, but for incremental ones, which take turns
+    Stream *first_incremental = nullptr;
+    std::uint32_t first_id = 0;
+    for (auto &[stream_id, stream] : m_streams) {
+        if (not canSend(stream) or stream.priority.urgency != urgency) {
+            continue;
+        }
+        if (not stream.priority.incremental) {
+            id = stream_id;
+            return &stream;
+        }
+        if (stream_id > m_last_incremental) {
+            id = stream_id;
+            return &stream;
+        }
+        if (not first_incremental) {
+            first_incremental = &stream;
+            first_id = stream_id;
+        }
+    }
+    id = first_id;
+    return first_incremental;
+}
+
+Task<bool> Http2Connection::send() noexcept {
+    std::uint32_t id = 0;
+    for (std::size_t sent = 0; sent < MAX_SEND_BATCH;) {
+        auto *const stream = nextToSend(id);
+        if (not stream) {
+            break;
+        }
+        const auto n = co_await sendData(id, *stream);
+        if (n < 0) {
+            co_return false;
+        }
+        sent += n;
+    }
+    co_return co_await flush();
+}
+
+Task<long> Http2Connection::sendData(const std::uint32_t id, Stream &stream) noexcept {
+    if (stream.priority.incremental) {
+        m_last_incremental = id;
+    }
+    const auto allowance = static_cast<std::size_t>(std::min<std::int64_t>(
+        {static_cast<std::int64_t>(m_max_frame_size), m_send_window, stream.send_window}));
+    const auto &body = stream.response.body;
+    const auto *const range = std::get_if<FileRange>(&body);
+    const auto *const generate = std::get_if<BodyGenerator>(&body);
+
+    PooledBuffer chunk;
+    std::string_view data;
+    if (generate) {
+        // A frame at a time, as far as the windows allow, until an empty one ends the body
+        chunk.Lease(SizeFor(allowance));
+        data = {chunk.Data(), (*generate)({chunk.Data(), std::min(allowance, chunk.Capacity())})};
+    } else if (not range) {
+        data = bodyView(body).substr(stream.body_sent, allowance);
+    }
+    const auto length = range ? std::min(allowance, stream.body_left) : data.size();
+    const bool end = generate ? length == 0 : length == stream.body_left;
+
+    AppendFrameHeader(m_output,
+                      {static_cast<std::uint32_t>(length),
+                       FrameType::DATA,
+                       end ? FLAG_END_STREAM : std::uint8_t {0},
+                       id});
+    bool sent = true;
+    if (range and length > MAX_COPIED_DATA) {
+        // Straight from the file, as for HTTP/1.1
+        const auto offset = range->offset + static_cast<off_t>(stream.body_sent);
+        sent = co_await flush({}, MSG_MORE);
+        if (sent) {
+            sent = co_await m_socket.WriteFile(range->fd, offset, length);
+        }
+    } else if (range) {
+        const auto size = m_output.size();
+        m_output.resize(size + length);
+        const auto offset = range->offset + static_cast<off_t>(stream.body_sent);
+        if (pread(range->fd, m_output.data() + size, length, offset) !=
+            static_cast<ssize_t>(length)) {
+            m_output.resize(size - FRAME_HEADER_SIZE);
+            resetStream(id, Http2Error::INTERNAL_ERROR);
+            co_return 0;
+        }
+    } else if (length > MAX_COPIED_DATA) {
+        sent = co_await flush(data);
+    } else {
+        m_output += data;
+    }
+    if (not sent) {
+        co_return -1;
+    }
+
+    m_send_window -= length;
+    stream.send_window -= length;
+    stream.body_sent += length;
+    if (not generate) {
+        stream.body_left -= length;
+    }
+    stream.bytes_sent += FRAME_HEADER_SIZE + length;
+    if (end) {
+        closeStream(m_streams.find(id));
+    }
+    co_return static_cast<long>(FRAME_HEADER_SIZE + length);
+}
+
+Task<bool> Http2Connection::flush(const std::string_view body, const int flags) noexcept {
+    if (m_output.empty() and body.empty()) {
+        co_return true;
+    }
+    const auto written = co_await m_socket.Write(m_output, body, flags);
+    m_output.clear();
+    co_return written;
+}
+
+Task<long> Http2Connection::readInput(const Clock::time_point deadline) noexcept {
+    compactInput();
+    const auto n = co_await m_socket.Read(
+        {m_input.Data() + m_input_end, m_input.Capacity() - m_input_end}, deadline);
+    if (n > 0) {
+        m_input_end += n;
+    }
+    co_return n;
+}
+
+long Http2Connection::tryReadInput() noexcept {
+    compactInput();
+    const auto n =
+        m_socket.TryRead({m_input.Data() + m_input_end, m_input.Capacity() - m_input_end});
+    if (n > 0) {
+        m_input_end += n;
+    }
+    return n;
+}
+
+void Http2Connection::compactInput() noexcept {
+    // Whatever is left is less than a frame, which leaves room for the rest of it
+    const auto size = m_input_end - m_input_begin;
+    if (m_input_begin > 0) {
+        std::memmove(m_input.Data(), m_input.Data() + m_input_begin, size);
+    }
+    m_input_begin = 0;
+    m_input_end = size;
+}
+
+} //namespace nginxpp
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include <nginxpp/async_socket.hpp>
+#include <nginxpp/buffer_pool.hpp>
+#include <nginxpp/hpack.hpp>
+#include <nginxpp/message.hpp>
+#include <nginxpp/task.hpp>
+
+
+namespace nginxpp {
+
+/// What a client that knows the server speaks h2c sends first. Parsed as a request head, it is
+/// a PRI * HTTP/2.0 request, followed by the rest (RFC 9113, section 3.4).
+constexpr std::string_view HTTP2_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr std::string_view HTTP2_PREFACE_REST = "SM\r\n\r\n";
+
+constexpr std::size_t FRAME_HEADER_SIZE = 9;
+/// Of the payload, as both ends allow until told otherwise, which is all this server allows
+constexpr std::size_t HTTP2_DEFAULT_FRAME_SIZE = 16384;
+constexpr std::int64_t HTTP2_DEFAULT_WINDOW = 65535;
+constexpr std::int64_t HTTP2_MAX_WINDOW = (std::int64_t {1} << 31) - 1;
+
+enum class FrameType : std::uint8_t {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9,
+    /// RFC 9218, section 7.1
+    PRIORITY_UPDATE = 0x10,
+};
+
+constexpr std::uint8_t FLAG_END_STREAM = 0x1;
+constexpr std::uint8_t FLAG_ACK = 0x1;
+constexpr std::uint8_t FLAG_END_HEADERS = 0x4;
+constexpr std::uint8_t FLAG_PADDED = 0x8;
+constexpr std::uint8_t FLAG_PRIORITY = 0x20;
+
+enum class SettingId : std::uint16_t {
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+enum class Http2Error : std::uint32_t {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    SETTINGS_TIMEOUT = 0x4,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+    CONNECT_ERROR = 0xa,
+    ENHANCE_YOUR_CALM = 0xb,
+};
+
+struct FrameHeader {
+    /// Of the payload
+    std::uint32_t length = 0;
+    FrameType type = FrameType::DATA;
+    std::uint8_t flags = 0;
+    std::uint32_t stream_id = 0;
+};
+
+/// From the first FRAME_HEADER_SIZE bytes, ignoring the reserved bit of the stream id.
+[[nodiscard]] FrameHeader ParseFrameHeader(const std::string_view bytes) noexcept;
+
+void AppendFrameHeader(std::string &out, const FrameHeader &header) noexcept;
+
+
+/// How soon a response is to be sent relative to the others on the connection (RFC 9218):
+/// lower urgencies first, those of the same urgency one after the other in the order they
+/// were requested, but for incremental ones, which share the connection in turns.
+struct StreamPriority {
+    static constexpr std::uint8_t DEFAULT_URGENCY = 3;
+    static constexpr std::uint8_t MAX_URGENCY = 7;
+
+    std::uint8_t urgency = DEFAULT_URGENCY;
+    bool incremental = false;
+};
+
+/// Parses the value of a Priority field, e.g. `u=1, i`, as the header of a request or in a
+/// PRIORITY_UPDATE frame; ignores what it does not know, or cannot parse.
+[[nodiscard]] StreamPriority ParsePriority(const std::string_view value) noexcept;
+
+
+struct Http2Options {
+    /// Requests answered at once; more are refused, for the client to retry later
+    std::uint32_t max_concurrent_streams = 256;
+    /// For the next request, once all are answered
+    std::chrono::milliseconds idle_timeout {};
+    /// For the rest of a frame, or of a request, or for the client to open its windows
+    std::chrono::milliseconds read_timeout {};
+};
+
+/// How a connection hands its requests over to the server it runs in.
+struct Http2Callbacks {
+    using Clock = std::chrono::steady_clock;
+
+    /// Answers a request right away, as Handle does
+    std::function<Response(const Request &)> handle;
+    /// Told of each response once sent, or given up on, with the bytes sent for it
+    std::function<void(const Request &, const Response &, std::size_t, Clock::duration)> done;
+    /// Whether the server is shutting down, for the connection to take no more requests
+    std::function<bool()> stopping;
+};
+
+
+/// Serves requests multiplexed over one connection, as streams (RFC 9113). Responses go out
+/// in DATA frames, as far as the flow control windows of the client allow, by priority; file
+/// bodies are sent from the file, a frame at a time, without being copied. Request bodies are
+/// read, to keep the windows open, but not handled.
+class Http2Connection {
+public:
+    using Clock = Http2Callbacks::Clock;
+
+    Http2Connection(AsyncSocket &socket,
+                    const Http2Options &options,
+                    Http2Callbacks callbacks) noexcept;
+
+    ~Http2Connection() noexcept;
+
+    Http2Connection(const Http2Connection &) = delete;
+    Http2Connection &operator=(const Http2Connection &) = delete;
+
+    /// Serves the connection from the input that followed the start line of the preface, until
+    /// the client closes it, it stays idle for too long, or the server shuts down. Returns false
+    /// on a connection error, or a failure to send.
+    [[nodiscard]] Task<bool> Serve(const std::string_view pending) noexcept;
+
+private:
+    struct Stream {
+        Request request;
+        Response response;
+        StreamPriority priority;
+        Clock::time_point started {};
+        std::int64_t send_window = 0;
+        std::int64_t receive_window = HTTP2_DEFAULT_WINDOW;
+        /// Of the body, for those of a known size
+        std::size_t body_left = 0;
+        std::size_t body_sent = 0;
+        std::size_t bytes_sent = 0;
+        /// Once the request is whole
+        bool dispatched = false;
+        /// With the headers of the response, for as long as there is a body to send after them
+        bool sending_body = false;
+    };
+
+    /// By id, which is also the order in which they were opened
+    using Streams = std::map<std::uint32_t, Stream>;
+
+    /// Returns false on a connection error, having queued the GOAWAY that tells why.
+    [[nodiscard]] bool processInput() noexcept;
+
+    [[nodiscard]] bool handleFrame(const FrameHeader &header, std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onData(const FrameHeader &header, std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onHeaders(const FrameHeader &header, std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onContinuation(const FrameHeader &header,
+                                      const std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onSettings(const FrameHeader &header,
+                                  const std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onWindowUpdate(const FrameHeader &header,
+                                      const std::string_view payload) noexcept;
+
+    [[nodiscard]] bool onPriorityUpdate(const std::string_view payload) noexcept;
+
+    /// Once the header block is whole.
+    [[nodiscard]] bool onHeaderBlock() noexcept;
+
+    /// Answers the request, once whole, and queues the headers of the response.
+    void dispatch(const Streams::iterator iter) noexcept;
+
+    /// Tells the server that the stream is done with, sent or not.
+    void closeStream(const Streams::iterator iter) noexcept;
+
+    void resetStream(const std::uint32_t id, const Http2Error error) noexcept;
+
+    /// Returns false.
+    bool connectionError(const Http2Error error) noexcept;
+
+    void queueFrame(const FrameHeader &header, const std::string_view payload) noexcept;
+
+    void queueWindowUpdate(const std::uint32_t id, const std::uint32_t increment) noexcept;
+
+    void queueGoAway(const Http2Error error) noexcept;
+
+    /// The stream that is next to send a DATA frame, by priority; nullptr if none may.
+    [[nodiscard]] Stream *nextToSend(std::uint32_t &id) noexcept;
+
+    /// Sends what is queued, and DATA frames for as long as there are some to send, up to a
+    /// limit, before looking at the input again. Returns false on failure.
+    [[nodiscard]] Task<bool> send() noexcept;
+
+    /// Queues or sends the next DATA frame of the stream. Returns the number of bytes of the
+    /// frame, or -1 on failure.
+    [[nodiscard]] Task<long> sendData(const std::uint32_t id, Stream &stream) noexcept;
+
+    /// Sends what is queued, with the body of a frame if given.
+    [[nodiscard]] Task<bool> flush(const std::string_view body = {}, const int flags = 0) noexcept;
+
+    [[nodiscard]] Task<long> readInput(const Clock::time_point deadline) noexcept;
+
+    /// Reads what has arrived already, without waiting for more.
+    [[nodiscard]] long tryReadInput() noexcept;
+
+    /// Moves what is left of the input to the front, to make room for more.
+    void compactInput() noexcept;
+
+    [[nodiscard]] std::string_view input() const noexcept {
+        return {m_input.Data() + m_input_begin, m_input_end - m_input_begin};
+    }
+
+    AsyncSocket &m_socket;
+    Http2Options m_options;
+    Http2Callbacks m_callbacks;
+
+    PooledBuffer m_input;
+    std::size_t m_input_begin = 0;
+    std::size_t m_input_end = 0;
+    /// Frames queued to be sent
+    std::string m_output;
+
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+    /// Of a HEADERS frame and the CONTINUATION frames after it, until END_HEADERS
+    std::string m_header_block;
+    std::uint32_t m_header_stream = 0;
+    bool m_header_end_stream = false;
+
+    Streams m_streams;
+    std::uint32_t m_last_stream_id = 0;
+    /// Of the incremental stream that last sent a frame, to take turns with the others
+    std::uint32_t m_last_incremental = 0;
+    bool m_settings_received = false;
+    /// Once GOAWAY is sent, after which new streams are ignored
+    bool m_going_away = false;
+    /// Once GOAWAY is received, after which the client opens no new streams
+    bool m_peer_going_away = false;
+
+    std::int64_t m_send_window = HTTP2_DEFAULT_WINDOW;
+    std::int64_t m_receive_window = HTTP2_DEFAULT_WINDOW;
+    /// As the client set them
+    std::int64_t m_initial_window = HTTP2_DEFAULT_WINDOW;
+    std::size_t m_max_frame_size = HTTP2_DEFAULT_FRAME_SIZE;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,363 @@
+#include <nginxpp/http2.hpp>
+
+#include <array>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/event_loop.hpp>
+#include <nginxpp/server.hpp>
+#include <nginxpp/version.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+void appendFrame(std::string &out,
+                 const FrameType type,
+                 const std::uint8_t flags,
+                 const std::uint32_t id,
+                 const std::string_view payload) {
+    AppendFrameHeader(out, {static_cast<std::uint32_t>(payload.size()), type, flags, id});
+    out += payload;
+}
+
+[[nodiscard]] std::string uint32Bytes(const std::uint32_t value) {
+    return {static_cast<char>(value >> 24),
+            static_cast<char>(value >> 16),
+            static_cast<char>(value >> 8),
+            static_cast<char>(value)};
+}
+
+[[nodiscard]] std::string setting(const SettingId id, const std::uint32_t value) {
+    return std::string {'\0', static_cast<char>(id)} + uint32Bytes(value);
+}
+
+DetachedTask serve(EventLoop &loop,
+                   const int fd,
+                   const Http2Options &options,
+                   Http2Callbacks callbacks,
+                   std::promise<bool> &served) {
+    AsyncSocket sock {loop, Socket {fd}, 1s, EventLoop::Clock::now()};
+    bool result = false;
+    {
+        Http2Connection connection {sock, options, std::move(callbacks)};
+        result = co_await connection.Serve({});
+    }
+    served.set_value(result);
+}
+
+struct Frame {
+    FrameHeader header;
+    std::string payload;
+};
+
+/// The client end of a connection, which blocks on the socket
+class Http2ConnectionTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds.data()));
+        ASSERT_EQ(0, fcntl(m_fds[0], F_SETFL, O_NONBLOCK));
+        const timeval timeout {5, 0};
+        ASSERT_EQ(0, setsockopt(m_fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+        m_thread = std::thread([this]() {
+            m_loop.Run();
+        });
+    }
+
+    void TearDown() override {
+        m_loop.Stop();
+        m_thread.join();
+        close(m_fds[1]);
+    }
+
+    void start(const std::uint32_t max_concurrent_streams = 256) {
+        Http2Options options;
+        options.max_concurrent_streams = max_concurrent_streams;
+        options.idle_timeout = 5s;
+        options.read_timeout = 5s;
+        Http2Callbacks callbacks {
+            [](const Request &a_request) {
+                Response a_response;
+                if (a_request.target == "large") {
+                    a_response.body = std::string(100, 'x');
+                } else {
+                    a_response.headers["Content-Type"] = "text/plain";
+                    a_response.body = "hello " + a_request.target;
+                }
+                return a_response;
+            },
+            [this](const Request &a_request, const Response &a_response, std::size_t, auto) {
+                std::lock_guard lock {m_mutex};
+                m_done.push_back(a_request.target + ' ' + std::to_string(a_response.status));
+            },
+            {},
+        };
+        const auto fd = m_fds[0];
+        m_loop.Post([this, fd, options, callbacks = std::move(callbacks)]() mutable {
+            serve(m_loop, fd, options, std::move(callbacks), m_served);
+        });
+    }
+
+    /// The rest of the preface, and settings
+    void sendPreface(const std::string &settings = {}) {
+        std::string out {HTTP2_PREFACE_REST};
+        appendFrame(out, FrameType::SETTINGS, 0, 0, settings);
+        sendAll(out);
+    }
+
+    void sendRequest(const std::uint32_t id, const std::string_view path) {
+        std::string block;
+        m_encoder.Encode(block, ":method", "GET");
+        m_encoder.Encode(block, ":scheme", "http");
+        m_encoder.Encode(block, ":path", path);
+        m_encoder.Encode(block, ":authority", "localhost");
+        std::string out;
+        appendFrame(out, FrameType::HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM, id, block);
+        sendAll(out);
+    }
+
+    void sendAll(const std::string_view out) {
+        ASSERT_EQ(static_cast<ssize_t>(out.size()), write(m_fds[1], out.data(), out.size()));
+    }
+
+    /// The next frame, but for settings and their acknowledgements; a frame of type 0xff
+    /// at the end of the stream.
+    [[nodiscard]] Frame readFrame() {
+        for (;;) {
+            std::array<char, FRAME_HEADER_SIZE> bytes {};
+            if (recv(m_fds[1], bytes.data(), bytes.size(), MSG_WAITALL) !=
+                static_cast<ssize_t>(bytes.size())) {
+                return {{0, static_cast<FrameType>(0xff), 0, 0}, {}};
+            }
+            Frame frame {ParseFrameHeader({bytes.data(), bytes.size()}), {}};
+            frame.payload.resize(frame.header.length);
+            if (frame.header.length) {
+                EXPECT_EQ(static_cast<ssize_t>(frame.header.length),
+                          recv(m_fds[1], frame.payload.data(), frame.header.length, MSG_WAITALL));
+            }
+            if (frame.header.type != FrameType::SETTINGS) {
+                return frame;
+            }
+        }
+    }
+
+    [[nodiscard]] bool readable(const std::chrono::milliseconds timeout) const {
+        pollfd fd {m_fds[1], POLLIN, 0};
+        return poll(&fd, 1, static_cast<int>(timeout.count())) == 1;
+    }
+
+    [[nodiscard]] HeaderList decodeHeaders(const Frame &frame) {
+        EXPECT_EQ(FrameType::HEADERS, frame.header.type);
+        HeaderList fields;
+        EXPECT_EQ(HpackResult::OK, m_decoder.Decode(frame.payload, fields));
+        return fields;
+    }
+
+    /// Returns whether the server ended the connection without an error.
+    [[nodiscard]] bool closeAndWait() {
+        shutdown(m_fds[1], SHUT_WR);
+        return m_served.get_future().get();
+    }
+
+    EventLoop m_loop;
+    std::array<int, 2> m_fds {};
+    std::thread m_thread;
+    std::promise<bool> m_served;
+    HpackEncoder m_encoder;
+    HpackDecoder m_decoder {HPACK_DEFAULT_TABLE_SIZE, 1 << 16};
+    std::mutex m_mutex;
+    std::vector<std::string> m_done;
+};
+
+[[nodiscard]] std::string findField(const HeaderList &fields, const std::string_view name) {
+    for (const auto &field : fields) {
+        if (field.name == name) {
+            return field.value;
+        }
+    }
+    return {};
+}
+
+} //namespace
+
+
+TEST(FrameHeaderTests, RoundTrips) {
+    std::string bytes;
+    AppendFrameHeader(bytes, {0x123456, FrameType::HEADERS, FLAG_END_HEADERS, 0x7fffffff});
+    ASSERT_EQ(FRAME_HEADER_SIZE, bytes.size());
+    EXPECT_EQ("\x12\x34\x56\x01\x04\x7f\xff\xff\xff", bytes);
+
+    const auto header = ParseFrameHeader(bytes);
+    EXPECT_EQ(0x123456, header.length);
+    EXPECT_EQ(FrameType::HEADERS, header.type);
+    EXPECT_EQ(FLAG_END_HEADERS, header.flags);
+    EXPECT_EQ(0x7fffffff, header.stream_id);
+}
+
+TEST(FrameHeaderTests, IgnoreTheReservedBit) {
+    EXPECT_EQ(1, ParseFrameHeader("\0\0\0\0\0\x80\0\0\x01"s).stream_id);
+}
+
+
+TEST(ParsePriorityTests, ParsesUrgencyAndIncremental) {
+    const auto priority = ParsePriority("u=1, i");
+    EXPECT_EQ(1, priority.urgency);
+    EXPECT_TRUE(priority.incremental);
+
+    EXPECT_FALSE(ParsePriority("u=5, i=?0").incremental);
+    EXPECT_EQ(5, ParsePriority("u=5, i=?0").urgency);
+    EXPECT_TRUE(ParsePriority("i=?1").incremental);
+}
+
+TEST(ParsePriorityTests, IgnoreWhatIsUnknownOrInvalid) {
+    EXPECT_EQ(StreamPriority::DEFAULT_URGENCY, ParsePriority("").urgency);
+    EXPECT_EQ(StreamPriority::DEFAULT_URGENCY, ParsePriority("u=8").urgency);
+    EXPECT_EQ(StreamPriority::DEFAULT_URGENCY, ParsePriority("u=high").urgency);
+    EXPECT_EQ(2, ParsePriority("x=1, u=2, y").urgency);
+}
+
+
+TEST_F(Http2ConnectionTests, AnswerStreamsInTurn) {
+    start();
+    sendPreface();
+    sendRequest(1, "/first");
+    sendRequest(3, "/second");
+
+    // The headers of both may come before their bodies
+    std::map<std::uint32_t, std::string> bodies;
+    for (std::size_t ended = 0; ended < 2;) {
+        const auto frame = readFrame();
+        if (frame.header.type == FrameType::HEADERS) {
+            const auto fields = decodeHeaders(frame);
+            EXPECT_EQ(FLAG_END_HEADERS, frame.header.flags);
+            ASSERT_FALSE(fields.empty());
+            EXPECT_EQ(":status", fields[0].name);
+            EXPECT_EQ("200", fields[0].value);
+            EXPECT_EQ("text/plain", findField(fields, "content-type"));
+            EXPECT_EQ("nginxpp/" + std::string {GetVersion()}, findField(fields, "server"));
+            continue;
+        }
+        ASSERT_EQ(FrameType::DATA, frame.header.type);
+        bodies[frame.header.stream_id] += frame.payload;
+        ended += frame.header.flags & FLAG_END_STREAM;
+    }
+    EXPECT_EQ("hello first", bodies[1]);
+    EXPECT_EQ("hello second", bodies[3]);
+
+    EXPECT_TRUE(closeAndWait());
+    EXPECT_EQ((std::vector<std::string> {"first 200", "second 200"}), m_done);
+}
+
+TEST_F(Http2ConnectionTests, SendNoMoreThanTheWindowsAllow) {
+    start();
+    sendPreface(setting(SettingId::INITIAL_WINDOW_SIZE, 10));
+    sendRequest(1, "/large");
+
+    EXPECT_EQ(FrameType::HEADERS, readFrame().header.type);
+    const auto first = readFrame();
+    EXPECT_EQ(FrameType::DATA, first.header.type);
+    EXPECT_EQ(10, first.payload.size());
+    EXPECT_EQ(0, first.header.flags);
+    EXPECT_FALSE(readable(100ms));
+
+    std::string update;
+    appendFrame(update, FrameType::WINDOW_UPDATE, 0, 1, uint32Bytes(90));
+    sendAll(update);
+    const auto rest = readFrame();
+    EXPECT_EQ(90, rest.payload.size());
+    EXPECT_EQ(FLAG_END_STREAM, rest.header.flags);
+
+    EXPECT_TRUE(closeAndWait());
+}
+
+TEST_F(Http2ConnectionTests, RefuseStreamsPastTheLimit) {
+    start(1);
+    // Keeps the first stream open, as its body cannot be sent
+    sendPreface(setting(SettingId::INITIAL_WINDOW_SIZE, 0));
+    sendRequest(1, "/large");
+    sendRequest(3, "/large");
+
+    EXPECT_EQ(FrameType::HEADERS, readFrame().header.type);
+    const auto reset = readFrame();
+    EXPECT_EQ(FrameType::RST_STREAM, reset.header.type);
+    EXPECT_EQ(3, reset.header.stream_id);
+    EXPECT_EQ(uint32Bytes(static_cast<std::uint32_t>(Http2Error::REFUSED_STREAM)),
+              reset.payload);
+
+    EXPECT_TRUE(closeAndWait());
+    // Given up on once the connection ends
+    EXPECT_EQ(std::vector<std::string> {"large 200"}, m_done);
+}
+
+TEST_F(Http2ConnectionTests, GoAwayOnProtocolErrors) {
+    start();
+    sendPreface();
+    std::string out;
+    appendFrame(out, FrameType::DATA, 0, 0, "x");
+    sendAll(out);
+
+    const auto goaway = readFrame();
+    EXPECT_EQ(FrameType::GOAWAY, goaway.header.type);
+    EXPECT_EQ(uint32Bytes(0) +
+                  uint32Bytes(static_cast<std::uint32_t>(Http2Error::PROTOCOL_ERROR)),
+              goaway.payload);
+    EXPECT_FALSE(m_served.get_future().get());
+}
+
+TEST_F(Http2ConnectionTests, GoAwayWithoutSettingsFirst) {
+    start();
+    std::string out {HTTP2_PREFACE_REST};
+    appendFrame(out, FrameType::PING, 0, 0, "12345678");
+    sendAll(out);
+
+    EXPECT_EQ(FrameType::GOAWAY, readFrame().header.type);
+    EXPECT_FALSE(m_served.get_future().get());
+}
+
+TEST_F(Http2ConnectionTests, AnswerPings) {
+    start();
+    sendPreface();
+    std::string out;
+    appendFrame(out, FrameType::PING, 0, 0, "12345678");
+    sendAll(out);
+
+    const auto pong = readFrame();
+    EXPECT_EQ(FrameType::PING, pong.header.type);
+    EXPECT_EQ(FLAG_ACK, pong.header.flags);
+    EXPECT_EQ("12345678", pong.payload);
+    EXPECT_TRUE(closeAndWait());
+}
+
+TEST_F(Http2ConnectionTests, ResetMalformedRequests) {
+    start();
+    sendPreface();
+    std::string block;
+    m_encoder.Encode(block, ":method", "GET");
+    m_encoder.Encode(block, ":path", "/first");
+    m_encoder.Encode(block, "Upper", "case");
+    std::string out;
+    appendFrame(out, FrameType::HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM, 1, block);
+    sendAll(out);
+
+    const auto reset = readFrame();
+    EXPECT_EQ(FrameType::RST_STREAM, reset.header.type);
+    EXPECT_EQ(1, reset.header.stream_id);
+    EXPECT_EQ(uint32Bytes(static_cast<std::uint32_t>(Http2Error::PROTOCOL_ERROR)),
+              reset.payload);
+    EXPECT_TRUE(closeAndWait());
+    EXPECT_TRUE(m_done.empty());
+}
@@ -0,0 +1,29 @@
+#include <nginxpp/load_shedder.hpp>
+
+
+namespace nginxpp {
+
+LoadShedder::LoadShedder(const std::chrono::microseconds target,
+                         const std::chrono::milliseconds interval) noexcept :
+    m_target(target), m_interval(interval) {
+}
+
+bool LoadShedder::ShouldShed(const Clock::duration sojourn, const Clock::time_point now) noexcept {
+    if (not Enabled()) {
+        return false;
+    }
+
+    if (now >= m_interval_end) {
+        // A whole interval without any request means there was no queue left
+        const auto idle = now >= m_interval_end + m_interval;
+        m_overloaded = not idle and m_min_sojourn > m_target;
+        m_min_sojourn = sojourn;
+        m_interval_end = now + m_interval;
+    } else if (sojourn < m_min_sojourn) {
+        m_min_sojourn = sojourn;
+    }
+
+    return m_overloaded and sojourn > 2 * m_target;
+}
+
+} //namespace nginxpp
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+
+
+namespace nginxpp {
+
+/// Decides whether to shed a request from how long it waited before being handled, in the
+/// manner of CoDel: the server is overloaded once even the shortest wait over an interval was
+/// above the target, and while overloaded, requests that waited more than twice the target are
+/// shed. A burst drains without shedding anything, a standing queue does not.
+/// Not thread-safe; every event loop owns one.
+class LoadShedder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// A target of 0 disables shedding.
+    LoadShedder(const std::chrono::microseconds target,
+                const std::chrono::milliseconds interval) noexcept;
+
+    /// Takes how long the request waited, from when the server could have started on it.
+    [[nodiscard]] bool ShouldShed(const Clock::duration sojourn,
+                                  const Clock::time_point now) noexcept;
+
+    [[nodiscard]] bool Overloaded() const noexcept {
+        return m_overloaded;
+    }
+
+    [[nodiscard]] bool Enabled() const noexcept {
+        return m_target.count() > 0;
+    }
+
+private:
+    Clock::duration m_target;
+    Clock::duration m_interval;
+    /// The shortest wait of the current interval
+    Clock::duration m_min_sojourn {};
+    Clock::time_point m_interval_end {};
+    bool m_overloaded = false;
+};
+
+} //namespace nginxpp
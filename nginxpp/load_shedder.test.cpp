@@ -0,0 +1,82 @@
+#include <nginxpp/load_shedder.hpp>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+using Clock = LoadShedder::Clock;
+
+class LoadShedderTests : public ::testing::Test {
+protected:
+    /// Feeds a request every millisecond for the given time, all having waited as long
+    std::size_t feed(const Clock::duration sojourn, const Clock::duration duration) {
+        std::size_t shed = 0;
+        for (const auto end = m_now + duration; m_now < end; m_now += 1ms) {
+            shed += m_shedder.ShouldShed(sojourn, m_now);
+        }
+        return shed;
+    }
+
+    LoadShedder m_shedder {5ms, 100ms};
+    Clock::time_point m_now = Clock::now();
+};
+
+} //namespace
+
+
+TEST_F(LoadShedderTests, ShortWaitsAreNeverShed) {
+    EXPECT_EQ(0, feed(1ms, 1s));
+    EXPECT_FALSE(m_shedder.Overloaded());
+}
+
+TEST_F(LoadShedderTests, StandingQueueIsShedAfterAnInterval) {
+    EXPECT_EQ(0, feed(20ms, 100ms));
+    EXPECT_EQ(100, feed(20ms, 100ms));
+    EXPECT_TRUE(m_shedder.Overloaded());
+}
+
+TEST_F(LoadShedderTests, BurstIsNotShed) {
+    (void)feed(1ms, 100ms);
+    // A single short wait per interval shows that the queue drains
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_FALSE(m_shedder.ShouldShed(1ms, m_now));
+        EXPECT_EQ(0, feed(50ms, 100ms));
+    }
+}
+
+TEST_F(LoadShedderTests, OnlyWaitsOverTwiceTheTargetAreShedWhileOverloaded) {
+    (void)feed(8ms, 200ms);
+    ASSERT_TRUE(m_shedder.Overloaded());
+    EXPECT_FALSE(m_shedder.ShouldShed(9ms, m_now));
+    EXPECT_TRUE(m_shedder.ShouldShed(11ms, m_now));
+}
+
+TEST_F(LoadShedderTests, OverloadEndsOnceTheQueueDrains) {
+    (void)feed(20ms, 200ms);
+    ASSERT_TRUE(m_shedder.Overloaded());
+
+    (void)feed(1ms, 200ms);
+    EXPECT_FALSE(m_shedder.Overloaded());
+}
+
+TEST_F(LoadShedderTests, OverloadEndsAfterAnIdleInterval) {
+    (void)feed(20ms, 200ms);
+    ASSERT_TRUE(m_shedder.Overloaded());
+
+    m_now += 1s;
+    EXPECT_FALSE(m_shedder.ShouldShed(20ms, m_now));
+    EXPECT_FALSE(m_shedder.Overloaded());
+}
+
+TEST(LoadShedderDisabledTests, NothingIsShedWithoutTarget) {
+    LoadShedder shedder {0ms, 100ms};
+    auto now = LoadShedder::Clock::now();
+    for (int i = 0; i < 1000; ++i, now += 1ms) {
+        EXPECT_FALSE(shedder.ShouldShed(1s, now));
+    }
+}
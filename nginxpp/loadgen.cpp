@@ -0,0 +1,545 @@
+#include <nginxpp/loadgen.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+
+#include <errno.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <cxxopts.hpp>
+#include <gsl/gsl>
+
+#include <nginxpp/exception.hpp>
+#include <nginxpp/server.hpp>
+#include <nginxpp/string_utils.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t READ_BUFFER_SIZE = 64 * 1024;
+constexpr std::chrono::milliseconds RECONNECT_DELAY {1};
+
+struct Address {
+    sockaddr_storage storage {};
+    socklen_t length {};
+    int family {};
+};
+
+[[nodiscard]] Address resolve(const LoadOptions &options) {
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    const auto service = std::to_string(options.port);
+    gsl::owner<addrinfo *> servinfo {};
+    if (const auto status = getaddrinfo(options.host.c_str(), service.c_str(), &hints, &servinfo);
+        status) {
+        throw SocketException {"Failed to getaddrinfo(): "s + gai_strerror(status)};
+    }
+    // Only call freeaddrinfo() after a successful getaddrinfo()
+    const auto servinfo_final = gsl::finally([servinfo]() {
+        freeaddrinfo(servinfo);
+    });
+
+    Address address;
+    std::memcpy(&address.storage, servinfo->ai_addr, servinfo->ai_addrlen);
+    address.length = servinfo->ai_addrlen;
+    address.family = servinfo->ai_family;
+    return address;
+}
+
+[[nodiscard]] Socket connectTo(const Address &address) noexcept {
+    Socket sock {socket(address.family, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (sock == Socket::INVALID_SOCKET) {
+        return sock;
+    }
+
+    if (connect(sock, reinterpret_cast<const sockaddr *>(&address.storage), address.length) ==
+        -1) {
+        return Socket {Socket::INVALID_SOCKET};
+    }
+
+    const int yes = 1;
+    (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return sock;
+}
+
+[[nodiscard]] inline auto toMicroseconds(const Clock::duration d) noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+[[nodiscard]] std::optional<std::size_t> toNumber(const std::string_view str) noexcept {
+    std::size_t value {};
+    const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (error != std::errc {} or end != str.data() + str.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+[[nodiscard]] inline auto trim(std::string_view str) noexcept {
+    while (not str.empty() and (str.front() == ' ' or str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (not str.empty() and (str.back() == ' ' or str.back() == '\t' or str.back() == '\r')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+
+/// Picks request targets by weight, with a cheap per-connection PRNG.
+class TargetPicker {
+public:
+    TargetPicker(const LoadOptions &options, const unsigned seed) noexcept :
+        m_state(0x9e3779b97f4a7c15ull * (seed + 1)) {
+        for (const auto &[target, weight] : options.targets) {
+            m_requests.push_back(buildRequest(options, target));
+            m_total_weight += weight;
+            m_cumulative_weights.push_back(m_total_weight);
+        }
+        Ensures(m_total_weight > 0);
+    }
+
+    [[nodiscard]] const std::string &Next() noexcept {
+        // xorshift64
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+
+        const auto iter = std::upper_bound(m_cumulative_weights.cbegin(),
+                                           m_cumulative_weights.cend(),
+                                           m_state % m_total_weight);
+        return m_requests[iter - m_cumulative_weights.cbegin()];
+    }
+
+private:
+    [[nodiscard]] static std::string buildRequest(const LoadOptions &options,
+                                                  const std::string_view target) noexcept {
+        std::string request = "GET ";
+        if (not StartsWith(target, "/")) {
+            request += '/';
+        }
+        request.append(target).append(" HTTP/1.1\r\nHost: ").append(options.host);
+        request.append("\r\nUser-Agent: nginxpp_loadgen\r\n");
+        if (not options.keep_alive) {
+            request.append("Connection: close\r\n");
+        }
+        return request.append("\r\n");
+    }
+
+    std::vector<std::string> m_requests;
+    std::vector<std::uint64_t> m_cumulative_weights;
+    std::uint64_t m_total_weight = 0;
+    std::uint64_t m_state;
+};
+
+
+/// One client connection, reconnecting whenever the server closes it.
+/// Requests left unanswered by a closed connection are sent again on the next one,
+/// keeping their due time.
+class Connection {
+public:
+    Connection(const LoadOptions &options, const Address &address, const unsigned index) noexcept :
+        m_options(options), m_address(address), m_picker(options, index), m_index(index) {
+        m_input.resize(READ_BUFFER_SIZE);
+    }
+
+    [[nodiscard]] LoadReport Run(const Clock::time_point start,
+                                 const Clock::time_point deadline) noexcept {
+        const auto open_loop = m_options.rate > 0;
+        const auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double> {open_loop ? m_options.connections / m_options.rate : 0});
+        // Staggers the first requests of the connections over one interval
+        auto next_due = start + interval * m_index / m_options.connections;
+
+        for (auto now = Clock::now(); now < deadline; now = Clock::now()) {
+            if (open_loop) {
+                while (m_in_flight.size() < m_options.pipeline and next_due <= now) {
+                    issue(next_due);
+                    next_due += interval;
+                }
+            } else {
+                while (m_in_flight.size() < m_options.pipeline) {
+                    issue(now);
+                }
+            }
+
+            if (m_sock == Socket::INVALID_SOCKET and not m_in_flight.empty() and not reconnect()) {
+                std::this_thread::sleep_for(RECONNECT_DELAY);
+                continue;
+            }
+
+            auto wake_up = deadline;
+            if (open_loop and m_in_flight.size() < m_options.pipeline) {
+                wake_up = std::min(wake_up, next_due);
+            }
+            if (m_sock != Socket::INVALID_SOCKET) {
+                waitAndProcess(wake_up - now);
+            } else {
+                std::this_thread::sleep_for(wake_up - now);
+            }
+        }
+
+        return m_report;
+    }
+
+private:
+    struct InFlight {
+        Clock::time_point due;
+        gsl::not_null<const std::string *> request;
+    };
+
+    void issue(const Clock::time_point due) noexcept {
+        const auto &request = m_picker.Next();
+        m_in_flight.push_back({due, &request});
+        if (m_sock != Socket::INVALID_SOCKET) {
+            m_output += request;
+        }
+    }
+
+    [[nodiscard]] bool reconnect() noexcept {
+        m_sock = connectTo(m_address);
+        if (m_sock == Socket::INVALID_SOCKET) {
+            ++m_report.errors;
+            return false;
+        }
+        ++m_report.connects;
+
+        m_output.clear();
+        for (const auto &in_flight : m_in_flight) {
+            m_output += *in_flight.request;
+        }
+        m_input_size = 0;
+        m_head.reset();
+        return true;
+    }
+
+    void disconnect() noexcept {
+        m_sock = Socket {Socket::INVALID_SOCKET};
+        m_output.clear();
+    }
+
+    void waitAndProcess(const Clock::duration timeout) noexcept {
+        pollfd pfd {};
+        pfd.fd = m_sock;
+        pfd.events = POLLIN;
+        if (not m_output.empty()) {
+            pfd.events |= POLLOUT;
+        }
+
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::max(timeout, Clock::duration::zero()));
+        const timespec ts {static_cast<time_t>(ns.count() / 1'000'000'000),
+                           static_cast<long>(ns.count() % 1'000'000'000)};
+        if (ppoll(&pfd, 1, &ts, nullptr) <= 0) {
+            return;
+        }
+
+        if (pfd.revents & POLLOUT) {
+            const auto n = send(m_sock, m_output.data(), m_output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n == -1) {
+                if (errno != EAGAIN and errno != EINTR) {
+                    disconnect();
+                }
+                return;
+            }
+            m_output.erase(0, n);
+        }
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            receive();
+        }
+    }
+
+    void receive() noexcept {
+        const auto n =
+            recv(m_sock, m_input.data() + m_input_size, m_input.size() - m_input_size, MSG_DONTWAIT);
+        if (n == -1 and (errno == EAGAIN or errno == EINTR)) {
+            return;
+        }
+        if (n <= 0) {
+            // Without a Content-Length, the body ends with the connection
+            if (m_head and not m_head->content_length) {
+                complete();
+            }
+            disconnect();
+            return;
+        }
+
+        m_report.bytes += n;
+        m_input_size += n;
+        if (not processInput()) {
+            ++m_report.errors;
+            m_in_flight.clear();
+            disconnect();
+        }
+    }
+
+    [[nodiscard]] bool processInput() noexcept {
+        std::size_t consumed = 0;
+        for (;;) {
+            if (not m_head) {
+                const std::string_view input {m_input.data() + consumed, m_input_size - consumed};
+                try {
+                    m_head = ParseResponseHead(input);
+                } catch (const ParserException &) {
+                    return false;
+                }
+                if (not m_head) {
+                    if (consumed == 0 and m_input_size == m_input.size()) {
+                        return false; // Head too large
+                    }
+                    break;
+                }
+                consumed += m_head->header_size;
+                m_body_remaining = m_head->content_length.value_or(~std::size_t {0});
+            }
+
+            const auto body = std::min(m_body_remaining, m_input_size - consumed);
+            consumed += body;
+            m_body_remaining -= body;
+            if (m_body_remaining != 0) {
+                break;
+            }
+
+            const auto close = m_head->close;
+            complete();
+            if (close) {
+                disconnect();
+                return true;
+            }
+        }
+
+        std::memmove(m_input.data(), m_input.data() + consumed, m_input_size - consumed);
+        m_input_size -= consumed;
+        return true;
+    }
+
+    void complete() noexcept {
+        Expects(m_head);
+
+        if (not m_in_flight.empty()) {
+            m_report.latency.Record(toMicroseconds(Clock::now() - m_in_flight.front().due));
+            m_in_flight.pop_front();
+        }
+        ++m_report.requests;
+        if (m_head->status >= 400) {
+            ++m_report.unsuccessful;
+        }
+        m_head.reset();
+    }
+
+    const LoadOptions &m_options;
+    const Address &m_address;
+    TargetPicker m_picker;
+    unsigned m_index;
+
+    Socket m_sock {Socket::INVALID_SOCKET};
+    std::deque<InFlight> m_in_flight;
+    std::string m_output;
+    std::vector<char> m_input;
+    std::size_t m_input_size = 0;
+    std::optional<ResponseHead> m_head;
+    std::size_t m_body_remaining = 0;
+
+    LoadReport m_report;
+};
+
+} //namespace
+
+
+namespace nginxpp {
+
+void AddLoadOptions(cxxopts::Options &options) noexcept {
+    // clang-format off
+    options.add_options("Load")
+    ("host", "host of the server to load", cxxopts::value<std::string>()->default_value("127.0.0.1"), "HOST")
+    ("p,port", "port of the server to load", cxxopts::value<int>()->default_value("19840"), "PORT")
+    ("c,connections", "number of concurrent connections", cxxopts::value<unsigned>()->default_value("1"), "N")
+    ("d,duration", "test duration in seconds", cxxopts::value<double>()->default_value("1"), "SECONDS")
+    ("pipeline", "maximum requests in flight per connection", cxxopts::value<unsigned>()->default_value("1"), "DEPTH")
+    ("no-keep-alive", "ask the server to close the connection after every response")
+    ("t,target", "targets to request, picked by weight", cxxopts::value<std::vector<std::string>>()->default_value("/"), "TARGET[:WEIGHT],...")
+    ("r,rate", "total requests per second, in open-loop mode; 0 for closed-loop", cxxopts::value<double>()->default_value("0"), "RPS")
+    ("min-throughput", "fail if fewer requests per second are completed", cxxopts::value<double>()->default_value("0"), "RPS")
+    ;
+    // clang-format on
+}
+
+LoadOptions HandleLoadOptions(const cxxopts::ParseResult &parsed_options) {
+    LoadOptions options;
+
+    options.host = parsed_options["host"].as<std::string>();
+    options.port = parsed_options["port"].as<int>();
+    options.connections = std::max(1u, parsed_options["connections"].as<unsigned>());
+    options.duration = std::chrono::milliseconds {
+        static_cast<long>(parsed_options["duration"].as<double>() * 1000)};
+    options.pipeline = std::max(1u, parsed_options["pipeline"].as<unsigned>());
+    options.keep_alive = not parsed_options.count("no-keep-alive");
+    for (const auto &target : parsed_options["target"].as<std::vector<std::string>>()) {
+        options.targets.push_back(ParseWeightedTarget(target));
+    }
+    options.rate = parsed_options["rate"].as<double>();
+    options.min_throughput = parsed_options["min-throughput"].as<double>();
+
+    return options;
+}
+
+WeightedTarget ParseWeightedTarget(const std::string_view target) {
+    WeightedTarget weighted;
+
+    const auto colon = target.rfind(':');
+    if (colon == std::string_view::npos) {
+        weighted.target = target;
+        return weighted;
+    }
+
+    const auto weight = toNumber(target.substr(colon + 1));
+    if (not weight or *weight == 0) {
+        throw ParserException {"Invalid target weight: '" + std::string {target} + '\''};
+    }
+    weighted.target = target.substr(0, colon);
+    weighted.weight = *weight;
+    return weighted;
+}
+
+
+std::optional<ResponseHead> ParseResponseHead(const std::string_view buffer) {
+    const auto end = buffer.find("\r\n\r\n");
+    if (end == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    ResponseHead head;
+    head.header_size = end + 4;
+
+    auto lines = buffer.substr(0, end + 2);
+    const auto status_line = lines.substr(0, lines.find("\r\n"));
+    if (not StartsWith(status_line, "HTTP/1.") or status_line.size() < 12) {
+        throw ParserException {"Invalid status line: '" + std::string {status_line} + '\''};
+    }
+    const auto status = toNumber(status_line.substr(9, 3));
+    if (not status) {
+        throw ParserException {"Invalid status line: '" + std::string {status_line} + '\''};
+    }
+    head.status = *status;
+    lines.remove_prefix(status_line.size() + 2);
+
+    while (not lines.empty()) {
+        const auto line = lines.substr(0, lines.find("\r\n"));
+        lines.remove_prefix(line.size() + 2);
+
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            throw ParserException {"Invalid header: '" + std::string {line} + '\''};
+        }
+        const auto key = ToLower(std::string {line.substr(0, colon)});
+        const auto value = trim(line.substr(colon + 1));
+
+        if (key == "content-length") {
+            head.content_length = toNumber(value);
+            if (not head.content_length) {
+                throw ParserException {"Invalid Content-Length: '" + std::string {value} + '\''};
+            }
+        } else if (key == "connection") {
+            head.close = ToLower(std::string {value}) == "close";
+        }
+    }
+
+    // No body, whatever the headers say
+    if (head.status < 200 or head.status == 204 or head.status == 304) {
+        head.content_length = 0;
+    }
+
+    return head;
+}
+
+
+double LoadReport::Throughput() const noexcept {
+    const auto seconds = std::chrono::duration<double> {elapsed}.count();
+    return seconds > 0 ? requests / seconds : 0;
+}
+
+void LoadReport::Merge(const LoadReport &other) noexcept {
+    requests += other.requests;
+    unsuccessful += other.unsuccessful;
+    errors += other.errors;
+    bytes += other.bytes;
+    connects += other.connects;
+    elapsed = std::max(elapsed, other.elapsed);
+    latency.Merge(other.latency);
+}
+
+LoadReport RunLoad(const LoadOptions &options) {
+    Expects(not options.targets.empty());
+
+    const auto address = resolve(options);
+    if (connectTo(address) == Socket::INVALID_SOCKET) {
+        throw SocketException {"Failed to connect to " + options.host + ':' +
+                               std::to_string(options.port) + ": " + strerror(errno)};
+    }
+
+    std::vector<LoadReport> reports(options.connections);
+    std::vector<std::thread> threads;
+    const auto start = Clock::now();
+    const auto deadline = start + options.duration;
+    for (unsigned i = 0; i < options.connections; ++i) {
+        threads.emplace_back([&options, &address, &reports, i, start, deadline]() {
+            Connection connection {options, address, i};
+            reports[i] = connection.Run(start, deadline);
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    LoadReport report;
+    for (const auto &r : reports) {
+        report.Merge(r);
+    }
+    report.elapsed = Clock::now() - start;
+    return report;
+}
+
+std::ostream &operator<<(std::ostream &out, const LoadReport &report) noexcept {
+    const auto seconds = std::chrono::duration<double> {report.elapsed}.count();
+    const auto &latency = report.latency;
+
+    out << std::fixed << std::setprecision(1);
+    out << "Requests:     " << report.requests << " in " << seconds << "s, "
+        << report.Throughput() << " requests/s\n";
+    out << "Transfer:     " << report.bytes / 1024.0 / 1024.0 << " MiB, "
+        << report.bytes / 1024.0 / 1024.0 / std::max(seconds, 1e-9) << " MiB/s\n";
+    out << "Connections:  " << report.connects << " opened\n";
+    out << "Errors:       " << report.errors << " socket/protocol, " << report.unsuccessful
+        << " 4xx/5xx responses\n";
+    out << "Latency (us): mean " << (latency.Count() ? latency.Sum() / latency.Count() : 0);
+    constexpr std::array<std::pair<std::string_view, double>, 4> PERCENTILES = {
+        {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}}};
+    for (const auto &[name, q] : PERCENTILES) {
+        out << ", " << name << ' ' << latency.ValueAt(q);
+    }
+    return out << ", max " << latency.ValueAt(1) << '\n';
+}
+
+} //namespace nginxpp
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nginxpp/metrics.hpp>
+
+
+namespace cxxopts {
+
+class Options;
+class ParseResult;
+
+} // namespace cxxopts
+
+
+namespace nginxpp {
+
+struct WeightedTarget {
+    std::string target;
+    unsigned weight = 1;
+};
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port {};
+    unsigned connections = 1;
+    std::chrono::milliseconds duration {1000};
+    /// Maximum requests in flight per connection
+    unsigned pipeline = 1;
+    bool keep_alive = true;
+    std::vector<WeightedTarget> targets;
+    /// Total requests per second in open-loop mode; 0 for closed-loop.
+    double rate = 0;
+    /// Fail if the throughput is below this, in requests per second
+    double min_throughput = 0;
+};
+
+void AddLoadOptions(cxxopts::Options &options) noexcept;
+
+/// Throws ParserException on an invalid target mix.
+[[nodiscard]] LoadOptions HandleLoadOptions(const cxxopts::ParseResult &parsed_options);
+
+/// Parses "index.html:3" into a target with a weight; the weight defaults to 1.
+[[nodiscard]] WeightedTarget ParseWeightedTarget(const std::string_view target);
+
+
+struct ResponseHead {
+    int status = 0;
+    std::size_t header_size = 0;
+    /// Without it, the body ends when the server closes the connection
+    std::optional<std::size_t> content_length;
+    bool close = false;
+};
+
+/// Returns nullopt until the buffer holds the whole head, including the blank line.
+/// Throws ParserException if the head is malformed.
+[[nodiscard]] std::optional<ResponseHead> ParseResponseHead(const std::string_view buffer);
+
+
+struct LoadReport {
+    std::uint64_t requests = 0;
+    /// Responses with 4xx or 5xx status
+    std::uint64_t unsuccessful = 0;
+    /// Failed connects, and malformed or oversized responses
+    std::uint64_t errors = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t connects = 0;
+    std::chrono::nanoseconds elapsed {};
+    /// In microseconds. In open-loop mode, measured from when each request was due to be sent,
+    /// which corrects for coordinated omission: a stalled server is charged for every request
+    /// it delayed, not only for the one it was slow on.
+    LatencyHistogram latency;
+
+    [[nodiscard]] double Throughput() const noexcept;
+
+    void Merge(const LoadReport &other) noexcept;
+};
+
+/// Drives the server with one thread per connection, and throws SocketException if the
+/// server cannot be reached.
+[[nodiscard]] LoadReport RunLoad(const LoadOptions &options);
+
+std::ostream &operator<<(std::ostream &out, const LoadReport &report) noexcept;
+
+} //namespace nginxpp
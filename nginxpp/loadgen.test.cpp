@@ -0,0 +1,93 @@
+#include <nginxpp/loadgen.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+TEST(WeightedTargetTests, DefaultWeightIsOne) {
+    const auto weighted = ParseWeightedTarget("index.html");
+    EXPECT_EQ("index.html", weighted.target);
+    EXPECT_EQ(1, weighted.weight);
+}
+
+TEST(WeightedTargetTests, CanParseWeight) {
+    const auto weighted = ParseWeightedTarget("/a:b/index.html:3");
+    EXPECT_EQ("/a:b/index.html", weighted.target);
+    EXPECT_EQ(3, weighted.weight);
+}
+
+TEST(WeightedTargetTests, ThrowIfInvalidWeight) {
+    EXPECT_THROW((void)ParseWeightedTarget("index.html:0"), ParserException);
+    EXPECT_THROW((void)ParseWeightedTarget("index.html:x"), ParserException);
+}
+
+
+TEST(ResponseHeadTests, IncompleteHead) {
+    EXPECT_FALSE(ParseResponseHead(""));
+    EXPECT_FALSE(ParseResponseHead("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n"));
+}
+
+TEST(ResponseHeadTests, CanParseHead) {
+    constexpr std::string_view RESPONSE =
+        "HTTP/1.1 200 OK\r\ncontent-length:  5\r\nConnection: Close\r\n\r\nhello";
+
+    const auto head = ParseResponseHead(RESPONSE);
+    ASSERT_TRUE(head);
+    EXPECT_EQ(200, head->status);
+    EXPECT_EQ(RESPONSE.size() - 5, head->header_size);
+    EXPECT_EQ(5, head->content_length);
+    EXPECT_TRUE(head->close);
+}
+
+TEST(ResponseHeadTests, BodyWithoutLengthEndsWithConnection) {
+    const auto head = ParseResponseHead("HTTP/1.1 404 Not Found\r\nServer: nginxpp\r\n\r\n");
+    ASSERT_TRUE(head);
+    EXPECT_EQ(404, head->status);
+    EXPECT_FALSE(head->content_length);
+    EXPECT_FALSE(head->close);
+}
+
+TEST(ResponseHeadTests, NoBodyIfNotModified) {
+    const auto head = ParseResponseHead("HTTP/1.1 304 Not Modified\r\nContent-Length: 5\r\n\r\n");
+    ASSERT_TRUE(head);
+    EXPECT_EQ(0, head->content_length);
+}
+
+TEST(ResponseHeadTests, ThrowIfMalformed) {
+    EXPECT_THROW((void)ParseResponseHead("SSH-2.0-OpenSSH\r\n\r\n"), ParserException);
+    EXPECT_THROW((void)ParseResponseHead("HTTP/1.1 200 OK\r\nno colon\r\n\r\n"),
+                 ParserException);
+    EXPECT_THROW((void)ParseResponseHead("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n"),
+                 ParserException);
+}
+
+
+TEST(LoadReportTests, MergeReports) {
+    LoadReport first;
+    first.requests = 10;
+    first.elapsed = std::chrono::seconds {2};
+    first.latency.Record(100);
+
+    LoadReport second;
+    second.requests = 30;
+    second.unsuccessful = 1;
+    second.elapsed = std::chrono::seconds {1};
+    second.latency.Record(200);
+
+    first.Merge(second);
+    EXPECT_EQ(40, first.requests);
+    EXPECT_EQ(1, first.unsuccessful);
+    EXPECT_EQ(2, first.latency.Count());
+    EXPECT_DOUBLE_EQ(20, first.Throughput());
+}
+
+TEST(LoadTests, ThrowIfServerUnreachable) {
+    LoadOptions options;
+    options.port = 1;
+    options.targets.push_back({"/"});
+    EXPECT_THROW((void)RunLoad(options), SocketException);
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+
+#include <nginxpp/args.hpp>
+#include <nginxpp/exception.hpp>
+#include <nginxpp/loadgen.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] inline auto buildOptions() noexcept {
+    auto options = CreateBaseOptions("nginxpp_loadgen", "HTTP load generator for nginxpp.");
+
+    AddLoadOptions(options);
+
+    return options;
+}
+
+[[nodiscard]] inline auto
+handleOptions(cxxopts::Options &options, const int argc, const char *argv[]) noexcept {
+    try {
+        const auto results = options.parse(argc, argv);
+        HandleBaseOptions(options, results);
+        return HandleLoadOptions(results);
+    } catch (const cxxopts::exceptions::exception &e) {
+        std::cerr << e.what() << std::endl;
+    } catch (const ParserException &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+
+int main(int argc, const char *argv[]) {
+    auto options = buildOptions();
+    const auto load_options = handleOptions(options, argc, argv);
+
+    const auto report = [&load_options]() {
+        try {
+            return RunLoad(load_options);
+        } catch (const SocketException &e) {
+            std::cerr << e.what() << std::endl;
+        }
+        exit(EXIT_FAILURE);
+    }();
+
+    std::cout << report;
+
+    if (report.requests == 0 or report.Throughput() < load_options.min_throughput) {
+        std::cerr << "Throughput below the minimum of " << load_options.min_throughput
+                  << " requests/s" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
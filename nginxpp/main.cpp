@@ -1,7 +1,10 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <nginxpp/args.hpp>
 #include <nginxpp/exception.hpp>
+#include <nginxpp/master.hpp>
 #include <nginxpp/server.hpp>
 
 
@@ -33,7 +36,12 @@ handleOptions(cxxopts::Options &options, const int argc, const char *argv[]) noe
 
     HandleBaseOptions(options, results);
 
-    return HandleServerOptions(results);
+    try {
+        return LoadServerOptions(std::vector<std::string>(argv, argv + argc));
+    } catch (const ConfigException &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    exit(EXIT_FAILURE);
 }
 
 [[nodiscard]] inline constexpr auto toExitCode(const bool success) noexcept {
@@ -47,6 +55,20 @@ int main(int argc, const char *argv[]) {
     auto options = buildOptions();
     const auto server_options = handleOptions(options, argc, argv);
 
+    if (server_options.workers) {
+        auto master = [&server_options, argc, argv]() {
+            try {
+                // Executed again as is on upgrade, to pick up the binary replaced on disk
+                return Master {server_options, std::vector<std::string>(argv, argv + argc)};
+            } catch (const SocketException &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            exit(EXIT_FAILURE);
+        }();
+
+        return toExitCode(master.Run());
+    }
+
     auto server = [&server_options]() {
         try {
             return HttpServer {server_options};
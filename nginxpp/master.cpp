@@ -0,0 +1,407 @@
+#include <nginxpp/master.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <csignal>
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <nginxpp/affinity.hpp>
+#include <nginxpp/exception.hpp>
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/tls.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+/// A worker exiting with a failure sooner than this failed to start, e.g. on a bad option,
+/// which respawning it would only repeat
+constexpr std::chrono::seconds STARTUP_GRACE {1};
+
+/// Names the old master to the new one of an upgrade, which inherits its socket
+constexpr auto UPGRADED_FROM_VARIABLE = "NGINXPP_UPGRADED_FROM";
+
+constexpr std::array HANDLED_SIGNALS = {
+    SIGINT, SIGQUIT, SIGTERM, SIGHUP, SIGUSR1, SIGUSR2, SIGCHLD, SIGALRM};
+
+std::atomic<int> g_stop_signal {0};
+std::atomic<bool> g_reload {false};
+std::atomic<bool> g_reopen {false};
+std::atomic<bool> g_upgrade {false};
+std::atomic<bool> g_child_exited {false};
+std::atomic<bool> g_started {false};
+
+extern "C" void masterSignalHandler(int signal) {
+    switch (signal) {
+    case SIGHUP:
+        g_reload = true;
+        break;
+    case SIGUSR1:
+        g_reopen = true;
+        break;
+    case SIGUSR2:
+        g_upgrade = true;
+        break;
+    case SIGCHLD:
+        g_child_exited = true;
+        break;
+    case SIGALRM:
+        g_started = true;
+        break;
+    default:
+        g_stop_signal = signal;
+        break;
+    }
+}
+
+[[nodiscard]] sigset_t handledSignals() noexcept {
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (const auto signal : HANDLED_SIGNALS) {
+        sigaddset(&signals, signal);
+    }
+    return signals;
+}
+
+/// Pins the calling process to one of the CPUs it may run on, picked by its slot. Pinned while
+/// single-threaded, its event loops inherit the CPU, and allocate on its node.
+void pinToCpu(const unsigned slot) noexcept {
+    const auto cpus = AllowedCpus();
+    if (cpus.empty()) {
+        return;
+    }
+    const auto cpu = cpus[slot % cpus.size()];
+    if (not PinThreadToCpu(cpu)) {
+        std::cerr << "Failed to pin worker to CPU " << cpu << std::endl;
+    }
+}
+
+/// The mask of the master, less the signals that it handles, for its children to restore
+[[nodiscard]] sigset_t childMask() noexcept {
+    sigset_t mask;
+    (void)sigprocmask(SIG_BLOCK, nullptr, &mask);
+    for (const auto signal : HANDLED_SIGNALS) {
+        sigdelset(&mask, signal);
+    }
+    return mask;
+}
+
+void resetSignals(const sigset_t &mask) noexcept {
+    for (const auto signal : HANDLED_SIGNALS) {
+        (void)std::signal(signal, SIG_DFL);
+    }
+    (void)sigprocmask(SIG_SETMASK, &mask, nullptr);
+}
+
+/// Executes the new binary with the listening sockets, passed on as by systemd socket activation.
+[[noreturn]] void execUpgrade(const std::vector<std::string> &command,
+                              const std::vector<Socket> &listeners,
+                              const pid_t master,
+                              const sigset_t &mask) noexcept {
+    resetSignals(mask);
+
+    // Moved out of the way first, so that placing one does not close another. Unlike the
+    // originals, the duplicates are inherited across exec()
+    const auto count = static_cast<int>(listeners.size());
+    std::vector<int> moved;
+    for (const auto &listener : listeners) {
+        moved.push_back(fcntl(listener, F_DUPFD, internal::LISTEN_FDS_START + count));
+    }
+    for (int i = 0; i < count; ++i) {
+        if (moved[i] == -1 or dup2(moved[i], internal::LISTEN_FDS_START + i) == -1) {
+            std::cerr << "Failed to pass on the listening sockets: " << strerror(errno)
+                      << std::endl;
+            _exit(EXIT_FAILURE);
+        }
+        (void)close(moved[i]);
+    }
+    (void)setenv("LISTEN_FDS", std::to_string(count).c_str(), 1);
+    (void)setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+    (void)setenv(UPGRADED_FROM_VARIABLE, std::to_string(master).c_str(), 1);
+
+    std::vector<char *> argv;
+    for (const auto &argument : command) {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    (void)execvp(argv.front(), argv.data());
+
+    std::cerr << "Failed to execute " << command.front() << ": " << strerror(errno) << std::endl;
+    _exit(EXIT_FAILURE);
+}
+
+[[noreturn]] void runWorker(ServerOptions options,
+                            std::vector<Socket> listeners,
+                            const unsigned slot,
+                            const pid_t master,
+                            const sigset_t &mask) noexcept {
+    resetSignals(mask);
+    // Workers do not outlive the master, which would leave no one to supervise them
+    if (prctl(PR_SET_PDEATHSIG, SIGTERM) == -1 or getppid() != master) {
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (options.worker_affinity) {
+        pinToCpu(slot);
+    }
+    options.quiet = slot != 0;
+    if (not options.trace_file.empty()) {
+        options.trace_file += '.' + std::to_string(getpid());
+    }
+
+    try {
+        bool served = false;
+        // Destroyed before exiting, so as to remove what it leaves on disk, e.g. its cache
+        {
+            HttpServer server {options, std::move(listeners)};
+            served = server.Run();
+        }
+        std::exit(served ? EXIT_SUCCESS : EXIT_FAILURE);
+    } catch (const ServerException &e) {
+        std::cerr << e.what() << std::endl;
+    } catch (const SocketException &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    std::exit(EXIT_FAILURE);
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+Master::Master(ServerOptions options, std::vector<std::string> command) :
+    m_options(std::move(options)), m_command(std::move(command)),
+    m_listeners(internal::openServerSockets(m_options)) {
+    Expects(m_options.workers > 0);
+
+    // Workers stand in for the loop threads
+    if (m_options.threads == 0) {
+        m_options.threads = 1;
+    }
+    // Picked by the kernel for port 0, or by the old master of an upgrade
+    m_options.port = internal::getPort(m_listeners.front());
+    // Made here rather than by each worker, so that any of them resumes the TLS sessions of the
+    // others, including once a reload turns TLS on
+    if (m_options.tls_ticket_key.empty()) {
+        m_options.tls_ticket_key = GenerateTicketKey();
+    }
+
+    if (const auto *const from = getenv(UPGRADED_FROM_VARIABLE); from) {
+        // Only while still its child, so that no unrelated process is signalled
+        if (const auto pid = ParseNumber<pid_t>(from); pid == getppid()) {
+            m_upgraded_from = *pid;
+        }
+        unsetenv(UPGRADED_FROM_VARIABLE);
+    }
+}
+
+bool Master::Run() noexcept {
+    // Blocked but while suspended, so that no signal slips in between checking the flags and
+    // waiting for the next one
+    const auto signals = handledSignals();
+    sigset_t mask;
+    (void)sigprocmask(SIG_BLOCK, &signals, &mask);
+    for (const auto signal : HANDLED_SIGNALS) {
+        struct sigaction action {};
+        action.sa_handler = masterSignalHandler;
+        (void)sigaction(signal, &action, nullptr);
+    }
+
+    std::cout << "Master " << getpid() << " starting " << m_options.workers
+              << " workers on port " << m_options.port << std::endl;
+    bool success = true;
+    for (unsigned slot = 0; slot < m_options.workers; ++slot) {
+        if (not spawn(slot)) {
+            success = false;
+            m_stopping = true;
+            signalAll(SIGTERM);
+            break;
+        }
+    }
+    if (m_upgraded_from and not m_stopping) {
+        // Workers failing to start exit within the grace, leaving the old master serving
+        (void)alarm(STARTUP_GRACE.count());
+    }
+
+    while (not(m_stopping and m_workers.empty())) {
+        (void)sigsuspend(&mask);
+
+        if (g_child_exited.exchange(false) and not reap()) {
+            success = false;
+            if (not m_stopping) {
+                std::cerr << "Worker failed to start, shutting down..." << std::endl;
+                m_stopping = true;
+                signalAll(SIGTERM);
+            }
+        }
+        if (const auto signal = g_stop_signal.exchange(0); signal and not m_stopping) {
+            std::cout << "Caught signal " << strsignal(signal) << '(' << signal
+                      << "), stopping workers..." << std::endl;
+            m_stopping = true;
+            signalAll(signal);
+        }
+        if (g_reload.exchange(false) and not m_stopping) {
+            reload();
+        }
+        if (g_reopen.exchange(false)) {
+            signalAll(SIGUSR1);
+        }
+        if (g_upgrade.exchange(false) and not m_stopping) {
+            upgrade();
+        }
+        if (g_started.exchange(false) and not m_stopping) {
+            takeOver();
+        }
+    }
+
+    (void)sigprocmask(SIG_SETMASK, &mask, nullptr);
+    return success;
+}
+
+bool Master::spawn(const unsigned slot) noexcept {
+    const auto mask = childMask();
+    const auto master = getpid();
+    const auto pid = fork();
+    if (pid == -1) {
+        std::cerr << "Failed to fork() worker: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (pid == 0) {
+        // The master is single-threaded, so the child inherits no lock held by another thread.
+        // It never returns, so takes over the listening sockets from its copy of the master.
+        runWorker(m_options, std::move(m_listeners), slot, master, mask);
+    }
+
+    m_workers.push_back(Worker {pid, slot, Clock::now()});
+    std::cout << "Started worker " << pid << " in slot " << slot << std::endl;
+    return true;
+}
+
+bool Master::reap() noexcept {
+    bool started = true;
+    for (;;) {
+        int status {};
+        const auto pid = waitpid(-1, &status, WNOHANG);
+        if (pid <= 0) {
+            return started;
+        }
+        if (pid == m_upgrade) {
+            m_upgrade = 0;
+            std::cerr << "New master " << pid << " exited, keeping the current binary"
+                      << std::endl;
+            continue;
+        }
+
+        const auto worker =
+            std::find_if(m_workers.begin(), m_workers.end(), [pid](const Worker &w) {
+                return w.pid == pid;
+            });
+        if (worker == m_workers.end()) {
+            continue;
+        }
+        const auto exited = *worker;
+        m_workers.erase(worker);
+
+        if (WIFSIGNALED(status)) {
+            std::cerr << "Worker " << pid << " killed by signal " << strsignal(WTERMSIG(status))
+                      << std::endl;
+        } else if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+            std::cerr << "Worker " << pid << " exited with status " << WEXITSTATUS(status)
+                      << std::endl;
+            if (Clock::now() - exited.started < STARTUP_GRACE) {
+                started = false;
+                continue;
+            }
+        }
+
+        if (not exited.retiring and not m_stopping and not spawn(exited.slot)) {
+            started = false;
+        }
+    }
+}
+
+void Master::reload() noexcept {
+    if (not m_options.config_file.empty()) {
+        try {
+            auto options = LoadServerOptions(m_options.command_line);
+            // Bound to the socket and to the slots, which outlive the workers, as does a ticket
+            // key that the config does not give
+            options.port = m_options.port;
+            options.workers = m_options.workers;
+            options.threads = m_options.threads;
+            if (options.tls_ticket_key.empty()) {
+                options.tls_ticket_key = m_options.tls_ticket_key;
+            }
+            m_options = std::move(options);
+        } catch (const ConfigException &e) {
+            std::cerr << "Failed to reload, keeping the current config: " << e.what()
+                      << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "Reloading, replacing " << m_workers.size() << " workers..." << std::endl;
+    const auto old_count = m_workers.size();
+    for (std::size_t i = 0; i < old_count; ++i) {
+        if (m_workers[i].retiring) {
+            continue;
+        }
+        // Spawned first, so that some worker keeps accepting; may reallocate m_workers
+        if (spawn(m_workers[i].slot)) {
+            m_workers[i].retiring = true;
+            (void)kill(m_workers[i].pid, SIGQUIT);
+        }
+    }
+}
+
+void Master::signalAll(const int signal) const noexcept {
+    for (const auto &worker : m_workers) {
+        (void)kill(worker.pid, signal);
+    }
+}
+
+void Master::upgrade() noexcept {
+    if (m_command.empty() or m_upgrade) {
+        std::cerr << "Ignoring upgrade: " << (m_upgrade ? "already under way" : "no command")
+                  << std::endl;
+        return;
+    }
+
+    const auto mask = childMask();
+    const auto master = getpid();
+    const auto pid = fork();
+    if (pid == -1) {
+        std::cerr << "Failed to fork() new master: " << strerror(errno) << std::endl;
+        return;
+    }
+    if (pid == 0) {
+        execUpgrade(m_command, m_listeners, master, mask);
+    }
+
+    // Keeps serving until the new master is up, which then has it quit
+    m_upgrade = pid;
+    std::cout << "Upgrading to new master " << pid << std::endl;
+}
+
+void Master::takeOver() noexcept {
+    std::cout << "Workers started, taking over from master " << m_upgraded_from << std::endl;
+    (void)kill(std::exchange(m_upgraded_from, 0), SIGQUIT);
+}
+
+} //namespace nginxpp
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <nginxpp/server.hpp>
+
+
+namespace nginxpp {
+
+/// Runs the server as worker processes sharing the listening sockets, which the master binds
+/// before forking them, so that a crash only takes down the connections of one worker, and
+/// workers share no allocator or stream. Workers that die are respawned.
+/// SIGINT, SIGQUIT and SIGTERM stop the workers and then the master, SIGHUP rereads the config
+/// file and replaces the workers with fresh ones serving it, and SIGUSR1 is forwarded to them
+/// to reopen the access log.
+/// SIGUSR2 upgrades the binary: the command is executed as a new master, which inherits the
+/// listening sockets through LISTEN_FDS, and which has this one quit once its workers are up,
+/// so that no connection is refused in between. If it fails instead, this one keeps serving.
+class Master {
+public:
+    /// Takes over the listening sockets passed on through LISTEN_FDS if any, e.g. by the master
+    /// being upgraded, otherwise throws SocketException if a socket cannot be created.
+    /// The command line to execute on SIGUSR2, empty to ignore it.
+    explicit Master(ServerOptions options, std::vector<std::string> command = {});
+
+    Master(const Master &) = delete;
+    Master &operator=(const Master &) = delete;
+
+    /// Returns once every worker stopped; false if they failed to start.
+    [[nodiscard]] bool Run() noexcept;
+
+    [[nodiscard]] int Port() const noexcept {
+        return m_options.port;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Worker {
+        pid_t pid {};
+        unsigned slot {};
+        Clock::time_point started;
+        /// Asked to stop, so not to be respawned
+        bool retiring = false;
+    };
+
+    [[nodiscard]] bool spawn(const unsigned slot) noexcept;
+
+    /// Returns false if a worker failed to start, which respawning would not fix.
+    [[nodiscard]] bool reap() noexcept;
+
+    /// Starts a new worker for every slot, then retires the old ones. Keeps the current options
+    /// if the config file turns out invalid, rather than replacing working workers.
+    void reload() noexcept;
+
+    void signalAll(const int signal) const noexcept;
+
+    /// Starts the new binary as a new master, unless an upgrade is already under way.
+    void upgrade() noexcept;
+
+    /// Once its workers are up, has the master that it was upgraded from quit.
+    void takeOver() noexcept;
+
+    ServerOptions m_options;
+    std::vector<std::string> m_command;
+    /// The one bound to the port first
+    std::vector<Socket> m_listeners;
+    std::vector<Worker> m_workers;
+    bool m_stopping = false;
+    /// The new master of an upgrade under way, 0 if none
+    pid_t m_upgrade {};
+    /// The old master of the upgrade that started this one, 0 if none
+    pid_t m_upgraded_from {};
+};
+
+} //namespace nginxpp
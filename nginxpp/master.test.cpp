@@ -0,0 +1,124 @@
+#include <nginxpp/master.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] std::string fetchStatusLine(const int port) {
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+        return {};
+    }
+
+    constexpr std::string_view REQUEST = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+    if (send(sock, REQUEST.data(), REQUEST.size(), 0) == -1) {
+        return {};
+    }
+    std::string response(64, '\0');
+    const auto n = recv(sock, response.data(), response.size(), MSG_WAITALL);
+    response.resize(std::max(0L, n));
+    return response.substr(0, response.find("\r\n"));
+}
+
+} //namespace
+
+
+TEST(MasterTests, WorkersServeAndStopWithTheMaster) {
+    ServerOptions options;
+    options.base_mount_dir = ".";
+    options.access_log = "off";
+    options.workers = 2;
+    Master master {options};
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        _exit(master.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Served by whichever worker accepts, and the first ones may still be starting
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(master.Port()));
+    }
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(MasterTests, PinnedWorkersServeFromTheLoopOfTheIncomingCpu) {
+    ServerOptions options;
+    options.base_mount_dir = ".";
+    options.access_log = "off";
+    options.workers = 2;
+    options.threads = 2;
+    options.worker_affinity = true;
+    options.loop_affinity = true;
+    options.incoming_cpu = true;
+    Master master {options};
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        _exit(master.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(master.Port()));
+    }
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(MasterTests, FailedUpgradeKeepsServing) {
+    ServerOptions options;
+    options.base_mount_dir = ".";
+    options.access_log = "off";
+    options.workers = 1;
+    Master master {options, {"/nonexistent/nginxpp"}};
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        _exit(master.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(master.Port()));
+    ASSERT_EQ(0, kill(pid, SIGUSR2));
+    // The new master exits on failing to execute, and the old one is left serving
+    std::this_thread::sleep_for(std::chrono::milliseconds {200});
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(master.Port()));
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
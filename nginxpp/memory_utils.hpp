@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace nginxpp {
+
+/// Padding per-thread data to this keeps threads from false sharing.
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+} //namespace nginxpp
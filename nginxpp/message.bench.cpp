@@ -0,0 +1,197 @@
+#include <nginxpp/message.hpp>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <ostream>
+
+#include <nginxpp/bench_utils.hpp>
+#include <nginxpp/response_headers.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::string_view FIREFOX_REQUEST = R"(GET /home.html HTTP/1.1
+Host: developer.mozilla.org
+User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.9; rv:50.0) Gecko/20100101 Firefox/50.0
+Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8
+Accept-Language: en-US,en;q=0.5
+Accept-Encoding: gzip, deflate, br
+Referer: https://developer.mozilla.org/testpage.html
+Connection: keep-alive
+Upgrade-Insecure-Requests: 1
+If-Modified-Since: Mon, 18 Jul 2016 02:36:04 GMT
+If-None-Match: "c561c68d0ba92bbeb8b0fff2a9199f722e3a621a"
+Cache-Control: max-age=0
+
+)";
+
+constexpr std::string_view CHROME_REQUEST = R"(GET /cmake HTTP/1.1
+Host: localhost:19840
+Connection: keep-alive
+Cache-Control: max-age=0
+sec-ch-ua: "Chromium";v="104", " Not A;Brand";v="99", "Google Chrome";v="104"
+sec-ch-ua-mobile: ?0
+sec-ch-ua-platform: "Linux"
+Upgrade-Insecure-Requests: 1
+User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/104.0.0.0 Safari/537.36
+Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.9
+Sec-Fetch-Site: none
+Sec-Fetch-Mode: navigate
+Sec-Fetch-User: ?1
+Sec-Fetch-Dest: document
+Accept-Encoding: gzip, deflate, br
+Accept-Language: zh-CN,zh;q=0.9,en-US;q=0.8,en;q=0.7
+
+)";
+
+constexpr std::string_view MINIMAL_REQUEST = "GET / HTTP/1.1\n\n";
+
+/// Like a request behind several proxies, with many tracing and cookie headers.
+[[nodiscard]] std::string createHeaderHeavyRequest(const int header_count) {
+    std::string request = "GET /api/v1/items?page=2&sort=desc HTTP/1.1\nHost: example.com\n";
+    for (int i = 0; i < header_count; ++i) {
+        request += "X-Custom-Header-" + std::to_string(i) + ": " + std::string(64, 'a' + i % 26) +
+                   '\n';
+    }
+    request += "Cookie: " + std::string(2048, 'c') + "\n\n";
+    return request;
+}
+
+void benchmarkParse(benchmark::State &state, const std::string_view request) {
+    ViewBuf buffer {request};
+    std::istream in {&buffer};
+
+    {
+        const AllocationCounter counter {state};
+        for (auto _ : state) {
+            buffer.Reset(request);
+            auto a_request = ParseOne(in);
+            benchmark::DoNotOptimize(a_request);
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * request.size());
+}
+
+void BM_ParseOne(benchmark::State &state) {
+    constexpr std::array CORPUS = {MINIMAL_REQUEST, FIREFOX_REQUEST, CHROME_REQUEST};
+    benchmarkParse(state, CORPUS[state.range(0)]);
+}
+BENCHMARK(BM_ParseOne)->ArgName("corpus")->DenseRange(0, 2);
+
+void BM_ParseOneHeaderHeavy(benchmark::State &state) {
+    benchmarkParse(state, createHeaderHeavyRequest(state.range(0)));
+}
+BENCHMARK(BM_ParseOneHeaderHeavy)->ArgName("headers")->Arg(16)->Arg(64);
+
+
+/// A directory of the given number of files, removed on destruction.
+class DirectoryFixture {
+public:
+    explicit DirectoryFixture(const int file_count) :
+        m_root(std::filesystem::canonical(std::filesystem::temp_directory_path()) /
+               ("nginxpp_bench_" + std::to_string(file_count))) {
+        std::filesystem::create_directories(m_root / "dir");
+        for (int i = 0; i < file_count; ++i) {
+            std::ofstream {m_root / "dir" / ("file_" + std::to_string(i) + ".html")} << i;
+        }
+        std::ofstream {m_root / "page.html"} << std::string(16 * 1024, 'x');
+    }
+
+    ~DirectoryFixture() noexcept {
+        std::error_code ec;
+        std::filesystem::remove_all(m_root, ec);
+    }
+
+    DirectoryFixture(const DirectoryFixture &) = delete;
+    DirectoryFixture &operator=(const DirectoryFixture &) = delete;
+
+    [[nodiscard]] const auto &Root() const noexcept {
+        return m_root;
+    }
+
+private:
+    std::filesystem::path m_root;
+};
+
+[[nodiscard]] inline auto createRequest(std::string target) {
+    Request a_request;
+    a_request.method = Method::GET;
+    a_request.target = std::move(target);
+    a_request.version = VERSION;
+    return a_request;
+}
+
+void benchmarkHandle(benchmark::State &state,
+                     const std::string &target,
+                     FileHeaderCache *const header_cache) {
+    const DirectoryFixture fixture {static_cast<int>(state.range(0))};
+    const auto a_request = createRequest(target);
+
+    const AllocationCounter counter {state};
+    for (auto _ : state) {
+        auto a_response = Handle(a_request, fixture.Root(), header_cache);
+        benchmark::DoNotOptimize(a_response);
+    }
+}
+
+void BM_HandleDirectory(benchmark::State &state) {
+    benchmarkHandle(state, "dir", nullptr);
+}
+BENCHMARK(BM_HandleDirectory)->ArgName("files")->Arg(10)->Arg(100)->Arg(1000);
+
+void BM_HandleFile(benchmark::State &state) {
+    benchmarkHandle(state, "page.html", nullptr);
+}
+BENCHMARK(BM_HandleFile)->ArgName("files")->Arg(0);
+
+void BM_HandleFileCached(benchmark::State &state) {
+    FileHeaderCache header_cache;
+    benchmarkHandle(state, "page.html", &header_cache);
+}
+BENCHMARK(BM_HandleFileCached)->ArgName("files")->Arg(0);
+
+void BM_HandleNotFound(benchmark::State &state) {
+    benchmarkHandle(state, "no_such_file.html", nullptr);
+}
+BENCHMARK(BM_HandleNotFound)->ArgName("files")->Arg(0);
+
+
+void BM_SerializeResponse(benchmark::State &state) {
+    const DirectoryFixture fixture {static_cast<int>(state.range(0))};
+    const auto a_response = Handle(createRequest("dir"), fixture.Root());
+
+    NullBuf buffer;
+    std::ostream out {&buffer};
+    {
+        const AllocationCounter counter {state};
+        for (auto _ : state) {
+            out << a_response;
+        }
+    }
+    state.SetBytesProcessed(buffer.Size());
+}
+BENCHMARK(BM_SerializeResponse)->ArgName("files")->Arg(10)->Arg(1000);
+
+void BM_SerializeHeaders(benchmark::State &state) {
+    FileHeaderCache header_cache;
+    const DirectoryFixture fixture {0};
+    const auto a_response = Handle(createRequest("page.html"), fixture.Root(), &header_cache);
+
+    std::size_t size = 0;
+    {
+        const AllocationCounter counter {state};
+        for (auto _ : state) {
+            const auto head = SerializeHeaders(a_response);
+            size += head.size();
+        }
+    }
+    state.SetBytesProcessed(size);
+}
+BENCHMARK(BM_SerializeHeaders);
+
+} //namespace
@@ -1,17 +1,29 @@
 #include <nginxpp/message.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <istream>
-#include <regex>
+#include <optional>
 #include <sstream>
+#include <streambuf>
 #include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <string.h>
+
+#include <unistd.h>
 
 #include <gsl/gsl>
 
 #include <nginxpp/chrono_utils.hpp>
 #include <nginxpp/exception.hpp>
 #include <nginxpp/path_utils.hpp>
+#include <nginxpp/response_headers.hpp>
 #include <nginxpp/string_utils.hpp>
+#include <nginxpp/trace.hpp>
+#include <nginxpp/variant_utils.hpp>
 
 
 using namespace nginxpp;
@@ -20,50 +32,122 @@ using namespace nginxpp;
 namespace {
 
 [[nodiscard]] auto parseMethod(const std::string_view method_str) {
-    static const std::unordered_map<std::string_view, Method> method_map {
-        {"GET", Method::GET},
-        {"HEAD", Method::HEAD},
-        {"POST", Method::POST},
-        {"PUT", Method::PUT},
-        {"DELETE", Method::DELETE},
-        {"CONNECT", Method::CONNECT},
-        {"OPTIONS", Method::OPTIONS},
-        {"TRACE", Method::TRACE},
-        {"PATCH", Method::PATCH},
-        {"PRI", Method::PRI}};
-
-    const auto iter = method_map.find(method_str);
-    if (iter == method_map.cend()) {
+    const auto method = ToMethod(method_str);
+    if (method == Method::UNKNOWN) {
         throw ParserException {"Unknown Method: '" + std::string(method_str) + '\''};
     }
 
-    return iter->second;
+    return method;
 }
 
 [[nodiscard]] auto decodeURI(std::string uri) noexcept {
     return uri;
 }
 
+[[nodiscard]] inline auto isSpace(const char c) noexcept {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+[[nodiscard]] inline auto trimFront(std::string_view s) noexcept {
+    while (not s.empty() and isSpace(s.front())) {
+        s.remove_prefix(1);
+    }
+    return s;
+}
+
+[[nodiscard]] inline auto trimBack(std::string_view s) noexcept {
+    while (not s.empty() and isSpace(s.back())) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+/// Splits off the leading run of non-space characters.
+[[nodiscard]] inline auto nextToken(std::string_view &s) noexcept {
+    const auto end = std::find_if(s.cbegin(), s.cend(), isSpace) - s.cbegin();
+    const auto token = s.substr(0, end);
+    s.remove_prefix(end);
+    return token;
+}
+
+/// Splits "METHOD TARGET VERSION", allowing trailing whitespace only.
+/// Scanned by hand, as std::regex recurses once per character, and would need megabytes of
+/// stack for a long line.
+[[nodiscard]] std::optional<std::array<std::string_view, 3>>
+splitStartLine(std::string_view line) noexcept {
+    std::array<std::string_view, 3> tokens;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        if (i != 0) {
+            if (line.empty() or not isSpace(line.front())) {
+                return std::nullopt;
+            }
+            line.remove_prefix(1);
+        }
+        tokens[i] = nextToken(line);
+        if (tokens[i].empty()) {
+            return std::nullopt;
+        }
+    }
+
+    if (not trimFront(line).empty()) {
+        return std::nullopt;
+    }
+    return tokens;
+}
+
+/// Splits "name: value"; the name may not contain whitespace, and the value may not be empty.
+[[nodiscard]] std::optional<std::pair<std::string_view, std::string_view>>
+splitHeader(std::string_view line) noexcept {
+    line = trimFront(line);
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    const auto name = trimBack(line.substr(0, colon));
+    const auto value = trimBack(trimFront(line.substr(colon + 1)));
+    if (name.empty() or value.empty() or
+        std::find_if(name.cbegin(), name.cend(), isSpace) != name.cend()) {
+        return std::nullopt;
+    }
+    return std::pair {name, value};
+}
+
+/// Reads a buffer in place, instead of copying it into a std::istringstream.
+class ViewBuf : public std::streambuf {
+public:
+    explicit ViewBuf(const std::string_view view) noexcept {
+        auto *const begin = const_cast<char *>(view.data());
+        setg(begin, begin, begin + view.size());
+    }
+};
+
+/// Accepts both CRLF, as required by RFC 9112, and bare LF line endings.
+auto &getLine(std::istream &in, std::string &a_line) noexcept {
+    if (std::getline(in, a_line) and not a_line.empty() and a_line.back() == '\r') {
+        a_line.pop_back();
+    }
+    return in;
+}
+
 [[nodiscard]] auto parseStartLine(std::istream &in) noexcept {
     Request a_request;
 
     std::string start_line;
-    if (not std::getline(in, start_line)) {
+    if (not getLine(in, start_line)) {
         a_request.status = 400;
         a_request.error_str = "No start line";
         return a_request;
     }
 
-    static const std::regex start_line_regex {R"(^(\S+)\s(\S+)\s(\S+)\s*$)"};
-
-    std::smatch matches;
-    if (not std::regex_match(start_line, matches, start_line_regex)) {
+    const auto tokens = splitStartLine(start_line);
+    if (not tokens) {
         a_request.status = 400;
         a_request.error_str = "Invalid start line: '" + start_line + '\'';
         return a_request;
     }
 
-    const auto method_str = matches[1].str();
+    const auto method_str = std::string {(*tokens)[0]};
     try {
         a_request.method = parseMethod(method_str);
     } catch (const ParserException &e) {
@@ -71,11 +155,11 @@ namespace {
         a_request.error_str = e.what();
         return a_request;
     }
-    a_request.target = decodeURI(matches[2].str());
+    a_request.target = decodeURI(std::string {(*tokens)[1]});
     if (not a_request.target.empty() and a_request.target.front() == '/') {
         a_request.target.erase(a_request.target.cbegin());
     }
-    a_request.version = matches[3].str();
+    a_request.version = (*tokens)[2];
 
     if (a_request.version != "HTTP/1.1" and a_request.version != "HTTP/1.0") {
         a_request.status = 505;
@@ -83,12 +167,6 @@ namespace {
         return a_request;
     }
 
-    if (a_request.method != Method::GET and a_request.method != Method::HEAD) {
-        a_request.status = 501;
-        a_request.error_str = "HTTP method " + method_str + " not implemented";
-        return a_request;
-    }
-
     if (a_request.target.size() > MAX_LINE_LENGTH) {
         a_request.status = 414;
         a_request.error_str = "Target URI length " + std::to_string(a_request.target.size()) +
@@ -100,17 +178,14 @@ namespace {
 }
 
 [[nodiscard]] auto parseOneHeader(const std::string &a_header, Request &a_request) noexcept {
-    static const std::regex header_regex {R"(^\s*(\S+)\s*:\s*(.+)\s*$)"};
-
     if (a_header.empty()) {
         return false;
     }
 
-    std::smatch matches;
-    if (std::regex_match(a_header, matches, header_regex)) {
-        auto value = decodeURI(matches[2].str());
+    if (const auto field = splitHeader(a_header); field) {
+        auto value = decodeURI(std::string {field->second});
         const auto [iter, inserted] =
-            a_request.headers.try_emplace(ToLower(matches[1].str()), std::move(value));
+            a_request.headers.try_emplace(ToLower(std::string {field->first}), std::move(value));
         if (not inserted) {
             iter->second += ", " + std::move(value);
         }
@@ -129,209 +204,8 @@ namespace {
 
 void parseHeaders(std::istream &in, Request &a_request) noexcept {
     std::string a_line;
-    while (std::getline(in, a_line) and parseOneHeader(a_line, a_request)) {
-    }
-}
-
-[[nodiscard]] auto toStatusText(const int code) noexcept {
-    switch (code) {
-    case 100:
-        return "Continue";
-    case 101:
-        return "Switching Protocol";
-    case 102:
-        return "Processing";
-    case 103:
-        return "Early Hints";
-    case 200:
-        return "OK";
-    case 201:
-        return "Created";
-    case 202:
-        return "Accepted";
-    case 203:
-        return "Non-Authoritative Information";
-    case 204:
-        return "No Content";
-    case 205:
-        return "Reset Content";
-    case 206:
-        return "Partial Content";
-    case 207:
-        return "Multi-Status";
-    case 208:
-        return "Already Reported";
-    case 226:
-        return "IM Used";
-    case 300:
-        return "Multiple Choice";
-    case 301:
-        return "Moved Permanently";
-    case 302:
-        return "Found";
-    case 303:
-        return "See Other";
-    case 304:
-        return "Not Modified";
-    case 305:
-        return "Use Proxy";
-    case 306:
-        return "unused";
-    case 307:
-        return "Temporary Redirect";
-    case 308:
-        return "Permanent Redirect";
-    case 400:
-        return "Bad Request";
-    case 401:
-        return "Unauthorized";
-    case 402:
-        return "Payment Required";
-    case 403:
-        return "Forbidden";
-    case 404:
-        return "Not Found";
-    case 405:
-        return "Method Not Allowed";
-    case 406:
-        return "Not Acceptable";
-    case 407:
-        return "Proxy Authentication Required";
-    case 408:
-        return "Request Timeout";
-    case 409:
-        return "Conflict";
-    case 410:
-        return "Gone";
-    case 411:
-        return "Length Required";
-    case 412:
-        return "Precondition Failed";
-    case 413:
-        return "Payload Too Large";
-    case 414:
-        return "URI Too Long";
-    case 415:
-        return "Unsupported Media Type";
-    case 416:
-        return "Range Not Satisfiable";
-    case 417:
-        return "Expectation Failed";
-    case 418:
-        return "I'm a teapot";
-    case 421:
-        return "Misdirected Request";
-    case 422:
-        return "Unprocessable Entity";
-    case 423:
-        return "Locked";
-    case 424:
-        return "Failed Dependency";
-    case 425:
-        return "Too Early";
-    case 426:
-        return "Upgrade Required";
-    case 428:
-        return "Precondition Required";
-    case 429:
-        return "Too Many Requests";
-    case 431:
-        return "Request Header Fields Too Large";
-    case 451:
-        return "Unavailable For Legal Reasons";
-    case 501:
-        return "Not Implemented";
-    case 502:
-        return "Bad Gateway";
-    case 503:
-        return "Service Unavailable";
-    case 504:
-        return "Gateway Timeout";
-    case 505:
-        return "HTTP Version Not Supported";
-    case 506:
-        return "Variant Also Negotiates";
-    case 507:
-        return "Insufficient Storage";
-    case 508:
-        return "Loop Detected";
-    case 510:
-        return "Not Extended";
-    case 511:
-        return "Network Authentication Required";
-
-    default:
-    case 500:
-        return "Internal Server Error";
-    }
-}
-
-[[nodiscard]] std::string toContentType(const std::filesystem::path &p) noexcept {
-    static const std::unordered_map<std::string_view, std::string> CONTENT_TYPE_MAP = {
-        {"css", "text/css"},
-        {"csv", "text/csv"},
-        {"htm", "text/html"},
-        {"html", "text/html"},
-        {"js", "text/javascript"},
-        {"mjs", "text/javascript"},
-        {"txt", "text/plain"},
-        {"vtt", "text/vtt"},
-
-        {"apng", "image/apng"},
-        {"avif", "image/avif"},
-        {"bmp", "image/bmp"},
-        {"gif", "image/gif"},
-        {"png", "image/png"},
-        {"svg", "image/svg+xml"},
-        {"webp", "image/webp"},
-        {"ico", "image/x-icon"},
-        {"tif", "image/tiff"},
-        {"tiff", "image/tiff"},
-        {"jpg", "image/jpeg"},
-        {"jpeg", "image/jpeg"},
-
-        {"mp4", "video/mp4"},
-        {"mpeg", "video/mpeg"},
-        {"webm", "video/webm"},
-
-        {"mp3", "audio/mp3"},
-        {"mpga", "audio/mpeg"},
-        {"weba", "audio/webm"},
-        {"wav", "audio/wave"},
-
-        {"otf", "font/otf"},
-        {"ttf", "font/ttf"},
-        {"woff", "font/woff"},
-        {"woff2", "font/woff2"},
-
-        {"7z", "application/x-7z-compressed"},
-        {"atom", "application/atom+xml"},
-        {"pdf", "application/pdf"},
-        {"json", "application/json"},
-        {"rss", "application/rss+xml"},
-        {"tar", "application/x-tar"},
-        {"xht", "application/xhtml+xml"},
-        {"xhtml", "application/xhtml+xml"},
-        {"xslt", "application/xslt+xml"},
-        {"xml", "application/xml"},
-        {"gz", "application/gzip"},
-        {"zip", "application/zip"},
-        {"wasm", "application/wasm"},
-    };
-
-    const auto extension = ToLower(p.extension());
-    const auto key = [](const std::string_view ext) {
-        if (not ext.empty() and ext.front() == '.') {
-            return ext.substr(1);
-        }
-        return ext;
-    }(extension);
-
-    if (const auto iter = CONTENT_TYPE_MAP.find(key); iter != CONTENT_TYPE_MAP.cend()) {
-        return iter->second;
+    while (getLine(in, a_line) and parseOneHeader(a_line, a_request)) {
     }
-
-    return "application/octet-stream";
 }
 
 inline auto toHtmlTableHeaderRow(const std::vector<std::string_view> &headers) noexcept {
@@ -448,11 +322,79 @@ auto &buildLsPage(std::ostream &out,
     return out << "</html>";
 }
 
+constexpr std::size_t BODY_CHUNK_SIZE = 4096;
+
+void writeFileRange(std::ostream &out, const FileRange &range) noexcept {
+    std::array<char, BODY_CHUNK_SIZE> buffer;
+    for (std::size_t total = 0; total < range.length;) {
+        const auto requested = std::min(buffer.size(), range.length - total);
+        const auto n = pread(range.fd, buffer.data(), requested, range.offset + total);
+        if (n <= 0) {
+            out.setstate(std::ios::badbit);
+            return;
+        }
+        out.write(buffer.data(), n);
+        total += n;
+    }
+}
+
+void writeGenerated(std::ostream &out, const BodyGenerator &generate) noexcept {
+    std::array<char, BODY_CHUNK_SIZE> buffer;
+    while (const auto n = generate(buffer)) {
+        out.write(buffer.data(), n);
+    }
+}
+
 } //namespace
 
 
 namespace nginxpp {
 
+Method ToMethod(const std::string_view name) noexcept {
+    static const std::unordered_map<std::string_view, Method> method_map {
+        {"GET", Method::GET},
+        {"HEAD", Method::HEAD},
+        {"POST", Method::POST},
+        {"PUT", Method::PUT},
+        {"DELETE", Method::DELETE},
+        {"CONNECT", Method::CONNECT},
+        {"OPTIONS", Method::OPTIONS},
+        {"TRACE", Method::TRACE},
+        {"PATCH", Method::PATCH},
+        {"PRI", Method::PRI}};
+
+    const auto iter = method_map.find(name);
+    return iter == method_map.cend() ? Method::UNKNOWN : iter->second;
+}
+
+std::string_view ToString(const Method method) noexcept {
+    switch (method) {
+    case Method::GET:
+        return "GET";
+    case Method::HEAD:
+        return "HEAD";
+    case Method::POST:
+        return "POST";
+    case Method::PUT:
+        return "PUT";
+    case Method::DELETE:
+        return "DELETE";
+    case Method::CONNECT:
+        return "CONNECT";
+    case Method::OPTIONS:
+        return "OPTIONS";
+    case Method::TRACE:
+        return "TRACE";
+    case Method::PATCH:
+        return "PATCH";
+    case Method::PRI:
+        return "PRI";
+    case Method::UNKNOWN:
+        break;
+    }
+    return "UNKNOWN";
+}
+
 [[nodiscard]] Request ParseOne(std::istream &in) noexcept {
     const auto in_final = gsl::finally([&in]() {
         in.clear();
@@ -466,7 +408,30 @@ namespace nginxpp {
     return a_request;
 }
 
-[[nodiscard]] Response Handle(Request a_request, const std::filesystem::path &root_dir) noexcept {
+[[nodiscard]] Request ParseOne(const std::string_view head) noexcept {
+    ViewBuf buf {head};
+    std::istream in {&buf};
+    return ParseOne(in);
+}
+
+std::size_t FindHeadEnd(const std::string_view input, const std::size_t scanned) noexcept {
+    for (auto pos = input.find('\n', scanned > 2 ? scanned - 2 : 0); pos != input.npos;
+         pos = input.find('\n', pos + 1)) {
+        const auto rest = input.substr(pos + 1);
+        if (StartsWith(rest, "\n")) {
+            return pos + 2;
+        }
+        if (StartsWith(rest, "\r\n")) {
+            return pos + 3;
+        }
+    }
+    return 0;
+}
+
+[[nodiscard]] Response Handle(Request a_request,
+                              const std::filesystem::path &root_dir,
+                              FileHeaderCache *const header_cache,
+                              RequestTrace *const trace) noexcept {
     Response a_response;
     a_response.status = a_request.status;
     a_response.error_str = std::move(a_request.error_str);
@@ -474,6 +439,15 @@ namespace nginxpp {
         return a_response;
     }
 
+    // Parsed, as other methods may be proxied, but not served from the mount directory
+    if (a_request.method != Method::GET and a_request.method != Method::HEAD) {
+        a_response.status = 501;
+        a_response.error_str = "HTTP method " + std::string {ToString(a_request.method)} +
+                               " not implemented";
+        return a_response;
+    }
+
+    std::optional<ScopedSpan> resolve_span {std::in_place, trace, Span::RESOLVE};
     const auto p = weakly_canonical(root_dir / a_request.target);
 
     if (not StartsWith(p, root_dir)) {
@@ -482,25 +456,41 @@ namespace nginxpp {
         return a_response;
     }
 
-    if (not std::filesystem::exists(p)) {
+    const auto status = std::filesystem::status(p);
+    resolve_span.reset();
+
+    if (not std::filesystem::exists(status)) {
         a_response.status = 404;
         a_response.error_str = "Target '" + p.string() + "' not found";
         return a_response;
     }
 
-    if (is_directory(p)) {
-        auto ss = std::make_unique<std::stringstream>();
-        buildLsPage(*ss, p, root_dir);
+    if (is_directory(status)) {
+        const ScopedSpan list_span {trace, Span::LIST};
+        std::ostringstream oss;
+        buildLsPage(oss, p, root_dir);
+        auto page = std::move(oss).str();
 
         a_response.headers["Content-Type"] = "text/html; charset=ascii";
-        a_response.headers["Content-Length"] = std::to_string(ss->str().size());
-        a_response.body_stream = std::move(ss);
+        a_response.headers["Content-Length"] = std::to_string(page.size());
+        a_response.body = std::move(page);
+
+    } else if (is_regular_file(status)) {
+        const ScopedSpan open_span {trace, Span::OPEN};
+        auto range = OpenFileRange(p);
+        if (range.fd == FileDescriptor::INVALID_FD) {
+            a_response.status = 403;
+            a_response.error_str = "Failed to open '" + p.string() + "': " + strerror(errno);
+            return a_response;
+        }
 
-    } else if (is_regular_file(p)) {
-        PathStats stats {p};
-        a_response.headers["Content-Type"] = toContentType(p);
-        a_response.headers["Content-Length"] = std::to_string(stats.size);
-        a_response.body_stream = std::make_unique<std::fstream>(p, std::ios::binary);
+        if (header_cache) {
+            a_response.fixed_headers = header_cache->Get(p, range);
+        } else {
+            a_response.fixed_headers =
+                std::make_shared<const std::string>(BuildFileHeaders(p, range));
+        }
+        a_response.body = std::move(range);
 
     } else {
         a_response.status = 500;
@@ -511,17 +501,47 @@ namespace nginxpp {
     return a_response;
 }
 
-std::ostream &operator<<(std::ostream &out, const Response &a_response) noexcept {
-    out << VERSION << ' ' << a_response.status << ' ' << toStatusText(a_response.status) << '\n';
+std::string SerializeHeaders(const Response &a_response) noexcept {
+    std::string head;
+    head.reserve(256);
 
+    head += GetStatusLine(a_response.status);
+    head += GetDateHeader();
+    head += GetServerHeader();
     for (const auto &[key, value] : a_response.headers) {
-        out << key << ": " << value << '\n';
+        head.append(key).append(": ").append(value).append(CRLF);
     }
-    out << '\n';
-
-    if (a_response.body_stream) {
-        out << a_response.body_stream->rdbuf();
+    if (a_response.fixed_headers) {
+        head += *a_response.fixed_headers;
     }
+    head += CRLF;
+
+    return head;
+}
+
+std::ostream &operator<<(std::ostream &out, const Response &a_response) noexcept {
+    out << SerializeHeaders(a_response);
+
+    std::visit(Overloaded {
+                   [](const std::monostate) {
+                   },
+                   [&out](const std::string_view view) {
+                       out << view;
+                   },
+                   [&out](const std::string &buffer) {
+                       out << buffer;
+                   },
+                   [&out](const FileRange &range) {
+                       writeFileRange(out, range);
+                   },
+                   [&out](const MappedRegion &region) {
+                       out << region.View();
+                   },
+                   [&out](const BodyGenerator &generate) {
+                       writeGenerated(out, generate);
+                   },
+               },
+               a_response.body);
 
     return out;
 }
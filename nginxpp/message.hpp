@@ -2,9 +2,13 @@
 
 #include <filesystem>
 #include <iosfwd>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
+#include <nginxpp/body.hpp>
+
 
 namespace nginxpp {
 
@@ -27,6 +31,11 @@ struct Message {
     }
 };
 
+[[nodiscard]] std::string_view ToString(const Method method) noexcept;
+
+/// Method::UNKNOWN if the name is not that of a method, in upper case.
+[[nodiscard]] Method ToMethod(const std::string_view name) noexcept;
+
 struct Request : public Message {
     std::string target;
     std::string version;
@@ -34,12 +43,33 @@ struct Request : public Message {
 };
 
 struct Response : public Message {
-    std::unique_ptr<std::iostream> body_stream;
+    /// Pre-serialized header lines, sent verbatim after the headers.
+    std::shared_ptr<const std::string> fixed_headers;
+    Body body;
 };
 
 [[nodiscard]] Request ParseOne(std::istream &in) noexcept;
 
-[[nodiscard]] Response Handle(Request a_request, const std::filesystem::path &root_dir) noexcept;
+/// Parses a request head already read into memory, up to and including its blank line.
+[[nodiscard]] Request ParseOne(const std::string_view head) noexcept;
+
+/// The size of the head at the front of the input, up to and including its blank line, or 0
+/// if the blank line has not arrived yet. Resumes the search from where the last one stopped,
+/// given how much of the input it scanned.
+[[nodiscard]] std::size_t FindHeadEnd(const std::string_view input,
+                                      const std::size_t scanned = 0) noexcept;
+
+class FileHeaderCache;
+class RequestTrace;
+
+/// Serves GET and HEAD only. If given a trace, records the RESOLVE, LIST and OPEN spans into it.
+[[nodiscard]] Response Handle(Request a_request,
+                              const std::filesystem::path &root_dir,
+                              FileHeaderCache *const header_cache = nullptr,
+                              RequestTrace *const trace = nullptr) noexcept;
+
+/// Serializes the status line and the headers, including the terminating blank line.
+[[nodiscard]] std::string SerializeHeaders(const Response &a_response) noexcept;
 
 std::ostream &operator<<(std::ostream &out, const Response &a_response) noexcept;
 
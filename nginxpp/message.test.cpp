@@ -1,8 +1,14 @@
 #include <nginxpp/message.hpp>
 
+#include <memory>
+
+#include <pthread.h>
+
 #include <gtest/gtest.h>
 
 #include <nginxpp/exception.hpp>
+#include <nginxpp/path_utils.hpp>
+#include <nginxpp/response_headers.hpp>
 
 
 using namespace nginxpp;
@@ -60,6 +66,20 @@ Accept-Language: zh-CN,zh;q=0.9,en-US;q=0.8,en;q=0.7
     ASSERT_EQ(15, a_request.headers.size());
 }
 
+TEST(ParserTest, CanParseCRLF) {
+    std::istringstream ss {"GET /a HTTP/1.1\r\nHost: localhost\r\n\r\nHEAD /b HTTP/1.1\r\n\r\n"};
+
+    const auto first = ParseOne(ss);
+    EXPECT_EQ("a", first.target);
+    EXPECT_EQ("HTTP/1.1", first.version);
+    ASSERT_EQ(1, first.headers.size());
+    EXPECT_EQ("localhost", first.headers.at("host"));
+
+    const auto second = ParseOne(ss);
+    EXPECT_EQ(Method::HEAD, second.method);
+    EXPECT_EQ("b", second.target);
+}
+
 TEST(ParserTest, ErrorIfMissingStartLine) {
     std::istringstream ss;
 
@@ -76,6 +96,14 @@ TEST(ParserTest, ErrorIfInvalidStartLine) {
     EXPECT_FALSE(a_request);
 }
 
+TEST(ParserTest, ErrorIfStartLineHasExtraSpaces) {
+    std::istringstream ss {"GET  /home.html HTTP/1.1\n"};
+
+    const auto a_request = ParseOne(ss);
+    EXPECT_EQ(400, a_request.status);
+    EXPECT_FALSE(a_request);
+}
+
 TEST(ParserTest, ErrorIfVersionNotSupported) {
     std::istringstream ss {R"(GET / HTTP/2.1)"};
 
@@ -92,12 +120,12 @@ TEST(ParserTest, ErrorIfUnknownMethod) {
     EXPECT_FALSE(a_request);
 }
 
-TEST(ParserTest, ErrorIfMethodNotImplemented) {
-    std::istringstream ss {R"(TRACE /home.html HTTP/1.1)"};
+TEST(ParserTest, CanParseMethodsNotServedFromDisk) {
+    std::istringstream ss {"POST /api HTTP/1.1\r\n\r\n"};
 
     const auto a_request = ParseOne(ss);
-    EXPECT_NE(200, a_request.status);
-    EXPECT_FALSE(a_request);
+    EXPECT_TRUE(a_request);
+    EXPECT_EQ(Method::POST, a_request.method);
 }
 
 TEST(ParserTest, ErrorIfTargetTooLong) {
@@ -182,6 +210,42 @@ max-age=0
     EXPECT_EQ("1", a_request.headers.at("upgrade-insecure-requests"));
 }
 
+TEST(ParserTest, HeaderValuesAreTrimmed) {
+    std::istringstream ss {"GET /home.html HTTP/1.1 \r\n  Host :  localhost \t\r\n\r\n"};
+
+    const auto a_request = ParseOne(ss);
+    ASSERT_TRUE(a_request);
+    EXPECT_EQ("HTTP/1.1", a_request.version);
+    EXPECT_EQ("localhost", a_request.headers.at("host"));
+}
+
+TEST(ParserTest, CanParseLongHeaderOnSmallStack) {
+    // Sessions run on small stacks, so parsing may not recurse per character
+    constexpr std::size_t STACK_SIZE = 128 * 1024;
+    std::istringstream ss {"GET /home.html HTTP/1.1\nLong-Header: " +
+                           std::string(MAX_LINE_LENGTH, '*') + "\n\n"};
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, STACK_SIZE);
+    pthread_t thread {};
+    ASSERT_EQ(0,
+              pthread_create(
+                  &thread,
+                  &attributes,
+                  [](void *const in) -> void * {
+                      return new Request {ParseOne(*static_cast<std::istringstream *>(in))};
+                  },
+                  &ss));
+    pthread_attr_destroy(&attributes);
+
+    void *result = nullptr;
+    ASSERT_EQ(0, pthread_join(thread, &result));
+    const std::unique_ptr<Request> a_request {static_cast<Request *>(result)};
+    ASSERT_TRUE(*a_request);
+    EXPECT_EQ(MAX_LINE_LENGTH, a_request->headers.at("long-header").size());
+}
+
 TEST(ParserTest, ErrorIfHeaderTooLong) {
     std::istringstream ss {R"(GET /home.html HTTP/1.1
 Connection: keep-alive
@@ -206,8 +270,19 @@ TEST(HandleTest, ErrorIfInvalidRequest) {
     EXPECT_EQ(a_request.status, a_response.status);
 }
 
+TEST(HandleTest, ErrorIfMethodNotImplemented) {
+    Request a_request;
+    a_request.method = Method::TRACE;
+    a_request.target = ".";
+
+    const auto a_response = Handle(a_request, std::filesystem::current_path());
+    EXPECT_FALSE(a_response);
+    EXPECT_EQ(501, a_response.status);
+}
+
 TEST(HandleTest, ErrorIfRequestFileOutSideRoot) {
     Request a_request;
+    a_request.method = Method::GET;
     a_request.target = "..";
 
     const auto a_response = Handle(a_request, std::filesystem::current_path());
@@ -216,6 +291,7 @@ TEST(HandleTest, ErrorIfRequestFileOutSideRoot) {
 
 TEST(HandleTest, ErrorIfRequestFileNotExist) {
     Request a_request;
+    a_request.method = Method::GET;
     a_request.target = "no_such_file";
 
     const auto a_response = Handle(a_request, std::filesystem::current_path());
@@ -224,20 +300,47 @@ TEST(HandleTest, ErrorIfRequestFileNotExist) {
 
 TEST(HandleTest, HasBodyIfRequestDir) {
     Request a_request;
+    a_request.method = Method::GET;
     a_request.target = ".";
 
     const auto a_response = Handle(a_request, std::filesystem::current_path());
     ASSERT_TRUE(a_response);
-    EXPECT_TRUE(a_response.body_stream);
+    EXPECT_TRUE(HasBody(a_response.body));
+    EXPECT_TRUE(std::holds_alternative<std::string>(a_response.body));
 }
 
 TEST(HandleTest, HasBodyIfRequestFile) {
     Request a_request;
+    a_request.method = Method::GET;
     a_request.target = "Makefile";
 
     const auto a_response = Handle(a_request, std::filesystem::current_path());
     ASSERT_TRUE(a_response);
-    EXPECT_TRUE(a_response.body_stream);
+    EXPECT_TRUE(HasBody(a_response.body));
+    EXPECT_TRUE(std::holds_alternative<FileRange>(a_response.body));
+}
+
+TEST(HandleTest, FileHeadersAreCached) {
+    Request a_request;
+    a_request.method = Method::GET;
+    a_request.target = "Makefile";
+    FileHeaderCache cache;
+
+    const auto first = Handle(a_request, std::filesystem::current_path(), &cache);
+    const auto second = Handle(a_request, std::filesystem::current_path(), &cache);
+    ASSERT_TRUE(first.fixed_headers);
+    EXPECT_EQ(first.fixed_headers, second.fixed_headers);
+    EXPECT_EQ(1, cache.Misses());
+    EXPECT_EQ(1, cache.Hits());
+}
+
+TEST(HandleTest, NoBodyIfInvalidRequest) {
+    Request a_request;
+    a_request.status = 400;
+    a_request.error_str = "Error";
+
+    const auto a_response = Handle(a_request, std::filesystem::current_path());
+    EXPECT_FALSE(HasBody(a_response.body));
 }
 
 
@@ -245,15 +348,66 @@ TEST(ResponseTest, OutputInExpectedFormat) {
     Response a_response;
     a_response.status = 200;
     a_response.headers["Connection"] = "keep-alive";
-    a_response.body_stream = std::make_unique<std::stringstream>("Hello");
+    a_response.body = std::string {"Hello"};
 
     std::ostringstream oss;
     oss << a_response;
+    const auto output = oss.str();
 
-    const std::string EXPECTED = R"(HTTP/1.1 200 OK
-Connection: keep-alive
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, output.find("\r\nDate: "));
+    EXPECT_NE(std::string::npos, output.find("\r\nServer: nginxpp/"));
+    EXPECT_NE(std::string::npos, output.find("\r\nConnection: keep-alive\r\n"));
+    EXPECT_TRUE(output.ends_with("\r\n\r\nHello"));
+}
+
+TEST(ResponseTest, FixedHeadersFollowOtherHeaders) {
+    Response a_response;
+    a_response.status = 404;
+    a_response.fixed_headers = std::make_shared<const std::string>("Content-Length: 0\r\n");
+
+    const auto head = SerializeHeaders(a_response);
+
+    EXPECT_TRUE(head.starts_with("HTTP/1.1 404 Not Found\r\n"));
+    EXPECT_TRUE(head.ends_with("\r\nContent-Length: 0\r\n\r\n"));
+}
 
-Hello)";
+TEST(ResponseTest, CanOutputStaticBody) {
+    Response a_response;
+    a_response.body = std::string_view {"Hello"};
+
+    std::ostringstream oss;
+    oss << a_response;
+
+    EXPECT_TRUE(oss.str().ends_with("\r\n\r\nHello"));
+}
+
+TEST(ResponseTest, CanOutputFileBody) {
+    const auto size = GetFileSize("Makefile");
+    ASSERT_LT(0, size);
+
+    Response a_response;
+    a_response.body = OpenFileRange("Makefile");
+
+    std::ostringstream oss;
+    oss << a_response;
+
+    EXPECT_EQ(SerializeHeaders(a_response).size() + size, oss.str().size());
+}
+
+TEST(ResponseTest, CanOutputGeneratedBody) {
+    Response a_response;
+    a_response.body = [remaining = 3](const gsl::span<char> buffer) mutable -> std::size_t {
+        if (remaining == 0) {
+            return 0;
+        }
+        --remaining;
+        buffer[0] = 'a';
+        return 1;
+    };
+
+    std::ostringstream oss;
+    oss << a_response;
 
-    EXPECT_EQ(EXPECTED, oss.str());
+    EXPECT_TRUE(oss.str().ends_with("\r\n\r\naaa"));
 }
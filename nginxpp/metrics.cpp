@@ -0,0 +1,561 @@
+#include <nginxpp/metrics.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include <gsl/gsl>
+
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/trace.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+using Counter = std::atomic<std::uint64_t>;
+
+/// Each shard has a single writer at a time, so a relaxed load and store is enough, and
+/// avoids the locked read-modify-write of fetch_add().
+inline void increase(Counter &counter, const std::uint64_t n = 1) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+[[nodiscard]] inline auto read(const Counter &counter) noexcept {
+    return counter.load(std::memory_order_relaxed);
+}
+
+struct alignas(CACHE_LINE_SIZE) Shard {
+    Counter connections_opened {0};
+    Counter connections_closed {0};
+    Counter connections_rejected {0};
+    Counter connection_memory_allocated {0};
+    Counter connection_memory_freed {0};
+    Counter bytes_sent {0};
+    Counter cache_hits {0};
+    Counter cache_misses {0};
+    Counter requests_shed {0};
+    /// A gauge of 0 or 1, summed over the shards into the number of overloaded loops
+    Counter overloaded {0};
+    std::array<Counter, STATUS_COUNT> requests_by_status {};
+    std::array<Counter, METHOD_COUNT> requests_by_method {};
+    std::array<Counter, CACHE_STATUS_COUNT> proxy_cache {};
+
+    struct alignas(CACHE_LINE_SIZE) Histogram {
+        std::array<Counter, LatencyHistogram::BUCKET_COUNT> buckets {};
+        Counter sum {0};
+    };
+    std::array<Histogram, PHASE_COUNT> latencies {};
+
+    struct Host {
+        Counter requests {0};
+        Counter bytes_sent {0};
+        Counter cache_hits {0};
+        Counter cache_misses {0};
+    };
+    std::array<Host, MAX_HOST_SLOTS> hosts {};
+};
+
+class ShardRegistry {
+public:
+    [[nodiscard]] gsl::not_null<Shard *> Acquire() noexcept {
+        const std::lock_guard lock {m_mutex};
+        if (not m_free.empty()) {
+            auto *const shard = m_free.back();
+            m_free.pop_back();
+            return shard;
+        }
+        return m_shards.emplace_back(std::make_unique<Shard>()).get();
+    }
+
+    void Release(const gsl::not_null<Shard *> shard) noexcept {
+        const std::lock_guard lock {m_mutex};
+        m_free.push_back(shard);
+    }
+
+    template<typename Function>
+    void ForEach(const Function func) const noexcept {
+        const std::lock_guard lock {m_mutex};
+        for (const auto &shard : m_shards) {
+            func(*shard);
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::vector<Shard *> m_free;
+};
+
+[[nodiscard]] auto &registry() noexcept {
+    // Never destroyed, as detached threads may still release their shards during exit
+    static auto *const REGISTRY = new ShardRegistry;
+    return *REGISTRY;
+}
+
+/// Returns the shard to the registry when its thread exits, keeping the counters, so the
+/// number of shards is bounded by the peak number of threads.
+class ShardLease {
+public:
+    ShardLease() noexcept : m_shard(registry().Acquire()) {
+    }
+
+    ~ShardLease() noexcept {
+        registry().Release(m_shard);
+    }
+
+    ShardLease(const ShardLease &) = delete;
+    ShardLease &operator=(const ShardLease &) = delete;
+
+    [[nodiscard]] Shard &Get() const noexcept {
+        return *m_shard;
+    }
+
+private:
+    gsl::not_null<Shard *> m_shard;
+};
+
+/// Gives out the host slots, which are never taken back, as the shards keep counting in them.
+class HostSlots {
+public:
+    [[nodiscard]] std::size_t SlotOf(const std::string_view server_name) noexcept {
+        const std::lock_guard lock {m_mutex};
+        // The default host has no name to be looked up by
+        const auto iter = std::find(m_names.begin() + 1, m_names.end(), server_name);
+        if (iter != m_names.end()) {
+            return iter - m_names.begin();
+        }
+        if (m_names.size() + 1 < MAX_HOST_SLOTS) {
+            m_names.emplace_back(server_name);
+            return m_names.size() - 1;
+        }
+        if (m_names.size() < MAX_HOST_SLOTS) {
+            m_names.emplace_back("other");
+        }
+        return MAX_HOST_SLOTS - 1;
+    }
+
+    [[nodiscard]] std::vector<std::string> Names() const noexcept {
+        const std::lock_guard lock {m_mutex};
+        return m_names;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::string> m_names {"default"};
+};
+
+[[nodiscard]] auto &hostSlots() noexcept {
+    static auto *const SLOTS = new HostSlots;
+    return *SLOTS;
+}
+
+[[nodiscard]] inline auto &localShard() noexcept {
+    thread_local ShardLease lease;
+    return lease.Get();
+}
+
+[[nodiscard]] inline auto toIndex(const int status) noexcept {
+    return status < 0 or static_cast<std::size_t>(status) >= STATUS_COUNT ? 0 : status;
+}
+
+[[nodiscard]] inline auto toMicroseconds(const std::chrono::nanoseconds latency) noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+}
+
+constexpr std::array QUANTILES = {0.5, 0.9, 0.99, 0.999};
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::string_view ToString(const Phase phase) noexcept {
+    switch (phase) {
+    case Phase::PARSE:
+        return "parse";
+    case Phase::HANDLE:
+        return "handle";
+    case Phase::WRITE:
+        return "write";
+    case Phase::QUEUE:
+        return "queue";
+    }
+    return "unknown";
+}
+
+
+std::size_t LatencyHistogram::BucketOf(std::uint64_t value) noexcept {
+    value = std::min(value, MAX_VALUE);
+    if (value < SUB_BUCKET_COUNT) {
+        return value;
+    }
+
+    const auto msb = std::bit_width(value) - 1;
+    const auto group = msb - SUB_BUCKET_BITS + 1;
+    const auto sub_bucket = (value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return group * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+std::uint64_t LatencyHistogram::LowerBoundOf(const std::size_t bucket) noexcept {
+    const auto group = bucket / SUB_BUCKET_COUNT;
+    const auto sub_bucket = bucket % SUB_BUCKET_COUNT;
+    if (group == 0) {
+        return sub_bucket;
+    }
+    return (SUB_BUCKET_COUNT + sub_bucket) << (group - 1);
+}
+
+void LatencyHistogram::Add(const Buckets &buckets, const std::uint64_t sum) noexcept {
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+        m_buckets[i] += buckets[i];
+        m_count += buckets[i];
+    }
+    m_sum += sum;
+}
+
+void LatencyHistogram::Record(const std::uint64_t value) noexcept {
+    ++m_buckets[BucketOf(value)];
+    ++m_count;
+    m_sum += value;
+}
+
+std::uint64_t LatencyHistogram::ValueAt(const double quantile) const noexcept {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const auto rank = std::max<std::uint64_t>(1, quantile * m_count + 0.5);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return i + 1 < BUCKET_COUNT ? LowerBoundOf(i + 1) - 1 : MAX_VALUE;
+        }
+    }
+    return MAX_VALUE;
+}
+
+
+std::uint64_t MetricsSnapshot::TotalRequests() const noexcept {
+    std::uint64_t total = 0;
+    for (const auto n : requests_by_status) {
+        total += n;
+    }
+    return total;
+}
+
+
+void RecordConnectionOpened() noexcept {
+    increase(localShard().connections_opened);
+}
+
+void RecordConnectionClosed() noexcept {
+    increase(localShard().connections_closed);
+}
+
+void RecordConnectionRejected() noexcept {
+    increase(localShard().connections_rejected);
+}
+
+void RecordConnectionMemory(const std::ptrdiff_t bytes) noexcept {
+    auto &shard = localShard();
+    if (bytes >= 0) {
+        increase(shard.connection_memory_allocated, bytes);
+    } else {
+        increase(shard.connection_memory_freed, -bytes);
+    }
+}
+
+std::size_t HostSlot(const std::string_view server_name) noexcept {
+    return hostSlots().SlotOf(server_name);
+}
+
+void RecordRequest(const Method method,
+                   const int status,
+                   const std::size_t bytes_sent,
+                   const std::size_t host_slot) noexcept {
+    Expects(host_slot < MAX_HOST_SLOTS);
+    auto &shard = localShard();
+    increase(shard.requests_by_status[toIndex(status)]);
+    increase(shard.requests_by_method[static_cast<std::size_t>(method)]);
+    increase(shard.bytes_sent, bytes_sent);
+    increase(shard.hosts[host_slot].requests);
+    increase(shard.hosts[host_slot].bytes_sent, bytes_sent);
+}
+
+void RecordLatency(const Phase phase, const std::chrono::nanoseconds latency) noexcept {
+    const auto us = toMicroseconds(latency);
+    auto &histogram = localShard().latencies[static_cast<std::size_t>(phase)];
+    increase(histogram.buckets[LatencyHistogram::BucketOf(us)]);
+    increase(histogram.sum, us);
+}
+
+void RecordCacheLookup(const bool hit, const std::size_t host_slot) noexcept {
+    Expects(host_slot < MAX_HOST_SLOTS);
+    auto &shard = localShard();
+    increase(hit ? shard.cache_hits : shard.cache_misses);
+    auto &host = shard.hosts[host_slot];
+    increase(hit ? host.cache_hits : host.cache_misses);
+}
+
+void RecordOverloaded(const bool overloaded) noexcept {
+    localShard().overloaded.store(overloaded, std::memory_order_relaxed);
+}
+
+void RecordRequestShed() noexcept {
+    increase(localShard().requests_shed);
+}
+
+void RecordProxyCache(const CacheStatus status) noexcept {
+    increase(localShard().proxy_cache[static_cast<std::size_t>(status)]);
+}
+
+MetricsSnapshot ScrapeMetrics() noexcept {
+    MetricsSnapshot snapshot;
+    for (auto &name : hostSlots().Names()) {
+        snapshot.hosts.push_back({std::move(name)});
+    }
+
+    registry().ForEach([&snapshot](const Shard &shard) {
+        snapshot.connections_opened += read(shard.connections_opened);
+        snapshot.connections_closed += read(shard.connections_closed);
+        snapshot.connections_rejected += read(shard.connections_rejected);
+        snapshot.connection_memory_allocated += read(shard.connection_memory_allocated);
+        snapshot.connection_memory_freed += read(shard.connection_memory_freed);
+        snapshot.bytes_sent += read(shard.bytes_sent);
+        snapshot.cache_hits += read(shard.cache_hits);
+        snapshot.cache_misses += read(shard.cache_misses);
+        snapshot.requests_shed += read(shard.requests_shed);
+        snapshot.overloaded_loops += read(shard.overloaded);
+        for (std::size_t i = 0; i < STATUS_COUNT; ++i) {
+            snapshot.requests_by_status[i] += read(shard.requests_by_status[i]);
+        }
+        for (std::size_t i = 0; i < METHOD_COUNT; ++i) {
+            snapshot.requests_by_method[i] += read(shard.requests_by_method[i]);
+        }
+        for (std::size_t i = 0; i < CACHE_STATUS_COUNT; ++i) {
+            snapshot.proxy_cache[i] += read(shard.proxy_cache[i]);
+        }
+        for (std::size_t i = 0; i < PHASE_COUNT; ++i) {
+            LatencyHistogram::Buckets buckets;
+            for (std::size_t j = 0; j < LatencyHistogram::BUCKET_COUNT; ++j) {
+                buckets[j] = read(shard.latencies[i].buckets[j]);
+            }
+            snapshot.latencies[i].Add(buckets, read(shard.latencies[i].sum));
+        }
+        for (std::size_t i = 0; i < snapshot.hosts.size(); ++i) {
+            auto &host = snapshot.hosts[i];
+            host.requests += read(shard.hosts[i].requests);
+            host.bytes_sent += read(shard.hosts[i].bytes_sent);
+            host.cache_hits += read(shard.hosts[i].cache_hits);
+            host.cache_misses += read(shard.hosts[i].cache_misses);
+        }
+    });
+
+    return snapshot;
+}
+
+std::string ToJson(const MetricsSnapshot &snapshot) noexcept {
+    std::ostringstream oss;
+    const auto lookups = snapshot.cache_hits + snapshot.cache_misses;
+
+    oss << "{\"connections\":{\"active\":" << snapshot.ActiveConnections()
+        << ",\"total\":" << snapshot.connections_opened
+        << ",\"rejected\":" << snapshot.connections_rejected
+        << ",\"memory_bytes\":" << snapshot.ConnectionMemory()
+        << ",\"memory_per_connection_bytes\":" << snapshot.MemoryPerConnection() << '}';
+
+    oss << ",\"requests\":{\"total\":" << snapshot.TotalRequests() << ",\"by_status\":{";
+    auto separator = "";
+    for (std::size_t i = 0; i < STATUS_COUNT; ++i) {
+        if (snapshot.requests_by_status[i]) {
+            oss << separator << '"' << i << "\":" << snapshot.requests_by_status[i];
+            separator = ",";
+        }
+    }
+    oss << "},\"by_method\":{";
+    separator = "";
+    for (std::size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (snapshot.requests_by_method[i]) {
+            oss << separator << '"' << ToString(static_cast<Method>(i))
+                << "\":" << snapshot.requests_by_method[i];
+            separator = ",";
+        }
+    }
+    oss << "}}";
+
+    oss << ",\"bytes_sent\":" << snapshot.bytes_sent;
+
+    oss << ",\"cache\":{\"hits\":" << snapshot.cache_hits << ",\"misses\":" << snapshot.cache_misses
+        << ",\"hit_ratio\":" << (lookups ? double(snapshot.cache_hits) / lookups : 0.0) << '}';
+
+    oss << ",\"proxy_cache\":{";
+    separator = "";
+    for (std::size_t i = 0; i < CACHE_STATUS_COUNT; ++i) {
+        oss << separator << '"' << ToLower(std::string {ToString(static_cast<CacheStatus>(i))})
+            << "\":" << snapshot.proxy_cache[i];
+        separator = ",";
+    }
+    oss << '}';
+
+    oss << ",\"hosts\":{";
+    separator = "";
+    for (const auto &host : snapshot.hosts) {
+        oss << separator << '"' << host.name << "\":{\"requests\":" << host.requests
+            << ",\"bytes_sent\":" << host.bytes_sent << ",\"cache_hits\":" << host.cache_hits
+            << ",\"cache_misses\":" << host.cache_misses << '}';
+        separator = ",";
+    }
+    oss << '}';
+
+    oss << ",\"shedding\":{\"overloaded_loops\":" << snapshot.overloaded_loops
+        << ",\"shed\":" << snapshot.requests_shed << '}';
+
+    oss << ",\"latency_us\":{";
+    separator = "";
+    for (std::size_t i = 0; i < PHASE_COUNT; ++i) {
+        const auto &histogram = snapshot.latencies[i];
+        oss << separator << '"' << ToString(static_cast<Phase>(i))
+            << "\":{\"count\":" << histogram.Count() << ",\"sum\":" << histogram.Sum()
+            << ",\"p50\":" << histogram.ValueAt(0.5) << ",\"p90\":" << histogram.ValueAt(0.9)
+            << ",\"p99\":" << histogram.ValueAt(0.99) << ",\"p999\":" << histogram.ValueAt(0.999)
+            << ",\"max\":" << histogram.ValueAt(1) << '}';
+        separator = ",";
+    }
+    oss << "}}";
+
+    return std::move(oss).str();
+}
+
+std::string ToPrometheusText(const MetricsSnapshot &snapshot) noexcept {
+    std::ostringstream oss;
+
+    oss << "# TYPE nginxpp_connections_active gauge\n"
+        << "nginxpp_connections_active " << snapshot.ActiveConnections() << '\n'
+        << "# TYPE nginxpp_connections_total counter\n"
+        << "nginxpp_connections_total " << snapshot.connections_opened << '\n'
+        << "# TYPE nginxpp_connections_rejected_total counter\n"
+        << "nginxpp_connections_rejected_total " << snapshot.connections_rejected << '\n'
+        << "# TYPE nginxpp_connection_memory_bytes gauge\n"
+        << "nginxpp_connection_memory_bytes " << snapshot.ConnectionMemory() << '\n'
+        << "# TYPE nginxpp_memory_per_connection_bytes gauge\n"
+        << "nginxpp_memory_per_connection_bytes " << snapshot.MemoryPerConnection() << '\n';
+
+    oss << "# TYPE nginxpp_requests_total counter\n";
+    for (std::size_t i = 0; i < STATUS_COUNT; ++i) {
+        if (snapshot.requests_by_status[i]) {
+            oss << "nginxpp_requests_total{status=\"" << i << "\"} "
+                << snapshot.requests_by_status[i] << '\n';
+        }
+    }
+    oss << "# TYPE nginxpp_requests_by_method_total counter\n";
+    for (std::size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (snapshot.requests_by_method[i]) {
+            oss << "nginxpp_requests_by_method_total{method=\""
+                << ToString(static_cast<Method>(i)) << "\"} " << snapshot.requests_by_method[i]
+                << '\n';
+        }
+    }
+
+    oss << "# TYPE nginxpp_sent_bytes_total counter\n"
+        << "nginxpp_sent_bytes_total " << snapshot.bytes_sent << '\n'
+        << "# TYPE nginxpp_cache_lookups_total counter\n"
+        << "nginxpp_cache_lookups_total{result=\"hit\"} " << snapshot.cache_hits << '\n'
+        << "nginxpp_cache_lookups_total{result=\"miss\"} " << snapshot.cache_misses << '\n'
+        << "# TYPE nginxpp_overloaded_loops gauge\n"
+        << "nginxpp_overloaded_loops " << snapshot.overloaded_loops << '\n'
+        << "# TYPE nginxpp_requests_shed_total counter\n"
+        << "nginxpp_requests_shed_total " << snapshot.requests_shed << '\n';
+
+    oss << "# TYPE nginxpp_proxy_cache_requests_total counter\n";
+    for (std::size_t i = 0; i < CACHE_STATUS_COUNT; ++i) {
+        oss << "nginxpp_proxy_cache_requests_total{status=\""
+            << ToLower(std::string {ToString(static_cast<CacheStatus>(i))}) << "\"} "
+            << snapshot.proxy_cache[i] << '\n';
+    }
+
+    oss << "# TYPE nginxpp_host_requests_total counter\n";
+    for (const auto &host : snapshot.hosts) {
+        oss << "nginxpp_host_requests_total{host=\"" << host.name << "\"} " << host.requests
+            << '\n';
+    }
+    oss << "# TYPE nginxpp_host_sent_bytes_total counter\n";
+    for (const auto &host : snapshot.hosts) {
+        oss << "nginxpp_host_sent_bytes_total{host=\"" << host.name << "\"} " << host.bytes_sent
+            << '\n';
+    }
+    oss << "# TYPE nginxpp_host_cache_lookups_total counter\n";
+    for (const auto &host : snapshot.hosts) {
+        oss << "nginxpp_host_cache_lookups_total{host=\"" << host.name << "\",result=\"hit\"} "
+            << host.cache_hits << '\n'
+            << "nginxpp_host_cache_lookups_total{host=\"" << host.name << "\",result=\"miss\"} "
+            << host.cache_misses << '\n';
+    }
+
+    oss << "# TYPE nginxpp_phase_latency_microseconds summary\n";
+    for (std::size_t i = 0; i < PHASE_COUNT; ++i) {
+        const auto &histogram = snapshot.latencies[i];
+        const auto phase = ToString(static_cast<Phase>(i));
+        for (const auto q : QUANTILES) {
+            oss << "nginxpp_phase_latency_microseconds{phase=\"" << phase << "\",quantile=\"" << q
+                << "\"} " << histogram.ValueAt(q) << '\n';
+        }
+        oss << "nginxpp_phase_latency_microseconds_sum{phase=\"" << phase << "\"} "
+            << histogram.Sum() << '\n'
+            << "nginxpp_phase_latency_microseconds_count{phase=\"" << phase << "\"} "
+            << histogram.Count() << '\n';
+    }
+
+    return std::move(oss).str();
+}
+
+
+bool IsStatusTarget(const std::string_view target) noexcept {
+    return target.substr(0, target.find('?')) == STATUS_TARGET;
+}
+
+Response HandleStatus(const Request &a_request) noexcept {
+    Expects(IsStatusTarget(a_request.target));
+
+    Response a_response;
+    a_response.status = a_request.status;
+    a_response.error_str = a_request.error_str;
+    if (not a_response) {
+        return a_response;
+    }
+    if (a_request.method != Method::GET and a_request.method != Method::HEAD) {
+        a_response.status = 501;
+        a_response.error_str = "HTTP method " + std::string {ToString(a_request.method)} +
+                               " not implemented";
+        return a_response;
+    }
+
+    constexpr std::string_view STATUS_TARGET_VIEW = STATUS_TARGET;
+    const auto query = std::string_view {a_request.target}.substr(STATUS_TARGET_VIEW.size());
+
+    const auto snapshot = ScrapeMetrics();
+    std::string body;
+    if (query == "?format=prometheus") {
+        a_response.headers["Content-Type"] = "text/plain; version=0.0.4";
+        body = ToPrometheusText(snapshot);
+    } else if (query == "?format=trace") {
+        a_response.headers["Content-Type"] = "application/json";
+        body = ToChromeTraceJson(RecentSlowRequests());
+    } else {
+        a_response.headers["Content-Type"] = "application/json";
+        body = ToJson(snapshot);
+    }
+    a_response.headers["Content-Length"] = std::to_string(body.size());
+    a_response.headers["Cache-Control"] = "no-store";
+    a_response.body = std::move(body);
+
+    return a_response;
+}
+
+} //namespace nginxpp
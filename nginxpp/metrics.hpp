@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nginxpp/cache.hpp>
+#include <nginxpp/memory_utils.hpp>
+#include <nginxpp/message.hpp>
+
+
+namespace nginxpp {
+
+constexpr auto STATUS_TARGET = "__nginxpp/status";
+
+/// QUEUE is how long a request waited before being handled, from when the server could have
+/// started on it, which is what the load shedder acts on.
+enum class Phase { PARSE, HANDLE, WRITE, QUEUE };
+constexpr std::size_t PHASE_COUNT = 4;
+constexpr std::size_t METHOD_COUNT = static_cast<std::size_t>(Method::PRI) + 1;
+constexpr std::size_t STATUS_COUNT = 600;
+/// Virtual hosts counted apart, the default one first; any past the last slot share it.
+constexpr std::size_t MAX_HOST_SLOTS = 64;
+constexpr std::size_t DEFAULT_HOST_SLOT = 0;
+
+[[nodiscard]] std::string_view ToString(const Phase phase) noexcept;
+
+
+/// An HDR-style log-linear histogram of microseconds: every power of two is split into
+/// 2^SUB_BUCKET_BITS linear sub-buckets, which bounds the relative error to 1/8.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr std::uint64_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_VALUE_BITS = 32;
+    static constexpr std::uint64_t MAX_VALUE = (std::uint64_t {1} << MAX_VALUE_BITS) - 1;
+    static constexpr std::size_t BUCKET_COUNT =
+        (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    using Buckets = std::array<std::uint64_t, BUCKET_COUNT>;
+
+    [[nodiscard]] static std::size_t BucketOf(std::uint64_t value) noexcept;
+
+    [[nodiscard]] static std::uint64_t LowerBoundOf(const std::size_t bucket) noexcept;
+
+    void Add(const Buckets &buckets, const std::uint64_t sum) noexcept;
+
+    void Record(const std::uint64_t value) noexcept;
+
+    void Merge(const LatencyHistogram &other) noexcept {
+        Add(other.m_buckets, other.m_sum);
+    }
+
+    /// Returns the upper bound of the bucket holding the given quantile, in [0, 1].
+    [[nodiscard]] std::uint64_t ValueAt(const double quantile) const noexcept;
+
+    [[nodiscard]] std::uint64_t Count() const noexcept {
+        return m_count;
+    }
+
+    [[nodiscard]] std::uint64_t Sum() const noexcept {
+        return m_sum;
+    }
+
+private:
+    Buckets m_buckets {};
+    std::uint64_t m_count = 0;
+    std::uint64_t m_sum = 0;
+};
+
+
+struct HostMetrics {
+    std::string name;
+    std::uint64_t requests = 0;
+    std::uint64_t bytes_sent = 0;
+    std::uint64_t cache_hits = 0;
+    std::uint64_t cache_misses = 0;
+};
+
+
+struct MetricsSnapshot {
+    std::uint64_t connections_opened = 0;
+    std::uint64_t connections_closed = 0;
+    std::uint64_t connections_rejected = 0;
+    std::uint64_t connection_memory_allocated = 0;
+    std::uint64_t connection_memory_freed = 0;
+    std::uint64_t bytes_sent = 0;
+    std::uint64_t cache_hits = 0;
+    std::uint64_t cache_misses = 0;
+    std::uint64_t requests_shed = 0;
+    std::uint64_t overloaded_loops = 0;
+    std::array<std::uint64_t, STATUS_COUNT> requests_by_status {};
+    std::array<std::uint64_t, METHOD_COUNT> requests_by_method {};
+    /// Of proxied requests, by CacheStatus
+    std::array<std::uint64_t, CACHE_STATUS_COUNT> proxy_cache {};
+    std::array<LatencyHistogram, PHASE_COUNT> latencies {};
+    /// By host slot, as many as were given out
+    std::vector<HostMetrics> hosts;
+
+    [[nodiscard]] std::uint64_t ActiveConnections() const noexcept {
+        return connections_opened - connections_closed;
+    }
+
+    /// Bytes held by open connections: sessions, thread stacks and leased buffers
+    [[nodiscard]] std::uint64_t ConnectionMemory() const noexcept {
+        return connection_memory_allocated - connection_memory_freed;
+    }
+
+    [[nodiscard]] std::uint64_t MemoryPerConnection() const noexcept {
+        return ActiveConnections() ? ConnectionMemory() / ActiveConnections() : 0;
+    }
+
+    [[nodiscard]] std::uint64_t TotalRequests() const noexcept;
+};
+
+
+// The Record*() functions only touch a cache-line aligned shard owned by the calling thread.
+// Shards are recycled when threads exit, and only aggregated by ScrapeMetrics().
+
+void RecordConnectionOpened() noexcept;
+
+void RecordConnectionClosed() noexcept;
+
+/// Accepted only to be closed right away, for lack of file descriptors.
+void RecordConnectionRejected() noexcept;
+
+/// Positive when a connection allocates, negative when it frees.
+void RecordConnectionMemory(const std::ptrdiff_t bytes) noexcept;
+
+/// Returns the slot counting the requests of the named virtual host, the same one for the same
+/// name, so that its counts carry over reloads. DEFAULT_HOST_SLOT counts the default host.
+[[nodiscard]] std::size_t HostSlot(const std::string_view server_name) noexcept;
+
+void RecordRequest(const Method method,
+                   const int status,
+                   const std::size_t bytes_sent,
+                   const std::size_t host_slot = DEFAULT_HOST_SLOT) noexcept;
+
+void RecordLatency(const Phase phase, const std::chrono::nanoseconds latency) noexcept;
+
+void RecordCacheLookup(const bool hit, const std::size_t host_slot = DEFAULT_HOST_SLOT) noexcept;
+
+/// Whether the load shedder of the calling event loop thread deems it overloaded.
+void RecordOverloaded(const bool overloaded) noexcept;
+
+void RecordRequestShed() noexcept;
+
+/// How a proxied request fared with the proxy cache, if enabled.
+void RecordProxyCache(const CacheStatus status) noexcept;
+
+[[nodiscard]] MetricsSnapshot ScrapeMetrics() noexcept;
+
+[[nodiscard]] std::string ToJson(const MetricsSnapshot &snapshot) noexcept;
+
+[[nodiscard]] std::string ToPrometheusText(const MetricsSnapshot &snapshot) noexcept;
+
+
+[[nodiscard]] bool IsStatusTarget(const std::string_view target) noexcept;
+
+/// Serves the scraped metrics as JSON, or as Prometheus text if "?format=prometheus".
+/// "?format=trace" serves the recent slow requests as Chrome trace-event JSON instead.
+[[nodiscard]] Response HandleStatus(const Request &a_request) noexcept;
+
+} //namespace nginxpp
@@ -0,0 +1,194 @@
+#include <nginxpp/metrics.hpp>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+TEST(LatencyHistogramTests, SmallValuesHaveExactBuckets) {
+    for (std::uint64_t v = 0; v < LatencyHistogram::SUB_BUCKET_COUNT; ++v) {
+        EXPECT_EQ(v, LatencyHistogram::BucketOf(v));
+        EXPECT_EQ(v, LatencyHistogram::LowerBoundOf(v));
+    }
+}
+
+TEST(LatencyHistogramTests, LowerBoundIsInverseOfBucket) {
+    for (std::size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        EXPECT_EQ(bucket, LatencyHistogram::BucketOf(LatencyHistogram::LowerBoundOf(bucket)));
+    }
+}
+
+TEST(LatencyHistogramTests, BoundedRelativeError) {
+    for (std::uint64_t v : {9ull, 100ull, 1'000ull, 123'456ull, 10'000'000ull}) {
+        const auto bucket = LatencyHistogram::BucketOf(v);
+        const auto lower = LatencyHistogram::LowerBoundOf(bucket);
+        EXPECT_LE(lower, v);
+        EXPECT_LE(v - lower, v / LatencyHistogram::SUB_BUCKET_COUNT);
+    }
+}
+
+TEST(LatencyHistogramTests, HugeValuesAreClamped) {
+    EXPECT_EQ(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::BucketOf(~0ull));
+}
+
+TEST(LatencyHistogramTests, CanComputeQuantiles) {
+    LatencyHistogram histogram;
+    for (std::uint64_t v = 1; v <= 100; ++v) {
+        histogram.Record(v);
+    }
+
+    EXPECT_EQ(100, histogram.Count());
+    EXPECT_EQ(5050, histogram.Sum());
+    EXPECT_NEAR(50, histogram.ValueAt(0.5), 50 / LatencyHistogram::SUB_BUCKET_COUNT);
+    EXPECT_NEAR(99, histogram.ValueAt(0.99), 99 / LatencyHistogram::SUB_BUCKET_COUNT);
+    EXPECT_LE(100, histogram.ValueAt(1));
+}
+
+TEST(LatencyHistogramTests, EmptyHistogramQuantileIsZero) {
+    const LatencyHistogram histogram;
+    EXPECT_EQ(0, histogram.ValueAt(0.99));
+}
+
+
+TEST(MetricsTests, ScrapeAggregatesAllThreads) {
+    const auto before = ScrapeMetrics();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([]() {
+            RecordConnectionOpened();
+            RecordRequest(Method::GET, 200, 10);
+            RecordLatency(Phase::HANDLE, std::chrono::microseconds {3});
+            RecordCacheLookup(true);
+            RecordConnectionClosed();
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    const auto after = ScrapeMetrics();
+    EXPECT_EQ(4, after.connections_opened - before.connections_opened);
+    EXPECT_EQ(before.ActiveConnections(), after.ActiveConnections());
+    EXPECT_EQ(4, after.requests_by_status[200] - before.requests_by_status[200]);
+    EXPECT_EQ(4,
+              after.requests_by_method[static_cast<std::size_t>(Method::GET)] -
+                  before.requests_by_method[static_cast<std::size_t>(Method::GET)]);
+    EXPECT_EQ(40, after.bytes_sent - before.bytes_sent);
+    EXPECT_EQ(4, after.cache_hits - before.cache_hits);
+    EXPECT_EQ(4,
+              after.latencies[static_cast<std::size_t>(Phase::HANDLE)].Count() -
+                  before.latencies[static_cast<std::size_t>(Phase::HANDLE)].Count());
+}
+
+TEST(MetricsTests, ActiveConnectionsAcrossThreads) {
+    const auto before = ScrapeMetrics();
+    RecordConnectionOpened();
+
+    const auto after = ScrapeMetrics();
+    EXPECT_EQ(before.ActiveConnections() + 1, after.ActiveConnections());
+
+    RecordConnectionClosed();
+}
+
+TEST(MetricsTests, MemoryPerConnection) {
+    MetricsSnapshot snapshot;
+    EXPECT_EQ(0, snapshot.MemoryPerConnection());
+
+    snapshot.connections_opened = 3;
+    snapshot.connections_closed = 1;
+    snapshot.connection_memory_allocated = 10'000;
+    snapshot.connection_memory_freed = 2'000;
+    EXPECT_EQ(8'000, snapshot.ConnectionMemory());
+    EXPECT_EQ(4'000, snapshot.MemoryPerConnection());
+}
+
+
+TEST(MetricsTests, CountsRequestsPerHost) {
+    const auto slot = HostSlot("metrics.example.com");
+    EXPECT_NE(DEFAULT_HOST_SLOT, slot);
+    EXPECT_EQ(slot, HostSlot("metrics.example.com"));
+    const auto before = ScrapeMetrics();
+
+    RecordRequest(Method::GET, 200, 10, slot);
+    RecordCacheLookup(false, slot);
+    RecordRequest(Method::GET, 200, 5);
+
+    const auto after = ScrapeMetrics();
+    ASSERT_LT(slot, after.hosts.size());
+    EXPECT_EQ("metrics.example.com", after.hosts[slot].name);
+    EXPECT_EQ(1, after.hosts[slot].requests - before.hosts[slot].requests);
+    EXPECT_EQ(10, after.hosts[slot].bytes_sent - before.hosts[slot].bytes_sent);
+    EXPECT_EQ(1, after.hosts[slot].cache_misses - before.hosts[slot].cache_misses);
+    EXPECT_EQ("default", after.hosts[DEFAULT_HOST_SLOT].name);
+    EXPECT_EQ(5,
+              after.hosts[DEFAULT_HOST_SLOT].bytes_sent -
+                  before.hosts[DEFAULT_HOST_SLOT].bytes_sent);
+    EXPECT_NE(std::string::npos, ToJson(after).find("\"metrics.example.com\":{\"requests\":"));
+    EXPECT_NE(std::string::npos,
+              ToPrometheusText(after).find(
+                  "nginxpp_host_requests_total{host=\"metrics.example.com\"}"));
+}
+
+
+TEST(MetricsTests, CountsProxyCacheStatuses) {
+    const auto before = ScrapeMetrics();
+    RecordProxyCache(CacheStatus::HIT);
+    RecordProxyCache(CacheStatus::HIT);
+    RecordProxyCache(CacheStatus::MISS);
+
+    const auto after = ScrapeMetrics();
+    const auto hit = static_cast<std::size_t>(CacheStatus::HIT);
+    const auto miss = static_cast<std::size_t>(CacheStatus::MISS);
+    EXPECT_EQ(2, after.proxy_cache[hit] - before.proxy_cache[hit]);
+    EXPECT_EQ(1, after.proxy_cache[miss] - before.proxy_cache[miss]);
+    EXPECT_NE(std::string::npos, ToJson(after).find("\"proxy_cache\":{\"bypass\":"));
+    EXPECT_NE(std::string::npos,
+              ToPrometheusText(after).find("nginxpp_proxy_cache_requests_total{status=\"hit\"}"));
+}
+
+
+TEST(StatusTests, IsStatusTarget) {
+    EXPECT_TRUE(IsStatusTarget(STATUS_TARGET));
+    EXPECT_TRUE(IsStatusTarget(std::string {STATUS_TARGET} + "?format=prometheus"));
+    EXPECT_FALSE(IsStatusTarget("index.html"));
+    EXPECT_FALSE(IsStatusTarget(std::string {STATUS_TARGET} + "/more"));
+}
+
+TEST(StatusTests, DefaultToJson) {
+    RecordRequest(Method::GET, 404, 0);
+
+    Request a_request;
+    a_request.method = Method::GET;
+    a_request.target = STATUS_TARGET;
+
+    const auto a_response = HandleStatus(a_request);
+    ASSERT_TRUE(a_response);
+    EXPECT_EQ("application/json", a_response.headers.at("Content-Type"));
+
+    const auto &body = std::get<std::string>(a_response.body);
+    EXPECT_EQ('{', body.front());
+    EXPECT_EQ('}', body.back());
+    EXPECT_NE(std::string::npos, body.find("\"404\":"));
+    EXPECT_NE(std::string::npos, body.find("\"latency_us\":"));
+}
+
+TEST(StatusTests, CanOutputPrometheusText) {
+    RecordRequest(Method::HEAD, 200, 0);
+
+    Request a_request;
+    a_request.method = Method::GET;
+    a_request.target = std::string {STATUS_TARGET} + "?format=prometheus";
+
+    const auto a_response = HandleStatus(a_request);
+    ASSERT_TRUE(a_response);
+
+    const auto &body = std::get<std::string>(a_response.body);
+    EXPECT_NE(std::string::npos, body.find("nginxpp_requests_by_method_total{method=\"HEAD\"}"));
+    EXPECT_NE(std::string::npos,
+              body.find("nginxpp_phase_latency_microseconds{phase=\"parse\",quantile=\"0.99\"}"));
+    EXPECT_NE(std::string::npos, body.find("nginxpp_memory_per_connection_bytes "));
+}
@@ -0,0 +1,856 @@
+#include <nginxpp/proxy.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <gsl/gsl>
+
+#include <nginxpp/async_socket.hpp>
+#include <nginxpp/buffer_pool.hpp>
+#include <nginxpp/cache.hpp>
+#include <nginxpp/exception.hpp>
+#include <nginxpp/response_headers.hpp>
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/trace.hpp>
+
+
+using std::string_literals::operator""s;
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::string_view CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
+
+/// Meant for the connection they arrived on only, per RFC 9110, section 7.6.1
+[[nodiscard]] bool isHopByHop(const std::string_view name) noexcept {
+    constexpr std::array<std::string_view, 7> HOP_BY_HOP = {"connection",
+                                                            "keep-alive",
+                                                            "proxy-connection",
+                                                            "te",
+                                                            "trailer",
+                                                            "transfer-encoding",
+                                                            "upgrade"};
+    return std::find(HOP_BY_HOP.begin(), HOP_BY_HOP.end(), name) != HOP_BY_HOP.end();
+}
+
+/// Adds the comma-separated options of a Connection field, lowercased, which name further
+/// fields meant for the connection only, or are "close" or "keep-alive".
+void addConnectionOptions(std::vector<std::string> &options, std::string_view value) noexcept {
+    while (not value.empty()) {
+        const auto comma = std::min(value.find(','), value.size());
+        auto option = value.substr(0, comma);
+        value.remove_prefix(std::min(comma + 1, value.size()));
+        option.remove_prefix(std::min(option.find_first_not_of(" \t"), option.size()));
+        option = option.substr(0, option.find_last_not_of(" \t") + 1);
+        if (not option.empty()) {
+            options.push_back(ToLower(std::string {option}));
+        }
+    }
+}
+
+[[nodiscard]] bool isListed(const std::vector<std::string> &options,
+                            const std::string_view name) noexcept {
+    return std::find(options.begin(), options.end(), name) != options.end();
+}
+
+/// Make the response depend on what the client has already, which a cache fill must not
+[[nodiscard]] bool isConditional(const std::string_view name) noexcept {
+    constexpr std::array<std::string_view, 6> CONDITIONAL = {"if-match",
+                                                             "if-modified-since",
+                                                             "if-none-match",
+                                                             "if-range",
+                                                             "if-unmodified-since",
+                                                             "range"};
+    return std::find(CONDITIONAL.begin(), CONDITIONAL.end(), name) != CONDITIONAL.end();
+}
+
+[[nodiscard]] bool isPort(const std::string_view port) noexcept {
+    const auto number = ParseNumber<unsigned>(port);
+    return number and *number > 0 and *number <= 65535;
+}
+
+/// Splits `HOST:PORT`, or `[HOST]:PORT` for IPv6, into the host without brackets and the port.
+[[nodiscard]] std::optional<std::pair<std::string, std::string>>
+splitHostPort(const std::string_view address) noexcept {
+    const auto colon = address.rfind(':');
+    if (colon == address.npos or colon == 0 or not isPort(address.substr(colon + 1))) {
+        return std::nullopt;
+    }
+    auto host = address.substr(0, colon);
+    if (host.front() == '[') {
+        if (host.size() < 3 or host.back() != ']') {
+            return std::nullopt;
+        }
+        host = host.substr(1, host.size() - 2);
+    } else if (host.find(':') != host.npos) {
+        return std::nullopt;
+    }
+    return std::pair {std::string {host}, std::string {address.substr(colon + 1)}};
+}
+
+/// The request line and the end-to-end fields of the request, and where it came from. A cache
+/// fill asks for the whole response with GET, conditional on the validators of the entry it
+/// refreshes, if any, rather than on those of the client.
+[[nodiscard]] std::string buildRequestHead(const Request &a_request,
+                                           const std::string_view client_address,
+                                           const Backend &backend,
+                                           const CacheFill *const fill) noexcept {
+    std::string head;
+    head.reserve(512);
+    head.append(fill ? "GET" : ToString(a_request.method)).append(" /").append(a_request.target);
+    head.append(" HTTP/1.1").append(CRLF);
+
+    std::vector<std::string> connection_options;
+    if (const auto connection = a_request.headers.find("connection");
+        connection != a_request.headers.end()) {
+        addConnectionOptions(connection_options, connection->second);
+    }
+
+    bool has_host = false;
+    std::string forwarded_for;
+    for (const auto &[name, value] : a_request.headers) {
+        // Answered by the proxy, as it reads the body only once the backend is connected
+        if (isHopByHop(name) or isListed(connection_options, name) or name == "expect" or
+            (fill and isConditional(name))) {
+            continue;
+        }
+        if (name == "x-forwarded-for") {
+            forwarded_for = value + ", ";
+            continue;
+        }
+        has_host = has_host or name == "host";
+        head.append(name).append(": ").append(value).append(CRLF);
+    }
+    // HTTP/1.0 clients may leave it out, which HTTP/1.1 backends may answer with a 400
+    if (not has_host) {
+        head.append("host: ").append(backend.address).append(CRLF);
+    }
+    if (fill and fill->Stale()) {
+        const auto &stale = *fill->Stale();
+        if (not stale.etag.empty()) {
+            head.append("if-none-match: ").append(stale.etag).append(CRLF);
+        }
+        if (not stale.last_modified.empty()) {
+            head.append("if-modified-since: ").append(stale.last_modified).append(CRLF);
+        }
+    }
+    forwarded_for.append(client_address);
+    head.append("x-forwarded-for: ").append(forwarded_for).append(CRLF);
+    head.append(CRLF);
+    return head;
+}
+
+
+/// How the end of a response body is told
+enum class Framing { NONE, LENGTH, CHUNKED, CLOSE };
+
+struct ResponseHead {
+    int status = 0;
+    /// Whether the backend connection may serve another request afterward
+    bool keep_alive = false;
+    bool chunked = false;
+    std::optional<std::size_t> content_length;
+    /// The status line and the end-to-end fields, each ending with CRLF
+    std::string forwarded;
+};
+
+/// Returns std::nullopt if malformed.
+[[nodiscard]] std::optional<ResponseHead> parseResponseHead(std::string_view head) noexcept {
+    ResponseHead parsed;
+    // Forwarded once all are read, as the Connection field may list those before it
+    std::vector<std::pair<std::string, std::string_view>> fields;
+    std::vector<std::string> connection_options;
+    bool ends_with_close = false;
+    for (bool first = true; not head.empty(); first = false) {
+        const auto end = head.find('\n');
+        auto line = head.substr(0, end);
+        head.remove_prefix(end == head.npos ? head.size() : end + 1);
+        if (not line.empty() and line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            break;
+        }
+
+        if (first) {
+            // "HTTP/1.1 200 OK", the reason phrase being optional
+            if (not StartsWith(line, "HTTP/1.") or line.size() < 12 or line[8] != ' ') {
+                return std::nullopt;
+            }
+            const auto status = ParseNumber<int>(line.substr(9, 3));
+            if (not status or *status < 100 or (line.size() > 12 and line[12] != ' ')) {
+                return std::nullopt;
+            }
+            parsed.status = *status;
+            parsed.keep_alive = line[7] != '0';
+            // In the version of the proxy, which frames the response to the client on its own
+            parsed.forwarded.append("HTTP/1.1").append(line.substr(8)).append(CRLF);
+            continue;
+        }
+
+        const auto colon = line.find(':');
+        if (colon == line.npos or colon == 0) {
+            return std::nullopt;
+        }
+        const auto name = ToLower(std::string {line.substr(0, colon)});
+        auto value = line.substr(colon + 1);
+        value.remove_prefix(std::min(value.find_first_not_of(" \t"), value.size()));
+        value = value.substr(0, value.find_last_not_of(" \t") + 1);
+
+        if (name == "connection") {
+            addConnectionOptions(connection_options, value);
+        } else if (name == "transfer-encoding") {
+            // Only the last coding tells the framing, and anything but chunked leaves it to
+            // the end of the connection
+            const auto codings = ToLower(std::string {value});
+            parsed.chunked = codings.ends_with("chunked");
+            ends_with_close = not parsed.chunked;
+        } else if (name == "content-length") {
+            const auto length = ParseNumber<std::size_t>(value);
+            if (not length or (parsed.content_length and *parsed.content_length != *length)) {
+                return std::nullopt;
+            }
+            parsed.content_length = length;
+        }
+        if (not isHopByHop(name)) {
+            fields.emplace_back(name, line);
+        }
+    }
+    if (parsed.status == 0) {
+        return std::nullopt;
+    }
+
+    if (isListed(connection_options, "close") or ends_with_close) {
+        parsed.keep_alive = false;
+    } else if (isListed(connection_options, "keep-alive")) {
+        parsed.keep_alive = true;
+    }
+    for (const auto &[name, line] : fields) {
+        if (not isListed(connection_options, name)) {
+            parsed.forwarded.append(line).append(CRLF);
+        }
+    }
+    return parsed;
+}
+
+[[nodiscard]] Framing framingOf(const ResponseHead &head, const Method method) noexcept {
+    if (method == Method::HEAD or head.status < 200 or head.status == 204 or
+        head.status == 304) {
+        return Framing::NONE;
+    }
+    if (head.chunked) {
+        return Framing::CHUNKED;
+    }
+    if (head.content_length) {
+        return Framing::LENGTH;
+    }
+    return Framing::CLOSE;
+}
+
+/// -1 if not a hex digit
+[[nodiscard]] inline int hexValue(const char c) noexcept {
+    if (c >= '0' and c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' and c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' and c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+[[nodiscard]] inline auto isTimeout() noexcept {
+    return errno == ETIMEDOUT;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::string_view ToString(const Balance balance) noexcept {
+    switch (balance) {
+    case Balance::ROUND_ROBIN:
+        return "round-robin";
+    case Balance::LEAST_CONN:
+        return "least-conn";
+    }
+    return "unknown";
+}
+
+Balance ParseBalance(const std::string_view name) {
+    for (const auto balance : {Balance::ROUND_ROBIN, Balance::LEAST_CONN}) {
+        if (name == ToString(balance)) {
+            return balance;
+        }
+    }
+    throw ConfigException {"Invalid balance '" + std::string {name} +
+                           "': expected round-robin or least-conn"};
+}
+
+ProxyOptions ParseProxy(const std::string_view spec) {
+    const auto equals = spec.find('=');
+    if (equals == spec.npos or not StartsWith(spec, "/") or
+        not splitHostPort(spec.substr(equals + 1))) {
+        throw ConfigException {"Invalid proxy '" + std::string {spec} +
+                               "': expected /PREFIX=HOST:PORT"};
+    }
+
+    ProxyOptions proxy;
+    proxy.prefix = spec.substr(1, equals - 1);
+    proxy.backend = spec.substr(equals + 1);
+    return proxy;
+}
+
+Backend ResolveBackend(const std::string &address) {
+    const auto host_port = splitHostPort(address);
+    if (not host_port) {
+        throw ServerException {"Invalid backend address '" + address + '\''};
+    }
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    gsl::owner<addrinfo *> info {};
+    if (const auto status =
+            getaddrinfo(host_port->first.c_str(), host_port->second.c_str(), &hints, &info);
+        status) {
+        throw ServerException {"Failed to resolve backend '" + address +
+                               "': " + gai_strerror(status)};
+    }
+    const auto info_final = gsl::finally([info]() {
+        freeaddrinfo(info);
+    });
+
+    Backend backend;
+    backend.address = address;
+    std::memcpy(&backend.sockaddr, info->ai_addr, info->ai_addrlen);
+    backend.length = info->ai_addrlen;
+    return backend;
+}
+
+
+Upstream::Upstream(std::string prefix,
+                   std::vector<Backend> backends,
+                   const Balance balance,
+                   const std::chrono::milliseconds connect_timeout,
+                   const std::chrono::milliseconds read_timeout) noexcept :
+    m_prefix(std::move(prefix)),
+    m_backends(std::move(backends)), m_balance(balance), m_connect_timeout(connect_timeout),
+    m_read_timeout(read_timeout),
+    m_in_flight(std::make_unique<std::atomic<std::size_t>[]>(m_backends.size())) {
+    Expects(not m_backends.empty());
+}
+
+bool Upstream::Matches(const std::string_view target) const noexcept {
+    if (not StartsWith(target, m_prefix)) {
+        return false;
+    }
+    if (m_prefix.empty() or m_prefix.back() == '/' or target.size() == m_prefix.size()) {
+        return true;
+    }
+    const auto next = target[m_prefix.size()];
+    return next == '/' or next == '?';
+}
+
+std::size_t Upstream::Acquire() noexcept {
+    const auto start = m_next.fetch_add(1, std::memory_order_relaxed);
+    auto chosen = start % m_backends.size();
+    if (m_balance == Balance::LEAST_CONN) {
+        // From the next in turn, so that ties are spread as round-robin would
+        for (std::size_t i = 1; i < m_backends.size(); ++i) {
+            const auto index = (start + i) % m_backends.size();
+            if (InFlight(index) < InFlight(chosen)) {
+                chosen = index;
+            }
+        }
+    }
+    m_in_flight[chosen].fetch_add(1, std::memory_order_relaxed);
+    return chosen;
+}
+
+void Upstream::Release(const std::size_t index) noexcept {
+    Expects(index < m_backends.size());
+    m_in_flight[index].fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::vector<std::shared_ptr<Upstream>>
+BuildUpstreams(const std::vector<ProxyOptions> &proxies,
+               const Balance balance,
+               const std::chrono::milliseconds connect_timeout,
+               const std::chrono::milliseconds read_timeout) {
+    // In the order their prefixes first appear
+    std::vector<std::pair<std::string, std::vector<Backend>>> groups;
+    for (const auto &proxy : proxies) {
+        auto group = std::find_if(groups.begin(), groups.end(), [&proxy](const auto &g) {
+            return g.first == proxy.prefix;
+        });
+        if (group == groups.end()) {
+            group = groups.insert(groups.end(), {proxy.prefix, {}});
+        }
+        group->second.push_back(ResolveBackend(proxy.backend));
+    }
+
+    std::vector<std::shared_ptr<Upstream>> upstreams;
+    for (auto &[prefix, backends] : groups) {
+        upstreams.push_back(std::make_shared<Upstream>(
+            std::move(prefix), std::move(backends), balance, connect_timeout, read_timeout));
+    }
+    std::stable_sort(upstreams.begin(), upstreams.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs->Prefix().size() > rhs->Prefix().size();
+    });
+    return upstreams;
+}
+
+Upstream *FindUpstream(const std::vector<std::shared_ptr<Upstream>> &upstreams,
+                       const std::string_view target) noexcept {
+    for (const auto &upstream : upstreams) {
+        if (upstream->Matches(target)) {
+            return upstream.get();
+        }
+    }
+    return nullptr;
+}
+
+
+ConnectionPool::ConnectionPool(EventLoop &loop, const std::size_t max_idle) noexcept :
+    m_loop(loop), m_max_idle(max_idle) {
+}
+
+ConnectionPool::~ConnectionPool() noexcept = default;
+
+std::unique_ptr<AsyncSocket> ConnectionPool::TakeIdle(const Backend &backend) noexcept {
+    const auto iter = m_idle.find(backend.address);
+    if (iter == m_idle.end()) {
+        return nullptr;
+    }
+
+    auto &idle = iter->second;
+    while (not idle.empty()) {
+        auto connection = std::move(idle.back());
+        idle.pop_back();
+        // Anything to read means the backend closed it, or sent what nobody asked for
+        char c {};
+        if (recv(connection->GetSocket(), &c, 1, MSG_PEEK | MSG_DONTWAIT) == -1 and
+            (errno == EAGAIN or errno == EWOULDBLOCK)) {
+            return connection;
+        }
+    }
+    return nullptr;
+}
+
+Task<std::unique_ptr<AsyncSocket>>
+ConnectionPool::Connect(const Backend &backend,
+                        const std::chrono::milliseconds connect_timeout,
+                        const std::chrono::milliseconds send_timeout) noexcept {
+    Socket sock {socket(backend.sockaddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (sock == Socket::INVALID_SOCKET) {
+        co_return nullptr;
+    }
+    // Requests go out whole, and should not wait for the acknowledgement of the previous one
+    const int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    const auto *const address = reinterpret_cast<const sockaddr *>(&backend.sockaddr);
+    const auto connected = connect(sock, address, backend.length) == 0;
+    if (not connected and errno != EINPROGRESS and errno != EINTR) {
+        co_return nullptr;
+    }
+
+    auto connection = std::make_unique<AsyncSocket>(
+        m_loop, std::move(sock), send_timeout, AsyncSocket::Clock::now());
+    if (connected) {
+        co_return std::move(connection);
+    }
+
+    const bool writable = co_await connection->WaitWritable(DeadlineAfter(connect_timeout));
+    int error = writable ? 0 : ETIMEDOUT;
+    socklen_t length = sizeof(error);
+    if (writable and
+        getsockopt(connection->GetSocket(), SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+        error = errno;
+    }
+    if (error) {
+        connection.reset();
+        errno = error;
+        co_return nullptr;
+    }
+    co_return std::move(connection);
+}
+
+void ConnectionPool::Release(const Backend &backend,
+                             std::unique_ptr<AsyncSocket> connection) noexcept {
+    auto &idle = m_idle[backend.address];
+    if (idle.size() < m_max_idle) {
+        idle.push_back(std::move(connection));
+    }
+}
+
+std::size_t ConnectionPool::IdleCount(const Backend &backend) const noexcept {
+    const auto iter = m_idle.find(backend.address);
+    return iter == m_idle.end() ? 0 : iter->second.size();
+}
+
+
+std::size_t ChunkedScanner::Scan(const std::string_view input,
+                                 std::vector<std::string_view> *const data) noexcept {
+    std::size_t i = 0;
+    while (i < input.size() and m_state != State::DONE and m_state != State::FAILED) {
+        if (m_state == State::DATA) {
+            const auto size = std::min(m_remaining, input.size() - i);
+            if (data) {
+                data->push_back(input.substr(i, size));
+            }
+            i += size;
+            m_remaining -= size;
+            if (m_remaining == 0) {
+                m_state = State::DATA_CR;
+            }
+            continue;
+        }
+
+        const auto c = input[i];
+        const auto endSizeLine = [this]() {
+            m_state = m_remaining == 0 ? State::TRAILER : State::DATA;
+            m_has_digits = false;
+            m_empty_line = true;
+        };
+        switch (m_state) {
+        case State::SIZE:
+            if (const auto digit = hexValue(c); digit >= 0) {
+                if (m_remaining > (SIZE_MAX >> 4)) {
+                    m_state = State::FAILED;
+                    break;
+                }
+                m_remaining = m_remaining * 16 + digit;
+                m_has_digits = true;
+            } else if (not m_has_digits) {
+                m_state = State::FAILED;
+            } else if (c == ';' or c == ' ' or c == '\t') {
+                m_state = State::EXTENSION;
+            } else if (c == '\r') {
+                m_state = State::SIZE_LF;
+            } else if (c == '\n') {
+                endSizeLine();
+            } else {
+                m_state = State::FAILED;
+            }
+            break;
+        case State::EXTENSION:
+            if (c == '\r') {
+                m_state = State::SIZE_LF;
+            } else if (c == '\n') {
+                endSizeLine();
+            }
+            break;
+        case State::SIZE_LF:
+            if (c == '\n') {
+                endSizeLine();
+            } else {
+                m_state = State::FAILED;
+            }
+            break;
+        case State::DATA_CR:
+            m_state = c == '\r' ? State::DATA_LF : c == '\n' ? State::SIZE : State::FAILED;
+            break;
+        case State::DATA_LF:
+            m_state = c == '\n' ? State::SIZE : State::FAILED;
+            break;
+        case State::TRAILER:
+            if (c == '\n') {
+                m_state = m_empty_line ? State::DONE : State::TRAILER;
+                m_empty_line = true;
+            } else if (c != '\r') {
+                m_empty_line = false;
+            }
+            break;
+        case State::DATA:
+        case State::DONE:
+        case State::FAILED:
+            break;
+        }
+        if (m_state != State::FAILED) {
+            ++i;
+        }
+    }
+    return i;
+}
+
+
+Task<ProxyResult> Proxy(const Request &a_request,
+                        const std::string_view input,
+                        AsyncSocket *const client,
+                        const std::string_view client_address,
+                        const bool keep_alive,
+                        Upstream &upstream,
+                        ConnectionPool &pool,
+                        CacheFill *const fill,
+                        RequestTrace *const trace) noexcept {
+    ProxyResult result;
+
+    std::size_t body_length = 0;
+    if (a_request.headers.contains("transfer-encoding")) {
+        result.status = 411;
+        result.error_str = "Only request bodies of a Content-Length are proxied";
+        co_return result;
+    }
+    if (const auto iter = a_request.headers.find("content-length");
+        iter != a_request.headers.end()) {
+        const auto length = ParseNumber<std::size_t>(iter->second);
+        if (not length) {
+            result.status = 400;
+            result.error_str = "Invalid Content-Length '" + iter->second + '\'';
+            co_return result;
+        }
+        body_length = *length;
+    }
+    const auto buffered_body = input.substr(0, std::min(input.size(), body_length));
+    result.input_consumed = buffered_body.size();
+    Expects(client or buffered_body.size() == body_length);
+
+    const auto index = upstream.Acquire();
+    const auto release = gsl::finally([&upstream, index]() {
+        upstream.Release(index);
+    });
+    const auto &backend = upstream.Backends()[index];
+    const auto head = buildRequestHead(a_request, client_address, backend, fill);
+    const auto http_1_0 = a_request.version == "HTTP/1.0";
+
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::LARGE);
+
+    // A kept-alive connection may have been closed by the backend in the meantime, which only
+    // shows as a failure before any response; the request is then sent again over a new
+    // connection, as long as its whole body is still at hand
+    const auto resendable = buffered_body.size() == body_length;
+    auto connection = pool.TakeIdle(backend);
+    auto reused = connection != nullptr;
+    std::optional<ResponseHead> response;
+    std::size_t head_size = 0;
+    std::size_t received = 0;
+    for (bool sent_continue = false; not response;) {
+        if (not connection) {
+            connection =
+                co_await pool.Connect(backend, upstream.ConnectTimeout(), upstream.ReadTimeout());
+            if (not connection) {
+                result.status = isTimeout() ? 504 : 502;
+                result.error_str =
+                    "Failed to connect to backend " + backend.address + ": " + strerror(errno);
+                co_return result;
+            }
+        }
+
+        const bool written = co_await connection->Write(head, buffered_body);
+        bool failed = not written;
+        // The client waits for it before sending the rest of its body, if it asked to
+        if (not failed and not resendable and not sent_continue) {
+            const auto expect = a_request.headers.find("expect");
+            if (expect != a_request.headers.end() and
+                ToLower(expect->second) == "100-continue") {
+                const bool continued = co_await client->Write(CONTINUE_RESPONSE, {});
+                if (not continued) {
+                    result.error_str = "Failed to send 100 Continue: "s + strerror(errno);
+                    co_return result;
+                }
+            }
+            sent_continue = true;
+        }
+        for (auto left = body_length - buffered_body.size(); not failed and left > 0;) {
+            const auto n = co_await client->Read(
+                buffer.Span().first(std::min(left, buffer.Capacity())),
+                DeadlineAfter(upstream.ReadTimeout()));
+            if (n <= 0) {
+                result.status = isTimeout() ? 408 : 400;
+                result.error_str = "Failed to read the request body: "s +
+                                   (n == 0 ? "connection closed" : strerror(errno));
+                co_return result;
+            }
+            const bool forwarded = co_await connection->Write({}, {buffer.Data(), std::size_t(n)});
+            failed = not forwarded;
+            left -= n;
+        }
+
+        // Interim 1xx responses are skipped, as the proxy answers Expect on its own
+        received = 0;
+        for (std::size_t scanned = 0; not failed and not response;) {
+            // Unless what followed an interim head is still to be scanned
+            if (scanned == received) {
+                if (received == buffer.Capacity()) {
+                    result.error_str = "Response head of backend " + backend.address +
+                                       " exceeds maximum size of " +
+                                       std::to_string(buffer.Capacity());
+                    co_return result;
+                }
+                const auto n = co_await connection->Read(buffer.Span().subspan(received),
+                                                         DeadlineAfter(upstream.ReadTimeout()));
+                if (n <= 0) {
+                    failed = true;
+                    break;
+                }
+                received += n;
+            }
+
+            const std::string_view view {buffer.Data(), received};
+            head_size = FindHeadEnd(view, scanned);
+            scanned = received;
+            if (head_size == 0) {
+                continue;
+            }
+            response = parseResponseHead(view.substr(0, head_size));
+            if (not response or response->status == 101) {
+                result.error_str = "Invalid response head from backend " + backend.address;
+                co_return result;
+            }
+            if (response->status < 200) {
+                response.reset();
+                std::memmove(buffer.Data(), buffer.Data() + head_size, received - head_size);
+                received -= head_size;
+                scanned = 0;
+            }
+        }
+
+        if (failed) {
+            if (reused and resendable and received == 0 and not isTimeout()) {
+                connection.reset();
+                reused = false;
+                continue;
+            }
+            result.status = isTimeout() ? 504 : 502;
+            result.error_str = "Failed to proxy to backend " + backend.address + ": " +
+                               (errno ? strerror(errno) : "connection closed");
+            co_return result;
+        }
+    }
+
+    // Of what was sent upstream, as a cache fill gets the body of GET for a HEAD client too
+    const auto framing = framingOf(*response, fill ? Method::GET : a_request.method);
+    const auto send_body = a_request.method != Method::HEAD;
+    const auto filling = fill and fill->Begin(response->status, response->forwarded);
+    // HTTP/1.0 clients know nothing of chunks, so they get the data and the end of the stream
+    const auto decode = framing == Framing::CHUNKED and http_1_0;
+    const auto client_keep_alive = keep_alive and framing != Framing::CLOSE and not decode;
+
+    auto client_head = std::move(response->forwarded);
+    if (fill) {
+        client_head.append("X-Cache-Status: ").append(ToString(fill->Status())).append(CRLF);
+    }
+    if (not client_keep_alive) {
+        client_head.append("Connection: close").append(CRLF);
+    } else if (http_1_0) {
+        client_head.append("Connection: keep-alive").append(CRLF);
+    }
+    if (framing == Framing::CHUNKED and not decode) {
+        client_head.append("Transfer-Encoding: chunked").append(CRLF);
+    }
+    client_head.append(CRLF);
+
+    if (trace) {
+        trace->End(Span::HANDLE);
+        trace->Begin(Span::WRITE);
+    }
+    result.responded = true;
+    result.status = response->status;
+
+    std::string_view pending {buffer.Data() + head_size, received - head_size};
+    std::string_view head_left = client_head;
+    auto remaining = response->content_length.value_or(0);
+    ChunkedScanner scanner;
+    std::vector<std::string_view> decoded;
+    bool complete = framing == Framing::NONE;
+    // Whether the backend sent more than the body, which leaves its connection in doubt
+    bool overrun = false;
+    long bytes_sent = 0;
+    for (;;) {
+        std::string_view body;
+        decoded.clear();
+        switch (framing) {
+        case Framing::NONE:
+            overrun = not pending.empty();
+            break;
+        case Framing::LENGTH:
+            body = pending.substr(0, remaining);
+            remaining -= body.size();
+            complete = remaining == 0;
+            overrun = pending.size() > body.size();
+            break;
+        case Framing::CHUNKED:
+            body = pending.substr(
+                0, scanner.Scan(pending, decode or filling ? &decoded : nullptr));
+            complete = scanner.Done();
+            overrun = pending.size() > body.size();
+            break;
+        case Framing::CLOSE:
+            body = pending;
+            break;
+        }
+
+        if (filling and framing == Framing::CHUNKED) {
+            for (const auto data : decoded) {
+                fill->Append(data);
+            }
+        } else if (filling) {
+            fill->Append(body);
+        }
+
+        bool sent = true;
+        if (not client) {
+            // Refreshing the cache in the background, for no one in particular
+        } else if (not send_body) {
+            sent = head_left.empty() or co_await client->Write(head_left, {});
+        } else if (decode) {
+            sent = co_await client->Write(head_left, {});
+            for (std::size_t i = 0; sent and i < decoded.size(); ++i) {
+                sent = co_await client->Write({}, decoded[i]);
+                bytes_sent += decoded[i].size();
+            }
+        } else {
+            sent = co_await client->Write(head_left, body);
+            bytes_sent += body.size();
+        }
+        bytes_sent += head_left.size();
+        head_left = {};
+        if (not sent) {
+            bytes_sent = -1;
+            break;
+        }
+        if (complete or overrun or scanner.Failed()) {
+            break;
+        }
+
+        const auto n =
+            co_await connection->Read(buffer.Span(), DeadlineAfter(upstream.ReadTimeout()));
+        if (n <= 0) {
+            complete = n == 0 and framing == Framing::CLOSE;
+            break;
+        }
+        pending = {buffer.Data(), std::size_t(n)};
+    }
+
+    if (filling and complete) {
+        fill->Commit();
+    }
+    result.bytes_sent = bytes_sent;
+    result.keep_alive = client_keep_alive and complete and bytes_sent != -1;
+    if (response->keep_alive and complete and not overrun and framing != Framing::CLOSE) {
+        pool.Release(backend, std::move(connection));
+    }
+    co_return result;
+}
+
+} //namespace nginxpp
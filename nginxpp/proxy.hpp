@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <nginxpp/message.hpp>
+#include <nginxpp/task.hpp>
+
+
+namespace nginxpp {
+
+class AsyncSocket;
+class CacheFill;
+class EventLoop;
+class RequestTrace;
+
+/// How an upstream spreads requests over its backends: in turn, or to the one with the fewest
+/// requests in flight.
+enum class Balance { ROUND_ROBIN, LEAST_CONN };
+
+[[nodiscard]] std::string_view ToString(const Balance balance) noexcept;
+
+/// Parses "round-robin" or "least-conn". Throws ConfigException if neither.
+[[nodiscard]] Balance ParseBalance(const std::string_view name);
+
+
+/// Proxies the requests whose target starts with the prefix, up to a path segment, to the
+/// backend. Several with the same prefix make up one upstream, balanced over their backends.
+struct ProxyOptions {
+    /// Without its leading slash, as targets are parsed; empty to proxy every request
+    std::string prefix;
+    /// HOST:PORT, with an IPv6 host in brackets
+    std::string backend;
+};
+
+/// Parses `PREFIX=HOST:PORT`, e.g. `/api=127.0.0.1:8080`.
+/// Throws ConfigException if malformed.
+[[nodiscard]] ProxyOptions ParseProxy(const std::string_view spec);
+
+
+/// A backend, resolved once per config.
+struct Backend {
+    std::string address;
+    sockaddr_storage sockaddr {};
+    socklen_t length = 0;
+};
+
+/// Throws ServerException if the address cannot be resolved.
+[[nodiscard]] Backend ResolveBackend(const std::string &address);
+
+
+/// The backends that a prefix is proxied to. Built once per config and shared by all loops,
+/// which only change the counters balancing the backends.
+class Upstream {
+public:
+    Upstream(std::string prefix,
+             std::vector<Backend> backends,
+             const Balance balance,
+             const std::chrono::milliseconds connect_timeout,
+             const std::chrono::milliseconds read_timeout) noexcept;
+
+    /// Whether the target starts with the prefix, followed by its end, a '/' or a '?'.
+    [[nodiscard]] bool Matches(const std::string_view target) const noexcept;
+
+    /// Picks the backend of the next request, which counts as in flight until released.
+    [[nodiscard]] std::size_t Acquire() noexcept;
+
+    void Release(const std::size_t index) noexcept;
+
+    [[nodiscard]] const std::string &Prefix() const noexcept {
+        return m_prefix;
+    }
+
+    [[nodiscard]] const std::vector<Backend> &Backends() const noexcept {
+        return m_backends;
+    }
+
+    [[nodiscard]] Balance GetBalance() const noexcept {
+        return m_balance;
+    }
+
+    [[nodiscard]] std::chrono::milliseconds ConnectTimeout() const noexcept {
+        return m_connect_timeout;
+    }
+
+    /// Per wait for the backend to make progress, reading or writing, not for a whole response
+    [[nodiscard]] std::chrono::milliseconds ReadTimeout() const noexcept {
+        return m_read_timeout;
+    }
+
+    [[nodiscard]] std::size_t InFlight(const std::size_t index) const noexcept {
+        return m_in_flight[index].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::string m_prefix;
+    std::vector<Backend> m_backends;
+    Balance m_balance;
+    std::chrono::milliseconds m_connect_timeout;
+    std::chrono::milliseconds m_read_timeout;
+    std::atomic<std::size_t> m_next {0};
+    /// By backend, at the same index
+    std::unique_ptr<std::atomic<std::size_t>[]> m_in_flight;
+};
+
+/// Groups the proxies by prefix into upstreams, the longest prefix first, so that the first
+/// one matching a target is the most specific. Throws ServerException if a backend cannot be
+/// resolved.
+[[nodiscard]] std::vector<std::shared_ptr<Upstream>>
+BuildUpstreams(const std::vector<ProxyOptions> &proxies,
+               const Balance balance,
+               const std::chrono::milliseconds connect_timeout,
+               const std::chrono::milliseconds read_timeout);
+
+/// The first upstream matching the target, or nullptr if it is to be served from disk.
+[[nodiscard]] Upstream *FindUpstream(const std::vector<std::shared_ptr<Upstream>> &upstreams,
+                                     const std::string_view target) noexcept;
+
+
+/// Idle keep-alive connections to the backends, for the sessions of one event loop, which
+/// alone uses it. Kept by backend address, so that they outlive a reload keeping the backend.
+class ConnectionPool {
+public:
+    ConnectionPool(EventLoop &loop, const std::size_t max_idle) noexcept;
+
+    ~ConnectionPool() noexcept;
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    /// The most recently released connection to the backend that is still open, or nullptr.
+    [[nodiscard]] std::unique_ptr<AsyncSocket> TakeIdle(const Backend &backend) noexcept;
+
+    /// Returns nullptr on failure, with errno set to ETIMEDOUT if the timeout passed first.
+    [[nodiscard]] Task<std::unique_ptr<AsyncSocket>>
+    Connect(const Backend &backend,
+            const std::chrono::milliseconds connect_timeout,
+            const std::chrono::milliseconds send_timeout) noexcept;
+
+    /// Keeps the connection for a later request to the backend, unless as many as allowed are
+    /// kept already, in which case it is closed.
+    void Release(const Backend &backend, std::unique_ptr<AsyncSocket> connection) noexcept;
+
+    [[nodiscard]] std::size_t IdleCount(const Backend &backend) const noexcept;
+
+    [[nodiscard]] EventLoop &Loop() const noexcept {
+        return m_loop;
+    }
+
+private:
+    EventLoop &m_loop;
+    std::size_t m_max_idle = 0;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<AsyncSocket>>> m_idle;
+};
+
+
+/// Follows the framing of a chunked body through the buffers it arrives in, to tell where it
+/// ends without copying it, or to decode it.
+class ChunkedScanner {
+public:
+    /// Returns how much of the input belongs to the body, up to its end, or up to the first
+    /// malformed byte. Appends the chunk data within to the given vector, if any.
+    [[nodiscard]] std::size_t Scan(const std::string_view input,
+                                   std::vector<std::string_view> *const data = nullptr) noexcept;
+
+    [[nodiscard]] bool Done() const noexcept {
+        return m_state == State::DONE;
+    }
+
+    [[nodiscard]] bool Failed() const noexcept {
+        return m_state == State::FAILED;
+    }
+
+private:
+    enum class State { SIZE, EXTENSION, SIZE_LF, DATA, DATA_CR, DATA_LF, TRAILER, DONE, FAILED };
+
+    State m_state = State::SIZE;
+    /// Of the chunk being read, or the size being parsed
+    std::size_t m_remaining = 0;
+    bool m_has_digits = false;
+    /// Whether the trailer line being read is empty so far, which ends the body
+    bool m_empty_line = true;
+};
+
+
+/// What became of a proxied request, for the session to log and count.
+struct ProxyResult {
+    /// As relayed from the backend, or the error to answer with if none was
+    int status = 502;
+    std::string error_str;
+    /// False if nothing was sent, leaving the session to answer with the error
+    bool responded = false;
+    /// To the client, -1 if sending failed
+    long bytes_sent = 0;
+    /// Whether the client connection may serve another request
+    bool keep_alive = false;
+    /// Of the buffered input given, how much was the request body
+    std::size_t input_consumed = 0;
+};
+
+/// Forwards the request to a backend of the upstream, over an idle connection of the pool if
+/// any, and relays the response to the client as it arrives. Bodies are streamed a buffer at a
+/// time whatever their size: the request body from the buffered input and then the client, the
+/// response body from the backend. A request needs a Content-Length to have a body. Drops the
+/// hop-by-hop headers and adds the client to X-Forwarded-For. If given a trace, ends its HANDLE
+/// span and begins WRITE when the response head arrives.
+/// If given a cache fill, stores the response as it is relayed, if cacheable; the client may
+/// then be nullptr, for a refresh in the background, and the request must have no body.
+[[nodiscard]] Task<ProxyResult> Proxy(const Request &a_request,
+                                      const std::string_view input,
+                                      AsyncSocket *const client,
+                                      const std::string_view client_address,
+                                      const bool keep_alive,
+                                      Upstream &upstream,
+                                      ConnectionPool &pool,
+                                      CacheFill *const fill = nullptr,
+                                      RequestTrace *const trace = nullptr) noexcept;
+
+} //namespace nginxpp
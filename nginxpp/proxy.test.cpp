@@ -0,0 +1,151 @@
+#include <nginxpp/proxy.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] Upstream createUpstream(const std::string &prefix,
+                                      const std::size_t backends,
+                                      const Balance balance = Balance::ROUND_ROBIN) {
+    std::vector<Backend> resolved;
+    for (std::size_t i = 0; i < backends; ++i) {
+        resolved.push_back(ResolveBackend("127.0.0.1:" + std::to_string(8080 + i)));
+    }
+    return {prefix,
+            std::move(resolved),
+            balance,
+            std::chrono::milliseconds {100},
+            std::chrono::milliseconds {100}};
+}
+
+/// The chunk data, if the whole body was scanned
+[[nodiscard]] std::string decode(const std::vector<std::string_view> &pieces) {
+    ChunkedScanner scanner;
+    std::string decoded;
+    for (const auto piece : pieces) {
+        std::vector<std::string_view> data;
+        const auto size = scanner.Scan(piece, &data);
+        if (size != piece.size() and not scanner.Done()) {
+            return "FAILED";
+        }
+        for (const auto chunk : data) {
+            decoded += chunk;
+        }
+    }
+    return scanner.Done() ? decoded : "INCOMPLETE";
+}
+
+} //namespace
+
+
+TEST(ParseProxyTests, ParsesPrefixAndBackend) {
+    const auto proxy = ParseProxy("/api/v1=127.0.0.1:8080");
+    EXPECT_EQ("api/v1", proxy.prefix);
+    EXPECT_EQ("127.0.0.1:8080", proxy.backend);
+
+    EXPECT_EQ("", ParseProxy("/=localhost:80").prefix);
+    EXPECT_EQ("[::1]:8080", ParseProxy("/api=[::1]:8080").backend);
+}
+
+TEST(ParseProxyTests, ThrowIfGivenMalformedSpec) {
+    EXPECT_THROW((void)ParseProxy("/api"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("api=127.0.0.1:8080"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("/api=127.0.0.1"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("/api=127.0.0.1:0"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("/api=127.0.0.1:65536"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("/api=::1:8080"), ConfigException);
+    EXPECT_THROW((void)ParseProxy("/api=:8080"), ConfigException);
+}
+
+TEST(ParseBalanceTests, ParsesNames) {
+    EXPECT_EQ(Balance::ROUND_ROBIN, ParseBalance("round-robin"));
+    EXPECT_EQ(Balance::LEAST_CONN, ParseBalance("least-conn"));
+    EXPECT_THROW((void)ParseBalance("random"), ConfigException);
+}
+
+TEST(UpstreamTests, MatchesPrefixUpToPathSegment) {
+    const auto upstream = createUpstream("api", 1);
+    EXPECT_TRUE(upstream.Matches("api"));
+    EXPECT_TRUE(upstream.Matches("api/users"));
+    EXPECT_TRUE(upstream.Matches("api?page=2"));
+    EXPECT_FALSE(upstream.Matches("apis"));
+    EXPECT_FALSE(upstream.Matches("static/api"));
+
+    EXPECT_TRUE(createUpstream("", 1).Matches("anything"));
+    EXPECT_TRUE(createUpstream("api/", 1).Matches("api/users"));
+}
+
+TEST(UpstreamTests, BalancesRoundRobin) {
+    auto upstream = createUpstream("api", 3);
+    for (std::size_t i = 0; i < 6; ++i) {
+        const auto index = upstream.Acquire();
+        EXPECT_EQ(i % 3, index);
+        upstream.Release(index);
+    }
+}
+
+TEST(UpstreamTests, BalancesToLeastConnections) {
+    auto upstream = createUpstream("api", 3, Balance::LEAST_CONN);
+    const auto first = upstream.Acquire();
+    const auto second = upstream.Acquire();
+    const auto third = upstream.Acquire();
+    EXPECT_NE(first, second);
+    EXPECT_NE(second, third);
+    EXPECT_NE(first, third);
+
+    upstream.Release(second);
+    EXPECT_EQ(second, upstream.Acquire());
+    EXPECT_EQ(1, upstream.InFlight(second));
+    EXPECT_EQ(1, upstream.InFlight(first));
+}
+
+TEST(UpstreamTests, FindsLongestPrefixFirst) {
+    const auto upstreams = BuildUpstreams({{"api", "127.0.0.1:8080"},
+                                           {"api/v2", "127.0.0.1:8081"},
+                                           {"api", "127.0.0.1:8082"}},
+                                          Balance::ROUND_ROBIN,
+                                          std::chrono::milliseconds {100},
+                                          std::chrono::milliseconds {100});
+    ASSERT_EQ(2, upstreams.size());
+    EXPECT_EQ("api/v2", upstreams[0]->Prefix());
+    EXPECT_EQ(2, upstreams[1]->Backends().size());
+
+    EXPECT_EQ(upstreams[0].get(), FindUpstream(upstreams, "api/v2/users"));
+    EXPECT_EQ(upstreams[1].get(), FindUpstream(upstreams, "api/v1/users"));
+    EXPECT_EQ(nullptr, FindUpstream(upstreams, "index.html"));
+}
+
+TEST(UpstreamTests, ThrowIfBackendCannotBeResolved) {
+    EXPECT_THROW((void)ResolveBackend("no-such-host.invalid:80"), ServerException);
+}
+
+TEST(ChunkedScannerTests, DecodesChunks) {
+    EXPECT_EQ("hello world", decode({"5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n"}));
+    EXPECT_EQ("", decode({"0\r\n\r\n"}));
+    EXPECT_EQ("ab", decode({"2\r\nab\r\n0\r\nTrailer: x\r\n\r\n"}));
+}
+
+TEST(ChunkedScannerTests, FollowsChunksAcrossBuffers) {
+    EXPECT_EQ("hello world",
+              decode({"5\r", "\nhel", "lo\r\n", "6\r\n world", "\r\n0\r\n", "\r\n"}));
+    EXPECT_EQ("INCOMPLETE", decode({"5\r\nhello\r\n0\r\n"}));
+}
+
+TEST(ChunkedScannerTests, StopsAtEndOfBody) {
+    ChunkedScanner scanner;
+    const std::string_view input = "1\r\na\r\n0\r\n\r\nHTTP/1.1 200 OK\r\n";
+    EXPECT_EQ(input.find("HTTP"), scanner.Scan(input));
+    EXPECT_TRUE(scanner.Done());
+}
+
+TEST(ChunkedScannerTests, FailsOnMalformedChunks) {
+    EXPECT_EQ("FAILED", decode({"x\r\n"}));
+    EXPECT_EQ("FAILED", decode({"2\r\nabc\r\n"}));
+    EXPECT_EQ("FAILED", decode({"ffffffffffffffffff\r\n"}));
+}
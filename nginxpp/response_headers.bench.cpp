@@ -0,0 +1,43 @@
+#include <nginxpp/response_headers.hpp>
+
+#include <array>
+
+#include <nginxpp/bench_utils.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+void BM_ToContentType(benchmark::State &state) {
+    const std::array<std::filesystem::path, 4> paths = {
+        "index.html", "assets/app.min.js", "images/logo.PNG", "README"};
+
+    const AllocationCounter counter {state};
+    for (auto _ : state) {
+        for (const auto &p : paths) {
+            auto type = ToContentType(p);
+            benchmark::DoNotOptimize(type);
+        }
+    }
+}
+BENCHMARK(BM_ToContentType);
+
+void BM_GetStatusLine(benchmark::State &state) {
+    const AllocationCounter counter {state};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(GetStatusLine(state.range(0)));
+    }
+}
+BENCHMARK(BM_GetStatusLine)->Arg(200)->Arg(404);
+
+void BM_GetDateHeader(benchmark::State &state) {
+    const AllocationCounter counter {state};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(GetDateHeader());
+    }
+}
+BENCHMARK(BM_GetDateHeader);
+
+} //namespace
@@ -0,0 +1,366 @@
+#include <nginxpp/response_headers.hpp>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <sys/stat.h>
+
+#include <nginxpp/body.hpp>
+#include <nginxpp/chrono_utils.hpp>
+#include <nginxpp/message.hpp>
+#include <nginxpp/metrics.hpp>
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/version.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr int MIN_STATUS = 100;
+constexpr int MAX_STATUS = 599;
+
+[[nodiscard]] auto toStatusText(const int code) noexcept {
+    switch (code) {
+    case 100:
+        return "Continue";
+    case 101:
+        return "Switching Protocol";
+    case 102:
+        return "Processing";
+    case 103:
+        return "Early Hints";
+    case 200:
+        return "OK";
+    case 201:
+        return "Created";
+    case 202:
+        return "Accepted";
+    case 203:
+        return "Non-Authoritative Information";
+    case 204:
+        return "No Content";
+    case 205:
+        return "Reset Content";
+    case 206:
+        return "Partial Content";
+    case 207:
+        return "Multi-Status";
+    case 208:
+        return "Already Reported";
+    case 226:
+        return "IM Used";
+    case 300:
+        return "Multiple Choice";
+    case 301:
+        return "Moved Permanently";
+    case 302:
+        return "Found";
+    case 303:
+        return "See Other";
+    case 304:
+        return "Not Modified";
+    case 305:
+        return "Use Proxy";
+    case 306:
+        return "unused";
+    case 307:
+        return "Temporary Redirect";
+    case 308:
+        return "Permanent Redirect";
+    case 400:
+        return "Bad Request";
+    case 401:
+        return "Unauthorized";
+    case 402:
+        return "Payment Required";
+    case 403:
+        return "Forbidden";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 406:
+        return "Not Acceptable";
+    case 407:
+        return "Proxy Authentication Required";
+    case 408:
+        return "Request Timeout";
+    case 409:
+        return "Conflict";
+    case 410:
+        return "Gone";
+    case 411:
+        return "Length Required";
+    case 412:
+        return "Precondition Failed";
+    case 413:
+        return "Payload Too Large";
+    case 414:
+        return "URI Too Long";
+    case 415:
+        return "Unsupported Media Type";
+    case 416:
+        return "Range Not Satisfiable";
+    case 417:
+        return "Expectation Failed";
+    case 418:
+        return "I'm a teapot";
+    case 421:
+        return "Misdirected Request";
+    case 422:
+        return "Unprocessable Entity";
+    case 423:
+        return "Locked";
+    case 424:
+        return "Failed Dependency";
+    case 425:
+        return "Too Early";
+    case 426:
+        return "Upgrade Required";
+    case 428:
+        return "Precondition Required";
+    case 429:
+        return "Too Many Requests";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 451:
+        return "Unavailable For Legal Reasons";
+    case 501:
+        return "Not Implemented";
+    case 502:
+        return "Bad Gateway";
+    case 503:
+        return "Service Unavailable";
+    case 504:
+        return "Gateway Timeout";
+    case 505:
+        return "HTTP Version Not Supported";
+    case 506:
+        return "Variant Also Negotiates";
+    case 507:
+        return "Insufficient Storage";
+    case 508:
+        return "Loop Detected";
+    case 510:
+        return "Not Extended";
+    case 511:
+        return "Network Authentication Required";
+
+    default:
+    case 500:
+        return "Internal Server Error";
+    }
+}
+
+[[nodiscard]] auto buildStatusLines() noexcept {
+    std::array<std::string, MAX_STATUS - MIN_STATUS + 1> lines;
+    for (auto code = MIN_STATUS; code <= MAX_STATUS; ++code) {
+        lines[code - MIN_STATUS] =
+            VERSION + (' ' + std::to_string(code)) + ' ' + toStatusText(code) + CRLF;
+    }
+    return lines;
+}
+
+[[nodiscard]] inline auto toSeconds(const std::chrono::system_clock::time_point &tp) noexcept {
+    return std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+}
+
+std::atomic<long long> g_current_second {0};
+
+/// Ticks g_current_second at every second boundary, so readers only pay for an atomic load.
+void startDateTimer() noexcept {
+    g_current_second = toSeconds(std::chrono::system_clock::now());
+
+    std::thread([]() {
+        for (;;) {
+            const auto now = std::chrono::system_clock::now();
+            std::this_thread::sleep_until(std::chrono::floor<std::chrono::seconds>(now) +
+                                          std::chrono::seconds {1});
+            g_current_second.store(toSeconds(std::chrono::system_clock::now()),
+                                   std::memory_order_relaxed);
+        }
+    }).detach();
+}
+
+[[nodiscard]] inline auto toModificationNs(const struct stat &st) noexcept {
+    return static_cast<long long>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::string_view GetStatusLine(const int status) noexcept {
+    static const auto STATUS_LINES = buildStatusLines();
+
+    if (status < MIN_STATUS or status > MAX_STATUS) {
+        return STATUS_LINES[500 - MIN_STATUS];
+    }
+    return STATUS_LINES[status - MIN_STATUS];
+}
+
+std::string_view GetDateHeader() noexcept {
+    static const bool timer_started = (startDateTimer(), true);
+    (void)timer_started;
+
+    static constexpr std::string_view PREFIX = "Date: ";
+    static constexpr std::string_view SUFFIX = CRLF;
+    static constexpr auto SIZE = PREFIX.size() + HTTP_DATE_SIZE + SUFFIX.size();
+
+    thread_local long long cached_second = -1;
+    thread_local std::array<char, SIZE> cached_header = []() {
+        std::array<char, SIZE> header {};
+        PREFIX.copy(header.data(), PREFIX.size());
+        SUFFIX.copy(header.data() + PREFIX.size() + HTTP_DATE_SIZE, SUFFIX.size());
+        return header;
+    }();
+
+    const auto second = g_current_second.load(std::memory_order_relaxed);
+    if (second != cached_second) {
+        cached_second = second;
+        const std::chrono::system_clock::time_point tp {std::chrono::seconds {second}};
+        (void)FormatHttpDate(tp,
+                             gsl::span<char, HTTP_DATE_SIZE> {cached_header.data() + PREFIX.size(),
+                                                              HTTP_DATE_SIZE});
+    }
+
+    return {cached_header.data(), cached_header.size()};
+}
+
+std::string_view GetServerHeader() noexcept {
+    static const auto SERVER_HEADER = "Server: nginxpp/" + std::string(GetVersion()) + CRLF;
+    return SERVER_HEADER;
+}
+
+std::string ToContentType(const std::filesystem::path &p) noexcept {
+    static const std::unordered_map<std::string_view, std::string> CONTENT_TYPE_MAP = {
+        {"css", "text/css"},
+        {"csv", "text/csv"},
+        {"htm", "text/html"},
+        {"html", "text/html"},
+        {"js", "text/javascript"},
+        {"mjs", "text/javascript"},
+        {"txt", "text/plain"},
+        {"vtt", "text/vtt"},
+
+        {"apng", "image/apng"},
+        {"avif", "image/avif"},
+        {"bmp", "image/bmp"},
+        {"gif", "image/gif"},
+        {"png", "image/png"},
+        {"svg", "image/svg+xml"},
+        {"webp", "image/webp"},
+        {"ico", "image/x-icon"},
+        {"tif", "image/tiff"},
+        {"tiff", "image/tiff"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+
+        {"mp4", "video/mp4"},
+        {"mpeg", "video/mpeg"},
+        {"webm", "video/webm"},
+
+        {"mp3", "audio/mp3"},
+        {"mpga", "audio/mpeg"},
+        {"weba", "audio/webm"},
+        {"wav", "audio/wave"},
+
+        {"otf", "font/otf"},
+        {"ttf", "font/ttf"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+
+        {"7z", "application/x-7z-compressed"},
+        {"atom", "application/atom+xml"},
+        {"pdf", "application/pdf"},
+        {"json", "application/json"},
+        {"rss", "application/rss+xml"},
+        {"tar", "application/x-tar"},
+        {"xht", "application/xhtml+xml"},
+        {"xhtml", "application/xhtml+xml"},
+        {"xslt", "application/xslt+xml"},
+        {"xml", "application/xml"},
+        {"gz", "application/gzip"},
+        {"zip", "application/zip"},
+        {"wasm", "application/wasm"},
+    };
+
+    const auto extension = ToLower(p.extension());
+    const auto key = [](const std::string_view ext) {
+        if (not ext.empty() and ext.front() == '.') {
+            return ext.substr(1);
+        }
+        return ext;
+    }(extension);
+
+    if (const auto iter = CONTENT_TYPE_MAP.find(key); iter != CONTENT_TYPE_MAP.cend()) {
+        return iter->second;
+    }
+
+    return "application/octet-stream";
+}
+
+
+std::string BuildFileHeaders(const std::filesystem::path &p, const FileRange &range) noexcept {
+    std::string block = "Content-Type: " + ToContentType(p) + CRLF;
+    block += "Content-Length: " + std::to_string(range.length) + CRLF;
+
+    struct stat st;
+    if (fstat(range.fd, &st) != -1) {
+        const std::chrono::system_clock::time_point tp {std::chrono::seconds {st.st_mtim.tv_sec}};
+        std::array<char, HTTP_DATE_SIZE> buffer;
+        block.append("Last-Modified: ").append(FormatHttpDate(tp, buffer)).append(CRLF);
+    }
+
+    return block;
+}
+
+
+FileHeaderCache::FileHeaderCache(const std::size_t capacity,
+                                 const std::size_t metrics_slot) noexcept :
+    m_shards(SHARD_COUNT),
+    m_shard_capacity(std::max<std::size_t>(1, capacity / SHARD_COUNT)),
+    m_metrics_slot(metrics_slot) {
+}
+
+FileHeaderCache::HeaderBlock FileHeaderCache::Get(const std::filesystem::path &p,
+                                                  const FileRange &range) noexcept {
+    struct stat st;
+    if (range.fd == FileDescriptor::INVALID_FD or fstat(range.fd, &st) == -1) {
+        return nullptr;
+    }
+    const auto modification_ns = toModificationNs(st);
+    const auto size = static_cast<std::size_t>(st.st_size);
+
+    const auto &key = p.native();
+    auto &shard = m_shards[std::hash<std::string> {}(key) % SHARD_COUNT];
+    {
+        const std::lock_guard lock {shard.mutex};
+        const auto iter = shard.entries.find(key);
+        if (iter != shard.entries.cend() and iter->second.size == size and
+            iter->second.modification_ns == modification_ns) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            RecordCacheLookup(true, m_metrics_slot);
+            return iter->second.block;
+        }
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    RecordCacheLookup(false, m_metrics_slot);
+    auto block = std::make_shared<const std::string>(BuildFileHeaders(p, range));
+
+    const std::lock_guard lock {shard.mutex};
+    if (shard.entries.size() >= m_shard_capacity and not shard.entries.contains(key)) {
+        shard.entries.erase(shard.entries.begin());
+    }
+    shard.entries.insert_or_assign(key, Entry {modification_ns, size, block});
+
+    return block;
+}
+
+} //namespace nginxpp
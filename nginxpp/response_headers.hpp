@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace nginxpp {
+
+struct FileRange;
+
+constexpr auto CRLF = "\r\n";
+
+/// Returns the pre-serialized status line, e.g. "HTTP/1.1 200 OK\r\n".
+/// Unknown codes map to the line of 500.
+[[nodiscard]] std::string_view GetStatusLine(const int status) noexcept;
+
+/// Returns the "Date: <IMF-fixdate>\r\n" header line of the current second.
+/// A background timer advances the second; each thread formats it at most once per second.
+/// The returned view stays valid until the next call from the same thread.
+[[nodiscard]] std::string_view GetDateHeader() noexcept;
+
+/// Returns the "Server: nginxpp/<version>\r\n" header line.
+[[nodiscard]] std::string_view GetServerHeader() noexcept;
+
+[[nodiscard]] std::string ToContentType(const std::filesystem::path &p) noexcept;
+
+/// Builds the ready-to-send header lines which only depend on the file itself:
+/// Content-Type, Content-Length and Last-Modified.
+[[nodiscard]] std::string BuildFileHeaders(const std::filesystem::path &p,
+                                           const FileRange &range) noexcept;
+
+
+/// Caches the header lines of files, keyed by path and validated by size and modification
+/// time, so that serving a hot file does not rebuild them.
+class FileHeaderCache {
+public:
+    using HeaderBlock = std::shared_ptr<const std::string>;
+
+    static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+    /// Its lookups count toward the metrics of the given host slot, see HostSlot().
+    explicit FileHeaderCache(const std::size_t capacity = DEFAULT_CAPACITY,
+                             const std::size_t metrics_slot = 0) noexcept;
+
+    /// Returns nullptr if the range has no valid fd.
+    [[nodiscard]] HeaderBlock Get(const std::filesystem::path &p, const FileRange &range) noexcept;
+
+    [[nodiscard]] std::size_t Hits() const noexcept {
+        return m_hits.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::size_t Misses() const noexcept {
+        return m_misses.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr std::size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        long long modification_ns = 0;
+        std::size_t size = 0;
+        HeaderBlock block;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    std::vector<Shard> m_shards;
+    std::size_t m_shard_capacity = 0;
+    std::size_t m_metrics_slot = 0;
+    std::atomic<std::size_t> m_hits {0};
+    std::atomic<std::size_t> m_misses {0};
+};
+
+} //namespace nginxpp
@@ -0,0 +1,64 @@
+#include <nginxpp/response_headers.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/body.hpp>
+
+
+using namespace nginxpp;
+
+
+TEST(GetStatusLineTests, KnownStatus) {
+    EXPECT_EQ("HTTP/1.1 200 OK\r\n", GetStatusLine(200));
+    EXPECT_EQ("HTTP/1.1 404 Not Found\r\n", GetStatusLine(404));
+}
+
+TEST(GetStatusLineTests, OutOfRangeStatusIs500) {
+    EXPECT_EQ(GetStatusLine(500), GetStatusLine(42));
+    EXPECT_EQ(GetStatusLine(500), GetStatusLine(1000));
+}
+
+
+TEST(GetDateHeaderTests, InIMFFixdateFormat) {
+    const std::string header {GetDateHeader()};
+
+    ASSERT_EQ(std::string_view {"Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"}.size(), header.size());
+    EXPECT_TRUE(header.starts_with("Date: "));
+    EXPECT_TRUE(header.ends_with(" GMT\r\n"));
+}
+
+
+TEST(GetServerHeaderTests, HasProductName) {
+    EXPECT_TRUE(GetServerHeader().starts_with("Server: nginxpp/"));
+    EXPECT_TRUE(GetServerHeader().ends_with("\r\n"));
+}
+
+
+TEST(ToContentTypeTests, KnownExtension) {
+    EXPECT_EQ("text/html", ToContentType("index.html"));
+    EXPECT_EQ("image/png", ToContentType("a/b/C.PNG"));
+}
+
+TEST(ToContentTypeTests, UnknownExtension) {
+    EXPECT_EQ("application/octet-stream", ToContentType("no_extension"));
+}
+
+
+TEST(FileHeaderCacheTests, NullIfInvalidFile) {
+    FileHeaderCache cache;
+    EXPECT_FALSE(cache.Get("no_such_file", OpenFileRange("no_such_file")));
+}
+
+TEST(FileHeaderCacheTests, HitAfterMiss) {
+    FileHeaderCache cache;
+
+    const auto first = cache.Get("Makefile", OpenFileRange("Makefile"));
+    const auto second = cache.Get("Makefile", OpenFileRange("Makefile"));
+
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(1, cache.Misses());
+    EXPECT_EQ(1, cache.Hits());
+    EXPECT_NE(std::string::npos, first->find("Content-Length: "));
+    EXPECT_NE(std::string::npos, first->find("Last-Modified: "));
+}
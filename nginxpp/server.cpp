@@ -1,11 +1,17 @@
 #include <nginxpp/server.hpp>
 
 #include <algorithm>
-#include <array>
 #include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <streambuf>
 #include <thread>
+#include <vector>
 
 #include <csignal>
 #include <errno.h>
@@ -17,13 +23,33 @@
 #include <netinet/tcp.h>
 #include <poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <cxxopts.hpp>
 
+#include <nginxpp/access_log.hpp>
+#include <nginxpp/admission.hpp>
+#include <nginxpp/affinity.hpp>
+#include <nginxpp/args.hpp>
+#include <nginxpp/async_socket.hpp>
+#include <nginxpp/buffer_pool.hpp>
+#include <nginxpp/cache.hpp>
+#include <nginxpp/config.hpp>
+#include <nginxpp/event_loop.hpp>
 #include <nginxpp/exception.hpp>
+#include <nginxpp/http2.hpp>
+#include <nginxpp/load_shedder.hpp>
 #include <nginxpp/message.hpp>
+#include <nginxpp/metrics.hpp>
+#include <nginxpp/response_headers.hpp>
+#include <nginxpp/string_utils.hpp>
+#include <nginxpp/task.hpp>
+#include <nginxpp/tls.hpp>
+#include <nginxpp/trace.hpp>
+#include <nginxpp/variant_utils.hpp>
 
 
 using std::string_literals::operator""s;
@@ -32,12 +58,36 @@ using namespace nginxpp;
 
 namespace {
 
+/// A drain checks how many connections are left at this interval
+constexpr std::chrono::milliseconds DRAIN_POLL_INTERVAL {10};
+
+/// A miss waiting for another request to fetch the same response looks again at this interval
+constexpr std::chrono::milliseconds CACHE_LOCK_POLL_INTERVAL {10};
+
 std::atomic<int> g_signal {0};
+/// A second signal cuts the drain short
+std::atomic<int> g_signal_count {0};
 
 extern "C" void signalHandler(int signal) {
     g_signal = signal;
+    ++g_signal_count;
+}
+
+extern "C" void reopenSignalHandler(int) {
+    ReopenAccessLog();
 }
 
+std::atomic<bool> g_reload {false};
+
+extern "C" void reloadSignalHandler(int) {
+    g_reload = true;
+}
+
+/// The context that the loop running on this thread serves new requests with. Only replaced
+/// on the loop thread, by the server posting a new one on reload, so reading it is as cheap as
+/// reading any pointer, and a session holding on to the previous one keeps it alive.
+thread_local std::shared_ptr<const SessionContext> t_context;
+
 template<typename... Args>
 inline constexpr void setSocketOption(Args &&...args) {
     if (setsockopt(std::forward<Args>(args)...) == -1) {
@@ -55,6 +105,47 @@ inline constexpr void setSocketOption(Args &&...args) {
     }
 }
 
+/// Of the Unix domain sockets given to listen on, and of their peers in the access log, as
+/// those are seldom bound to a path
+constexpr std::string_view UNIX_PREFIX = "unix:";
+
+/// Returns the length of the address, or 0 if it does not fit.
+[[nodiscard]] socklen_t makeUnixAddress(const std::string &address, sockaddr_un &out) noexcept {
+    out = {};
+    out.sun_family = AF_UNIX;
+    if (address.empty() or address.size() >= sizeof(out.sun_path)) {
+        return 0;
+    }
+    address.copy(out.sun_path, address.size());
+    // Abstract names start with a NUL byte rather than '@', and end where the address does
+    const bool abstract = address.front() == '@';
+    if (abstract) {
+        out.sun_path[0] = '\0';
+    }
+    return offsetof(sockaddr_un, sun_path) + address.size() + (abstract ? 0 : 1);
+}
+
+/// Whether the file is a socket that nothing listens on any more, e.g. one left behind by a
+/// server that crashed, rather than one still in use.
+[[nodiscard]] bool isStaleSocket(const sockaddr_un &address, const socklen_t length) noexcept {
+    struct stat status {};
+    if (lstat(address.sun_path, &status) == -1 or not S_ISSOCK(status.st_mode)) {
+        return false;
+    }
+    // Without blocking on a listener whose queue is full, which is in use all the more
+    const Socket probe {socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    return probe != Socket::INVALID_SOCKET and
+           connect(probe, reinterpret_cast<const sockaddr *>(&address), length) == -1 and
+           errno == ECONNREFUSED;
+}
+
+/// As a vector, which cannot be brace-initialized with elements that only move
+[[nodiscard]] std::vector<Socket> onlyListener(Socket listener) {
+    std::vector<Socket> listeners;
+    listeners.push_back(std::move(listener));
+    return listeners;
+}
+
 [[nodiscard]] gsl::not_null<const void *> locateInternetAddress(const sockaddr_storage &address) {
     if (address.ss_family == AF_INET) {
         return &(reinterpret_cast<const sockaddr_in *>(&address)->sin_addr);
@@ -82,43 +173,189 @@ template<typename Function, typename... Args>
     return handleEINTR(poll, &pfd, 1, timeout.count());
 }
 
+/// The kernel silently caps the backlog at net.core.somaxconn
+[[nodiscard]] int effectiveBacklog(const int backlog) noexcept {
+    std::ifstream file {"/proc/sys/net/core/somaxconn"};
+    int somaxconn {};
+    if (file >> somaxconn) {
+        return std::min(backlog, somaxconn);
+    }
+    return backlog;
+}
+
 [[nodiscard]] inline auto hasConnectionRequest(pollfd &pfd) noexcept {
     Expects(pfd.events == POLLIN);
 
     return 0 != pollOne(pfd, ServerOptions::accept_timeout);
 }
 
-[[nodiscard]] inline auto readyToRead(pollfd &pfd) noexcept {
-    Expects(pfd.events == POLLIN);
+/// The index of a listener with a connection pending, looking from the one after the last
+/// found, so that none starves the others; the number of listeners if none has any in time.
+[[nodiscard]] std::size_t findConnectionRequest(std::vector<pollfd> &pfds,
+                                                std::size_t &next) noexcept {
+    if (handleEINTR(poll, pfds.data(), pfds.size(), ServerOptions::accept_timeout.count()) <= 0) {
+        return pfds.size();
+    }
+    for (std::size_t i = 0; i < pfds.size(); ++i) {
+        const auto index = (next + i) % pfds.size();
+        if (pfds[index].revents) {
+            next = index + 1;
+            return index;
+        }
+    }
+    return pfds.size();
+}
 
-    return 0 != pollOne(pfd, ServerOptions::read_timeout);
+/// Out of descriptors, accepts the oldest pending connection with the one kept spare and
+/// closes it, so that its peer learns right away instead of timing out in the queue.
+void rejectWithSpare(const Socket &listener, Socket &spare) noexcept {
+    spare = Socket {Socket::INVALID_SOCKET};
+    if (const Socket rejected {accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)};
+        rejected != Socket::INVALID_SOCKET) {
+        RecordConnectionRejected();
+    }
+    spare = Socket {open("/dev/null", O_RDONLY | O_CLOEXEC)};
 }
 
-[[nodiscard]] inline auto
-read(const Socket &sock, char *const buffer, const std::size_t len) noexcept {
-    Expects(buffer);
-    return handleEINTR(recv, sock, buffer, len, 0);
+/// Without a Date, which 5xx responses may go without
+[[nodiscard]] std::string buildOverloadResponse(const std::chrono::seconds retry_after) {
+    return std::string {GetStatusLine(503)} + std::string {GetServerHeader()} +
+           "Retry-After: " + std::to_string(retry_after.count()) + CRLF +
+           "Content-Length: 0" + CRLF + "Connection: close" + CRLF + CRLF;
 }
 
-[[nodiscard]] inline auto
-write(const Socket &sock, const char *const buffer, const std::size_t len) noexcept {
-    Expects(buffer);
-    return handleEINTR(send, sock, buffer, len, 0);
+using Clock = std::chrono::steady_clock;
+
+[[nodiscard]] Task<long> sendBuffers(AsyncSocket &sock,
+                                     const std::string_view head,
+                                     const std::string_view body) noexcept {
+    co_return co_await sock.Write(head, body) ? static_cast<long>(head.size() + body.size())
+                                              : -1L;
 }
 
-[[nodiscard]] inline auto
-sendAll(const Socket &sock, const char *const buffer, const std::size_t requested) noexcept {
-    Expects(buffer);
-    for (std::size_t total_sent = 0; total_sent < requested;) {
-        const auto left = requested - total_sent;
-        const auto n = write(sock, buffer + total_sent, left);
-        if (n == -1) {
-            return false;
+[[nodiscard]] Task<long>
+sendFile(AsyncSocket &sock, const std::string_view head, const FileRange &range) noexcept {
+    co_return co_await sock.Write(head, {}, MSG_MORE) and co_await sock.WriteFile(range)
+        ? static_cast<long>(head.size() + range.length)
+        : -1L;
+}
+
+/// Starts with a small buffer, and moves up a size class whenever the generator fills it,
+/// so that short listings stay cheap while long ones take fewer syscalls.
+[[nodiscard]] Task<long> sendGenerated(AsyncSocket &sock,
+                                       const std::string_view head,
+                                       const BodyGenerator &generate) noexcept {
+    if (not co_await sock.Write(head, {}, MSG_MORE)) {
+        co_return -1;
+    }
+
+    PooledBuffer buffer;
+    buffer.Lease(BufferSize::SMALL);
+    long total_sent = head.size();
+    while (const auto n = generate(buffer.Span())) {
+        if (not co_await sock.Write({}, {buffer.Data(), n})) {
+            co_return -1;
         }
         total_sent += n;
+
+        if (n == buffer.Capacity() and buffer.Size() != BufferSize::LARGE) {
+            buffer.Lease(static_cast<BufferSize>(static_cast<std::size_t>(buffer.Size()) + 1));
+        }
     }
 
-    return true;
+    co_return total_sent;
+}
+
+/// Picks the cheapest way to put each kind of body on the wire.
+/// Returns the number of bytes sent, or -1 on failure.
+[[nodiscard]] Task<long> sendResponse(AsyncSocket &sock, const Response &a_response) noexcept {
+    const auto head = SerializeHeaders(a_response);
+
+    co_return co_await std::visit(
+        Overloaded {
+            [&](const std::monostate) {
+                return sendBuffers(sock, head, {});
+            },
+            [&](const std::string_view view) {
+                return sendBuffers(sock, head, view);
+            },
+            [&](const std::string &buffer) {
+                return sendBuffers(sock, head, buffer);
+            },
+            [&](const FileRange &range) {
+                return sendFile(sock, head, range);
+            },
+            [&](const MappedRegion &region) {
+                return sendBuffers(sock, head, region.View());
+            },
+            [&](const BodyGenerator &generate) {
+                return sendGenerated(sock, head, generate);
+            },
+        },
+        a_response.body);
+}
+
+[[nodiscard]] inline std::string_view hostOf(const Request &a_request) noexcept {
+    const auto iter = a_request.headers.find("host");
+    return iter == a_request.headers.cend() ? std::string_view {} : iter->second;
+}
+
+/// Whether the connection may serve another request after this one.
+[[nodiscard]] inline auto isKeepAlive(const Request &a_request) noexcept {
+    if (not a_request) {
+        return false;
+    }
+
+    const auto iter = a_request.headers.find("connection");
+    const auto connection =
+        iter == a_request.headers.cend() ? std::string {} : ToLower(iter->second);
+    if (a_request.version == "HTTP/1.0") {
+        return connection == "keep-alive";
+    }
+    return connection != "close";
+}
+
+/// Without a known length, only closing the connection can end the body.
+[[nodiscard]] inline auto hasDelimitedBody(const Response &a_response) noexcept {
+    return a_response and not std::holds_alternative<BodyGenerator>(a_response.body);
+}
+
+/// Throws ConfigException unless given as unix:PATH, or unix:@NAME, short enough to bind to.
+[[nodiscard]] std::string parseUnixSocket(const std::string &spec) {
+    if (not std::string_view {spec}.starts_with(UNIX_PREFIX)) {
+        throw ConfigException {"Only unix: addresses are listened on besides the port: '" +
+                               spec + "'"};
+    }
+    auto address = spec.substr(UNIX_PREFIX.size());
+    if (sockaddr_un unix_address {}; makeUnixAddress(address, unix_address) == 0) {
+        throw ConfigException {"Invalid Unix domain socket address: '" + spec + "'"};
+    }
+    return address;
+}
+
+/// Throws ConfigException unless octal permissions, e.g. 0660.
+[[nodiscard]] mode_t parseMode(const std::string &spec) {
+    mode_t mode {};
+    const auto *const last = spec.data() + spec.size();
+    if (const auto [end, error] = std::from_chars(spec.data(), last, mode, 8);
+        spec.empty() or error != std::errc {} or end != last or mode > 07777) {
+        throw ConfigException {"Invalid mode: '" + spec + "'"};
+    }
+    return mode;
+}
+
+/// Throws ConfigException if the file cannot be read, or is not of TLS_TICKET_KEY_SIZE bytes.
+[[nodiscard]] std::string readTicketKey(const std::string &path) {
+    std::ifstream file {path, std::ios::binary};
+    std::string key {std::istreambuf_iterator<char> {file}, std::istreambuf_iterator<char> {}};
+    if (not file.is_open() or file.bad()) {
+        throw ConfigException {"Failed to read TLS ticket key: '" + path + "'"};
+    }
+    if (key.size() != TLS_TICKET_KEY_SIZE) {
+        throw ConfigException {"TLS ticket key '" + path + "' must be " +
+                               std::to_string(TLS_TICKET_KEY_SIZE) + " bytes"};
+    }
+    return key;
 }
 
 } //namespace
@@ -156,18 +393,44 @@ Socket createServerSocket(const ServerOptions &options) {
         if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1) {
             continue;
         }
+        // Shared by worker processes, which all wake up for a connection only one of them gets
+        if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+            continue;
+        }
 
         setSocketOption(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-        if (ServerOptions::tcp_nodelay) {
+        if (options.tcp_nodelay) {
             setSocketOption(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
         }
+        // Before listen(), as the window scale is agreed upon during the handshake
+        if (options.receive_buffer) {
+            setSocketOption(sock,
+                            SOL_SOCKET,
+                            SO_RCVBUF,
+                            &options.receive_buffer,
+                            sizeof(options.receive_buffer));
+        }
+        if (options.send_buffer) {
+            setSocketOption(
+                sock, SOL_SOCKET, SO_SNDBUF, &options.send_buffer, sizeof(options.send_buffer));
+        }
+        if (const int seconds = options.defer_accept.count(); seconds) {
+            setSocketOption(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds));
+        }
+        if (options.fastopen_queue) {
+            setSocketOption(sock,
+                            IPPROTO_TCP,
+                            TCP_FASTOPEN,
+                            &options.fastopen_queue,
+                            sizeof(options.fastopen_queue));
+        }
 
         if (bind(sock, p->ai_addr, p->ai_addrlen) == -1) {
             errors << "Failed to bind(): " << strerror(errno) << '\n';
             continue;
         }
 
-        if (listen(sock, ServerOptions::listen_backlog) == -1) {
+        if (listen(sock, options.listen_backlog) == -1) {
             throw SocketException("Failed to listen(): "s + strerror(errno));
         }
 
@@ -187,164 +450,670 @@ Socket createServerSocket(const ServerOptions &options) {
     return ::getPort(address);
 }
 
+int getSocketOption(const Socket &socket, const int level, const int name) {
+    int value {};
+    socklen_t length = sizeof(value);
+    if (getsockopt(socket, level, name, &value, &length) == -1) {
+        throw SocketException("Failed to getsockopt(): "s + strerror(errno));
+    }
+    return value;
+}
+
+Socket createUnixServerSocket(const std::string &address, const ServerOptions &options) {
+    sockaddr_un unix_address {};
+    const auto length = makeUnixAddress(address, unix_address);
+    if (length == 0) {
+        throw SocketException("Invalid Unix domain socket address: '" + address + "'");
+    }
+    const auto *const bound_address = reinterpret_cast<const sockaddr *>(&unix_address);
+    const bool abstract = address.front() == '@';
+
+    Socket sock {socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (sock == Socket::INVALID_SOCKET) {
+        throw SocketException("Failed to create socket: "s + strerror(errno));
+    }
+    bool bound = bind(sock, bound_address, length) == 0;
+    // Abstract names go away along with their last socket, files stay behind
+    if (not bound and errno == EADDRINUSE and not abstract and
+        isStaleSocket(unix_address, length)) {
+        bound = unlink(address.c_str()) == 0 and bind(sock, bound_address, length) == 0;
+    }
+    if (not bound) {
+        throw SocketException("Failed to bind() '" + address + "': " + strerror(errno));
+    }
+    // Connecting takes writing to the file, which is how access to the socket is controlled
+    if (options.unix_mode and not abstract and chmod(address.c_str(), *options.unix_mode) == -1) {
+        throw SocketException("Failed to chmod() '" + address + "': " + strerror(errno));
+    }
+
+    if (listen(sock, options.listen_backlog) == -1) {
+        throw SocketException("Failed to listen(): "s + strerror(errno));
+    }
+    return sock;
+}
+
+std::string getUnixAddress(const Socket &socket) {
+    sockaddr_un address {};
+    socklen_t length = sizeof(address);
+    if (getsockname(socket, reinterpret_cast<sockaddr *>(&address), &length) == -1) {
+        throw SocketException("Failed to getsockname(): "s + strerror(errno));
+    }
+    const auto size = length - std::min<socklen_t>(length, offsetof(sockaddr_un, sun_path));
+    if (address.sun_family != AF_UNIX or size == 0) {
+        return {};
+    }
+    if (address.sun_path[0] == '\0') {
+        return '@' + std::string(address.sun_path + 1, size - 1);
+    }
+    return {address.sun_path, strnlen(address.sun_path, size)};
+}
+
+std::vector<Socket> inheritServerSockets() {
+    const auto *const pid = getenv("LISTEN_PID");
+    const auto *const fds = getenv("LISTEN_FDS");
+    const auto count = fds ? ParseNumber<int>(fds) : std::nullopt;
+    const bool ours = pid and ParseNumber<pid_t>(pid) == getpid();
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if (not ours or count.value_or(0) < 1) {
+        return {};
+    }
+
+    std::vector<Socket> sockets;
+    for (int i = 0; i < *count; ++i) {
+        Socket sock {LISTEN_FDS_START + i};
+        if (getSocketOption(sock, SOL_SOCKET, SO_ACCEPTCONN) == 0) {
+            throw SocketException("Inherited descriptor is not a listening socket");
+        }
+        if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1 or fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+            throw SocketException("Failed to fcntl() inherited socket: "s + strerror(errno));
+        }
+        sockets.push_back(std::move(sock));
+    }
+    return sockets;
+}
+
+std::vector<Socket> openServerSockets(const ServerOptions &options) {
+    auto inherited = inheritServerSockets();
+    // By address, the one bound to the port having none
+    const auto take = [&inherited](const std::string &address) {
+        for (auto &sock : inherited) {
+            if (sock != Socket::INVALID_SOCKET and getUnixAddress(sock) == address) {
+                return std::move(sock);
+            }
+        }
+        return Socket {Socket::INVALID_SOCKET};
+    };
+
+    std::vector<Socket> sockets;
+    auto sock = take({});
+    sockets.push_back(sock != Socket::INVALID_SOCKET ? std::move(sock)
+                                                     : createServerSocket(options));
+    for (const auto &address : options.unix_sockets) {
+        sock = take(address);
+        sockets.push_back(sock != Socket::INVALID_SOCKET
+                              ? std::move(sock)
+                              : createUnixServerSocket(address, options));
+    }
+    // Any others are left to whoever passed them
+    for (auto &unused : inherited) {
+        (void)unused.Release();
+    }
+    return sockets;
+}
+
 } //namespace internal
 
 
-class SocketBuf : public std::streambuf {
+/// A virtual host, or the default one, as sessions serve it.
+struct HostContext {
+    std::filesystem::path root_dir;
+    /// nullptr if the host caches no headers
+    std::shared_ptr<FileHeaderCache> header_cache;
+    std::size_t metrics_slot = DEFAULT_HOST_SLOT;
+};
+
+/// Shared by all sessions, instead of each holding a copy.
+struct SessionContext {
+    std::shared_ptr<const HostRouter> router;
+    /// At the index the router gives, the default host first
+    std::vector<HostContext> hosts;
+    /// Longest prefix first
+    std::vector<std::shared_ptr<Upstream>> upstreams;
+    /// nullptr if proxied responses are not cached
+    std::shared_ptr<ContentCache> cache;
+    std::chrono::milliseconds cache_lock_timeout {};
+    bool status_endpoint = false;
+    std::chrono::microseconds slow_request_threshold {};
+    std::chrono::milliseconds header_timeout {};
+    std::chrono::milliseconds keep_alive_timeout {};
+    std::chrono::milliseconds send_timeout {};
+    /// 0 if HTTP/2 is not served
+    std::uint32_t http2_max_streams = 0;
+    /// nullptr if serving plaintext
+    std::shared_ptr<const TlsContext> tls;
+    std::shared_ptr<ConnectionLimiter> limiter;
+    /// Precomputed, so that shedding a request costs next to nothing
+    std::string overload_response;
+};
+
+
+/// Refreshes a stale cache entry in the background, while the session that found it serves it
+/// as is. Holds on to the context, and so to the upstream; the loop it runs on outlives the pool.
+DetachedTask refreshCache(const Request a_request,
+                          [[maybe_unused]] const std::shared_ptr<const SessionContext> context,
+                          Upstream &upstream,
+                          ConnectionPool &pool,
+                          std::unique_ptr<CacheFill> fill,
+                          const std::string client_address) noexcept {
+    const auto proxied = co_await Proxy(
+        a_request, {}, nullptr, client_address, false, upstream, pool, fill.get());
+    if (not proxied.responded) {
+        std::cerr << "Failed to refresh cached /" << a_request.target << ": "
+                  << proxied.error_str << std::endl;
+    }
+}
+
+
+class Session {
 public:
-    SocketBuf(Socket sock) noexcept : m_socket(std::move(sock)) {
-        Expects(m_socket != Socket::INVALID_SOCKET);
+    Session(EventLoop &loop,
+            LoadShedder &shedder,
+            ConnectionPool &pool,
+            Socket sock,
+            const Clock::time_point accepted_at,
+            const gsl::not_null<gsl::czstring> address,
+            const int port,
+            std::shared_ptr<const SessionContext> context) noexcept;
+
+    ~Session() noexcept;
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+    [[nodiscard]] Task<> Run() noexcept;
 
-        timeval timeout {};
-        timeout.tv_sec = ServerOptions::read_timeout.count();
-        timeout.tv_usec = 0;
-        setSocketOption(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+private:
+    /// Returns false if the connection was closed, failed or stayed idle for too long.
+    [[nodiscard]] Task<bool> waitForRequest(const std::chrono::milliseconds timeout) noexcept;
+
+    [[nodiscard]] Task<Request> readRequest() noexcept;
+
+    /// Serves the rest of the connection over HTTP/2, once the client sent the preface.
+    /// Returns false on a connection error, or a failure to send.
+    [[nodiscard]] Task<bool> serveHttp2() noexcept;
+
+    /// Answers a stream of an HTTP/2 connection; proxied prefixes are only served over
+    /// HTTP/1.1, which relays the response as it arrives.
+    [[nodiscard]] Response handleStream(const Request &a_request) noexcept;
+
+    void onStreamDone(const Request &a_request,
+                      const Response &a_response,
+                      const std::size_t bytes_sent,
+                      const Clock::duration duration) noexcept;
 
-        timeout.tv_sec = ServerOptions::write_timeout.count();
-        timeout.tv_usec = 0;
-        setSocketOption(m_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    [[nodiscard]] Task<long> readInput(const Clock::time_point deadline) noexcept;
 
-        m_poll_fd.fd = m_socket;
-        m_poll_fd.events = POLLIN;
+    /// Returns false if the input is full of a head too large for any buffer.
+    [[nodiscard]] bool makeRoom() noexcept;
 
-        setg(m_in_buffer.begin(), m_in_buffer.begin(), m_in_buffer.begin());
-        setp(m_out_buffer.begin(), m_out_buffer.begin() + SIZE - 1);
+    void consumeInput(const std::size_t size) noexcept;
+
+    /// Waits for another request fetching the same response, polling the cache until the lock
+    /// timeout; BYPASS if it is still not done by then.
+    [[nodiscard]] Task<ContentCache::Lookup> lookUpCache(const Request &a_request) noexcept;
+
+    /// Sends the precomputed 503, which closes the connection.
+    [[nodiscard]] Task<long> shed() noexcept;
+
+    void onSlowRequest(const RequestTrace &trace) const noexcept;
+
+    [[nodiscard]] auto &logError() const noexcept {
+        return std::cerr << '[' << m_id << "] ";
     }
 
-    SocketBuf(const SocketBuf &) = delete;
-    SocketBuf &operator=(const SocketBuf &) = delete;
-    SocketBuf(SocketBuf &&) = default;
-    SocketBuf &operator=(SocketBuf &&) = default;
+    static std::atomic<unsigned> session_created;
+
+    AsyncSocket m_socket;
+    LoadShedder &m_shedder;
+    /// Of the loop, as are the connections it keeps
+    ConnectionPool &m_pool;
+    std::shared_ptr<const SessionContext> m_context;
+    /// Holds a request head and whatever was pipelined after it, and is leased only while
+    /// there is something in it, so that an idle connection holds no buffer
+    PooledBuffer m_input;
+    std::size_t m_input_begin = 0;
+    std::size_t m_input_end = 0;
+    /// Set once reading has failed, which leaves nothing to keep the connection alive for
+    bool m_input_closed = false;
+    unsigned m_id {};
+    /// Client fields are filled once, the rest per request
+    AccessLogEntry m_log_entry;
+};
+
+std::atomic<unsigned> Session::session_created = 0;
+
+Session::Session(EventLoop &loop,
+                 LoadShedder &shedder,
+                 ConnectionPool &pool,
+                 Socket sock,
+                 const Clock::time_point accepted_at,
+                 const gsl::not_null<gsl::czstring> address,
+                 const int port,
+                 std::shared_ptr<const SessionContext> context) noexcept :
+    m_socket(loop, std::move(sock), context->send_timeout, accepted_at),
+    m_shedder(shedder), m_pool(pool), m_context(std::move(context)), m_id(session_created++) {
+    m_log_entry.SetClient(address.get());
+    m_log_entry.port = port;
+    RecordConnectionMemory(sizeof(Session));
+}
+
+Session::~Session() noexcept {
+    RecordConnectionMemory(-static_cast<std::ptrdiff_t>(sizeof(Session)));
+}
 
-    virtual ~SocketBuf() {
-        sync();
+Task<> Session::Run() noexcept {
+    RecordConnectionOpened();
+
+    // Counted against the header timeout, as part of the first request
+    bool handshaken = true;
+    if (m_context->tls) {
+        handshaken = co_await m_socket.Handshake(*m_context->tls,
+                                                 DeadlineAfter(m_context->header_timeout));
     }
 
-protected:
-    static constexpr int SIZE = 4096;
-    static constexpr int MAX_PUTBACK = 8;
+    // The first request is due as soon as the connection is, later ones may take their time
+    auto idle_timeout = m_context->header_timeout;
+    // A request pipelined behind the previous one is ready once that one is done
+    Clock::time_point previous_done {};
+    for (bool keep_alive = handshaken; keep_alive and not g_signal;) {
+        if (not co_await waitForRequest(idle_timeout)) {
+            break;
+        }
+        // A reload applies from the next request on, the one in flight keeps its context
+        if (m_context != t_context) {
+            m_context = t_context;
+            m_socket.SetSendTimeout(m_context->send_timeout);
+        }
+        idle_timeout = m_context->keep_alive_timeout;
+
+        RequestTrace trace;
 
-    virtual int_type underflow() override {
-        if (gptr() < egptr()) {
-            return traits_type::to_int_type(*gptr());
+        trace.Begin(Span::PARSE);
+        auto a_request = co_await readRequest();
+        trace.End(Span::PARSE);
+
+        // A client that knows the server speaks h2c starts with the preface rather than a
+        // request, which switches the connection over to HTTP/2 for good
+        if (a_request.method == Method::PRI and a_request.version == "HTTP/2.0" and
+            m_context->http2_max_streams) {
+            const auto served = co_await serveHttp2();
+            if (not served) {
+                logError() << "HTTP/2 connection failed" << std::endl;
+            }
+            break;
         }
 
-        const auto num_putback = std::min(MAX_PUTBACK, static_cast<int>(gptr() - eback()));
-        std::copy(gptr() - num_putback, gptr(), m_in_buffer.begin());
+        const auto method = a_request.method;
+        const auto is_http_1_0 = a_request.version == "HTTP/1.0";
+        keep_alive = isKeepAlive(a_request) and m_context->keep_alive_timeout.count();
+        m_log_entry.time = std::chrono::system_clock::now();
+        m_log_entry.method = method;
+        m_log_entry.SetTarget(a_request.target);
+        const auto &host = m_context->hosts[m_context->router->Route(hostOf(a_request))];
+
+        trace.Begin(Span::HANDLE);
+        const auto start = trace.BeginOf(Span::HANDLE);
+        const auto sojourn = start - std::max(m_socket.ReadySince(), previous_done);
+        RecordLatency(Phase::QUEUE, sojourn);
+        const auto overload = m_shedder.ShouldShed(sojourn, start);
+        RecordOverloaded(m_shedder.Overloaded());
+        // Before anything touches the filesystem; the status endpoint stays up to tell why
+        if (overload and not(m_context->status_endpoint and IsStatusTarget(a_request.target))) {
+            const auto bytes_sent = co_await shed();
+            RecordRequest(method, 503, std::max(0L, bytes_sent), host.metrics_slot);
+
+            m_log_entry.status = 503;
+            m_log_entry.bytes_sent = std::max(0L, bytes_sent);
+            m_log_entry.duration =
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+            LogAccess(m_log_entry);
+            break;
+        }
 
-        auto *const new_gptr = m_in_buffer.begin() + num_putback;
-        const auto n = read(m_socket, new_gptr, SIZE - num_putback);
-        if (n <= 0) {
-            return traits_type::eof();
+        const auto is_status = m_context->status_endpoint and IsStatusTarget(a_request.target);
+        auto *const upstream =
+            a_request and not is_status ? FindUpstream(m_context->upstreams, a_request.target)
+                                        : nullptr;
+        Response a_response;
+        ProxyResult proxied;
+        bool proxy_failed = false;
+        if (upstream) {
+            const std::string_view input {m_input.Data() + m_input_begin,
+                                          m_input_end - m_input_begin};
+            const std::string_view client {m_log_entry.client.data(), m_log_entry.client_size};
+            ContentCache::Lookup cached {CacheStatus::BYPASS, nullptr, nullptr};
+            if (m_context->cache) {
+                cached = co_await lookUpCache(a_request);
+                RecordProxyCache(cached.status);
+            }
+            if (cached.entry) {
+                a_response = ServeEntry(*cached.entry, method, cached.status, Clock::now());
+                if (cached.fill) {
+                    refreshCache(a_request,
+                                 m_context,
+                                 *upstream,
+                                 m_pool,
+                                 std::move(cached.fill),
+                                 std::string {client});
+                }
+            } else {
+                proxied = co_await Proxy(a_request,
+                                         input,
+                                         &m_socket,
+                                         client,
+                                         keep_alive and not m_input_closed and not g_signal,
+                                         *upstream,
+                                         m_pool,
+                                         cached.fill.get(),
+                                         &trace);
+                consumeInput(proxied.input_consumed);
+                if (not proxied.responded) {
+                    a_response.status = proxied.status;
+                    a_response.error_str = std::move(proxied.error_str);
+                    proxy_failed = true;
+                }
+            }
+        } else if (is_status) {
+            a_response = HandleStatus(a_request);
+        } else {
+            a_response =
+                Handle(std::move(a_request), host.root_dir, host.header_cache.get(), &trace);
         }
 
-        setg(m_in_buffer.begin(), new_gptr, new_gptr + n);
+        long bytes_sent = 0;
+        if (proxied.responded) {
+            // Relayed as it arrived, in the WRITE span from the response head on
+            a_response.status = proxied.status;
+            keep_alive = proxied.keep_alive;
+            bytes_sent = proxied.bytes_sent;
+        } else {
+            trace.End(Span::HANDLE);
+
+            if (not a_response) {
+                logError() << a_response.error_str << std::endl;
+            }
 
-        return traits_type::to_int_type(*gptr());
-    }
+            // Draining, the connection is closed once this response is sent; so it is after a
+            // failed proxy, which may have left some of the request body unread
+            keep_alive = keep_alive and hasDelimitedBody(a_response) and not m_input_closed and
+                         not g_signal and not proxy_failed;
+            if (not keep_alive) {
+                a_response.headers["Connection"] = "close";
+            } else if (is_http_1_0) {
+                a_response.headers["Connection"] = "keep-alive";
+            }
+            // With the Content-Length of GET all the same, but not its body, which the next
+            // response on the connection would otherwise be taken to start with
+            if (method == Method::HEAD) {
+                a_response.body = std::monostate {};
+            }
 
-    auto flushBuffer() noexcept {
-        if (pptr() == pbase()) {
-            return true;
+            trace.Begin(Span::WRITE);
+            bytes_sent = co_await sendResponse(m_socket, a_response);
+        }
+        trace.End(Span::WRITE);
+        if (bytes_sent == -1) {
+            logError() << "Failed to send response: " << strerror(errno) << std::endl;
+            keep_alive = false;
         }
 
-        const auto requested = pptr() - pbase();
-        const auto result = sendAll(m_socket, pbase(), requested);
-        pbump(-requested);
+        RecordLatency(Phase::PARSE, trace.Duration(Span::PARSE));
+        RecordLatency(Phase::HANDLE, trace.Duration(Span::HANDLE));
+        RecordLatency(Phase::WRITE, trace.Duration(Span::WRITE));
+        RecordRequest(method, a_response.status, std::max(0L, bytes_sent), host.metrics_slot);
+        previous_done = trace.EndOf(Span::WRITE);
 
-        return result;
-    }
+        m_log_entry.status = a_response.status;
+        m_log_entry.bytes_sent = std::max(0L, bytes_sent);
+        m_log_entry.duration = std::chrono::duration_cast<std::chrono::microseconds>(trace.Total());
+        LogAccess(m_log_entry);
 
-    virtual int_type overflow(int_type c) override {
-        if (not traits_type::eq_int_type(c, traits_type::eof())) {
-            *pptr() = c;
-            pbump(1);
+        if (m_context->slow_request_threshold.count() and
+            trace.Total() >= m_context->slow_request_threshold) {
+            onSlowRequest(trace);
         }
+    }
 
-        return flushBuffer() ? traits_type::not_eof(c) : traits_type::eof();
+    RecordConnectionClosed();
+}
+
+Task<bool> Session::waitForRequest(const std::chrono::milliseconds timeout) noexcept {
+    if (m_input_begin < m_input_end) {
+        co_return true;
     }
 
-    virtual int sync() override {
-        return flushBuffer() ? 0 : -1;
+    const auto deadline = DeadlineAfter(timeout);
+    // Waits before leasing the buffer, so that an idle connection holds none
+    if (not co_await m_socket.WaitReadable(deadline) or not makeRoom()) {
+        co_return false;
     }
+    co_return co_await readInput(deadline) > 0;
+}
 
-private:
-    std::array<char_type, SIZE> m_in_buffer;
-    std::array<char_type, SIZE> m_out_buffer;
-    pollfd m_poll_fd {};
-    Socket m_socket;
-};
+Task<Request> Session::readRequest() noexcept {
+    // For the whole head, so that a peer trickling it byte by byte cannot hold on forever
+    const auto deadline = DeadlineAfter(m_context->header_timeout);
+    for (std::size_t scanned = 0;;) {
+        const std::string_view input {m_input.Data() + m_input_begin,
+                                      m_input_end - m_input_begin};
+        if (const auto head_size = FindHeadEnd(input, scanned); head_size) {
+            auto a_request = ParseOne(input.substr(0, head_size));
+            consumeInput(head_size);
+            co_return a_request;
+        }
+        scanned = input.size();
 
+        if (not makeRoom()) {
+            m_input_closed = true;
+            consumeInput(input.size());
 
-class SocketStream : public std::iostream {
-public:
-    explicit SocketStream(Socket sock) noexcept : std::iostream(nullptr), m_buf(std::move(sock)) {
-        rdbuf(&m_buf);
-    }
+            Request a_request;
+            a_request.status = 431;
+            a_request.error_str = "Request head exceeds maximum size of " +
+                                  std::to_string(CapacityOf(BufferSize::LARGE));
+            co_return a_request;
+        }
 
-    SocketStream(SocketStream &&rhs) noexcept :
-        std::iostream(std::move(rhs)), m_buf(std::move(rhs.m_buf)) {
-        rdbuf(&m_buf);
-    }
+        if (co_await readInput(deadline) <= 0) {
+            m_input_closed = true;
+            if (errno == ETIMEDOUT) {
+                consumeInput(m_input_end - m_input_begin);
 
-    auto &operator=(SocketStream &&rhs) noexcept {
-        if (this != &rhs) {
-            std::iostream::operator=(std::move(rhs));
-            m_buf = std::move(rhs.m_buf);
+                Request a_request;
+                a_request.status = 408;
+                a_request.error_str = "Timed out reading the request head";
+                co_return a_request;
+            }
+
+            // Parses whatever arrived, like a stream would at its end
+            const std::string_view partial {m_input.Data() + m_input_begin,
+                                            m_input_end - m_input_begin};
+            auto a_request = ParseOne(partial);
+            consumeInput(partial.size());
+            co_return a_request;
         }
-        return *this;
     }
+}
 
-private:
-    SocketBuf m_buf;
-};
-
+Task<bool> Session::serveHttp2() noexcept {
+    Http2Options options;
+    options.max_concurrent_streams = m_context->http2_max_streams;
+    options.idle_timeout = m_context->keep_alive_timeout;
+    options.read_timeout = m_context->header_timeout;
+    Http2Callbacks callbacks {
+        [this](const Request &a_request) {
+            return handleStream(a_request);
+        },
+        [this](const Request &a_request,
+               const Response &a_response,
+               const std::size_t bytes_sent,
+               const Clock::duration duration) {
+            onStreamDone(a_request, a_response, bytes_sent, duration);
+        },
+        []() {
+            return g_signal != 0;
+        },
+    };
+
+    const std::string_view pending {m_input.Data() + m_input_begin, m_input_end - m_input_begin};
+    Http2Connection connection {m_socket, options, std::move(callbacks)};
+    const auto served = co_await connection.Serve(pending);
+    consumeInput(pending.size());
+    co_return served;
+}
 
-class Session {
-public:
-    Session(Socket sock,
-            const gsl::not_null<gsl::czstring> address,
-            const int port,
-            std::filesystem::path root_dir) noexcept;
+Response Session::handleStream(const Request &a_request) noexcept {
+    // A reload applies from the next stream on, those open keep what they were answered with
+    if (m_context != t_context) {
+        m_context = t_context;
+        m_socket.SetSendTimeout(m_context->send_timeout);
+    }
 
-    void Run() noexcept;
+    if (m_context->status_endpoint and IsStatusTarget(a_request.target)) {
+        return HandleStatus(a_request);
+    }
+    if (a_request and FindUpstream(m_context->upstreams, a_request.target)) {
+        Response a_response;
+        a_response.status = 501;
+        a_response.error_str = "Proxying /" + a_request.target + " is not supported over HTTP/2";
+        return a_response;
+    }
+    const auto &host = m_context->hosts[m_context->router->Route(hostOf(a_request))];
+    return Handle(a_request, host.root_dir, host.header_cache.get());
+}
 
-private:
-    [[nodiscard]] auto &log(std::ostream &out = std::cout) const noexcept {
-        return out << '[' << m_id << "] ";
+void Session::onStreamDone(const Request &a_request,
+                           const Response &a_response,
+                           const std::size_t bytes_sent,
+                           const Clock::duration duration) noexcept {
+    if (not a_response) {
+        logError() << a_response.error_str << std::endl;
     }
+    const auto &host = m_context->hosts[m_context->router->Route(hostOf(a_request))];
+    RecordRequest(a_request.method, a_response.status, bytes_sent, host.metrics_slot);
+
+    m_log_entry.duration = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+    m_log_entry.time = std::chrono::system_clock::now() -
+                       std::chrono::duration_cast<std::chrono::system_clock::duration>(duration);
+    m_log_entry.method = a_request.method;
+    m_log_entry.SetTarget(a_request.target);
+    m_log_entry.status = a_response.status;
+    m_log_entry.bytes_sent = bytes_sent;
+    LogAccess(m_log_entry);
+}
 
-    static unsigned session_created;
+Task<long> Session::shed() noexcept {
+    RecordRequestShed();
+    const auto &response = m_context->overload_response;
+    co_return co_await m_socket.Write(response, {}) ? static_cast<long>(response.size()) : -1;
+}
 
-    SocketStream m_stream;
-    std::filesystem::path m_root_dir;
-    unsigned m_id {};
-};
+Task<long> Session::readInput(const Clock::time_point deadline) noexcept {
+    const auto n = co_await m_socket.Read(
+        {m_input.Data() + m_input_end, m_input.Capacity() - m_input_end}, deadline);
+    if (n > 0) {
+        m_input_end += n;
+    }
+    co_return n;
+}
 
-unsigned Session::session_created = 0;
+bool Session::makeRoom() noexcept {
+    if (m_input.Empty()) {
+        m_input.Lease(BufferSize::SMALL);
+        return true;
+    }
+    if (m_input_end < m_input.Capacity()) {
+        return true;
+    }
 
-Session::Session(Socket sock,
-                 const gsl::not_null<gsl::czstring> address,
-                 const int port,
-                 std::filesystem::path root_dir) noexcept :
-    m_stream(std::move(sock)),
-    m_root_dir(std::move(root_dir)), m_id(session_created++) {
-    log() << "Accepted new connection from: " << address << "; Port: " << port
-          << "; Session: " << m_id << std::endl;
+    const auto size = m_input_end - m_input_begin;
+    if (m_input_begin > 0) {
+        std::memmove(m_input.Data(), m_input.Data() + m_input_begin, size);
+    } else if (m_input.Size() != BufferSize::LARGE) {
+        PooledBuffer larger;
+        larger.Lease(static_cast<BufferSize>(static_cast<std::size_t>(m_input.Size()) + 1));
+        std::memcpy(larger.Data(), m_input.Data(), size);
+        m_input = std::move(larger);
+    } else {
+        return false;
+    }
+    m_input_begin = 0;
+    m_input_end = size;
+    return true;
 }
 
-void Session::Run() noexcept {
-    while (not g_signal) {
-        const auto a_response = Handle(ParseOne(m_stream), m_root_dir);
+void Session::consumeInput(const std::size_t size) noexcept {
+    m_input_begin += size;
+    if (m_input_begin == m_input_end) {
+        m_input.Release();
+        m_input_begin = 0;
+        m_input_end = 0;
+    }
+}
 
-        if (not a_response) {
-            log() << a_response.error_str << std::endl;
+Task<ContentCache::Lookup> Session::lookUpCache(const Request &a_request) noexcept {
+    auto &cache = *m_context->cache;
+    const auto key = cache.Key(a_request);
+    if (key.empty()) {
+        co_return ContentCache::Lookup {CacheStatus::BYPASS, nullptr, nullptr};
+    }
+
+    const auto deadline = DeadlineAfter(m_context->cache_lock_timeout);
+    for (;;) {
+        auto lookup = cache.Find(key, Clock::now());
+        if (lookup.entry or lookup.fill) {
+            co_return std::move(lookup);
         }
-        m_stream << a_response << std::flush;
-        break;
+        const auto now = Clock::now();
+        if (now >= deadline) {
+            co_return ContentCache::Lookup {CacheStatus::BYPASS, nullptr, nullptr};
+        }
+        co_await m_pool.Loop().Sleep(std::min(deadline, now + CACHE_LOCK_POLL_INTERVAL));
     }
+}
+
+void Session::onSlowRequest(const RequestTrace &trace) const noexcept {
+    SlowRequest slow;
+    slow.trace = trace;
+    slow.target.assign(m_log_entry.target.data(), m_log_entry.target_size);
+    slow.method = m_log_entry.method;
+    slow.status = m_log_entry.status;
+    slow.session = m_id;
+
+    std::cerr << ToString(slow) << std::endl;
+    RecordSlowRequest(std::move(slow));
+}
 
-    log() << "Connection closed." << std::endl;
+/// The session lives in the frame of this coroutine, which like every frame it awaits comes
+/// from the frame allocator of the loop thread. Run on the loop thread, it starts with the
+/// context of the loop.
+DetachedTask runSession(EventLoop &loop,
+                        LoadShedder &shedder,
+                        ConnectionPool &pool,
+                        Socket sock,
+                        const Clock::time_point accepted_at,
+                        const std::string address,
+                        const int port) noexcept {
+    const auto context = t_context;
+    {
+        Session session {
+            loop, shedder, pool, std::move(sock), accepted_at, address.c_str(), port, context};
+        co_await session.Run();
+    }
+    // Once the socket is closed, so that its descriptor is free for the next connection
+    context->limiter->Release();
 }
 
 
@@ -353,22 +1122,243 @@ void AddServerOptions(cxxopts::Options &options) noexcept {
     options.add_options("Server")
     ("p,port", "port on which the server is to listen for connections from client applications.",
      cxxopts::value<int>()->default_value("19840"), "PORT")
+    ("listen", "also listen on a Unix domain socket, at PATH or as @NAME in the abstract namespace",
+     cxxopts::value<std::vector<std::string>>(), "unix:PATH")
+    ("listen-mode", "permissions of the Unix domain socket files, in octal, e.g. 0660",
+     cxxopts::value<std::string>(), "MODE")
     ("m,mount", "base directory that the server will mount on",
      cxxopts::value<std::string>()->default_value("./"), "DIR")
+    ("status", "serve metrics at /__nginxpp/status, in JSON or with ?format=prometheus")
+    ("access-log", "file to append the access log to, '-' for stdout or 'off'; reopened on SIGUSR1",
+     cxxopts::value<std::string>()->default_value(ACCESS_LOG_STDOUT), "PATH")
+    ("slow-request", "trace the phases of requests slower than this, 0 to disable",
+     cxxopts::value<unsigned>()->default_value("0"), "MS")
+    ("trace-file", "write the slow request traces as Chrome trace-event JSON on shutdown",
+     cxxopts::value<std::string>(), "PATH")
+    ("threads", "number of event loop threads serving the connections, 0 for one per CPU",
+     cxxopts::value<unsigned>()->default_value("0"), "N")
+    ("header-timeout", "time allowed to receive a request head, answered with 408 once exceeded",
+     cxxopts::value<unsigned>()->default_value("5000"), "MS")
+    ("keep-alive-timeout", "time an idle connection is kept open, 0 to disable keep-alive",
+     cxxopts::value<unsigned>()->default_value("15000"), "MS")
+    ("send-timeout", "time sending a response may stall before the connection is dropped",
+     cxxopts::value<unsigned>()->default_value("5000"), "MS")
+    ("http2-max-streams", "streams an HTTP/2 connection may have open at once, 0 to disable it",
+     cxxopts::value<std::uint32_t>()->default_value("256"), "N")
+    ("tls-cert", "terminate TLS with this PEM certificate, followed by its chain",
+     cxxopts::value<std::string>(), "PATH")
+    ("tls-key", "PEM private key of the TLS certificate", cxxopts::value<std::string>(), "PATH")
+    ("tls-ticket-key", "file of 80 random bytes protecting session tickets, to share between hosts",
+     cxxopts::value<std::string>(), "PATH")
+    ("no-ktls", "encrypt in userspace rather than hand TLS records over to the kernel")
+    ("backlog", "length of the queue of connections waiting to be accepted",
+     cxxopts::value<int>()->default_value("511"), "N")
+    ("tcp-nodelay", "send small responses without waiting to coalesce them")
+    ("defer-accept", "accept connections only once they sent data or after this long, 0 to disable",
+     cxxopts::value<unsigned>()->default_value("0"), "S")
+    ("fastopen", "queue length of pending TCP Fast Open requests, 0 to disable",
+     cxxopts::value<int>()->default_value("0"), "N")
+    ("rcvbuf", "socket receive buffer size, 0 for the kernel default",
+     cxxopts::value<int>()->default_value("0"), "BYTES")
+    ("sndbuf", "socket send buffer size, 0 for the kernel default",
+     cxxopts::value<int>()->default_value("0"), "BYTES")
+    ("notsent-lowat", "unsent bytes queued per socket before it stops being writable, 0 for default",
+     cxxopts::value<int>()->default_value("0"), "BYTES")
+    ("max-connections", "open connections at which accepting pauses, 0 to derive from RLIMIT_NOFILE",
+     cxxopts::value<std::size_t>()->default_value("0"), "N")
+    ("shed-target", "queueing delay above which an event loop sheds requests with 503, 0 to disable",
+     cxxopts::value<unsigned>()->default_value("5"), "MS")
+    ("shed-interval", "window over which the queueing delay must stay above the target to shed",
+     cxxopts::value<unsigned>()->default_value("100"), "MS")
+    ("retry-after", "seconds after which shed requests are told to retry",
+     cxxopts::value<unsigned>()->default_value("1"), "S")
+    ("workers", "worker processes to serve from, respawned if they die, 0 for a single process",
+     cxxopts::value<unsigned>()->default_value("0"), "N")
+    ("worker-affinity", "pin each worker process to a CPU of its own")
+    ("loop-affinity", "pin each event loop thread to a CPU, with its memory on the CPU's NUMA node")
+    ("incoming-cpu", "hand connections to the loop pinned to the CPU that received them")
+    ("drain-timeout", "time to let open connections finish on shutdown before they are aborted",
+     cxxopts::value<unsigned>()->default_value("10000"), "MS")
+    ("header-cache-entries", "response heads of files to cache per NUMA node, for each host",
+     cxxopts::value<std::size_t>()->default_value("4096"), "N")
+    ("vhost", "serve requests for NAME, or '*.NAME' for its subdomains, from DIR; may be repeated",
+     cxxopts::value<std::vector<std::string>>(), "NAME[:ENTRIES]=DIR")
+    ("proxy", "proxy requests under /PREFIX to HOST:PORT; repeat a prefix to balance its backends",
+     cxxopts::value<std::vector<std::string>>(), "/PREFIX=HOST:PORT")
+    ("proxy-balance", "how a prefix spreads requests over its backends: round-robin or least-conn",
+     cxxopts::value<std::string>()->default_value("round-robin"), "NAME")
+    ("proxy-connect-timeout", "time allowed to connect to a backend, answered with 504 if exceeded",
+     cxxopts::value<unsigned>()->default_value("1000"), "MS")
+    ("proxy-read-timeout", "time a backend may stall sending its response before it is given up on",
+     cxxopts::value<unsigned>()->default_value("60000"), "MS")
+    ("proxy-keepalive", "idle connections kept per backend by each event loop, 0 to disable",
+     cxxopts::value<std::size_t>()->default_value("32"), "N")
+    ("proxy-cache", "cache proxied responses in files under DIR; per worker, emptied when it exits",
+     cxxopts::value<std::string>(), "DIR")
+    ("proxy-cache-size", "MiB of response bodies to cache, the least recently used evicted first",
+     cxxopts::value<std::size_t>()->default_value("256"), "MIB")
+    ("proxy-cache-valid", "time responses stay fresh if Cache-Control and Expires do not tell",
+     cxxopts::value<unsigned>()->default_value("0"), "MS")
+    ("proxy-cache-stale", "time stale responses are served while refreshed, if they do not tell",
+     cxxopts::value<unsigned>()->default_value("60000"), "MS")
+    ("proxy-cache-vary", "request header whose value the cache keys on too; may be repeated",
+     cxxopts::value<std::vector<std::string>>(), "NAME")
+    ("proxy-cache-lock-timeout", "time a miss waits for another request fetching the same response",
+     cxxopts::value<unsigned>()->default_value("5000"), "MS")
+    ("config", "file of options as 'name = value' lines, which the command line overrides; "
+               "reread on SIGHUP", cxxopts::value<std::string>(), "PATH")
     ;
     // clang-format on
 }
 
-ServerOptions HandleServerOptions(const cxxopts::ParseResult &parsed_options) noexcept {
+ServerOptions HandleServerOptions(const cxxopts::ParseResult &parsed_options) {
     ServerOptions options;
 
     options.base_mount_dir = parsed_options["mount"].as<std::string>();
 
     options.port = parsed_options["port"].as<int>();
+    if (parsed_options.count("listen")) {
+        for (const auto &spec : parsed_options["listen"].as<std::vector<std::string>>()) {
+            options.unix_sockets.push_back(parseUnixSocket(spec));
+        }
+    }
+    if (parsed_options.count("listen-mode")) {
+        options.unix_mode = parseMode(parsed_options["listen-mode"].as<std::string>());
+    }
+
+    options.status_endpoint = parsed_options.count("status");
+
+    options.access_log = parsed_options["access-log"].as<std::string>();
+
+    options.slow_request_threshold =
+        std::chrono::milliseconds {parsed_options["slow-request"].as<unsigned>()};
+    if (parsed_options.count("trace-file")) {
+        options.trace_file = parsed_options["trace-file"].as<std::string>();
+    }
+
+    options.threads = parsed_options["threads"].as<unsigned>();
+
+    options.header_timeout =
+        std::chrono::milliseconds {parsed_options["header-timeout"].as<unsigned>()};
+    options.keep_alive_timeout =
+        std::chrono::milliseconds {parsed_options["keep-alive-timeout"].as<unsigned>()};
+    options.send_timeout =
+        std::chrono::milliseconds {parsed_options["send-timeout"].as<unsigned>()};
+    options.http2_max_streams = parsed_options["http2-max-streams"].as<std::uint32_t>();
+
+    if (parsed_options.count("tls-cert")) {
+        options.tls_certificate = parsed_options["tls-cert"].as<std::string>();
+    }
+    if (parsed_options.count("tls-key")) {
+        options.tls_key = parsed_options["tls-key"].as<std::string>();
+    }
+    if (options.tls_certificate.empty() != options.tls_key.empty()) {
+        throw ConfigException {"--tls-cert and --tls-key must be given together"};
+    }
+    if (parsed_options.count("tls-ticket-key")) {
+        options.tls_ticket_key = readTicketKey(parsed_options["tls-ticket-key"].as<std::string>());
+    }
+    options.ktls = not parsed_options.count("no-ktls");
+
+    options.listen_backlog = parsed_options["backlog"].as<int>();
+    options.tcp_nodelay = parsed_options.count("tcp-nodelay");
+    options.defer_accept = std::chrono::seconds {parsed_options["defer-accept"].as<unsigned>()};
+    options.fastopen_queue = parsed_options["fastopen"].as<int>();
+    options.receive_buffer = parsed_options["rcvbuf"].as<int>();
+    options.send_buffer = parsed_options["sndbuf"].as<int>();
+    options.notsent_lowat = parsed_options["notsent-lowat"].as<int>();
+    options.max_connections = parsed_options["max-connections"].as<std::size_t>();
+
+    options.shed_target = std::chrono::milliseconds {parsed_options["shed-target"].as<unsigned>()};
+    options.shed_interval =
+        std::chrono::milliseconds {parsed_options["shed-interval"].as<unsigned>()};
+    options.retry_after = std::chrono::seconds {parsed_options["retry-after"].as<unsigned>()};
+
+    options.workers = parsed_options["workers"].as<unsigned>();
+    options.worker_affinity = parsed_options.count("worker-affinity");
+    options.incoming_cpu = parsed_options.count("incoming-cpu");
+    options.loop_affinity = options.incoming_cpu or parsed_options.count("loop-affinity");
+
+    options.drain_timeout =
+        std::chrono::milliseconds {parsed_options["drain-timeout"].as<unsigned>()};
+
+    options.header_cache_entries = parsed_options["header-cache-entries"].as<std::size_t>();
+
+    if (parsed_options.count("vhost")) {
+        for (const auto &spec : parsed_options["vhost"].as<std::vector<std::string>>()) {
+            options.virtual_hosts.push_back(
+                ParseVirtualHost(spec, options.header_cache_entries));
+        }
+        // Throws on a name given twice, which only the router tells
+        static_cast<void>(HostRouter {options.virtual_hosts});
+    }
+
+    if (parsed_options.count("proxy")) {
+        for (const auto &spec : parsed_options["proxy"].as<std::vector<std::string>>()) {
+            options.proxies.push_back(ParseProxy(spec));
+        }
+    }
+    options.proxy_balance = ParseBalance(parsed_options["proxy-balance"].as<std::string>());
+    options.proxy_connect_timeout =
+        std::chrono::milliseconds {parsed_options["proxy-connect-timeout"].as<unsigned>()};
+    options.proxy_read_timeout =
+        std::chrono::milliseconds {parsed_options["proxy-read-timeout"].as<unsigned>()};
+    options.proxy_keepalive = parsed_options["proxy-keepalive"].as<std::size_t>();
+    if (parsed_options.count("proxy-cache")) {
+        options.proxy_cache_dir = parsed_options["proxy-cache"].as<std::string>();
+    }
+    options.proxy_cache_size = parsed_options["proxy-cache-size"].as<std::size_t>() << 20;
+    options.proxy_cache_valid =
+        std::chrono::milliseconds {parsed_options["proxy-cache-valid"].as<unsigned>()};
+    options.proxy_cache_stale =
+        std::chrono::milliseconds {parsed_options["proxy-cache-stale"].as<unsigned>()};
+    if (parsed_options.count("proxy-cache-vary")) {
+        for (const auto &name : parsed_options["proxy-cache-vary"].as<std::vector<std::string>>()) {
+            options.proxy_cache_vary.push_back(ToLower(name));
+        }
+    }
+    options.proxy_cache_lock_timeout =
+        std::chrono::milliseconds {parsed_options["proxy-cache-lock-timeout"].as<unsigned>()};
 
     return options;
 }
 
+ServerOptions LoadServerOptions(const std::vector<std::string> &command_line) {
+    Expects(not command_line.empty());
+
+    auto options = CreateBaseOptions();
+    AddServerOptions(options);
+    const auto parse = [&options](const std::vector<std::string> &arguments) {
+        std::vector<const char *> argv;
+        for (const auto &argument : arguments) {
+            argv.push_back(argument.c_str());
+        }
+        try {
+            return options.parse(static_cast<int>(argv.size()), argv.data());
+        } catch (const cxxopts::exceptions::exception &e) {
+            throw ConfigException {e.what()};
+        }
+    };
+
+    const auto parsed = parse(command_line);
+    if (not parsed.count("config")) {
+        auto server_options = HandleServerOptions(parsed);
+        server_options.command_line = command_line;
+        return server_options;
+    }
+
+    // The last value of an option given twice wins, so the command line goes after the file
+    const auto config_file = parsed["config"].as<std::string>();
+    auto arguments = ReadConfigFile(config_file);
+    arguments.insert(arguments.begin(), command_line.front());
+    arguments.insert(arguments.end(), command_line.begin() + 1, command_line.end());
+
+    auto server_options = HandleServerOptions(parse(arguments));
+    server_options.config_file = config_file;
+    server_options.command_line = command_line;
+    return server_options;
+}
+
 
 Socket::~Socket() noexcept {
     if (m_socket_fd != INVALID_SOCKET) {
@@ -378,24 +1368,197 @@ Socket::~Socket() noexcept {
 
 
 HttpServer::HttpServer(const ServerOptions &options) :
-    m_root_dir(options.base_mount_dir), m_socket(internal::createServerSocket(options)),
-    m_port(options.port) {
-    Expects(m_socket != Socket::INVALID_SOCKET);
+    HttpServer(options, internal::openServerSockets(options)) {
+}
 
-    if (not std::filesystem::exists(m_root_dir)) {
-        throw ServerException {"Base mount directory doesn't exist: '" + options.base_mount_dir +
-                               '\''};
+HttpServer::HttpServer(const ServerOptions &options, Socket listener) :
+    HttpServer(options, onlyListener(std::move(listener))) {
+}
+
+HttpServer::HttpServer(const ServerOptions &options, std::vector<Socket> listeners) :
+    m_listeners(std::move(listeners)), m_port(options.port), m_access_log(options.access_log),
+    m_trace_file(options.trace_file), m_quiet(options.quiet),
+    m_listen_backlog(options.listen_backlog), m_notsent_lowat(options.notsent_lowat),
+    m_limiter(std::make_shared<ConnectionLimiter>(options.max_connections)),
+    m_shed_target(options.shed_target), m_shed_interval(options.shed_interval),
+    m_incoming_cpu(options.incoming_cpu), m_config_file(options.config_file),
+    m_command_line(options.command_line) {
+    Expects(not m_listeners.empty());
+    Expects(std::none_of(m_listeners.begin(), m_listeners.end(), [](const Socket &listener) {
+        return listener == Socket::INVALID_SOCKET;
+    }));
+
+    const auto threads =
+        options.threads ? options.threads : std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) {
+        m_loops.push_back(std::make_unique<EventLoop>());
+        m_shedders.push_back(std::make_unique<LoadShedder>(m_shed_target, m_shed_interval));
+        m_pools.push_back(
+            std::make_unique<ConnectionPool>(*m_loops.back(), options.proxy_keepalive));
     }
-    m_root_dir = canonical(m_root_dir);
 
-    if (m_port == 0) {
-        m_port = internal::getPort(m_socket);
+    if (not options.proxy_cache_dir.empty()) {
+        m_cache = std::make_shared<ContentCache>(options.proxy_cache_dir,
+                                                 options.proxy_cache_size,
+                                                 options.proxy_cache_vary,
+                                                 options.proxy_cache_valid,
+                                                 options.proxy_cache_stale);
     }
 
+    m_loop_nodes.resize(m_loops.size());
+    if (const auto cpus = AllowedCpus(); options.loop_affinity and not cpus.empty()) {
+        // Spread over the CPUs in turn, sharing them only with more loops than CPUs
+        for (std::size_t i = 0; i < m_loops.size(); ++i) {
+            const auto cpu = cpus[i % cpus.size()];
+            m_loop_cpus.push_back(cpu);
+            m_loop_nodes[i] = NodeOfCpu(cpu);
+            if (m_loops_of_cpu.size() <= cpu) {
+                m_loops_of_cpu.resize(cpu + 1);
+            }
+            m_loops_of_cpu[cpu].push_back(i);
+        }
+    }
+
+    configure(options);
+
+    if (not OpenAccessLog(m_access_log)) {
+        throw ServerException {"Failed to open access log: '" + m_access_log + "': " +
+                               strerror(errno)};
+    }
+
+    // Picked by the kernel for port 0, or by whoever created an inherited socket
+    m_port = internal::getPort(m_listeners.front());
+
     Ensures(m_port != 0);
 }
 
+HttpServer::~HttpServer() noexcept = default;
+
+void HttpServer::configure(const ServerOptions &options) {
+    // Before changing anything, which a reload keeps as it was on failure
+    std::error_code error;
+    auto root_dir = std::filesystem::canonical(options.base_mount_dir, error);
+    if (error) {
+        throw ServerException {"Base mount directory doesn't exist: '" + options.base_mount_dir +
+                               "': " + error.message()};
+    }
+    auto virtual_hosts = options.virtual_hosts;
+    for (auto &host : virtual_hosts) {
+        auto mount_dir = std::filesystem::canonical(host.mount_dir, error);
+        if (error) {
+            throw ServerException {"Mount directory of virtual host '" + host.server_name +
+                                   "' doesn't exist: '" + host.mount_dir +
+                                   "': " + error.message()};
+        }
+        host.mount_dir = mount_dir.native();
+    }
+    auto router = std::make_shared<const HostRouter>(virtual_hosts);
+    auto upstreams = BuildUpstreams(options.proxies,
+                                    options.proxy_balance,
+                                    options.proxy_connect_timeout,
+                                    options.proxy_read_timeout);
+    // Loaded anew on reload, to pick up a renewed certificate, with the same ticket key unless
+    // given another, so that sessions resume across it
+    auto ticket_key = options.tls_ticket_key.empty() ? m_tls_ticket_key : options.tls_ticket_key;
+    std::shared_ptr<const TlsContext> tls;
+    if (not options.tls_certificate.empty()) {
+        if (ticket_key.empty()) {
+            ticket_key = GenerateTicketKey();
+        }
+        tls = std::make_shared<const TlsContext>(TlsOptions {options.tls_certificate,
+                                                             options.tls_key,
+                                                             ticket_key,
+                                                             options.http2_max_streams > 0,
+                                                             options.ktls});
+    }
+    m_root_dir = std::move(root_dir);
+    m_virtual_hosts = std::move(virtual_hosts);
+    m_upstreams = std::move(upstreams);
+    m_cache_lock_timeout = options.proxy_cache_lock_timeout;
+
+    m_status_endpoint = options.status_endpoint;
+    m_slow_request_threshold = options.slow_request_threshold;
+    m_header_timeout = options.header_timeout;
+    m_keep_alive_timeout = options.keep_alive_timeout;
+    m_send_timeout = options.send_timeout;
+    m_http2_max_streams = options.http2_max_streams;
+    m_tls_ticket_key = std::move(ticket_key);
+    m_tls = std::move(tls);
+    m_drain_timeout = options.drain_timeout;
+    m_header_cache_entries = options.header_cache_entries;
+    m_retry_after = options.retry_after;
+    m_limiter->SetLimit(options.max_connections);
+
+    // Rebuilt rather than changed in place, as sessions may still be reading the current ones
+    const auto nodes = *std::max_element(m_loop_nodes.begin(), m_loop_nodes.end()) + 1;
+    const auto overload_response = buildOverloadResponse(m_retry_after);
+    const auto buildHost = [](std::filesystem::path root_dir,
+                              const std::size_t header_cache_entries,
+                              const std::size_t metrics_slot) {
+        // Entries are allocated by the loops filling the cache, so on their node
+        auto header_cache = header_cache_entries ? std::make_shared<FileHeaderCache>(
+                                                       header_cache_entries, metrics_slot)
+                                                 : nullptr;
+        return HostContext {std::move(root_dir), std::move(header_cache), metrics_slot};
+    };
+    m_contexts.clear();
+    for (unsigned node = 0; node < nodes; ++node) {
+        std::vector<HostContext> hosts;
+        hosts.push_back(buildHost(m_root_dir, m_header_cache_entries, DEFAULT_HOST_SLOT));
+        for (const auto &host : m_virtual_hosts) {
+            hosts.push_back(buildHost(
+                host.mount_dir, host.header_cache_entries, HostSlot(host.server_name)));
+        }
+        // Upstreams are shared by all nodes, so that each balances over all the loops
+        SessionContext context {router,
+                                std::move(hosts),
+                                m_upstreams,
+                                m_cache,
+                                m_cache_lock_timeout,
+                                m_status_endpoint,
+                                m_slow_request_threshold,
+                                m_header_timeout,
+                                m_keep_alive_timeout,
+                                m_send_timeout,
+                                m_http2_max_streams,
+                                m_tls,
+                                m_limiter,
+                                overload_response};
+        m_contexts.push_back(std::make_shared<const SessionContext>(std::move(context)));
+    }
+}
+
+void HttpServer::publish() const noexcept {
+    for (std::size_t i = 0; i < m_loops.size(); ++i) {
+        // Sessions started after it on the loop start with it, older ones switch over between
+        // requests, and the previous context is freed by whichever lets go of it last
+        m_loops[i]->Post([context = m_contexts[m_loop_nodes[i]]]() {
+            t_context = context;
+        });
+    }
+}
+
+void HttpServer::reload() noexcept {
+    if (m_config_file.empty()) {
+        std::cerr << "Ignoring reload: no config file" << std::endl;
+        return;
+    }
+
+    try {
+        configure(LoadServerOptions(m_command_line));
+    } catch (const Exception &e) {
+        std::cerr << "Failed to reload, keeping the current config: " << e.what() << std::endl;
+        return;
+    }
+    publish();
+    std::cout << "Reloaded " << m_config_file << ", serving " << m_root_dir << std::endl;
+}
+
 void HttpServer::greet() const noexcept {
+    if (m_quiet) {
+        return;
+    }
+
     std::cout << R"(
  _ __   __ _(_)
 | '_ \ / _` | | '_ \\ \/ / '_ \| '_ \
@@ -404,64 +1567,293 @@ void HttpServer::greet() const noexcept {
        |___/             |_|   |_|      starting up.
 )"
               << "Listening on port: " << m_port << '\n'
-              << "Base mount directory: " << m_root_dir << std::endl;
+              << "Unix domain sockets: " << m_listeners.size() - 1 << '\n';
+    try {
+        for (auto iter = std::next(m_listeners.begin()); iter != m_listeners.end(); ++iter) {
+            std::cout << "  " << internal::getUnixAddress(*iter) << '\n';
+        }
+    } catch (const SocketException &e) {
+        std::cout << e.what() << '\n';
+    }
+    std::cout << "Config file: " << (m_config_file.empty() ? "none" : m_config_file) << '\n'
+              << "Base mount directory: " << m_root_dir << '\n'
+              << "Virtual hosts: " << m_virtual_hosts.size() << '\n';
+    for (const auto &host : m_virtual_hosts) {
+        std::cout << "  " << host.server_name << ": " << host.mount_dir << ", "
+                  << host.header_cache_entries << " cached heads\n";
+    }
+    std::cout << "Proxies: " << m_upstreams.size() << '\n';
+    for (const auto &upstream : m_upstreams) {
+        std::cout << "  /" << upstream->Prefix() << ": " << ToString(upstream->GetBalance())
+                  << " over";
+        for (const auto &backend : upstream->Backends()) {
+            std::cout << ' ' << backend.address;
+        }
+        std::cout << ", connect timeout " << upstream->ConnectTimeout().count()
+                  << "ms, read timeout " << upstream->ReadTimeout().count() << "ms\n";
+    }
+    std::cout << "Proxy cache: ";
+    if (m_cache) {
+        std::cout << m_cache->Directory().native() << ", lock timeout "
+                  << m_cache_lock_timeout.count() << "ms\n";
+    } else {
+        std::cout << "off\n";
+    }
+    std::cout << "Status endpoint: " << (m_status_endpoint ? STATUS_TARGET : "off") << '\n'
+              << "Access log: " << m_access_log << '\n'
+              << "Slow request threshold: " << m_slow_request_threshold.count() << "us\n"
+              << "Header timeout: " << m_header_timeout.count() << "ms\n"
+              << "Keep-alive timeout: " << m_keep_alive_timeout.count() << "ms\n"
+              << "Send timeout: " << m_send_timeout.count() << "ms\n"
+              << "TLS: ";
+    if (m_tls) {
+        const auto &tls = m_tls->Options();
+        std::cout << tls.certificate << ", kTLS " << (tls.ktls ? "on" : "off") << '\n';
+    } else {
+        std::cout << "off\n";
+    }
+    std::cout << "HTTP/2: ";
+    if (m_http2_max_streams) {
+        std::cout << m_http2_max_streams << " streams per connection\n";
+    } else {
+        std::cout << "off\n";
+    }
+    std::cout << "Drain timeout: " << m_drain_timeout.count() << "ms\n"
+              << "Event loop threads: " << m_loops.size() << '\n'
+              << "Event loop CPUs: ";
+    if (m_loop_cpus.empty()) {
+        std::cout << "unpinned\n";
+    } else {
+        for (std::size_t i = 0; i < m_loop_cpus.size(); ++i) {
+            std::cout << (i ? "," : "") << m_loop_cpus[i] << "(node " << m_loop_nodes[i] << ')';
+        }
+        std::cout << '\n';
+    }
+    std::cout << "Dispatch: " << (m_incoming_cpu ? "incoming CPU" : "round-robin") << '\n'
+              << "Max connections: " << m_limiter->Limit() << '\n'
+              << "Load shedding: ";
+    if (m_shed_target.count()) {
+        std::cout << "above " << m_shed_target.count() << "ms of queueing over "
+                  << m_shed_interval.count() << "ms\n";
+    } else {
+        std::cout << "off\n";
+    }
+
+    // What the kernel made of the options, rather than what was asked of it
+    try {
+        const auto option = [this](const int level, const int name) {
+            return internal::getSocketOption(m_listeners.front(), level, name);
+        };
+        std::cout << "Listen backlog: " << effectiveBacklog(m_listen_backlog) << '\n'
+                  << "TCP_NODELAY: " << (option(IPPROTO_TCP, TCP_NODELAY) ? "on" : "off") << '\n'
+                  << "TCP_DEFER_ACCEPT: " << option(IPPROTO_TCP, TCP_DEFER_ACCEPT) << "s\n"
+                  << "TCP_FASTOPEN queue: " << option(IPPROTO_TCP, TCP_FASTOPEN) << '\n'
+                  << "SO_RCVBUF: " << option(SOL_SOCKET, SO_RCVBUF) << "B\n"
+                  << "SO_SNDBUF: " << option(SOL_SOCKET, SO_SNDBUF) << "B\n";
+    } catch (const SocketException &e) {
+        std::cout << e.what() << '\n';
+    }
+    std::cout << "TCP_NOTSENT_LOWAT: "
+              << (m_notsent_lowat ? std::to_string(m_notsent_lowat) + "B" : "default"s)
+              << std::endl;
+}
+
+bool HttpServer::tuneAccepted(const Socket &sock) const noexcept {
+    return m_notsent_lowat == 0 or setsockopt(sock,
+                                              IPPROTO_TCP,
+                                              TCP_NOTSENT_LOWAT,
+                                              &m_notsent_lowat,
+                                              sizeof(m_notsent_lowat)) == 0;
 }
 
 
-bool HttpServer::Run() const noexcept {
+bool HttpServer::Run() noexcept {
     greet();
 
     (void)std::signal(SIGINT, signalHandler);  // Handle 'Ctrl+c'
     (void)std::signal(SIGQUIT, signalHandler); // Handle 'Ctrl+\'
+    (void)std::signal(SIGTERM, signalHandler); // Sent by the master to its workers
+    (void)std::signal(SIGPIPE, SIG_IGN);       // Peers may go away mid-sendfile()
+    (void)std::signal(SIGUSR1, reopenSignalHandler); // Reopen the access log after rotation
+    (void)std::signal(SIGHUP, reloadSignalHandler);  // Reread the config file
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < m_loops.size(); ++i) {
+        threads.emplace_back([this, i]() {
+            // Before running, so that the loop touches its buffers first on its own node
+            if (not m_loop_cpus.empty() and not PinThreadToCpu(m_loop_cpus[i])) {
+                std::cerr << "Failed to pin event loop " << i << " to CPU " << m_loop_cpus[i]
+                          << std::endl;
+            }
+            t_context = m_contexts[m_loop_nodes[i]];
+            m_loops[i]->Run();
+        });
+    }
+    // Connections still open are abandoned, along with their sessions
+    const auto stop_loops = gsl::finally([this, &threads]() {
+        for (const auto &loop : m_loops) {
+            loop->Stop();
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    });
+
+    const auto flush_logs = gsl::finally([this]() {
+        FlushAccessLog();
+        if (not m_trace_file.empty()) {
+            exportTrace();
+        }
+    });
 
     sockaddr_storage their_address {};
     char address_buffer[INET6_ADDRSTRLEN] = {};
-    pollfd server_pfd;
-    server_pfd.fd = m_socket;
-    server_pfd.events = POLLIN;
-    for (;;) {
+    std::vector<pollfd> listener_pfds;
+    for (const auto &listener : m_listeners) {
+        listener_pfds.push_back(pollfd {listener, POLLIN, 0});
+    }
+    std::size_t next_listener = 0;
+    pollfd resume_pfd;
+    resume_pfd.fd = m_limiter->ResumeDescriptor();
+    resume_pfd.events = POLLIN;
+    bool paused = false;
+    // Reserved up front, to turn connections away once out of descriptors
+    Socket spare {open("/dev/null", O_RDONLY | O_CLOEXEC)};
+    for (std::size_t accepted = 0;;) {
         if (g_signal) {
             std::cout << "Caught signal " << strsignal(g_signal) << '(' << g_signal
                       << "), shutting down..." << std::endl;
+            drain();
             break;
         }
+        if (g_reload.exchange(false)) {
+            reload();
+        }
 
-        if (not hasConnectionRequest(server_pfd)) {
+        // While paused, new connections wait in the listen queue, or are refused by the kernel
+        // once it is full, rather than being accepted only to starve
+        if (paused) {
+            if (not hasConnectionRequest(resume_pfd)) {
+                continue;
+            }
+            m_limiter->Resume();
+            paused = false;
+        }
+
+        const auto ready = findConnectionRequest(listener_pfds, next_listener);
+        if (ready == m_listeners.size()) {
+            continue;
+        }
+        const auto &listener = m_listeners[ready];
+
+        if (not m_limiter->TryAcquire()) {
+            paused = m_limiter->Pause();
             continue;
         }
 
         socklen_t address_size = sizeof(their_address);
-        Socket sock {
-            accept(m_socket, reinterpret_cast<sockaddr *>(&their_address), &address_size)};
+        Socket sock {accept4(listener,
+                             reinterpret_cast<sockaddr *>(&their_address),
+                             &address_size,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC)};
         if (sock == Socket::INVALID_SOCKET) {
-            if (errno == EMFILE) {
-                std::cerr << "Open file descriptors limit reached. Waiting for available spots."
-                          << std::endl;
-                std::this_thread::sleep_for(ServerOptions::accept_timeout);
+            const auto error = errno;
+            m_limiter->Release();
+            if (error == EAGAIN or error == EWOULDBLOCK or error == ECONNABORTED) {
+                // Taken by another worker, or gone before it was accepted
+                continue;
+            }
+            if (error == EMFILE or error == ENFILE) {
+                // Below the connection limit, so descriptors are held elsewhere, e.g. by files
+                // being sent; waits for connections to close if there are any to wait for
+                rejectWithSpare(listener, spare);
+                paused = m_limiter->Pause();
                 continue;
             }
 
-            std::cerr << "Failed to accept(): " << strerror(errno) << std::endl;
+            std::cerr << "Failed to accept(): " << strerror(error) << std::endl;
             return false;
         }
 
+        const auto loop_index = pickLoop(sock, accepted);
+        if (their_address.ss_family == AF_UNIX) {
+            onAccept(loop_index, std::move(sock), UNIX_PREFIX.data(), 0);
+            continue;
+        }
+
+        if (not tuneAccepted(sock)) {
+            std::cerr << "Failed to tune accepted socket: " << strerror(errno) << std::endl;
+        }
+
         inet_ntop(their_address.ss_family,
                   locateInternetAddress(their_address),
                   address_buffer,
                   sizeof(address_buffer));
-        onAccept(std::move(sock), address_buffer, getPort(their_address));
+        onAccept(loop_index,
+                 std::move(sock),
+                 address_buffer,
+                 getPort(their_address));
     }
 
     return true;
 }
 
-void HttpServer::onAccept(Socket sock,
+void HttpServer::drain() const noexcept {
+    // No longer accepting, so the count only goes down
+    const auto open = m_limiter->Count();
+    for (const auto &loop : m_loops) {
+        loop->Drain();
+    }
+
+    const auto deadline = Clock::now() + m_drain_timeout;
+    while (m_limiter->Count() > 0 and Clock::now() < deadline and g_signal_count < 2) {
+        std::this_thread::sleep_for(DRAIN_POLL_INTERVAL);
+    }
+
+    // Left to the loops being stopped, and closed on exit
+    const auto aborted = m_limiter->Count();
+    std::cout << "Drained " << open - std::min(open, aborted) << " connections, aborted "
+              << aborted << std::endl;
+}
+
+void HttpServer::exportTrace() const noexcept {
+    std::ofstream file {m_trace_file};
+    file << ToChromeTraceJson(RecentSlowRequests());
+    if (not file) {
+        std::cerr << "Failed to write trace file: " << m_trace_file << std::endl;
+    }
+}
+
+std::size_t HttpServer::pickLoop(const Socket &sock, std::size_t &accepted) const noexcept {
+    if (m_incoming_cpu) {
+        // Served where the NIC queue delivered it, the connection stays in that CPU's caches
+        int cpu = -1;
+        socklen_t size = sizeof(cpu);
+        if (getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &size) == 0 and cpu >= 0 and
+            static_cast<std::size_t>(cpu) < m_loops_of_cpu.size()) {
+            if (const auto &loops = m_loops_of_cpu[cpu]; not loops.empty()) {
+                return loops[accepted++ % loops.size()];
+            }
+        }
+    }
+    // Round-robin, as every loop serves the same kind of work
+    return accepted++ % m_loops.size();
+}
+
+void HttpServer::onAccept(const std::size_t loop_index,
+                          Socket sock,
                           const gsl::not_null<gsl::czstring> address,
                           const int port) const noexcept {
-    Session s {std::move(sock), address, port, m_root_dir};
-    std::thread([s = std::move(s)]() mutable {
-        s.Run();
-    }).detach();
+    auto &loop = *m_loops[loop_index];
+    loop.Post([&loop,
+               &shedder = *m_shedders[loop_index],
+               &pool = *m_pools[loop_index],
+               fd = sock.Release(),
+               accepted_at = Clock::now(),
+               address = std::string {address.get()},
+               port]() {
+        runSession(loop, shedder, pool, Socket {fd}, accepted_at, address, port);
+    });
 }
 
 } //namespace nginxpp
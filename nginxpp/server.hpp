@@ -1,12 +1,22 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
 #include <utility>
+#include <vector>
+
+#include <sys/types.h>
 
 #include <gsl/gsl>
 
+#include <nginxpp/proxy.hpp>
+#include <nginxpp/vhost.hpp>
+
 
 namespace cxxopts {
 
@@ -18,21 +28,125 @@ class ParseResult;
 
 namespace nginxpp {
 
+class ConnectionLimiter;
+class ContentCache;
+class EventLoop;
+class LoadShedder;
+struct SessionContext;
+class TlsContext;
+
 struct ServerOptions {
     std::string base_mount_dir;
     int port {};
+    /// Unix domain sockets listened on along with the port, by path, or by name after '@' for
+    /// one in the abstract namespace, e.g. for a proxy on the same host
+    std::vector<std::string> unix_sockets;
+    /// Permissions of the socket files, which are left to the umask if not given
+    std::optional<mode_t> unix_mode;
+    bool status_endpoint = false;
+    std::string access_log = "-"; // ACCESS_LOG_STDOUT
+    std::chrono::microseconds slow_request_threshold {};
+    std::string trace_file;
+    /// Event loop threads, 0 for one per CPU
+    unsigned threads = 0;
+    /// For the whole request head, counted from when the connection or the previous request
+    /// has nothing more to read
+    std::chrono::milliseconds header_timeout {5000};
+    /// How long an idle connection is kept open for its next request, 0 to close it after one
+    std::chrono::milliseconds keep_alive_timeout {15000};
+    /// How long sending a response may stall on a peer that does not read
+    std::chrono::milliseconds send_timeout {5000};
+    /// Streams an HTTP/2 connection may have open at once, 0 to serve HTTP/1.1 only
+    std::uint32_t http2_max_streams = 256;
+    /// PEM files that the listener terminates TLS with; empty to serve plaintext
+    std::string tls_certificate;
+    std::string tls_key;
+    /// TLS_TICKET_KEY_SIZE bytes that session tickets are protected with; random if empty, and
+    /// then shared by the workers of a master, so that any of them resumes a session
+    std::string tls_ticket_key;
+    /// Offloads the record layer of TLS to the kernel, where it supports it
+    bool ktls = true;
+
+    bool tcp_nodelay = false;
+    /// Capped by the kernel at net.core.somaxconn
+    int listen_backlog = 511;
+    /// How long the kernel holds a connection until its first data, before handing it to
+    /// accept() anyway; 0 to hand it over right away
+    std::chrono::seconds defer_accept {};
+    /// Pending TCP Fast Open requests, 0 to disable it
+    int fastopen_queue = 0;
+    /// Socket buffer sizes in bytes, 0 for the kernel defaults and their auto-tuning
+    int receive_buffer = 0;
+    int send_buffer = 0;
+    /// Unsent bytes a socket queues before it stops polling writable, 0 for the kernel default
+    int notsent_lowat = 0;
+    /// Open connections beyond which the listener is paused, 0 to derive it from RLIMIT_NOFILE
+    std::size_t max_connections = 0;
+    /// How long requests may wait for the event loop before it counts as overloaded, as CoDel
+    /// would have it; 0 disables load shedding
+    std::chrono::milliseconds shed_target {5};
+    std::chrono::milliseconds shed_interval {100};
+    /// Sent along with the 503 of shed requests
+    std::chrono::seconds retry_after {1};
+    /// Worker processes sharing the listening socket, 0 to serve from this process
+    unsigned workers = 0;
+    /// Pins each worker process to a CPU of its own
+    bool worker_affinity = false;
+    /// Pins each event loop thread to a CPU, in turn, with its memory on the CPU's NUMA node
+    bool loop_affinity = false;
+    /// Hands connections to a loop pinned to the CPU that received them, as told by
+    /// SO_INCOMING_CPU, rather than round-robin; implies loop_affinity
+    bool incoming_cpu = false;
+    /// How long open connections may take to finish on shutdown, before they are aborted
+    std::chrono::milliseconds drain_timeout {10000};
+    /// Response heads of files cached per NUMA node of the loops, for each host that does not
+    /// size its own
+    std::size_t header_cache_entries = 4096;
+    /// Served instead of the base mount directory to requests whose Host header names them
+    std::vector<VirtualHostOptions> virtual_hosts;
+    /// Proxied to their backends instead of being served from disk, whatever the host
+    std::vector<ProxyOptions> proxies;
+    Balance proxy_balance = Balance::ROUND_ROBIN;
+    std::chrono::milliseconds proxy_connect_timeout {1000};
+    /// How long a backend may stall, sending the response or reading the request body
+    std::chrono::milliseconds proxy_read_timeout {60000};
+    /// Idle connections kept per backend by each event loop, 0 to close them after one request
+    std::size_t proxy_keepalive = 32;
+    /// Where proxied responses are cached, in a directory of the process; empty to cache none.
+    /// Taken on start only, as the cache outlives reloads of the config within the process.
+    /// Each worker caches on its own, and its entries go once it exits: they are neither shared
+    /// among workers nor kept across restarts, workers respawned by the master, or upgrades.
+    std::string proxy_cache_dir;
+    std::size_t proxy_cache_size = std::size_t {256} << 20;
+    /// How long responses stay fresh if they do not tell
+    std::chrono::milliseconds proxy_cache_valid {0};
+    /// How long stale responses are served while being refreshed, if they do not tell
+    std::chrono::milliseconds proxy_cache_stale {60000};
+    /// Request headers, in lower case, whose values the cache keys on too
+    std::vector<std::string> proxy_cache_vary;
+    /// How long a miss waits for another request fetching the same response, before it is
+    /// proxied on its own
+    std::chrono::milliseconds proxy_cache_lock_timeout {5000};
+    /// Read along with the command line, which overrides it, and again on SIGHUP; empty if none
+    std::string config_file;
+    /// As given, to be parsed again along with the config file on reload
+    std::vector<std::string> command_line;
+    /// Skips the greeting, e.g. for all workers but the first
+    bool quiet = false;
 
-    static constexpr bool tcp_nodelay = false;
-    static constexpr int listen_backlog = 10;
-    static constexpr std::chrono::seconds read_timeout {5};
-    static constexpr std::chrono::seconds write_timeout {5};
     static constexpr std::chrono::milliseconds accept_timeout {100};
 };
 
 void AddServerOptions(cxxopts::Options &options) noexcept;
 
-[[nodiscard]] ServerOptions
-HandleServerOptions(const cxxopts::ParseResult &parsed_options) noexcept;
+/// Throws ConfigException if a virtual host is malformed or given twice, or a proxy or the
+/// balance is malformed.
+[[nodiscard]] ServerOptions HandleServerOptions(const cxxopts::ParseResult &parsed_options);
+
+/// Parses the command line, after the options of the config file that it names with --config
+/// if any, so that the command line overrides the file.
+/// Throws ConfigException if the file cannot be read, or either is invalid.
+[[nodiscard]] ServerOptions LoadServerOptions(const std::vector<std::string> &command_line);
 
 
 class Socket {
@@ -61,6 +175,11 @@ public:
         return m_socket_fd;
     }
 
+    /// Gives up ownership, e.g. to hand the descriptor over to another thread.
+    [[nodiscard]] int Release() noexcept {
+        return std::exchange(m_socket_fd, INVALID_SOCKET);
+    }
+
 private:
     int m_socket_fd = INVALID_SOCKET;
 };
@@ -70,27 +189,142 @@ class HttpServer {
 public:
     explicit HttpServer(const ServerOptions &options);
 
-    [[nodiscard]] bool Run() const noexcept;
+    /// Serves from a listening socket created beforehand.
+    HttpServer(const ServerOptions &options, Socket listener);
+
+    /// Serves from listening sockets created beforehand, e.g. by the master of a worker, the
+    /// one bound to the port first.
+    HttpServer(const ServerOptions &options, std::vector<Socket> listeners);
+
+    ~HttpServer() noexcept;
+
+    HttpServer(const HttpServer &) = delete;
+    HttpServer &operator=(const HttpServer &) = delete;
+
+    /// SIGHUP reloads the config file, whose mount directories, virtual hosts, proxies, timeouts,
+    /// cache sizes and limits apply from the next request of each connection on; the rest takes
+    /// a restart.
+    [[nodiscard]] bool Run() noexcept;
 
 private:
     void greet() const noexcept;
 
-    void onAccept(Socket sock,
+    /// Applies the options that may change on reload, and builds the contexts of the sessions
+    /// off the loops, with caches of their own for each virtual host. Throws ServerException,
+    /// leaving everything as it was, if a mount directory does not exist, a backend cannot be
+    /// resolved or the TLS certificate cannot be loaded, or ConfigException if a virtual host
+    /// is given twice.
+    void configure(const ServerOptions &options);
+
+    /// Hands each loop the context of its node, which it swaps in between two callbacks, so
+    /// that its sessions read it without taking a lock.
+    void publish() const noexcept;
+
+    /// Rereads the config file, keeping the current config if it is invalid.
+    void reload() noexcept;
+
+    /// Tuning that accepted sockets do not inherit from the listening one.
+    [[nodiscard]] bool tuneAccepted(const Socket &sock) const noexcept;
+
+    /// Stops keeping connections alive, closes the idle ones, and waits for the others to be
+    /// done with their current request, until the drain timeout.
+    void drain() const noexcept;
+
+    void exportTrace() const noexcept;
+
+    /// The loop pinned to the CPU that received the connection if any, or the next one in turn.
+    [[nodiscard]] std::size_t pickLoop(const Socket &sock, std::size_t &accepted) const noexcept;
+
+    void onAccept(const std::size_t loop_index,
+                  Socket sock,
                   const gsl::not_null<gsl::czstring> address,
                   const int port) const noexcept;
 
     std::filesystem::path m_root_dir;
-    Socket m_socket;
+    /// The one bound to the port first, then the Unix domain sockets
+    std::vector<Socket> m_listeners;
     int m_port = 0;
+    std::string m_access_log;
+    std::string m_trace_file;
+    bool m_status_endpoint = false;
+    bool m_quiet = false;
+    std::chrono::microseconds m_slow_request_threshold {};
+    std::chrono::milliseconds m_header_timeout {};
+    std::chrono::milliseconds m_keep_alive_timeout {};
+    std::chrono::milliseconds m_send_timeout {};
+    std::uint32_t m_http2_max_streams = 0;
+    /// Kept over reloads, which load the certificate again, so that tickets stay valid
+    std::string m_tls_ticket_key;
+    /// nullptr if serving plaintext
+    std::shared_ptr<const TlsContext> m_tls;
+    int m_listen_backlog = 0;
+    int m_notsent_lowat = 0;
+    std::shared_ptr<ConnectionLimiter> m_limiter;
+    std::chrono::milliseconds m_shed_target {};
+    std::chrono::milliseconds m_shed_interval {};
+    bool m_incoming_cpu = false;
+    std::chrono::milliseconds m_drain_timeout {};
+    std::size_t m_header_cache_entries = 0;
+    /// With their mount directories made canonical
+    std::vector<VirtualHostOptions> m_virtual_hosts;
+    /// Resolved anew on reload, longest prefix first
+    std::vector<std::shared_ptr<Upstream>> m_upstreams;
+    /// nullptr if proxied responses are not cached
+    std::shared_ptr<ContentCache> m_cache;
+    std::chrono::milliseconds m_cache_lock_timeout {};
+    std::chrono::seconds m_retry_after {};
+    std::string m_config_file;
+    std::vector<std::string> m_command_line;
+    /// One per NUMA node of the loops, so that each node fills a header cache of its own.
+    /// The latest published, while sessions may still hold on to earlier ones
+    std::vector<std::shared_ptr<const SessionContext>> m_contexts;
+    std::vector<std::unique_ptr<EventLoop>> m_loops;
+    /// One per loop, at the same index
+    std::vector<std::unique_ptr<LoadShedder>> m_shedders;
+    /// One per loop, at the same index; declared after the loops, so as to close the idle
+    /// connections before the loops they are registered with go
+    std::vector<std::unique_ptr<ConnectionPool>> m_pools;
+    /// The CPU each loop is pinned to, at the same index; empty if loops are not pinned
+    std::vector<unsigned> m_loop_cpus;
+    /// The NUMA node of each loop, at the same index
+    std::vector<unsigned> m_loop_nodes;
+    /// The loops pinned to each CPU, by CPU number
+    std::vector<std::vector<std::size_t>> m_loops_of_cpu;
 };
 
 
 namespace internal {
 
+/// Where the listening sockets passed on by systemd socket activation, or by an upgrade, start
+constexpr int LISTEN_FDS_START = 3;
+
 [[nodiscard]] Socket createServerSocket(const ServerOptions &options);
 
+/// Binds to a path, replacing a socket file that nothing listens on any more, e.g. one left
+/// behind by a crash, or to a name in the abstract namespace after '@'.
+/// Throws SocketException if the address is in use, or cannot be bound to.
+[[nodiscard]] Socket createUnixServerSocket(const std::string &address,
+                                            const ServerOptions &options);
+
+/// Takes over the listening sockets passed on through LISTEN_FDS to the process named by
+/// LISTEN_PID, and unsets both so that children do not take them for theirs; empty if none
+/// were passed. They keep the tuning of whoever created them.
+/// Throws SocketException if a descriptor is not a listening socket.
+[[nodiscard]] std::vector<Socket> inheritServerSockets();
+
+/// The one bound to the port first, then one for each Unix domain socket of the options; each
+/// the inherited one if any, else a new one.
+[[nodiscard]] std::vector<Socket> openServerSockets(const ServerOptions &options);
+
 [[nodiscard]] int getPort(const Socket &socket);
 
+/// The path of a Unix domain socket, or its name after '@' if abstract; empty if the socket
+/// is not one.
+[[nodiscard]] std::string getUnixAddress(const Socket &socket);
+
+/// The effective value, e.g. buffer sizes as doubled by the kernel for its bookkeeping.
+[[nodiscard]] int getSocketOption(const Socket &socket, const int level, const int name);
+
 } //namespace internal
 
 } //namespace nginxpp
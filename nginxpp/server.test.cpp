@@ -1,8 +1,28 @@
 #include <nginxpp/server.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 #include <nginxpp/exception.hpp>
+#include <nginxpp/http2.hpp>
 
 
 using namespace nginxpp;
@@ -17,6 +37,113 @@ namespace {
     return options;
 }
 
+[[nodiscard]] std::string fetchStatusLine(const Socket &sock,
+                                          const std::string_view target,
+                                          const std::string_view host) {
+    auto request = "GET " + std::string {target} + " HTTP/1.1\r\nConnection: close\r\n";
+    if (not host.empty()) {
+        request += "Host: " + std::string {host} + "\r\n";
+    }
+    request += "\r\n";
+    if (send(sock, request.data(), request.size(), 0) == -1) {
+        return {};
+    }
+    std::string response(64, '\0');
+    const auto n = recv(sock, response.data(), response.size(), MSG_WAITALL);
+    response.resize(std::max(0L, n));
+    return response.substr(0, response.find("\r\n"));
+}
+
+[[nodiscard]] std::string fetchStatusLine(const int port,
+                                          const std::string_view target,
+                                          const std::string_view host = {}) {
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+        return {};
+    }
+    return fetchStatusLine(sock, target, host);
+}
+
+/// Over a Unix domain socket, at a path or named after '@' in the abstract namespace
+[[nodiscard]] std::string fetchStatusLine(const std::string &unix_address,
+                                          const std::string_view target) {
+    const Socket sock {socket(AF_UNIX, SOCK_STREAM, 0)};
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    unix_address.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    auto length = static_cast<socklen_t>(sizeof(address));
+    if (unix_address.front() == '@') {
+        address.sun_path[0] = '\0';
+        length = offsetof(sockaddr_un, sun_path) + unix_address.size();
+    }
+    if (connect(sock, reinterpret_cast<const sockaddr *>(&address), length) == -1) {
+        return {};
+    }
+    return fetchStatusLine(sock, target, {});
+}
+
+/// Reads one response, whose body has a Content-Length, off a kept-alive connection.
+[[nodiscard]] std::string readResponse(const Socket &sock) {
+    std::string response;
+    for (;;) {
+        if (const auto head_end = response.find("\r\n\r\n"); head_end != response.npos) {
+            const auto length_at = response.find("Content-Length: ");
+            const auto length =
+                length_at < head_end ? std::stoul(response.substr(length_at + 16)) : 0;
+            if (response.size() >= head_end + 4 + length) {
+                return response;
+            }
+        }
+        char buffer[1024];
+        const auto n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return response;
+        }
+        response.append(buffer, n);
+    }
+}
+
+/// A loopback backend answering each request with its request line, its X-Forwarded-For and
+/// its body, over keep-alive connections, one at a time, until the listener is shut down.
+void serveBackend(const Socket &listener, std::atomic<int> &connections) {
+    for (;;) {
+        const Socket sock {accept(listener, nullptr, nullptr)};
+        if (sock == Socket::INVALID_SOCKET) {
+            return;
+        }
+        ++connections;
+
+        std::string input;
+        for (bool open = true; open;) {
+            auto head_end = input.find("\r\n\r\n");
+            const auto length_at = input.find("content-length: ");
+            const auto length =
+                length_at < head_end ? std::stoul(input.substr(length_at + 16)) : 0;
+            if (head_end == input.npos or input.size() < head_end + 4 + length) {
+                char buffer[1024];
+                const auto n = recv(sock, buffer, sizeof(buffer), 0);
+                open = n > 0;
+                input.append(buffer, std::max(0L, n));
+                continue;
+            }
+
+            const auto forwarded_at = input.find("x-forwarded-for: ");
+            auto body = input.substr(0, input.find("\r\n")) + '|' +
+                        input.substr(forwarded_at + 17, input.find('\r', forwarded_at) -
+                                                            forwarded_at - 17) +
+                        '|' + input.substr(head_end + 4, length);
+            input.erase(0, head_end + 4 + length);
+            const auto response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                                  std::to_string(body.size()) + "\r\n\r\n" + body;
+            open = send(sock, response.data(), response.size(), MSG_NOSIGNAL) != -1;
+        }
+    }
+}
+
 } // namespace
 
 
@@ -41,3 +168,696 @@ TEST(HttpServerTests, ThrowIfBindOnTheSamePortTwice) {
     options.port = internal::getPort(socket);
     ASSERT_THROW(HttpServer {options}, SocketException);
 }
+
+TEST(HttpServerTests, ThrowIfAccessLogCannotBeOpened) {
+    auto options = createServerOptions(0);
+    options.access_log = "no_such_path/access.log";
+    ASSERT_THROW(HttpServer {options}, ServerException);
+}
+
+TEST(HttpServerTests, ListeningSocketIsTuned) {
+    auto options = createServerOptions(0);
+    options.tcp_nodelay = true;
+    options.defer_accept = std::chrono::seconds {1};
+    options.fastopen_queue = 16;
+    options.receive_buffer = 64 * 1024;
+    options.send_buffer = 64 * 1024;
+    const auto socket = internal::createServerSocket(options);
+
+    EXPECT_NE(0, internal::getSocketOption(socket, IPPROTO_TCP, TCP_NODELAY));
+    EXPECT_NE(0, internal::getSocketOption(socket, IPPROTO_TCP, TCP_DEFER_ACCEPT));
+    EXPECT_EQ(16, internal::getSocketOption(socket, IPPROTO_TCP, TCP_FASTOPEN));
+    // Doubled by the kernel, for its own bookkeeping
+    EXPECT_LE(options.receive_buffer, internal::getSocketOption(socket, SOL_SOCKET, SO_RCVBUF));
+    EXPECT_LE(options.send_buffer, internal::getSocketOption(socket, SOL_SOCKET, SO_SNDBUF));
+}
+
+TEST(HttpServerTests, ListeningSocketKeepsKernelDefaultsUnlessAsked) {
+    const auto socket = internal::createServerSocket(createServerOptions(0));
+
+    EXPECT_EQ(0, internal::getSocketOption(socket, IPPROTO_TCP, TCP_NODELAY));
+    EXPECT_EQ(0, internal::getSocketOption(socket, IPPROTO_TCP, TCP_DEFER_ACCEPT));
+    EXPECT_EQ(0, internal::getSocketOption(socket, IPPROTO_TCP, TCP_FASTOPEN));
+}
+
+TEST(HttpServerTests, InheritsTheListeningSocketPassedOn) {
+    const auto listener = internal::createServerSocket(createServerOptions(0));
+    const auto port = internal::getPort(listener);
+
+    // In a child, as the socket is passed at a fixed descriptor
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        const bool passed = dup2(listener, internal::LISTEN_FDS_START) != -1 and
+                            setenv("LISTEN_FDS", "1", 1) == 0 and
+                            setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1) == 0;
+        const auto inherited = internal::openServerSockets(createServerOptions(0));
+        const bool taken = inherited.size() == 1 and
+                           internal::getPort(inherited.front()) == port and
+                           not getenv("LISTEN_FDS");
+        _exit(passed and taken ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(HttpServerTests, IgnoresListeningSocketsPassedToAnotherProcess) {
+    ASSERT_EQ(0, setenv("LISTEN_FDS", "1", 1));
+    ASSERT_EQ(0, setenv("LISTEN_PID", std::to_string(getppid()).c_str(), 1));
+
+    EXPECT_TRUE(internal::inheritServerSockets().empty());
+    EXPECT_EQ(nullptr, getenv("LISTEN_FDS"));
+    EXPECT_EQ(nullptr, getenv("LISTEN_PID"));
+}
+
+TEST(HttpServerTests, LoadsUnixSockets) {
+    const auto options = LoadServerOptions(
+        {"nginxpp", "--listen", "unix:/run/nginxpp.sock", "--listen", "unix:@nginxpp",
+         "--listen-mode", "0660"});
+    EXPECT_EQ((std::vector<std::string> {"/run/nginxpp.sock", "@nginxpp"}), options.unix_sockets);
+    EXPECT_EQ(0660U, options.unix_mode);
+    EXPECT_FALSE(LoadServerOptions({"nginxpp"}).unix_mode);
+    EXPECT_EQ(0U, LoadServerOptions({"nginxpp", "--listen-mode", "0000"}).unix_mode);
+
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--listen", "8080"}), ConfigException);
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--listen", "unix:"}), ConfigException);
+    EXPECT_THROW(
+        (void)LoadServerOptions({"nginxpp", "--listen", "unix:/" + std::string(200, 'a')}),
+        ConfigException);
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--listen-mode", "0980"}), ConfigException);
+}
+
+TEST(HttpServerTests, ReplacesOnlyStaleSocketFiles) {
+    const auto path = (std::filesystem::temp_directory_path() /
+                       ("nginxpp_stale_test." + std::to_string(getpid()) + ".sock"))
+                          .string();
+    auto options = createServerOptions(0);
+    options.unix_mode = 0600;
+    {
+        const auto listener = internal::createUnixServerSocket(path, options);
+        EXPECT_EQ(path, internal::getUnixAddress(listener));
+        EXPECT_EQ(std::filesystem::perms::owner_read | std::filesystem::perms::owner_write,
+                  std::filesystem::status(path).permissions());
+        // In use
+        EXPECT_THROW((void)internal::createUnixServerSocket(path, options), SocketException);
+    }
+    // Left behind by the listener, which is gone
+    ASSERT_TRUE(std::filesystem::is_socket(path));
+    EXPECT_NO_THROW((void)internal::createUnixServerSocket(path, options));
+    // Applied even if it gives no permission at all
+    options.unix_mode = 0;
+    EXPECT_NO_THROW((void)internal::createUnixServerSocket(path, options));
+    EXPECT_EQ(std::filesystem::perms::none, std::filesystem::status(path).permissions());
+
+    // Not a socket, so not ours to replace
+    std::filesystem::remove(path);
+    std::ofstream {path} << "data";
+    EXPECT_THROW((void)internal::createUnixServerSocket(path, options), SocketException);
+    std::filesystem::remove(path);
+}
+
+TEST(HttpServerTests, ServesUnixSocketsAlongWithThePort) {
+    const auto path = (std::filesystem::temp_directory_path() /
+                       ("nginxpp_listen_test." + std::to_string(getpid()) + ".sock"))
+                          .string();
+    const auto abstract = "@nginxpp_listen_test." + std::to_string(getpid());
+    auto options = createServerOptions(0);
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    std::vector<Socket> listeners;
+    listeners.push_back(internal::createServerSocket(options));
+    listeners.push_back(internal::createUnixServerSocket(path, options));
+    listeners.push_back(internal::createUnixServerSocket(abstract, options));
+    const auto port = internal::getPort(listeners.front());
+    EXPECT_EQ(abstract, internal::getUnixAddress(listeners.back()));
+    EXPECT_EQ("", internal::getUnixAddress(listeners.front()));
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listeners)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(port, "/no_such_file"));
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(path, "/no_such_file"));
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(abstract, "/no_such_file"));
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+    std::filesystem::remove(path);
+}
+
+TEST(HttpServerTests, CommandLineOverridesTheConfigFile) {
+    const auto path = std::filesystem::temp_directory_path() / "nginxpp_server_test.conf";
+    std::ofstream {path} << "port = 8080\nkeep-alive-timeout = 0\nstatus\n";
+
+    const auto options =
+        LoadServerOptions({"nginxpp", "--config", path.string(), "--keep-alive-timeout=50"});
+    EXPECT_EQ(path.string(), options.config_file);
+    EXPECT_EQ(8080, options.port);
+    EXPECT_TRUE(options.status_endpoint);
+    EXPECT_EQ(std::chrono::milliseconds {50}, options.keep_alive_timeout);
+    EXPECT_EQ(std::chrono::milliseconds {5000}, options.header_timeout);
+
+    std::ofstream {path} << "no-such-option = 1\n";
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--config", path.string()}),
+                 ConfigException);
+    std::filesystem::remove(path);
+}
+
+TEST(HttpServerTests, ThrowIfConfigFileNotExists) {
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--config", "no_such_path/nginxpp.conf"}),
+                 ConfigException);
+}
+
+TEST(HttpServerTests, ThrowIfVirtualHostPathNotExists) {
+    auto options = createServerOptions(0);
+    options.virtual_hosts.push_back({"example.com", "no_such_path"});
+    ASSERT_THROW(HttpServer {options}, ServerException);
+}
+
+TEST(HttpServerTests, LoadsVirtualHosts) {
+    const auto options = LoadServerOptions({"nginxpp",
+                                            "--header-cache-entries=8",
+                                            "--vhost",
+                                            "example.com=/srv/a",
+                                            "--vhost",
+                                            "*.Example.com:0=/srv/b"});
+    ASSERT_EQ(2, options.virtual_hosts.size());
+    EXPECT_EQ("example.com", options.virtual_hosts[0].server_name);
+    EXPECT_EQ("/srv/a", options.virtual_hosts[0].mount_dir);
+    EXPECT_EQ(8, options.virtual_hosts[0].header_cache_entries);
+    EXPECT_EQ("*.example.com", options.virtual_hosts[1].server_name);
+    EXPECT_EQ(0, options.virtual_hosts[1].header_cache_entries);
+
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--vhost", "example.com"}), ConfigException);
+    EXPECT_THROW((void)LoadServerOptions(
+                     {"nginxpp", "--vhost", "example.com=/a", "--vhost", "EXAMPLE.com=/b"}),
+                 ConfigException);
+}
+
+TEST(HttpServerTests, ServesVirtualHostsByName) {
+    const auto temp = std::filesystem::temp_directory_path();
+    const auto base = temp / "nginxpp_vhost_base";
+    const auto site = temp / "nginxpp_vhost_site";
+    std::filesystem::create_directories(base);
+    std::filesystem::create_directories(site);
+    std::ofstream {base / "base.txt"} << "base";
+    std::ofstream {site / "site.txt"} << "site";
+
+    auto options = createServerOptions(0, base.string());
+    options.virtual_hosts.push_back({"*.example.com", site.string(), 16});
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(port, "/base.txt"));
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(port, "/site.txt"));
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(port, "/site.txt", "www.Example.com:80"));
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(port, "/base.txt", "www.example.com"));
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(port, "/base.txt", "example.com"));
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    std::filesystem::remove_all(base);
+    std::filesystem::remove_all(site);
+}
+
+TEST(HttpServerTests, AnswersHeadWithoutTheBodyOnAKeptConnection) {
+    const auto root = std::filesystem::temp_directory_path() / "nginxpp_head_test";
+    std::filesystem::create_directories(root);
+    std::ofstream {root / "a.txt"} << "hello-body\n";
+
+    auto options = createServerOptions(0, root.string());
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+    // Pipelined: a file, a directory listing, then the file again
+    const std::string requests = "HEAD /a.txt HTTP/1.1\r\n\r\nHEAD / HTTP/1.1\r\n\r\n"
+                                 "GET /a.txt HTTP/1.1\r\nConnection: close\r\n\r\n";
+    ASSERT_EQ(requests.size(), send(sock, requests.data(), requests.size(), 0));
+    std::string responses;
+    char buffer[1024];
+    for (ssize_t n = 0; (n = recv(sock, buffer, sizeof(buffer), 0)) > 0;) {
+        responses.append(buffer, n);
+    }
+
+    const auto file_head_end = responses.find("\r\n\r\n");
+    ASSERT_NE(responses.npos, file_head_end) << responses;
+    EXPECT_NE(responses.npos, responses.substr(0, file_head_end).find("Content-Length: 11"));
+    const auto listing = responses.substr(file_head_end + 4);
+    EXPECT_TRUE(listing.starts_with("HTTP/1.1 200 OK\r\n")) << responses;
+    const auto listing_head_end = listing.find("\r\n\r\n");
+    ASSERT_NE(listing.npos, listing_head_end) << responses;
+    const auto get = listing.substr(listing_head_end + 4);
+    EXPECT_TRUE(get.starts_with("HTTP/1.1 200 OK\r\n")) << responses;
+    EXPECT_TRUE(get.ends_with("\r\n\r\nhello-body\n")) << responses;
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(HttpServerTests, ReloadsTheConfigFileOnSighup) {
+    const auto temp = std::filesystem::temp_directory_path();
+    const auto path = temp / "nginxpp_reload_test.conf";
+    const auto first = temp / "nginxpp_reload_first";
+    const auto second = temp / "nginxpp_reload_second";
+    std::filesystem::create_directories(first);
+    std::filesystem::create_directories(second);
+    std::ofstream {first / "first.txt"} << "first";
+    std::ofstream {path} << "mount = " << first.string() << "\naccess-log = off\n";
+
+    auto options = LoadServerOptions({"nginxpp", "--config", path.string(), "--port=0"});
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    // Created in the child, which does not inherit the threads of the parent
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(port, "/first.txt"));
+
+    // Invalid, so the current config is kept
+    std::ofstream {path} << "mount = " << (temp / "nginxpp_no_such_dir").string() << '\n';
+    ASSERT_EQ(0, kill(pid, SIGHUP));
+    std::this_thread::sleep_for(std::chrono::milliseconds {300});
+    EXPECT_EQ("HTTP/1.1 200 OK", fetchStatusLine(port, "/first.txt"));
+
+    std::ofstream {path} << "mount = " << second.string() << "\naccess-log = off\n";
+    ASSERT_EQ(0, kill(pid, SIGHUP));
+    auto status_line = fetchStatusLine(port, "/first.txt");
+    for (int i = 0; i < 50 and status_line == "HTTP/1.1 200 OK"; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds {20});
+        status_line = fetchStatusLine(port, "/first.txt");
+    }
+    EXPECT_EQ("HTTP/1.1 404 Not Found", status_line);
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(first);
+    std::filesystem::remove_all(second);
+}
+
+TEST(HttpServerTests, LoadsProxies) {
+    const auto options = LoadServerOptions({"nginxpp",
+                                            "--proxy",
+                                            "/api=127.0.0.1:8080",
+                                            "--proxy-balance=least-conn",
+                                            "--proxy-read-timeout=500"});
+    ASSERT_EQ(1, options.proxies.size());
+    EXPECT_EQ("api", options.proxies[0].prefix);
+    EXPECT_EQ(Balance::LEAST_CONN, options.proxy_balance);
+    EXPECT_EQ(std::chrono::milliseconds {500}, options.proxy_read_timeout);
+
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--proxy", "api"}), ConfigException);
+    EXPECT_THROW((void)LoadServerOptions({"nginxpp", "--proxy-balance", "random"}),
+                 ConfigException);
+}
+
+TEST(HttpServerTests, ProxiesPrefixesOverPooledConnections) {
+    auto backend_options = createServerOptions(0);
+    const auto backend = internal::createServerSocket(backend_options);
+    const auto backend_port = internal::getPort(backend);
+    // Blocking, for the backend thread to wait in accept()
+    ASSERT_NE(-1, fcntl(backend, F_SETFL, 0));
+
+    auto options = createServerOptions(0);
+    options.proxies.push_back(ParseProxy("/api=127.0.0.1:" + std::to_string(backend_port)));
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    std::atomic<int> connections = 0;
+    std::thread backend_thread {[&backend, &connections]() {
+        serveBackend(backend, connections);
+    }};
+
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+    const std::string get = "GET /api/items?id=1 HTTP/1.1\r\nX-Forwarded-For: 10.0.0.1\r\n\r\n";
+    ASSERT_EQ(get.size(), send(sock, get.data(), get.size(), 0));
+    auto response = readResponse(sock);
+    EXPECT_TRUE(response.starts_with("HTTP/1.1 200 OK\r\n")) << response;
+    EXPECT_TRUE(response.ends_with("GET /api/items?id=1 HTTP/1.1|10.0.0.1, 127.0.0.1|"))
+        << response;
+
+    // The body in two parts, the second only once the first was forwarded
+    const std::string post = "POST /api/echo HTTP/1.1\r\nContent-Length: 10\r\n\r\nhello";
+    ASSERT_EQ(post.size(), send(sock, post.data(), post.size(), 0));
+    std::this_thread::sleep_for(std::chrono::milliseconds {50});
+    ASSERT_EQ(5, send(sock, "world", 5, 0));
+    response = readResponse(sock);
+    EXPECT_TRUE(response.ends_with("POST /api/echo HTTP/1.1|127.0.0.1|helloworld")) << response;
+
+    // Not proxied, and not served from disk either
+    EXPECT_EQ("HTTP/1.1 404 Not Found", fetchStatusLine(port, "/apis"));
+    // Over the connection kept from the first request
+    EXPECT_EQ(1, connections);
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    shutdown(backend, SHUT_RDWR);
+    backend_thread.join();
+}
+
+TEST(HttpServerTests, DropsFieldsNamedByConnectionBothWays) {
+    auto backend_options = createServerOptions(0);
+    const auto backend = internal::createServerSocket(backend_options);
+    const auto backend_port = internal::getPort(backend);
+    ASSERT_NE(-1, fcntl(backend, F_SETFL, 0));
+
+    auto options = createServerOptions(0);
+    options.proxies.push_back(ParseProxy("/api=127.0.0.1:" + std::to_string(backend_port)));
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    std::string forwarded;
+    std::thread backend_thread {[&backend, &forwarded]() {
+        const Socket sock {accept(backend, nullptr, nullptr)};
+        while (forwarded.find("\r\n\r\n") == forwarded.npos) {
+            char buffer[1024];
+            const auto n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return;
+            }
+            forwarded.append(buffer, n);
+        }
+        const std::string response = "HTTP/1.1 200 OK\r\nConnection: X-Bar\r\nX-Bar: secret\r\n"
+                                     "X-Kept: yes\r\nContent-Length: 2\r\n\r\nok";
+        (void)send(sock, response.data(), response.size(), MSG_NOSIGNAL);
+    }};
+
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+    const std::string get = "GET /api/items HTTP/1.1\r\nConnection: close, X-Foo\r\n"
+                            "X-Foo: secret\r\nX-Other: kept\r\n\r\n";
+    ASSERT_EQ(get.size(), send(sock, get.data(), get.size(), 0));
+    const auto response = readResponse(sock);
+    backend_thread.join();
+
+    EXPECT_TRUE(response.starts_with("HTTP/1.1 200 OK\r\n")) << response;
+    EXPECT_TRUE(response.ends_with("ok")) << response;
+    EXPECT_EQ(response.npos, response.find("X-Bar")) << response;
+    EXPECT_NE(response.npos, response.find("X-Kept: yes")) << response;
+    EXPECT_EQ(forwarded.npos, forwarded.find("x-foo")) << forwarded;
+    EXPECT_NE(forwarded.npos, forwarded.find("x-other: kept")) << forwarded;
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(HttpServerTests, SkipsInterimResponsesSentAlongWithTheFinalOne) {
+    auto backend_options = createServerOptions(0);
+    const auto backend = internal::createServerSocket(backend_options);
+    const auto backend_port = internal::getPort(backend);
+    ASSERT_NE(-1, fcntl(backend, F_SETFL, 0));
+
+    auto options = createServerOptions(0);
+    options.proxies.push_back(ParseProxy("/api=127.0.0.1:" + std::to_string(backend_port)));
+    options.proxy_read_timeout = std::chrono::milliseconds {2000};
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    std::thread backend_thread {[&backend]() {
+        const Socket sock {accept(backend, nullptr, nullptr)};
+        std::string request;
+        while (request.find("\r\n\r\n") == request.npos) {
+            char buffer[1024];
+            const auto n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return;
+            }
+            request.append(buffer, n);
+        }
+        // In a single segment
+        const std::string response = "HTTP/1.1 103 Early Hints\r\nLink: </a.css>\r\n\r\n"
+                                     "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        (void)send(sock, response.data(), response.size(), MSG_NOSIGNAL);
+    }};
+
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+    const std::string get = "GET /api/items HTTP/1.1\r\nConnection: close\r\n\r\n";
+    ASSERT_EQ(get.size(), send(sock, get.data(), get.size(), 0));
+    const auto response = readResponse(sock);
+    backend_thread.join();
+
+    EXPECT_TRUE(response.starts_with("HTTP/1.1 200 OK\r\n")) << response;
+    EXPECT_TRUE(response.ends_with("\r\n\r\nok")) << response;
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(HttpServerTests, CachesProxiedResponses) {
+    auto backend_options = createServerOptions(0);
+    const auto backend = internal::createServerSocket(backend_options);
+    const auto backend_port = internal::getPort(backend);
+    ASSERT_NE(-1, fcntl(backend, F_SETFL, 0));
+
+    auto options = LoadServerOptions({"nginxpp",
+                                      "--proxy",
+                                      "/api=127.0.0.1:" + std::to_string(backend_port),
+                                      "--proxy-cache",
+                                      std::filesystem::temp_directory_path().string(),
+                                      "--proxy-cache-valid=60000",
+                                      "--proxy-cache-vary=Accept-Language"});
+    EXPECT_EQ(std::vector<std::string> {"accept-language"}, options.proxy_cache_vary);
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        bool served = false;
+        // Destroyed before exiting, which removes the cache directory
+        {
+            HttpServer server {options, std::move(listener)};
+            served = server.Run();
+        }
+        _exit(served ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    std::atomic<int> connections = 0;
+    std::thread backend_thread {[&backend, &connections]() {
+        serveBackend(backend, connections);
+    }};
+
+    const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+    const std::string get = "GET /api/items HTTP/1.1\r\nAccept-Language: en\r\n\r\n";
+    ASSERT_EQ(get.size(), send(sock, get.data(), get.size(), 0));
+    const auto miss = readResponse(sock);
+    EXPECT_NE(std::string::npos, miss.find("X-Cache-Status: MISS\r\n")) << miss;
+    EXPECT_TRUE(miss.ends_with("GET /api/items HTTP/1.1|127.0.0.1|")) << miss;
+
+    ASSERT_EQ(get.size(), send(sock, get.data(), get.size(), 0));
+    const auto hit = readResponse(sock);
+    EXPECT_NE(std::string::npos, hit.find("X-Cache-Status: HIT\r\n")) << hit;
+    EXPECT_TRUE(hit.ends_with("GET /api/items HTTP/1.1|127.0.0.1|")) << hit;
+
+    // Another language is another entry
+    const std::string other = "GET /api/items HTTP/1.1\r\nAccept-Language: fr\r\n\r\n";
+    ASSERT_EQ(other.size(), send(sock, other.data(), other.size(), 0));
+    const auto other_miss = readResponse(sock);
+    EXPECT_NE(std::string::npos, other_miss.find("X-Cache-Status: MISS\r\n")) << other_miss;
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::temp_directory_path() /
+                                         ("nginxpp-" + std::to_string(pid))));
+
+    shutdown(backend, SHUT_RDWR);
+    backend_thread.join();
+}
+
+TEST(HttpServerTests, AnswersWith502IfBackendIsDown) {
+    // Bound but not listening, so that connecting is refused
+    const Socket closed {socket(AF_INET, SOCK_STREAM, 0)};
+    sockaddr_in backend {};
+    backend.sin_family = AF_INET;
+    backend.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, bind(closed, reinterpret_cast<const sockaddr *>(&backend), sizeof(backend)));
+    socklen_t length = sizeof(backend);
+    ASSERT_EQ(0, getsockname(closed, reinterpret_cast<sockaddr *>(&backend), &length));
+
+    auto options = createServerOptions(0);
+    options.proxies.push_back(ParseProxy("/=127.0.0.1:" + std::to_string(ntohs(backend.sin_port))));
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    EXPECT_EQ("HTTP/1.1 502 Bad Gateway", fetchStatusLine(port, "/anything"));
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(HttpServerTests, SwitchesToHttp2OnThePreface) {
+    auto options = createServerOptions(0);
+    options.access_log = "off";
+    options.quiet = true;
+    options.threads = 1;
+    auto listener = internal::createServerSocket(options);
+    const auto port = internal::getPort(listener);
+
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        HttpServer server {options, std::move(listener)};
+        _exit(server.Run() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    {
+        const Socket sock {socket(AF_INET, SOCK_STREAM, 0)};
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(0, connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+        std::string preface {HTTP2_PREFACE};
+        AppendFrameHeader(preface, {0, FrameType::SETTINGS, 0, 0});
+        ASSERT_EQ(static_cast<ssize_t>(preface.size()),
+                  send(sock, preface.data(), preface.size(), 0));
+        std::string header(FRAME_HEADER_SIZE, '\0');
+        ASSERT_EQ(static_cast<ssize_t>(header.size()),
+                  recv(sock, header.data(), header.size(), MSG_WAITALL));
+        // The settings of the server, which it sends first
+        EXPECT_EQ(FrameType::SETTINGS, ParseFrameHeader(header).type);
+        EXPECT_EQ(0, ParseFrameHeader(header).stream_id);
+    }
+
+    ASSERT_EQ(0, kill(pid, SIGTERM));
+    int status {};
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
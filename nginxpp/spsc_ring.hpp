@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+#include <nginxpp/memory_utils.hpp>
+
+
+namespace nginxpp {
+
+/// A bounded, lock-free single-producer single-consumer queue.
+/// TryPush() never blocks, it fails instead when the ring is full.
+template<typename T, std::size_t Capacity>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(Capacity > 0 and (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of 2");
+
+public:
+    [[nodiscard]] bool TryPush(const T &item) noexcept {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cached_head == Capacity) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail - m_cached_head == Capacity) {
+                return false;
+            }
+        }
+
+        m_items[tail & MASK] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Calls func on every available item, and returns how many there were.
+    template<typename Function>
+    std::size_t ConsumeAll(const Function &func) noexcept {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        const auto tail = m_tail.load(std::memory_order_acquire);
+        for (auto i = head; i != tail; ++i) {
+            func(m_items[i & MASK]);
+        }
+
+        m_head.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    [[nodiscard]] bool Empty() const noexcept {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr std::size_t MASK = Capacity - 1;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head {0};
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail {0};
+    /// Producer only, saves reading m_head while the ring is known to have room
+    std::size_t m_cached_head = 0;
+    alignas(CACHE_LINE_SIZE) std::array<T, Capacity> m_items;
+};
+
+} //namespace nginxpp
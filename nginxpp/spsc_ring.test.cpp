@@ -0,0 +1,58 @@
+#include <nginxpp/spsc_ring.hpp>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+TEST(SpscRingTests, EmptyByDefault) {
+    SpscRing<int, 4> ring;
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SpscRingTests, PushFailsWhenFull) {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.TryPush(i));
+    }
+    EXPECT_FALSE(ring.TryPush(4));
+
+    std::vector<int> items;
+    EXPECT_EQ(4, ring.ConsumeAll([&items](const int i) {
+        items.push_back(i);
+    }));
+    EXPECT_EQ((std::vector {0, 1, 2, 3}), items);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_TRUE(ring.TryPush(4));
+}
+
+TEST(SpscRingTests, PreservesOrderAcrossThreads) {
+    constexpr int COUNT = 10'000;
+    SpscRing<int, 64> ring;
+
+    std::thread producer([&ring]() {
+        for (int i = 0; i < COUNT;) {
+            if (ring.TryPush(i)) {
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    while (expected < COUNT) {
+        const auto consumed = ring.ConsumeAll([&expected](const int i) {
+            EXPECT_EQ(expected++, i);
+        });
+        if (consumed == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ring.Empty());
+}
@@ -2,7 +2,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <optional>
 #include <string>
+#include <string_view>
 
 
 namespace nginxpp {
@@ -19,4 +22,16 @@ namespace nginxpp {
     return s;
 }
 
+/// The whole string as a decimal number, or nullopt if it is not one or is out of range.
+template<typename T>
+[[nodiscard]] static inline std::optional<T> ParseNumber(const std::string_view str) noexcept {
+    T value {};
+    const auto *const last = str.data() + str.size();
+    if (const auto [end, error] = std::from_chars(str.data(), last, value);
+        error != std::errc {} or end != last) {
+        return std::nullopt;
+    }
+    return value;
+}
+
 } //namespace nginxpp
@@ -29,3 +29,16 @@ TEST(StartsWithTests, ReturnTrueIfGiveRightPrefix) {
 TEST(StartsWithTests, ReturnFalseIfGiveWrongPrefix) {
     ASSERT_FALSE(StartsWith("some_string"s + PREFIX, PREFIX));
 }
+
+TEST(ParseNumberTests, ParsesTheWholeString) {
+    EXPECT_EQ(42, ParseNumber<int>("42"));
+    EXPECT_EQ(0U, ParseNumber<unsigned>("0"));
+}
+
+TEST(ParseNumberTests, RejectsAnythingElse) {
+    EXPECT_FALSE(ParseNumber<int>(""));
+    EXPECT_FALSE(ParseNumber<int>("42s"));
+    EXPECT_FALSE(ParseNumber<int>(" 42"));
+    EXPECT_FALSE(ParseNumber<unsigned>("-1"));
+    EXPECT_FALSE(ParseNumber<unsigned char>("256"));
+}
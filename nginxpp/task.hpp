@@ -0,0 +1,173 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include <nginxpp/frame_allocator.hpp>
+
+
+namespace nginxpp {
+
+template<typename T>
+class Task;
+
+namespace internal {
+
+/// Resumes whoever awaited the task by symmetric transfer, which optimized builds turn into a
+/// tail call, so that chains of tasks completing synchronously do not grow the stack.
+template<typename Promise>
+struct FinalAwaiter {
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+
+    [[nodiscard]] std::coroutine_handle<>
+    await_suspend(const std::coroutine_handle<Promise> handle) const noexcept {
+        if (const auto continuation = handle.promise().continuation; continuation) {
+            return continuation;
+        }
+        return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+template<typename Promise>
+struct PromiseBase : public FrameAllocated {
+    std::coroutine_handle<> continuation;
+
+    [[nodiscard]] std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    [[nodiscard]] FinalAwaiter<Promise> final_suspend() const noexcept {
+        return {};
+    }
+
+    /// Sessions are noexcept from top to bottom, as is the rest of the request path
+    [[noreturn]] void unhandled_exception() const noexcept {
+        std::terminate();
+    }
+};
+
+template<typename T>
+struct Promise : public PromiseBase<Promise<T>> {
+    std::optional<T> value;
+
+    [[nodiscard]] Task<T> get_return_object() noexcept;
+
+    void return_value(T a_value) noexcept {
+        value.emplace(std::move(a_value));
+    }
+
+    [[nodiscard]] T Result() noexcept {
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : public PromiseBase<Promise<void>> {
+    [[nodiscard]] Task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {
+    }
+
+    void Result() const noexcept {
+    }
+};
+
+} //namespace internal
+
+
+/// A lazily started coroutine, which runs when awaited and resumes its awaiter when done.
+/// Its frame comes from the frame allocator of the thread.
+template<typename T = void>
+class [[nodiscard]] Task {
+public:
+    using promise_type = internal::Promise<T>;
+
+    explicit Task(const std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {
+    }
+
+    ~Task() noexcept {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    Task(Task &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {
+    }
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            std::swap(m_handle, other.m_handle);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+
+    [[nodiscard]] std::coroutine_handle<>
+    await_suspend(const std::coroutine_handle<> continuation) const noexcept {
+        m_handle.promise().continuation = continuation;
+        return m_handle;
+    }
+
+    T await_resume() const noexcept {
+        return m_handle.promise().Result();
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+
+namespace internal {
+
+template<typename T>
+inline Task<T> Promise<T>::get_return_object() noexcept {
+    return Task<T> {std::coroutine_handle<Promise<T>>::from_promise(*this)};
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+    return Task<void> {std::coroutine_handle<Promise<void>>::from_promise(*this)};
+}
+
+} //namespace internal
+
+
+/// A coroutine that starts right away, and frees itself once done. Nothing awaits it, so it
+/// must own everything it uses, e.g. a whole session.
+class DetachedTask {
+public:
+    struct promise_type : public FrameAllocated {
+        [[nodiscard]] DetachedTask get_return_object() const noexcept {
+            return {};
+        }
+
+        [[nodiscard]] std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+
+        [[nodiscard]] std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+
+        void return_void() const noexcept {
+        }
+
+        [[noreturn]] void unhandled_exception() const noexcept {
+            std::terminate();
+        }
+    };
+};
+
+} //namespace nginxpp
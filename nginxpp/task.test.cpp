@@ -0,0 +1,97 @@
+#include <nginxpp/task.hpp>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+Task<int> answer() {
+    co_return 42;
+}
+
+Task<std::string> describe(const int depth) {
+    if (depth == 0) {
+        co_return std::to_string(co_await answer());
+    }
+    co_return '(' + co_await describe(depth - 1) + ')';
+}
+
+Task<int> count(const int depth) {
+    if (depth == 0) {
+        co_return 0;
+    }
+    co_return co_await count(depth - 1) + 1;
+}
+
+template<typename T>
+DetachedTask store(Task<T> task, T &result) {
+    result = co_await task;
+}
+
+/// Suspends until resumed by hand.
+struct Gate {
+    std::coroutine_handle<> waiter;
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(const std::coroutine_handle<> handle) noexcept {
+        waiter = handle;
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+Task<> passThrough(Gate &gate, int &steps) {
+    ++steps;
+    co_await gate;
+    ++steps;
+}
+
+DetachedTask run(Gate &gate, int &steps) {
+    co_await passThrough(gate, steps);
+    ++steps;
+}
+
+} //namespace
+
+
+TEST(TaskTests, TasksAreLazy) {
+    bool started = false;
+    const auto task = [&started]() -> Task<> {
+        started = true;
+        co_return;
+    }();
+    EXPECT_FALSE(started);
+}
+
+TEST(TaskTests, CanChainTasks) {
+    std::string result;
+    store(describe(3), result);
+    EXPECT_EQ("(((42)))", result);
+}
+
+TEST(TaskTests, CanAwaitLongChains) {
+    int result = 0;
+    store(count(10'000), result);
+    EXPECT_EQ(10'000, result);
+}
+
+TEST(TaskTests, ResumesAwaiterOnCompletion) {
+    Gate gate;
+    int steps = 0;
+
+    run(gate, steps);
+    EXPECT_EQ(1, steps);
+    ASSERT_TRUE(gate.waiter);
+
+    gate.waiter.resume();
+    EXPECT_EQ(3, steps);
+}
@@ -0,0 +1,146 @@
+#include <nginxpp/timer_wheel.hpp>
+
+#include <algorithm>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::uint64_t SLOT_MASK = TimerWheel::SLOT_COUNT - 1;
+
+/// Furthest a timer can be placed from now
+constexpr std::uint64_t MAX_DELTA =
+    (std::uint64_t {1} << (TimerWheel::LEVEL_BITS * TimerWheel::LEVEL_COUNT)) - 1;
+
+[[nodiscard]] inline constexpr std::size_t shiftOf(const std::size_t level) noexcept {
+    return TimerWheel::LEVEL_BITS * level;
+}
+
+/// Whether the tick starts a new rotation of the slots of the level below
+[[nodiscard]] inline constexpr bool isBoundary(const std::uint64_t tick,
+                                               const std::size_t level) noexcept {
+    return (tick & ((std::uint64_t {1} << shiftOf(level)) - 1)) == 0;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+TimerWheel::TimerWheel(const Clock::time_point now) noexcept : m_origin(now) {
+}
+
+void TimerWheel::Schedule(Timer &timer, const Clock::time_point deadline) noexcept {
+    Cancel(timer);
+
+    // Rounded up, so that a timer never expires early
+    const auto expiry =
+        deadline <= m_origin ? 0 : std::chrono::ceil<Tick>(deadline - m_origin).count();
+    timer.m_expiry = std::max<std::uint64_t>(expiry, m_now + 1);
+    insert(timer);
+    ++m_size;
+}
+
+void TimerWheel::Cancel(Timer &timer) noexcept {
+    if (not timer.Scheduled()) {
+        return;
+    }
+
+    timer.m_prev->m_next = timer.m_next;
+    timer.m_next->m_prev = timer.m_prev;
+    timer.m_prev = nullptr;
+    timer.m_next = nullptr;
+    --m_size;
+}
+
+void TimerWheel::Advance(const Clock::time_point now, std::vector<Timer *> &expired) noexcept {
+    const auto target = toTick(now);
+    while (m_now < target) {
+        ++m_now;
+
+        // Higher levels first, so that timers cascading down land in slots yet to be visited
+        for (auto level = LEVEL_COUNT - 1; level > 0; --level) {
+            if (isBoundary(m_now, level)) {
+                cascade(level);
+            }
+        }
+
+        auto &slot = m_levels[0][m_now & SLOT_MASK];
+        while (not slot.Empty()) {
+            auto &timer = *slot.head.m_next;
+            Cancel(timer);
+            if (timer.m_expiry <= m_now) {
+                expired.push_back(&timer);
+            } else {
+                // Parked out of range, and still not due
+                insert(timer);
+                ++m_size;
+            }
+        }
+    }
+}
+
+TimerWheel::Clock::duration TimerWheel::NextTimeout(const Clock::time_point now,
+                                                    const Clock::duration max) const noexcept {
+    if (m_size == 0) {
+        return max;
+    }
+
+    const auto has_work_at = [this](const std::uint64_t tick) {
+        if (not m_levels[0][tick & SLOT_MASK].Empty()) {
+            return true;
+        }
+        for (std::size_t level = 1; level < LEVEL_COUNT and isBoundary(tick, level); ++level) {
+            if (not m_levels[level][(tick >> shiftOf(level)) & SLOT_MASK].Empty()) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Timers only reach the lowest level on boundaries, so the boundaries of each level are
+    // all that need checking beyond the lowest one
+    for (std::size_t level = 0; level < LEVEL_COUNT; ++level) {
+        for (std::uint64_t i = 1; i <= SLOT_COUNT; ++i) {
+            const auto tick = ((m_now >> shiftOf(level)) + i) << shiftOf(level);
+            if (has_work_at(tick)) {
+                const auto left = m_origin + Tick {tick} - now;
+                return std::clamp(left, Clock::duration::zero(), max);
+            }
+        }
+    }
+    return max;
+}
+
+std::uint64_t TimerWheel::toTick(const Clock::time_point time) const noexcept {
+    return time <= m_origin ? 0 : std::chrono::floor<Tick>(time - m_origin).count();
+}
+
+void TimerWheel::insert(Timer &timer) noexcept {
+    const auto delta = std::min(timer.m_expiry - std::min(timer.m_expiry, m_now), MAX_DELTA);
+
+    std::size_t level = 0;
+    while (level + 1 < LEVEL_COUNT and delta >> shiftOf(level + 1)) {
+        ++level;
+    }
+
+    auto &head = m_levels[level][((m_now + delta) >> shiftOf(level)) & SLOT_MASK].head;
+    timer.m_prev = head.m_prev;
+    timer.m_next = &head;
+    head.m_prev->m_next = &timer;
+    head.m_prev = &timer;
+}
+
+void TimerWheel::cascade(const std::size_t level) noexcept {
+    auto &slot = m_levels[level][(m_now >> shiftOf(level)) & SLOT_MASK];
+    while (not slot.Empty()) {
+        auto &timer = *slot.head.m_next;
+        Cancel(timer);
+        insert(timer);
+        ++m_size;
+    }
+}
+
+} //namespace nginxpp
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace nginxpp {
+
+/// Hierarchical timing wheel: 4 levels of 64 slots, with a tick of 1ms at the lowest level,
+/// so scheduling and cancelling are O(1) whatever the number of timers. Timers further out
+/// than the range of the wheel, about 4.6 hours, are parked in its last level until they are
+/// in range. Not thread-safe; every event loop owns one.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Tick = std::chrono::milliseconds;
+
+    static constexpr std::size_t LEVEL_BITS = 6;
+    static constexpr std::size_t SLOT_COUNT = std::size_t {1} << LEVEL_BITS;
+    static constexpr std::size_t LEVEL_COUNT = 4;
+
+    /// Intrusive, so that scheduling never allocates. Embed it in whatever waits.
+    class Timer {
+    public:
+        Timer() noexcept = default;
+
+        ~Timer() noexcept = default;
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        [[nodiscard]] bool Scheduled() const noexcept {
+            return m_prev != nullptr;
+        }
+
+    private:
+        friend class TimerWheel;
+
+        Timer *m_prev = nullptr;
+        Timer *m_next = nullptr;
+        std::uint64_t m_expiry = 0;
+    };
+
+    explicit TimerWheel(const Clock::time_point now = Clock::now()) noexcept;
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    /// Schedules the timer, or reschedules it if already scheduled. A deadline already passed
+    /// expires on the next tick.
+    void Schedule(Timer &timer, const Clock::time_point deadline) noexcept;
+
+    /// Does nothing if the timer is not scheduled.
+    void Cancel(Timer &timer) noexcept;
+
+    /// Moves the wheel forward to now, appending the timers that expired on the way.
+    void Advance(const Clock::time_point now, std::vector<Timer *> &expired) noexcept;
+
+    /// How long until the wheel may have something to expire, at most the given maximum.
+    [[nodiscard]] Clock::duration NextTimeout(const Clock::time_point now,
+                                              const Clock::duration max) const noexcept;
+
+    [[nodiscard]] std::size_t Size() const noexcept {
+        return m_size;
+    }
+
+private:
+    /// Circular list heads; a sentinel, so that linking and unlinking never branch
+    struct Slot {
+        Timer head;
+
+        Slot() noexcept {
+            head.m_prev = &head;
+            head.m_next = &head;
+        }
+
+        [[nodiscard]] bool Empty() const noexcept {
+            return head.m_next == &head;
+        }
+    };
+
+    [[nodiscard]] std::uint64_t toTick(const Clock::time_point time) const noexcept;
+
+    void insert(Timer &timer) noexcept;
+
+    void cascade(const std::size_t level) noexcept;
+
+    Clock::time_point m_origin;
+    std::uint64_t m_now = 0;
+    std::size_t m_size = 0;
+    std::array<std::array<Slot, SLOT_COUNT>, LEVEL_COUNT> m_levels;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,140 @@
+#include <nginxpp/timer_wheel.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+using Clock = TimerWheel::Clock;
+
+class TimerWheelTests : public ::testing::Test {
+protected:
+    /// Advances to the given offset from the origin, returning the timers that expired
+    std::vector<TimerWheel::Timer *> advanceTo(const Clock::duration offset) {
+        std::vector<TimerWheel::Timer *> expired;
+        m_wheel.Advance(m_origin + offset, expired);
+        return expired;
+    }
+
+    /// Advances in steps, returning the offset at which the timer expired
+    Clock::duration expiryOf(const TimerWheel::Timer &timer, const Clock::duration step) {
+        for (auto offset = step; offset < 24h; offset += step) {
+            advanceTo(offset);
+            if (not timer.Scheduled()) {
+                return offset;
+            }
+        }
+        return Clock::duration::max();
+    }
+
+    const Clock::time_point m_origin = Clock::now();
+    TimerWheel m_wheel {m_origin};
+};
+
+} //namespace
+
+
+TEST_F(TimerWheelTests, ExpiresOnTime) {
+    for (const auto delay : {1ms, 63ms, 64ms, 65ms, 4095ms, 4096ms, 262'145ms}) {
+        TimerWheel wheel {m_origin};
+        TimerWheel::Timer timer;
+        wheel.Schedule(timer, m_origin + delay);
+
+        std::vector<TimerWheel::Timer *> expired;
+        wheel.Advance(m_origin + delay - 1ms, expired);
+        EXPECT_TRUE(expired.empty()) << delay.count();
+
+        wheel.Advance(m_origin + delay, expired);
+        ASSERT_EQ(1, expired.size()) << delay.count();
+        EXPECT_EQ(&timer, expired.front());
+        EXPECT_EQ(0, wheel.Size());
+    }
+}
+
+TEST_F(TimerWheelTests, NeverExpiresEarly) {
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin + 1500us);
+
+    EXPECT_TRUE(advanceTo(1ms).empty());
+    EXPECT_EQ(1, advanceTo(2ms).size());
+}
+
+TEST_F(TimerWheelTests, ExpiresBeyondTheRangeOfTheWheel) {
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin + 6h);
+
+    const auto expiry = expiryOf(timer, 1min);
+    EXPECT_LE(6h, expiry);
+    EXPECT_GT(6h + 1min, expiry);
+}
+
+TEST_F(TimerWheelTests, PassedDeadlineExpiresOnNextTick) {
+    advanceTo(10ms);
+
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin);
+    EXPECT_EQ(1, advanceTo(11ms).size());
+}
+
+TEST_F(TimerWheelTests, CancelledTimerDoesNotExpire) {
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin + 10ms);
+    m_wheel.Cancel(timer);
+
+    EXPECT_FALSE(timer.Scheduled());
+    EXPECT_EQ(0, m_wheel.Size());
+    EXPECT_TRUE(advanceTo(1s).empty());
+}
+
+TEST_F(TimerWheelTests, RescheduleMovesTheDeadline) {
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin + 10ms);
+    m_wheel.Schedule(timer, m_origin + 5s);
+    EXPECT_EQ(1, m_wheel.Size());
+
+    EXPECT_TRUE(advanceTo(4999ms).empty());
+    EXPECT_EQ(1, advanceTo(5s).size());
+}
+
+TEST_F(TimerWheelTests, ExpiresInDeadlineOrder) {
+    std::vector<TimerWheel::Timer> timers(100);
+    for (std::size_t i = 0; i < timers.size(); ++i) {
+        m_wheel.Schedule(timers[i], m_origin + std::chrono::milliseconds {(i * 37) % 1000 + 1});
+    }
+    EXPECT_EQ(timers.size(), m_wheel.Size());
+
+    std::size_t count = 0;
+    for (auto offset = 1ms; offset <= 1000ms; ++offset) {
+        for (auto *const timer : advanceTo(offset)) {
+            const auto i = static_cast<std::size_t>(timer - timers.data());
+            EXPECT_EQ(offset.count(), (i * 37) % 1000 + 1);
+            ++count;
+        }
+    }
+    EXPECT_EQ(timers.size(), count);
+}
+
+TEST_F(TimerWheelTests, NextTimeoutIsMaxWhenEmpty) {
+    EXPECT_EQ(Clock::duration {1s}, m_wheel.NextTimeout(m_origin, 1s));
+}
+
+TEST_F(TimerWheelTests, NextTimeoutIsNeverLate) {
+    TimerWheel::Timer timer;
+    m_wheel.Schedule(timer, m_origin + 300ms);
+
+    // Waking up early only costs a cascade; waking up late would delay the timer
+    for (auto now = m_origin; timer.Scheduled();) {
+        const auto timeout = m_wheel.NextTimeout(now, 1h);
+        EXPECT_GE(m_origin + 300ms - now, timeout);
+        ASSERT_LT(Clock::duration::zero(), timeout);
+        now += timeout;
+        std::vector<TimerWheel::Timer *> expired;
+        m_wheel.Advance(now, expired);
+    }
+}
@@ -0,0 +1,320 @@
+#include <nginxpp/tls.hpp>
+
+#include <memory>
+
+#include <errno.h>
+
+#ifdef NGINXPP_HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#endif
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+#ifdef NGINXPP_HAVE_OPENSSL
+
+/// Empties the error queue of the thread, for the next operation to tell its own error.
+/// Returns the first error, which is the cause of the others.
+[[nodiscard]] std::string takeErrors() {
+    const auto first = ERR_get_error();
+    ERR_clear_error();
+    if (first == 0) {
+        return "unknown error";
+    }
+    std::string reason(256, '\0');
+    ERR_error_string_n(first, reason.data(), reason.size());
+    reason.resize(reason.find('\0'));
+    return reason;
+}
+
+/// Picks the first protocol served that the client offers, h2 ahead of http/1.1; with none,
+/// the handshake goes on without ALPN.
+int selectProtocol(SSL *,
+                   const unsigned char **out,
+                   unsigned char *out_length,
+                   const unsigned char *in,
+                   const unsigned int in_length,
+                   void *arg) noexcept {
+    const auto &options = *static_cast<const TlsOptions *>(arg);
+    const std::string_view offered {reinterpret_cast<const char *>(in), in_length};
+    for (const auto protocol : {ALPN_H2, ALPN_HTTP_1_1}) {
+        if (protocol == ALPN_H2 and not options.http2) {
+            continue;
+        }
+        // Each name is prefixed with its length
+        for (std::size_t i = 0; i < offered.size();) {
+            const auto length = static_cast<unsigned char>(offered[i]);
+            if (offered.substr(i + 1, length) == protocol) {
+                *out = in + i + 1;
+                *out_length = length;
+                return SSL_TLSEXT_ERR_OK;
+            }
+            i += 1 + length;
+        }
+    }
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+#endif
+
+} //namespace
+
+
+namespace nginxpp {
+
+#ifdef NGINXPP_HAVE_OPENSSL
+
+bool TlsSupported() noexcept {
+    return true;
+}
+
+std::string GenerateTicketKey() {
+    std::string key(TLS_TICKET_KEY_SIZE, '\0');
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(key.data()), key.size()) != 1) {
+        throw ServerException("Failed to generate TLS ticket key: " + takeErrors());
+    }
+    return key;
+}
+
+
+TlsContext::TlsContext(const TlsOptions &options) : m_options(options) {
+    std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> context {
+        SSL_CTX_new(TLS_server_method()), SSL_CTX_free};
+    if (not context) {
+        throw ServerException("Failed to create TLS context: " + takeErrors());
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(context.get(), m_options.certificate.c_str()) != 1) {
+        throw ServerException("Failed to load TLS certificate " + m_options.certificate + ": " +
+                              takeErrors());
+    }
+    if (SSL_CTX_use_PrivateKey_file(context.get(), m_options.key.c_str(), SSL_FILETYPE_PEM) !=
+        1) {
+        throw ServerException("Failed to load TLS key " + m_options.key + ": " + takeErrors());
+    }
+    if (SSL_CTX_check_private_key(context.get()) != 1) {
+        throw ServerException("TLS key " + m_options.key + " does not match certificate " +
+                              m_options.certificate + ": " + takeErrors());
+    }
+
+    (void)SSL_CTX_set_min_proto_version(context.get(), TLS1_2_VERSION);
+    // Clients that close without close_notify are common, and harmless to a server that
+    // tells where its responses end
+    auto tls_options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE |
+                       SSL_OP_IGNORE_UNEXPECTED_EOF;
+    if (m_options.ktls) {
+        tls_options |= SSL_OP_ENABLE_KTLS;
+    }
+    (void)SSL_CTX_set_options(context.get(), tls_options);
+    // Writes as send() does, and holds no buffers while the connection is idle
+    (void)SSL_CTX_set_mode(context.get(),
+                           SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                               SSL_MODE_RELEASE_BUFFERS);
+
+    (void)SSL_CTX_set_session_cache_mode(context.get(), SSL_SESS_CACHE_OFF);
+    if (not m_options.ticket_key.empty()) {
+        if (m_options.ticket_key.size() != TLS_TICKET_KEY_SIZE) {
+            throw ServerException("TLS ticket key must be " +
+                                  std::to_string(TLS_TICKET_KEY_SIZE) + " bytes");
+        }
+        if (SSL_CTX_set_tlsext_ticket_keys(
+                context.get(), m_options.ticket_key.data(), m_options.ticket_key.size()) != 1) {
+            throw ServerException("Failed to set TLS ticket key: " + takeErrors());
+        }
+    }
+
+    SSL_CTX_set_alpn_select_cb(context.get(), selectProtocol, &m_options);
+
+    m_context = context.release();
+}
+
+TlsContext::~TlsContext() noexcept {
+    SSL_CTX_free(m_context);
+}
+
+
+TlsStream::TlsStream(const TlsContext &context, const int fd) noexcept :
+    m_ssl(SSL_new(context.m_context)) {
+    if (m_ssl) {
+        (void)SSL_set_fd(m_ssl, fd);
+        SSL_set_accept_state(m_ssl);
+    }
+}
+
+TlsStream::~TlsStream() noexcept {
+    if (not m_ssl) {
+        return;
+    }
+    // Not after a fatal error, which leaves nothing to tell the peer
+    if (not m_broken and SSL_is_init_finished(m_ssl)) {
+        (void)SSL_shutdown(m_ssl);
+        ERR_clear_error();
+    }
+    SSL_free(m_ssl);
+}
+
+int TlsStream::Handshake() noexcept {
+    if (not m_ssl) {
+        errno = ENOMEM;
+        return -1;
+    }
+    const auto result = SSL_do_handshake(m_ssl);
+    if (result == 1) {
+        m_wants_write = false;
+        return 1;
+    }
+    // The end of the stream before the handshake is done is a failure
+    if (fail(result) == 0) {
+        errno = ECONNRESET;
+    }
+    return -1;
+}
+
+long TlsStream::Read(const gsl::span<char> buffer) noexcept {
+    std::size_t read = 0;
+    const auto result = SSL_read_ex(m_ssl, buffer.data(), buffer.size(), &read);
+    if (result == 1) {
+        m_wants_write = false;
+        return static_cast<long>(read);
+    }
+    return fail(result);
+}
+
+long TlsStream::Write(const std::string_view data) noexcept {
+    std::size_t written = 0;
+    const auto result = SSL_write_ex(m_ssl, data.data(), data.size(), &written);
+    if (result == 1) {
+        m_wants_write = false;
+        return static_cast<long>(written);
+    }
+    return fail(result);
+}
+
+long TlsStream::SendFile(const int fd, const off_t offset, const std::size_t length) noexcept {
+    const auto sent = SSL_sendfile(m_ssl, fd, offset, length, 0);
+    if (sent >= 0) {
+        m_wants_write = false;
+        return static_cast<long>(sent);
+    }
+    return fail(static_cast<int>(sent));
+}
+
+bool TlsStream::HasPending() const noexcept {
+    return SSL_has_pending(m_ssl) == 1;
+}
+
+bool TlsStream::KernelSend() const noexcept {
+    return BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+}
+
+std::string_view TlsStream::Protocol() const noexcept {
+    const unsigned char *data = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(m_ssl, &data, &length);
+    return {reinterpret_cast<const char *>(data), length};
+}
+
+bool TlsStream::Resumed() const noexcept {
+    return SSL_session_reused(m_ssl) == 1;
+}
+
+long TlsStream::fail(const int result) noexcept {
+    const auto error = SSL_get_error(m_ssl, result);
+    m_wants_write = error == SSL_ERROR_WANT_WRITE;
+    switch (error) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        // As the system call left errno, which is not one to wait on
+        m_broken = true;
+        ERR_clear_error();
+        if (errno == 0 or errno == EAGAIN or errno == EWOULDBLOCK) {
+            errno = ECONNRESET;
+        }
+        return -1;
+    default:
+        m_broken = true;
+        ERR_clear_error();
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+#else
+
+bool TlsSupported() noexcept {
+    return false;
+}
+
+std::string GenerateTicketKey() {
+    return {};
+}
+
+
+TlsContext::TlsContext(const TlsOptions &options) : m_options(options) {
+    throw ServerException("TLS is not supported, as nginxpp was built without OpenSSL");
+}
+
+TlsContext::~TlsContext() noexcept = default;
+
+
+TlsStream::TlsStream(const TlsContext &, const int) noexcept {
+}
+
+TlsStream::~TlsStream() noexcept = default;
+
+int TlsStream::Handshake() noexcept {
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+long TlsStream::Read(const gsl::span<char>) noexcept {
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+long TlsStream::Write(const std::string_view) noexcept {
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+long TlsStream::SendFile(const int, const off_t, const std::size_t) noexcept {
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+bool TlsStream::HasPending() const noexcept {
+    return false;
+}
+
+bool TlsStream::KernelSend() const noexcept {
+    return false;
+}
+
+std::string_view TlsStream::Protocol() const noexcept {
+    return {};
+}
+
+bool TlsStream::Resumed() const noexcept {
+    return false;
+}
+
+long TlsStream::fail(const int) noexcept {
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+#endif
+
+} //namespace nginxpp
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <sys/types.h>
+
+#include <gsl/gsl>
+
+
+struct ssl_ctx_st;
+struct ssl_st;
+
+
+namespace nginxpp {
+
+/// A 16-byte key name, followed by the HMAC and AES keys that session tickets are protected
+/// with, as OpenSSL takes them
+constexpr std::size_t TLS_TICKET_KEY_SIZE = 80;
+
+constexpr std::string_view ALPN_HTTP_1_1 = "http/1.1";
+constexpr std::string_view ALPN_H2 = "h2";
+
+/// Whether this build serves TLS, i.e. was built with OpenSSL.
+[[nodiscard]] bool TlsSupported() noexcept;
+
+/// Random, for the workers of a master to share, so that each resumes the sessions of the
+/// others. Throws ServerException if there is not enough entropy.
+[[nodiscard]] std::string GenerateTicketKey();
+
+struct TlsOptions {
+    /// PEM files, the certificate followed by its chain
+    std::string certificate;
+    std::string key;
+    /// TLS_TICKET_KEY_SIZE bytes
+    std::string ticket_key;
+    /// Offers h2 over ALPN, ahead of http/1.1
+    bool http2 = false;
+    /// Hands the record layer over to the kernel after the handshake, where it can take it
+    bool ktls = true;
+};
+
+
+/// What the connections of a listener share: the certificate, the protocols, and the key of
+/// the session tickets that resume them. Sessions are resumed from tickets only, so that
+/// resuming holds no state in the server, and works in any worker that shares the key.
+class TlsContext {
+public:
+    /// Throws ServerException if the certificate or the key cannot be loaded, do not match,
+    /// or if TLS is not supported.
+    explicit TlsContext(const TlsOptions &options);
+
+    ~TlsContext() noexcept;
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    [[nodiscard]] const TlsOptions &Options() const noexcept {
+        return m_options;
+    }
+
+private:
+    friend class TlsStream;
+
+    TlsOptions m_options;
+    ssl_ctx_st *m_context = nullptr;
+};
+
+
+/// The server end of a TLS connection over a non-blocking socket, which it does not own. Its
+/// operations return as the system calls they stand for do: -1 with errno set to EAGAIN if
+/// they have to wait for the socket, to be readable unless WantsWrite(), or to EPROTO if
+/// the peer broke the protocol.
+class TlsStream {
+public:
+    TlsStream(const TlsContext &context, const int fd) noexcept;
+
+    /// Sends close_notify, if the handshake was done, without waiting for the reply.
+    ~TlsStream() noexcept;
+
+    TlsStream(const TlsStream &) = delete;
+    TlsStream &operator=(const TlsStream &) = delete;
+
+    /// Returns 1 once done.
+    [[nodiscard]] int Handshake() noexcept;
+
+    /// Returns 0 at close_notify, or at the end of the stream.
+    [[nodiscard]] long Read(const gsl::span<char> buffer) noexcept;
+
+    /// Encrypts part of the data if it cannot send all of it; must be called again with the
+    /// same data after EAGAIN.
+    [[nodiscard]] long Write(const std::string_view data) noexcept;
+
+    /// Sends part of a file, encrypted by the kernel; only if KernelSend().
+    [[nodiscard]] long
+    SendFile(const int fd, const off_t offset, const std::size_t length) noexcept;
+
+    [[nodiscard]] bool WantsWrite() const noexcept {
+        return m_wants_write;
+    }
+
+    /// Whether data was decrypted already, and waits to be read without the socket being
+    /// readable.
+    [[nodiscard]] bool HasPending() const noexcept;
+
+    /// Whether the kernel encrypts what is sent, so that files are sent without being read in.
+    [[nodiscard]] bool KernelSend() const noexcept;
+
+    /// Negotiated over ALPN; empty if the client did not offer any that is served.
+    [[nodiscard]] std::string_view Protocol() const noexcept;
+
+    [[nodiscard]] bool Resumed() const noexcept;
+
+private:
+    /// Sets errno from the error of the last operation, and returns -1.
+    long fail(const int result) noexcept;
+
+    ssl_st *m_ssl = nullptr;
+    bool m_wants_write = false;
+    /// After a fatal error, which leaves the connection unusable
+    bool m_broken = false;
+};
+
+} //namespace nginxpp
@@ -0,0 +1,298 @@
+#include <nginxpp/tls.hpp>
+
+#include <array>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <nginxpp/async_socket.hpp>
+#include <nginxpp/event_loop.hpp>
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+using UniqueKey = std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+using UniqueCertificate = std::unique_ptr<X509, decltype(&X509_free)>;
+using UniqueContext = std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)>;
+using UniqueSsl = std::unique_ptr<SSL, decltype(&SSL_free)>;
+using UniqueSession = std::unique_ptr<SSL_SESSION, decltype(&SSL_SESSION_free)>;
+
+/// Self-signed, for localhost
+[[nodiscard]] UniqueCertificate makeCertificate(EVP_PKEY *const key) {
+    UniqueCertificate certificate {X509_new(), X509_free};
+    (void)X509_set_version(certificate.get(), 2);
+    (void)ASN1_INTEGER_set(X509_get_serialNumber(certificate.get()), 1);
+    (void)X509_gmtime_adj(X509_getm_notBefore(certificate.get()), 0);
+    (void)X509_gmtime_adj(X509_getm_notAfter(certificate.get()), 3600);
+    (void)X509_set_pubkey(certificate.get(), key);
+    auto *const name = X509_get_subject_name(certificate.get());
+    (void)X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    (void)X509_set_issuer_name(certificate.get(), name);
+    (void)X509_sign(certificate.get(), key, EVP_sha256());
+    return certificate;
+}
+
+void writeCertificate(const std::filesystem::path &path, X509 *const certificate) {
+    std::unique_ptr<FILE, decltype(&fclose)> file {fopen(path.c_str(), "w"), fclose};
+    ASSERT_TRUE(file);
+    ASSERT_EQ(1, PEM_write_X509(file.get(), certificate));
+}
+
+void writeKey(const std::filesystem::path &path, EVP_PKEY *const key) {
+    std::unique_ptr<FILE, decltype(&fclose)> file {fopen(path.c_str(), "w"), fclose};
+    ASSERT_TRUE(file);
+    ASSERT_EQ(1, PEM_write_PrivateKey(file.get(), key, nullptr, nullptr, 0, nullptr, nullptr));
+}
+
+struct FilePart {
+    int fd = -1;
+    off_t offset = 0;
+    std::size_t length = 0;
+};
+
+struct Served {
+    bool handshaken = false;
+    std::string protocol;
+    bool resumed = false;
+};
+
+/// Echoes what it reads, but for "file", which it answers with the file
+DetachedTask serve(EventLoop &loop,
+                   const int fd,
+                   const TlsContext &context,
+                   const FilePart file,
+                   std::promise<Served> &served) {
+    AsyncSocket sock {loop, Socket {fd}, 1s, EventLoop::Clock::now()};
+    Served result;
+    result.handshaken = co_await sock.Handshake(context, DeadlineAfter(5s));
+    if (result.handshaken) {
+        result.protocol = sock.Tls()->Protocol();
+        result.resumed = sock.Tls()->Resumed();
+    }
+    std::array<char, 256> buffer {};
+    for (bool sent = result.handshaken; sent;) {
+        const auto n = co_await sock.Read(buffer, DeadlineAfter(5s));
+        if (n <= 0) {
+            break;
+        }
+        const std::string_view request {buffer.data(), static_cast<std::size_t>(n)};
+        if (request == "file") {
+            sent = co_await sock.WriteFile(file.fd, file.offset, file.length);
+        } else {
+            sent = co_await sock.Write(request, {});
+        }
+    }
+    served.set_value(result);
+}
+
+struct Exchanged {
+    Served served;
+    std::string reply;
+    /// To resume from, once the ticket arrived along with the reply
+    UniqueSession session {nullptr, SSL_SESSION_free};
+};
+
+/// The client end of each connection, which blocks on the socket
+class TlsTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // As the server ignores it, for close_notify sent to a peer gone already
+        (void)std::signal(SIGPIPE, SIG_IGN);
+
+        m_directory = std::filesystem::temp_directory_path() /
+                      ("nginxpp_tls_test." + std::to_string(getpid()));
+        std::filesystem::create_directories(m_directory);
+        UniqueKey key {EVP_EC_gen("P-256"), EVP_PKEY_free};
+        ASSERT_TRUE(key);
+        const auto certificate = makeCertificate(key.get());
+        writeCertificate(m_directory / "cert.pem", certificate.get());
+        writeKey(m_directory / "key.pem", key.get());
+        UniqueKey other_key {EVP_EC_gen("P-256"), EVP_PKEY_free};
+        ASSERT_TRUE(other_key);
+        writeKey(m_directory / "other_key.pem", other_key.get());
+
+        m_thread = std::thread([this]() {
+            m_loop.Run();
+        });
+    }
+
+    void TearDown() override {
+        m_loop.Stop();
+        m_thread.join();
+        std::filesystem::remove_all(m_directory);
+    }
+
+    [[nodiscard]] TlsOptions options(const bool http2 = false) const {
+        return {(m_directory / "cert.pem").native(),
+                (m_directory / "key.pem").native(),
+                std::string(TLS_TICKET_KEY_SIZE, 'k'),
+                http2,
+                true};
+    }
+
+    /// Connects, offering h2 and http/1.1, sends the request and reads the reply of the given
+    /// size, then closes.
+    [[nodiscard]] Exchanged exchange(const TlsContext &context,
+                                     const std::string_view request,
+                                     const std::size_t reply_size,
+                                     SSL_SESSION *const session = nullptr,
+                                     const FilePart file = {}) {
+        Exchanged exchanged;
+        std::array<int, 2> fds {};
+        EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()));
+        EXPECT_EQ(0, fcntl(fds[0], F_SETFL, O_NONBLOCK));
+        const timeval timeout {5, 0};
+        EXPECT_EQ(0, setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+
+        std::promise<Served> served;
+        auto result = served.get_future();
+        m_loop.Post([this, fd = fds[0], &context, file, &served]() {
+            serve(m_loop, fd, context, file, served);
+        });
+
+        UniqueContext client_context {SSL_CTX_new(TLS_client_method()), SSL_CTX_free};
+        UniqueSsl ssl {SSL_new(client_context.get()), SSL_free};
+        (void)SSL_set_fd(ssl.get(), fds[1]);
+        constexpr std::string_view protocols = "\x02h2\x08http/1.1";
+        (void)SSL_set_alpn_protos(ssl.get(),
+                                  reinterpret_cast<const unsigned char *>(protocols.data()),
+                                  protocols.size());
+        if (session) {
+            (void)SSL_set_session(ssl.get(), session);
+        }
+        if (SSL_connect(ssl.get()) == 1) {
+            EXPECT_EQ(static_cast<int>(request.size()),
+                      SSL_write(ssl.get(), request.data(), static_cast<int>(request.size())));
+            std::array<char, 16384> buffer {};
+            while (exchanged.reply.size() < reply_size) {
+                const auto n = SSL_read(ssl.get(), buffer.data(), buffer.size());
+                if (n <= 0) {
+                    break;
+                }
+                exchanged.reply.append(buffer.data(), static_cast<std::size_t>(n));
+            }
+            exchanged.session.reset(SSL_get1_session(ssl.get()));
+            (void)SSL_shutdown(ssl.get());
+        }
+        close(fds[1]);
+
+        EXPECT_EQ(std::future_status::ready, result.wait_for(5s));
+        exchanged.served = result.get();
+        return exchanged;
+    }
+
+    std::filesystem::path m_directory;
+    EventLoop m_loop;
+    std::thread m_thread;
+};
+
+} //namespace
+
+
+TEST_F(TlsTests, RejectsAMissingCertificate) {
+    auto missing = options();
+    missing.certificate = (m_directory / "missing.pem").native();
+    EXPECT_THROW(TlsContext {missing}, ServerException);
+}
+
+TEST_F(TlsTests, RejectsAKeyThatDoesNotMatch) {
+    auto mismatched = options();
+    mismatched.key = (m_directory / "other_key.pem").native();
+    EXPECT_THROW(TlsContext {mismatched}, ServerException);
+}
+
+TEST_F(TlsTests, RejectsATicketKeyOfTheWrongSize) {
+    auto short_key = options();
+    short_key.ticket_key = "short";
+    EXPECT_THROW(TlsContext {short_key}, ServerException);
+}
+
+TEST_F(TlsTests, GeneratesDistinctTicketKeys) {
+    const auto key = GenerateTicketKey();
+    EXPECT_EQ(TLS_TICKET_KEY_SIZE, key.size());
+    EXPECT_NE(key, GenerateTicketKey());
+}
+
+TEST_F(TlsTests, EchoesOverTls) {
+    const TlsContext context {options()};
+    const auto exchanged = exchange(context, "hello", 5);
+    EXPECT_TRUE(exchanged.served.handshaken);
+    EXPECT_FALSE(exchanged.served.resumed);
+    EXPECT_EQ("hello", exchanged.reply);
+}
+
+TEST_F(TlsTests, NegotiatesHttp1WithoutHttp2) {
+    const TlsContext context {options()};
+    EXPECT_EQ(ALPN_HTTP_1_1, exchange(context, "hello", 5).served.protocol);
+}
+
+TEST_F(TlsTests, NegotiatesHttp2AheadOfHttp1) {
+    const TlsContext context {options(true)};
+    EXPECT_EQ(ALPN_H2, exchange(context, "hello", 5).served.protocol);
+}
+
+TEST_F(TlsTests, ResumesFromATicket) {
+    const TlsContext context {options()};
+    const auto first = exchange(context, "first", 5);
+    ASSERT_TRUE(first.session);
+
+    const auto second = exchange(context, "second", 6, first.session.get());
+    EXPECT_TRUE(second.served.handshaken);
+    EXPECT_TRUE(second.served.resumed);
+    EXPECT_EQ("second", second.reply);
+}
+
+TEST_F(TlsTests, ResumesInAnotherContextSharingTheTicketKey) {
+    const TlsContext context {options()};
+    const auto first = exchange(context, "first", 5);
+    ASSERT_TRUE(first.session);
+
+    const TlsContext sharing {options()};
+    EXPECT_TRUE(exchange(sharing, "second", 6, first.session.get()).served.resumed);
+
+    auto other_options = options();
+    other_options.ticket_key = GenerateTicketKey();
+    const TlsContext other {other_options};
+    const auto full = exchange(other, "third", 5, first.session.get());
+    EXPECT_TRUE(full.served.handshaken);
+    EXPECT_FALSE(full.served.resumed);
+}
+
+TEST_F(TlsTests, SendsAFile) {
+    const auto path = m_directory / "file";
+    std::string content(100000, '\0');
+    for (std::size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>('a' + i % 26);
+    }
+    std::ofstream {path} << content;
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_NE(-1, fd);
+
+    const TlsContext context {options()};
+    // Read in and encrypted, unless the kernel does it
+    const auto exchanged =
+        exchange(context, "file", content.size() - 1, nullptr, {fd, 1, content.size() - 1});
+    close(fd);
+    EXPECT_EQ(content.substr(1), exchanged.reply);
+}
@@ -0,0 +1,159 @@
+#include <nginxpp/trace.hpp>
+
+#include <deque>
+#include <mutex>
+
+#include <nginxpp/metrics.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+constexpr std::size_t MAX_SLOW_REQUESTS = 256;
+
+[[nodiscard]] inline auto toMicroseconds(const RequestTrace::Clock::duration d) noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+inline void appendJsonEscaped(std::string &out, const std::string_view text) noexcept {
+    constexpr std::string_view HEX_DIGITS = "0123456789abcdef";
+
+    for (const auto c : text) {
+        const auto u = static_cast<unsigned char>(c);
+        if (c == '"' or c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20) {
+            out += "\\u00";
+            out += HEX_DIGITS[u >> 4];
+            out += HEX_DIGITS[u & 0xf];
+        } else {
+            out += c;
+        }
+    }
+}
+
+void appendEvent(std::string &out,
+                 const std::string_view name,
+                 const RequestTrace::Clock::time_point begin,
+                 const RequestTrace::Clock::duration duration,
+                 const unsigned session) noexcept {
+    if (out.back() != '[') {
+        out += ',';
+    }
+    out += "{\"name\":\"";
+    appendJsonEscaped(out, name);
+    out += "\",\"cat\":\"request\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+    out += std::to_string(session);
+    out += ",\"ts\":";
+    out += std::to_string(toMicroseconds(begin.time_since_epoch()));
+    out += ",\"dur\":";
+    out += std::to_string(toMicroseconds(duration));
+    out += '}';
+}
+
+
+class SlowRequestLog {
+public:
+    void Add(SlowRequest slow) noexcept {
+        const std::lock_guard lock {m_mutex};
+        if (m_requests.size() == MAX_SLOW_REQUESTS) {
+            m_requests.pop_front();
+        }
+        m_requests.push_back(std::move(slow));
+    }
+
+    [[nodiscard]] std::vector<SlowRequest> Get() const noexcept {
+        const std::lock_guard lock {m_mutex};
+        return {m_requests.cbegin(), m_requests.cend()};
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::deque<SlowRequest> m_requests;
+};
+
+[[nodiscard]] auto &slowRequestLog() noexcept {
+    // Never destroyed, as detached threads may still record during exit
+    static auto *const LOG = new SlowRequestLog;
+    return *LOG;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+std::string_view ToString(const Span span) noexcept {
+    switch (span) {
+    case Span::PARSE:
+        return "parse";
+    case Span::HANDLE:
+        return "handle";
+    case Span::RESOLVE:
+        return "resolve";
+    case Span::LIST:
+        return "list";
+    case Span::OPEN:
+        return "open";
+    case Span::WRITE:
+        return "write";
+    }
+    return "unknown";
+}
+
+std::string ToString(const SlowRequest &slow) noexcept {
+    std::string line = "slow request [" + std::to_string(slow.session) + "] ";
+    line.append(ToString(slow.method)).append(" /").append(slow.target);
+    line.append(" status=").append(std::to_string(slow.status));
+    line.append(" total_us=").append(std::to_string(toMicroseconds(slow.trace.Total())));
+
+    for (std::size_t i = 0; i < SPAN_COUNT; ++i) {
+        const auto span = static_cast<Span>(i);
+        if (slow.trace.Has(span)) {
+            line.append(" ").append(ToString(span)).append("_us=");
+            line.append(std::to_string(toMicroseconds(slow.trace.Duration(span))));
+        }
+    }
+    return line;
+}
+
+void RecordSlowRequest(SlowRequest slow) noexcept {
+    slowRequestLog().Add(std::move(slow));
+}
+
+std::vector<SlowRequest> RecentSlowRequests() noexcept {
+    return slowRequestLog().Get();
+}
+
+std::string ToChromeTraceJson(const std::vector<SlowRequest> &requests) noexcept {
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for (const auto &slow : requests) {
+        const auto name = std::string {ToString(slow.method)} + " /" + slow.target + ' ' +
+                          std::to_string(slow.status);
+        appendEvent(out,
+                    name,
+                    slow.trace.BeginOf(Span::PARSE),
+                    slow.trace.Total(),
+                    slow.session);
+
+        for (std::size_t i = 0; i < SPAN_COUNT; ++i) {
+            const auto span = static_cast<Span>(i);
+            if (slow.trace.Has(span)) {
+                appendEvent(out,
+                            ToString(span),
+                            slow.trace.BeginOf(span),
+                            slow.trace.Duration(span),
+                            slow.session);
+            }
+        }
+    }
+
+    out += "]}";
+    return out;
+}
+
+} //namespace nginxpp
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nginxpp/message.hpp>
+
+
+namespace nginxpp {
+
+/// RESOLVE, LIST and OPEN are nested in HANDLE.
+enum class Span { PARSE, HANDLE, RESOLVE, LIST, OPEN, WRITE };
+constexpr std::size_t SPAN_COUNT = 6;
+
+[[nodiscard]] std::string_view ToString(const Span span) noexcept;
+
+
+/// Monotonic timestamps of the phases of one request. Spans never entered stay empty.
+class RequestTrace {
+public:
+    /// steady_clock is clock_gettime(CLOCK_MONOTONIC), which the vDSO serves from the TSC
+    using Clock = std::chrono::steady_clock;
+
+    void Begin(const Span span) noexcept {
+        m_begins[index(span)] = Clock::now();
+    }
+
+    void End(const Span span) noexcept {
+        m_ends[index(span)] = Clock::now();
+    }
+
+    [[nodiscard]] bool Has(const Span span) const noexcept {
+        return m_ends[index(span)] != Clock::time_point {};
+    }
+
+    [[nodiscard]] Clock::time_point BeginOf(const Span span) const noexcept {
+        return m_begins[index(span)];
+    }
+
+    [[nodiscard]] Clock::time_point EndOf(const Span span) const noexcept {
+        return m_ends[index(span)];
+    }
+
+    [[nodiscard]] Clock::duration Duration(const Span span) const noexcept {
+        return Has(span) ? m_ends[index(span)] - m_begins[index(span)] : Clock::duration {};
+    }
+
+    /// From the beginning of PARSE to the end of WRITE
+    [[nodiscard]] Clock::duration Total() const noexcept {
+        return m_ends[index(Span::WRITE)] - m_begins[index(Span::PARSE)];
+    }
+
+private:
+    [[nodiscard]] static constexpr std::size_t index(const Span span) noexcept {
+        return static_cast<std::size_t>(span);
+    }
+
+    std::array<Clock::time_point, SPAN_COUNT> m_begins {};
+    std::array<Clock::time_point, SPAN_COUNT> m_ends {};
+};
+
+/// Times a scope as the given span, if there is a trace to record into.
+class ScopedSpan {
+public:
+    ScopedSpan(RequestTrace *const trace, const Span span) noexcept :
+        m_trace(trace), m_span(span) {
+        if (m_trace) {
+            m_trace->Begin(m_span);
+        }
+    }
+
+    ~ScopedSpan() noexcept {
+        if (m_trace) {
+            m_trace->End(m_span);
+        }
+    }
+
+    ScopedSpan(const ScopedSpan &) = delete;
+    ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+private:
+    RequestTrace *m_trace;
+    Span m_span;
+};
+
+
+struct SlowRequest {
+    RequestTrace trace;
+    std::string target;
+    Method method {};
+    int status = 0;
+    unsigned session = 0;
+};
+
+/// Formats the phase breakdown as one line, e.g.
+/// slow request [3] GET /big status=200 total_us=1520 parse_us=12 handle_us=1490 ...
+[[nodiscard]] std::string ToString(const SlowRequest &slow) noexcept;
+
+/// Keeps the most recent slow requests, for export.
+/// Slow requests are expected to be rare, so this simply takes a lock.
+void RecordSlowRequest(SlowRequest slow) noexcept;
+
+[[nodiscard]] std::vector<SlowRequest> RecentSlowRequests() noexcept;
+
+/// Chrome trace-event JSON, which chrome://tracing and Perfetto can load.
+/// Every request is an event on the track of its session, with its spans nested in it.
+[[nodiscard]] std::string ToChromeTraceJson(const std::vector<SlowRequest> &requests) noexcept;
+
+} //namespace nginxpp
@@ -0,0 +1,87 @@
+#include <nginxpp/trace.hpp>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] inline auto createSlowRequest(std::string target) {
+    SlowRequest slow;
+    slow.trace.Begin(Span::PARSE);
+    slow.trace.End(Span::PARSE);
+    slow.trace.Begin(Span::HANDLE);
+    slow.trace.Begin(Span::RESOLVE);
+    std::this_thread::sleep_for(std::chrono::milliseconds {1});
+    slow.trace.End(Span::RESOLVE);
+    slow.trace.End(Span::HANDLE);
+    slow.trace.Begin(Span::WRITE);
+    slow.trace.End(Span::WRITE);
+
+    slow.target = std::move(target);
+    slow.method = Method::GET;
+    slow.status = 200;
+    slow.session = 7;
+    return slow;
+}
+
+} // namespace
+
+
+TEST(RequestTraceTests, SpansNotEnteredAreEmpty) {
+    const auto slow = createSlowRequest("index.html");
+    EXPECT_TRUE(slow.trace.Has(Span::RESOLVE));
+    EXPECT_FALSE(slow.trace.Has(Span::LIST));
+    EXPECT_EQ(RequestTrace::Clock::duration {}, slow.trace.Duration(Span::LIST));
+}
+
+TEST(RequestTraceTests, NestedSpansAreWithinTotal) {
+    const auto slow = createSlowRequest("index.html");
+    EXPECT_LE(std::chrono::milliseconds {1}, slow.trace.Duration(Span::RESOLVE));
+    EXPECT_LE(slow.trace.Duration(Span::RESOLVE), slow.trace.Duration(Span::HANDLE));
+    EXPECT_LE(slow.trace.Duration(Span::HANDLE), slow.trace.Total());
+}
+
+TEST(RequestTraceTests, ScopedSpanIgnoresNullTrace) {
+    RequestTrace trace;
+    {
+        const ScopedSpan span {&trace, Span::LIST};
+        const ScopedSpan no_trace {nullptr, Span::OPEN};
+    }
+    EXPECT_TRUE(trace.Has(Span::LIST));
+    EXPECT_FALSE(trace.Has(Span::OPEN));
+}
+
+
+TEST(SlowRequestTests, CanFormatBreakdown) {
+    const auto line = ToString(createSlowRequest("index.html"));
+    EXPECT_EQ(0, line.find("slow request [7] GET /index.html status=200 total_us="));
+    EXPECT_NE(std::string::npos, line.find(" resolve_us="));
+    EXPECT_EQ(std::string::npos, line.find(" list_us="));
+}
+
+TEST(SlowRequestTests, KeepMostRecent) {
+    RecordSlowRequest(createSlowRequest("first"));
+    RecordSlowRequest(createSlowRequest("last"));
+
+    const auto requests = RecentSlowRequests();
+    ASSERT_LE(2, requests.size());
+    EXPECT_EQ("last", requests.back().target);
+}
+
+TEST(SlowRequestTests, CanExportChromeTrace) {
+    const auto json = ToChromeTraceJson({createSlowRequest("a\"b")});
+    EXPECT_EQ(0, json.find(R"({"displayTimeUnit":"ms","traceEvents":[{"name":"GET /a\"b 200")"));
+    EXPECT_NE(std::string::npos, json.find(R"({"name":"resolve","cat":"request","ph":"X")"));
+    EXPECT_NE(std::string::npos, json.find("\"tid\":7"));
+    EXPECT_EQ(std::string::npos, json.find("\"list\""));
+    EXPECT_EQ("]}", json.substr(json.size() - 2));
+}
+
+TEST(SlowRequestTests, EmptyChromeTrace) {
+    EXPECT_EQ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}", ToChromeTraceJson({}));
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+
+namespace nginxpp {
+
+template<typename... Visitors>
+struct Overloaded : Visitors... {
+    using Visitors::operator()...;
+};
+
+template<typename... Visitors>
+Overloaded(Visitors...) -> Overloaded<Visitors...>;
+
+} //namespace nginxpp
@@ -0,0 +1,132 @@
+#include <nginxpp/vhost.hpp>
+
+#include <algorithm>
+#include <array>
+
+#include <gsl/gsl>
+
+#include <nginxpp/exception.hpp>
+#include <nginxpp/string_utils.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+/// As limited by DNS
+constexpr std::size_t MAX_HOST_SIZE = 253;
+
+constexpr std::string_view WILDCARD_PREFIX = "*.";
+
+[[nodiscard]] inline char toLower(const char c) noexcept {
+    return c >= 'A' and c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/// Dot-separated labels of letters, digits and hyphens, none of them empty
+[[nodiscard]] bool isHostName(const std::string_view name) noexcept {
+    if (name.empty() or name.size() > MAX_HOST_SIZE or name.front() == '.' or
+        name.back() == '.' or name.find("..") != name.npos) {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](const char c) {
+        return (c >= 'a' and c <= 'z') or (c >= '0' and c <= '9') or c == '-' or c == '.';
+    });
+}
+
+[[nodiscard]] bool isServerName(const std::string_view name) noexcept {
+    return isHostName(name.starts_with(WILDCARD_PREFIX) ? name.substr(WILDCARD_PREFIX.size())
+                                                        : name);
+}
+
+/// The host of a Host header, without its port nor trailing dot; an IPv6 literal keeps its
+/// brackets
+[[nodiscard]] std::string_view stripPort(std::string_view host) noexcept {
+    if (host.starts_with('[')) {
+        const auto end = host.find(']');
+        return end == host.npos ? std::string_view {} : host.substr(0, end + 1);
+    }
+    host = host.substr(0, host.find(':'));
+    if (host.ends_with('.')) {
+        host.remove_suffix(1);
+    }
+    return host;
+}
+
+} //namespace
+
+
+namespace nginxpp {
+
+VirtualHostOptions ParseVirtualHost(const std::string_view spec,
+                                    const std::size_t default_cache_entries) {
+    const auto equals = spec.find('=');
+    if (equals == spec.npos or equals + 1 == spec.size()) {
+        throw ConfigException {"Invalid virtual host '" + std::string {spec} +
+                               "': expected NAME[:ENTRIES]=DIR"};
+    }
+
+    VirtualHostOptions host;
+    host.mount_dir = spec.substr(equals + 1);
+    host.header_cache_entries = default_cache_entries;
+
+    auto name = spec.substr(0, equals);
+    if (const auto colon = name.find(':'); colon != name.npos) {
+        const auto entries = ParseNumber<std::size_t>(name.substr(colon + 1));
+        if (not entries) {
+            throw ConfigException {"Invalid header cache size of virtual host '" +
+                                   std::string {spec} + '\''};
+        }
+        host.header_cache_entries = *entries;
+        name = name.substr(0, colon);
+    }
+
+    host.server_name = ToLower(std::string {name});
+    if (not isServerName(host.server_name)) {
+        throw ConfigException {"Invalid server name of virtual host '" + std::string {spec} +
+                               '\''};
+    }
+    return host;
+}
+
+
+HostRouter::HostRouter(const std::vector<VirtualHostOptions> &hosts) {
+    for (std::size_t i = 0; i < hosts.size(); ++i) {
+        const std::string_view name = hosts[i].server_name;
+        Expects(isServerName(name));
+
+        const bool added =
+            name.starts_with(WILDCARD_PREFIX)
+                ? m_wildcards.emplace(name.substr(WILDCARD_PREFIX.size() - 1), i + 1).second
+                : m_exact.emplace(name, i + 1).second;
+        if (not added) {
+            throw ConfigException {"Virtual host '" + std::string {name} + "' given twice"};
+        }
+    }
+}
+
+std::size_t HostRouter::Route(const std::string_view host) const noexcept {
+    const auto stripped = stripPort(host);
+    if (stripped.empty() or stripped.size() > MAX_HOST_SIZE) {
+        return DEFAULT_HOST;
+    }
+
+    // Lowered on the stack, as requests name their host in whatever case
+    std::array<char, MAX_HOST_SIZE> buffer;
+    std::transform(stripped.begin(), stripped.end(), buffer.begin(), toLower);
+    const std::string_view name {buffer.data(), stripped.size()};
+
+    if (const auto exact = m_exact.find(name); exact != m_exact.end()) {
+        return exact->second;
+    }
+    // Longest suffix first, i.e. the most specific wildcard
+    for (auto dot = name.find('.'); dot != name.npos; dot = name.find('.', dot + 1)) {
+        if (const auto wildcard = m_wildcards.find(name.substr(dot));
+            wildcard != m_wildcards.end()) {
+            return wildcard->second;
+        }
+    }
+    return DEFAULT_HOST;
+}
+
+} //namespace nginxpp
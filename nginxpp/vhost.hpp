@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace nginxpp {
+
+/// A site served by name: `example.com` for exactly that host, or `*.example.com` for any of
+/// its subdomains, but not for `example.com` itself.
+struct VirtualHostOptions {
+    std::string server_name;
+    std::string mount_dir;
+    /// Response heads of its files cached per NUMA node, 0 for none
+    std::size_t header_cache_entries = 0;
+};
+
+/// Parses `NAME=DIR`, or `NAME:ENTRIES=DIR` to size the header cache of the host apart from
+/// the default. Names are case-insensitive, and kept in lower case.
+/// Throws ConfigException if malformed.
+[[nodiscard]] VirtualHostOptions ParseVirtualHost(const std::string_view spec,
+                                                  const std::size_t default_cache_entries);
+
+
+/// Routes requests to virtual hosts by their Host header: to the host of that exact name if
+/// any, else to the wildcard host of the longest matching suffix, else to the default host.
+/// Built once per config and only read afterward, so that every loop may share it. A lookup
+/// costs a hash of the host, and one more per label for a name that is not exact.
+class HostRouter {
+public:
+    static constexpr std::size_t DEFAULT_HOST = 0;
+
+    /// Names the virtual hosts 1 and on, in the order given, after the default one.
+    /// Throws ConfigException if a name is given twice.
+    explicit HostRouter(const std::vector<VirtualHostOptions> &hosts);
+
+    /// Ignores case, the port and a trailing dot; DEFAULT_HOST for an empty or invalid host.
+    [[nodiscard]] std::size_t Route(const std::string_view host) const noexcept;
+
+private:
+    struct Hash {
+        using is_transparent = void;
+
+        [[nodiscard]] std::size_t operator()(const std::string_view str) const noexcept {
+            return std::hash<std::string_view> {}(str);
+        }
+    };
+
+    using Names = std::unordered_map<std::string, std::size_t, Hash, std::equal_to<>>;
+
+    Names m_exact;
+    /// By the suffix that follows the `*`, leading dot included
+    Names m_wildcards;
+};
+
+} //namespace nginxpp
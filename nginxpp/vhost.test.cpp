@@ -0,0 +1,89 @@
+#include <nginxpp/vhost.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nginxpp/exception.hpp>
+
+
+using namespace nginxpp;
+
+
+namespace {
+
+[[nodiscard]] HostRouter createRouter(const std::vector<std::string> &specs) {
+    std::vector<VirtualHostOptions> hosts;
+    for (const auto &spec : specs) {
+        hosts.push_back(ParseVirtualHost(spec, 0));
+    }
+    return HostRouter {hosts};
+}
+
+} //namespace
+
+
+TEST(ParseVirtualHostTests, ParsesNameAndMountDirectory) {
+    const auto host = ParseVirtualHost("Example.COM=/srv/example", 16);
+    EXPECT_EQ("example.com", host.server_name);
+    EXPECT_EQ("/srv/example", host.mount_dir);
+    EXPECT_EQ(16, host.header_cache_entries);
+}
+
+TEST(ParseVirtualHostTests, ParsesHeaderCacheSize) {
+    const auto host = ParseVirtualHost("*.example.com:0=/srv/a=b", 16);
+    EXPECT_EQ("*.example.com", host.server_name);
+    EXPECT_EQ("/srv/a=b", host.mount_dir);
+    EXPECT_EQ(0, host.header_cache_entries);
+}
+
+TEST(ParseVirtualHostTests, ThrowIfGivenMalformedSpec) {
+    EXPECT_THROW((void)ParseVirtualHost("example.com", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("example.com=", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("=/srv", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("example.com:lots=/srv", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("exa mple.com=/srv", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("example..com=/srv", 0), ConfigException);
+    EXPECT_THROW((void)ParseVirtualHost("www.*.com=/srv", 0), ConfigException);
+}
+
+TEST(HostRouterTests, RoutesExactNames) {
+    const auto router = createRouter({"example.com=/a", "www.example.com=/b"});
+    EXPECT_EQ(1, router.Route("example.com"));
+    EXPECT_EQ(2, router.Route("www.example.com"));
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route("example.org"));
+}
+
+TEST(HostRouterTests, IgnoresCasePortAndTrailingDot) {
+    const auto router = createRouter({"example.com=/a"});
+    EXPECT_EQ(1, router.Route("EXAMPLE.com"));
+    EXPECT_EQ(1, router.Route("example.com:8080"));
+    EXPECT_EQ(1, router.Route("example.com."));
+    EXPECT_EQ(1, router.Route("example.com.:80"));
+}
+
+TEST(HostRouterTests, RoutesWildcardsByLongestSuffix) {
+    const auto router =
+        createRouter({"*.example.com=/a", "*.api.example.com=/b", "www.api.example.com=/c"});
+    EXPECT_EQ(1, router.Route("www.example.com"));
+    EXPECT_EQ(2, router.Route("v1.api.example.com"));
+    EXPECT_EQ(2, router.Route("a.b.api.example.com"));
+    EXPECT_EQ(3, router.Route("www.api.example.com"));
+    EXPECT_EQ(1, router.Route("api.example.com"));
+    // Subdomains only
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route("example.com"));
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route("badexample.com"));
+}
+
+TEST(HostRouterTests, RoutesMissingOrInvalidHostsToTheDefault) {
+    const auto router = createRouter({"example.com=/a"});
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route(""));
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route(":80"));
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route("[::1]:80"));
+    EXPECT_EQ(HostRouter::DEFAULT_HOST, router.Route(std::string(300, 'a')));
+}
+
+TEST(HostRouterTests, ThrowIfGivenNameTwice) {
+    EXPECT_THROW((void)createRouter({"example.com=/a", "EXAMPLE.com=/b"}), ConfigException);
+    EXPECT_THROW((void)createRouter({"*.example.com=/a", "*.example.com:0=/b"}),
+                 ConfigException);
+    EXPECT_NO_THROW((void)createRouter({"example.com=/a", "*.example.com=/b"}));
+}
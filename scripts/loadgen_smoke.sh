@@ -0,0 +1,59 @@
+#!/bin/bash
+
+set -euo pipefail
+
+#
+# This script runs a short load against a server on a temp mount dir, and fails if the
+# throughput is grossly below MIN_THROUGHPUT requests per second.
+#
+# Usage: loadgen_smoke.sh <nginxpp> <nginxpp_loadgen> [MIN_THROUGHPUT]
+#
+
+SERVER=$1
+LOADGEN=$2
+MIN_THROUGHPUT=${3:-200}
+
+MOUNT_DIR=$(mktemp -d)
+SERVER_OUTPUT="$MOUNT_DIR.out"
+SERVER_PID=
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2> /dev/null || true
+        wait "$SERVER_PID" 2> /dev/null || true
+    fi
+    rm -rf "$MOUNT_DIR" "$SERVER_OUTPUT"
+}
+trap cleanup EXIT
+
+head -c 1024 /dev/zero | tr '\0' 'a' > "$MOUNT_DIR/index.html"
+head -c 1048576 /dev/zero > "$MOUNT_DIR/big.bin"
+mkdir "$MOUNT_DIR/dir"
+for i in $(seq 1 50); do
+    echo "$i" > "$MOUNT_DIR/dir/file_$i.txt"
+done
+
+"$SERVER" --port 0 --mount "$MOUNT_DIR" --access-log off > "$SERVER_OUTPUT" 2>&1 &
+SERVER_PID=$!
+
+PORT=
+for _ in $(seq 1 50); do
+    PORT=$(sed -n 's/^Listening on port: //p' "$SERVER_OUTPUT")
+    if [ -n "$PORT" ]; then
+        break
+    fi
+    sleep 0.1
+done
+if [ -z "$PORT" ]; then
+    echo "Server failed to start:"
+    cat "$SERVER_OUTPUT"
+    exit 1
+fi
+
+echo "Closed-loop:"
+"$LOADGEN" --port "$PORT" --connections 4 --duration 2 \
+    --target index.html:8,dir:1,big.bin:1 --min-throughput "$MIN_THROUGHPUT"
+
+echo "Open-loop:"
+"$LOADGEN" --port "$PORT" --connections 2 --duration 1 --rate "$MIN_THROUGHPUT" \
+    --target index.html --min-throughput "$((MIN_THROUGHPUT / 2))"